@@ -0,0 +1,45 @@
+# Compares computing RMS of every frame in Elixir with the native `levels` option,
+# with and without returning the samples.
+#
+#   mix run bench/audio_levels.exs [path]
+path = List.first(System.argv()) || "test/fixtures/stt/harvard.mp3"
+
+rms_in_elixir = fn ->
+  path
+  |> Xav.Reader.stream!(read: :audio, out_format: :flt)
+  |> Enum.map(fn frame ->
+    {sum, count} =
+      for <<s::float-32-native <- frame.data>>, reduce: {0.0, 0} do
+        {sum, count} -> {sum + s * s, count + 1}
+      end
+
+    :math.sqrt(sum / max(count, 1))
+  end)
+end
+
+levels = fn payload ->
+  fn ->
+    path
+    |> Xav.Reader.stream!(read: :audio, out_format: :flt, levels: [payload: payload, vad: []])
+    |> Enum.map(& &1.levels.level)
+  end
+end
+
+IO.puts("Reading #{path}\n")
+
+for {name, fun} <- [
+      {"RMS in Elixir", rms_in_elixir},
+      {"levels", levels.(true)},
+      {"levels, payload: false", levels.(false)}
+    ] do
+  # warm up, so that the file is in the page cache
+  fun.()
+
+  {time_us, frames} = :timer.tc(fun)
+
+  IO.puts(
+    String.pad_trailing(name, 30) <>
+      "#{length(frames)} frames in #{div(time_us, 1000)} ms, " <>
+      "#{round(length(frames) / (time_us / 1_000_000))} frames/s"
+  )
+end
@@ -0,0 +1,57 @@
+# Compares mixing decoded tracks in Elixir with `Xav.AudioMixer`.
+#
+# The same file is used as every track, decoded up front, so that only mixing is measured.
+#
+#   mix run bench/audio_mixer.exs [path] [tracks]
+{path, tracks} =
+  case System.argv() do
+    [path, tracks | _] -> {path, String.to_integer(tracks)}
+    [path] -> {path, 8}
+    [] -> {"test/fixtures/stt/harvard.mp3", 8}
+  end
+
+opts = [read: :audio, out_format: :s16, out_sample_rate: 48_000, out_channels: 2]
+frames = path |> Xav.Reader.stream!(opts) |> Enum.to_list()
+samples = frames |> Enum.map(& &1.samples) |> Enum.sum()
+
+# s16 samples summed with clipping, frame by frame, as in the BEAM
+mix_in_elixir = fn ->
+  for frame <- frames do
+    sum =
+      frame.data
+      |> List.duplicate(tracks)
+      |> Enum.map(fn data -> for <<s::signed-16-native <- data>>, do: s end)
+      |> Enum.zip_with(&Enum.sum/1)
+
+    for s <- sum, into: <<>>, do: <<max(min(s, 32_767), -32_768)::signed-16-native>>
+  end
+end
+
+mix_natively = fn ->
+  mixer = Xav.AudioMixer.new(out_format: :s16, frame_size: 960)
+  sources = for _ <- 1..tracks, do: Xav.AudioMixer.add_source(mixer)
+
+  {mixed, _pts} =
+    Enum.flat_map_reduce(frames, 0, fn frame, pts ->
+      frame = %{frame | pts: pts}
+      Enum.each(sources, &Xav.AudioMixer.write(mixer, &1, frame))
+      {Xav.AudioMixer.mix(mixer), pts + frame.samples}
+    end)
+
+  mixed ++ Xav.AudioMixer.flush(mixer)
+end
+
+IO.puts("Mixing #{tracks} tracks of #{path}, #{samples} samples each\n")
+
+for {name, fun} <- [{"Elixir", mix_in_elixir}, {"Xav.AudioMixer", mix_natively}] do
+  # warm up
+  fun.()
+
+  {time_us, _frames} = :timer.tc(fun)
+  rate = samples * tracks / (time_us / 1_000_000)
+
+  IO.puts(
+    String.pad_trailing(name, 20) <>
+      "#{div(time_us, 1000)} ms, #{round(rate)} input samples/s"
+  )
+end
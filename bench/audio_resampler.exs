@@ -0,0 +1,81 @@
+# Measures resampling throughput and quality of the `resampler` presets.
+#
+# Audio is converted to 16 kHz mono, as for speech recognition. SNR is computed against
+# a much longer swresample filter, at the lag which matches both signals best,
+# so it only reflects the filters' passband ripple and stopband leakage.
+#
+#   mix run bench/audio_resampler.exs [path]
+paths =
+  case System.argv() do
+    [path | _] -> [path]
+    [] -> Path.wildcard("test/fixtures/stt/*.{mp3,wav}")
+  end
+
+opts = [read: :audio, out_format: :flt, out_sample_rate: 16_000, out_channels: 1]
+reference = [preset: :high, options: [filter_size: 256, phase_shift: 16, cutoff: 0.99]]
+
+configs = [
+  [preset: :fast],
+  [preset: :default],
+  [preset: :high],
+  [preset: :soxr],
+  [options: [filter_size: 16]]
+]
+
+read = fn path, resampler ->
+  path
+  |> Xav.Reader.stream!([resampler: resampler] ++ opts)
+  |> Enum.map(& &1.data)
+  |> IO.iodata_to_binary()
+  |> Nx.from_binary(:f32)
+end
+
+max_lag = 16
+
+snr = fn reference, samples ->
+  size = min(Nx.size(reference), Nx.size(samples)) - 2 * max_lag
+  ref = Nx.slice(reference, [max_lag], [size])
+  power = ref |> Nx.pow(2) |> Nx.sum() |> Nx.to_number()
+
+  noise =
+    for lag <- 0..(2 * max_lag) do
+      samples |> Nx.slice([lag], [size]) |> Nx.subtract(ref) |> Nx.pow(2) |> Nx.sum()
+    end
+    |> Enum.map(&Nx.to_number/1)
+    |> Enum.min()
+
+  10 * :math.log10(power / max(noise, 1.0e-20))
+end
+
+for path <- paths do
+  IO.puts("Resampling #{path}\n")
+  reference_samples = read.(path, reference)
+
+  for config <- configs do
+    name = String.pad_trailing(inspect(config), 50)
+
+    try do
+      # warm up, so that the file is in the page cache
+      samples = read.(path, config)
+
+      {time_us, count} =
+        :timer.tc(fn ->
+          path
+          |> Xav.Reader.stream!([resampler: config] ++ opts)
+          |> Enum.reduce(0, fn frame, acc -> acc + frame.samples end)
+        end)
+
+      rate = count / (time_us / 1_000_000)
+      snr_db = snr.(reference_samples, samples)
+
+      IO.puts(
+        name <>
+          "#{round(rate)} samples/s, SNR #{:erlang.float_to_binary(snr_db, decimals: 1)} dB"
+      )
+    rescue
+      error -> IO.puts(name <> "unavailable: #{Exception.message(error)}")
+    end
+  end
+
+  IO.puts("")
+end
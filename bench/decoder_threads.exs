@@ -0,0 +1,36 @@
+# Measures decoding throughput for different threading configurations.
+#
+#   mix run bench/decoder_threads.exs [path]
+#
+# The whole file is decoded through Xav.Reader, so the numbers also
+# include demuxing and pixel format conversion, which are the same
+# for every configuration.
+path = List.first(System.argv()) || "test/fixtures/sample_h264.mp4"
+
+configs = [
+  [thread_count: 1],
+  [thread_count: 2, thread_type: :slice],
+  [thread_count: 2, thread_type: :frame],
+  [thread_count: 4, thread_type: :frame],
+  [thread_count: 0, thread_type: :frame],
+  [thread_count: 0, thread_type: :auto]
+]
+
+IO.puts("Decoding #{path} (#{System.schedulers_online()} schedulers online)\n")
+
+for config <- configs do
+  # warm up disk cache and codec initialization
+  path |> Xav.Reader.stream!(config) |> Stream.take(10) |> Stream.run()
+
+  {time_us, frames} =
+    :timer.tc(fn ->
+      path |> Xav.Reader.stream!(config) |> Enum.count()
+    end)
+
+  fps = frames / (time_us / 1_000_000)
+
+  IO.puts(
+    String.pad_trailing(inspect(config), 45) <>
+      "#{frames} frames in #{div(time_us, 1000)} ms, #{Float.round(fps, 1)} fps"
+  )
+end
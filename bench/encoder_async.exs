@@ -0,0 +1,63 @@
+# Compares encoding frames one by one with `Xav.Encoder.encode/2` with queueing them
+# with `Xav.Encoder.encode_async/2`, while the caller prepares the next frames.
+#
+# Preparing a frame is simulated by copying its binary, which is what a capture
+# or decode step would cost the calling process.
+#
+#   mix run bench/encoder_async.exs [frames]
+frames_count = String.to_integer(List.first(System.argv()) || "300")
+
+data = File.read!("test/fixtures/video_converter/frame_360x240.yuv")
+frame = %Xav.Frame{type: :video, data: data, format: :yuv420p, width: 360, height: 240, pts: 0}
+opts = [width: 360, height: 240, format: :yuv420p, time_base: {1, 30}, async_queue_size: 8]
+
+prepare = fn pts -> %{frame | data: :binary.copy(data), pts: pts} end
+
+encode_sync = fn ->
+  encoder = Xav.Encoder.new(:h264, opts)
+
+  packets = Enum.flat_map(0..(frames_count - 1), &Xav.Encoder.encode(encoder, prepare.(&1)))
+  packets ++ Xav.Encoder.flush(encoder)
+end
+
+receive_packets = fn encoder ->
+  receive do
+    {:xav_encoder, ^encoder, {:ok, packets}} -> packets
+  end
+end
+
+encode_async = fn ->
+  encoder = Xav.Encoder.new(:h264, opts)
+
+  # keep up to `async_queue_size` frames in flight
+  {packets, in_flight} =
+    Enum.reduce(0..(frames_count - 1), {[], 0}, fn pts, {packets, in_flight} ->
+      frame = prepare.(pts)
+
+      {packets, in_flight} =
+        if in_flight == opts[:async_queue_size],
+          do: {packets ++ receive_packets.(encoder), in_flight - 1},
+          else: {packets, in_flight}
+
+      :ok = Xav.Encoder.encode_async(encoder, frame)
+      {packets, in_flight + 1}
+    end)
+
+  packets = packets ++ Enum.flat_map(1..in_flight//1, fn _ -> receive_packets.(encoder) end)
+  packets ++ Xav.Encoder.flush(encoder)
+end
+
+IO.puts("Encoding #{frames_count} frames of 360x240 video with h264\n")
+
+for {name, fun} <- [{"encode/2", encode_sync}, {"encode_async/2", encode_async}] do
+  # warm up
+  fun.()
+
+  {time_us, packets} = :timer.tc(fun)
+  fps = frames_count / (time_us / 1_000_000)
+
+  IO.puts(
+    String.pad_trailing(name, 20) <>
+      "#{length(packets)} packets in #{div(time_us, 1000)} ms, #{Float.round(fps, 1)} fps"
+  )
+end
@@ -0,0 +1,38 @@
+# Measures audio decoding and conversion throughput for a few common output formats.
+#
+# For the default fltp input, `[]` only interleaves samples and `:fltp` copies them,
+# while the remaining configs go through swresample.
+#
+#   mix run bench/reader_audio.exs [path]
+path = List.first(System.argv()) || "test/fixtures/stt/harvard.mp3"
+
+configs = [
+  [],
+  [out_format: :fltp],
+  [out_format: :s16],
+  [out_format: :s16, out_sample_rate: 16_000, out_channels: 1],
+  [out_format: :flt, out_sample_rate: 48_000, out_channels: 2]
+]
+
+IO.puts("Reading #{path}\n")
+
+for config <- configs do
+  opts = Keyword.put(config, :read, :audio)
+
+  # warm up, so that the file is in the page cache
+  path |> Xav.Reader.stream!(opts) |> Stream.run()
+
+  {time_us, samples} =
+    :timer.tc(fn ->
+      path
+      |> Xav.Reader.stream!(opts)
+      |> Enum.reduce(0, fn frame, acc -> acc + frame.samples end)
+    end)
+
+  rate = samples / (time_us / 1_000_000)
+
+  IO.puts(
+    String.pad_trailing(inspect(config), 60) <>
+      "#{samples} samples in #{div(time_us, 1000)} ms, #{round(rate)} samples/s"
+  )
+end
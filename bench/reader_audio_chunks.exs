@@ -0,0 +1,39 @@
+# Compares re-chunking audio into fixed-size frames in Elixir with the `frame_size` option.
+#
+#   mix run bench/reader_audio_chunks.exs [path]
+path = List.first(System.argv()) || "test/fixtures/stt/harvard.mp3"
+
+# 10 ms of 16 kHz mono audio, as used for VAD
+frame_size = 160
+opts = [read: :audio, out_format: :s16, out_sample_rate: 16_000, out_channels: 1]
+chunk_bytes = frame_size * 2
+
+chunk_in_elixir = fn ->
+  path
+  |> Xav.Reader.stream!(opts)
+  |> Enum.reduce({<<>>, 0}, fn frame, {rest, count} ->
+    chunk = fn
+      <<_chunk::binary-size(chunk_bytes), rest::binary>>, count, f -> f.(rest, count + 1, f)
+      rest, count, _f -> {rest, count}
+    end
+
+    chunk.(rest <> frame.data, count, chunk)
+  end)
+  |> elem(1)
+end
+
+chunk_in_fifo = fn ->
+  path
+  |> Xav.Reader.stream!([frame_size: frame_size] ++ opts)
+  |> Enum.count()
+end
+
+IO.puts("Reading #{path} in frames of #{frame_size} samples\n")
+
+for {name, fun} <- [{"Elixir", chunk_in_elixir}, {"frame_size", chunk_in_fifo}] do
+  # warm up, so that the file is in the page cache
+  fun.()
+
+  {time_us, frames} = :timer.tc(fun)
+  IO.puts(String.pad_trailing(name, 15) <> "#{frames} frames in #{div(time_us, 1000)} ms")
+end
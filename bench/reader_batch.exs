@@ -0,0 +1,34 @@
+# Compares building batched model inputs out of single frames with Nx.stack
+# and reading batches straight from the reader.
+#
+#   mix run bench/reader_batch.exs [path] [batch_size]
+path = Enum.at(System.argv(), 0) || "test/fixtures/sample_h264.mp4"
+batch_size = String.to_integer(Enum.at(System.argv(), 1) || "16")
+
+read_batches = fn reader ->
+  Stream.repeatedly(fn -> Xav.Reader.next_batch(reader, batch_size) end)
+  |> Stream.take_while(&match?({:ok, _batch}, &1))
+  |> Enum.map(fn {:ok, batch} -> Xav.Batch.to_nx(batch) end)
+end
+
+runs = [
+  {"frames + Nx.stack",
+   fn ->
+     path
+     |> Xav.Reader.stream!(tensor: [])
+     |> Stream.chunk_every(batch_size)
+     |> Enum.map(fn frames -> frames |> Enum.map(&Xav.Frame.to_nx/1) |> Nx.stack() end)
+   end},
+  {"next_batch/2", fn -> read_batches.(Xav.Reader.new!(path, tensor: [])) end}
+]
+
+IO.puts("Reading #{path} in batches of #{batch_size} f32 frames\n")
+
+for {name, fun} <- runs do
+  {time_us, batches} = :timer.tc(fun)
+
+  IO.puts(
+    String.pad_trailing(name, 30) <>
+      "#{length(batches)} batches in #{div(time_us, 1000)} ms"
+  )
+end
@@ -0,0 +1,25 @@
+# Compares a full decode with a keyframe-only scan.
+#
+#   mix run bench/reader_keyframes.exs [path]
+path = List.first(System.argv()) || "test/fixtures/sample_h264.mp4"
+
+configs = [
+  [],
+  [skip_loop_filter: :all],
+  [skip_frame: :bidir],
+  [skip_frame: :nonkey]
+]
+
+IO.puts("Reading #{path}\n")
+
+for config <- configs do
+  {time_us, frames} =
+    :timer.tc(fn ->
+      path |> Xav.Reader.stream!(config) |> Enum.count()
+    end)
+
+  IO.puts(
+    String.pad_trailing(inspect(config), 30) <>
+      "#{frames} frames in #{div(time_us, 1000)} ms"
+  )
+end
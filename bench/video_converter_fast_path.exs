@@ -0,0 +1,45 @@
+# Compares the hand-written conversion kernels with swscale.
+#
+#   mix run bench/video_converter_fast_path.exs
+#
+# Every conversion is run on the same fixture frame many times,
+# in a single convert_many/2 call, so that the NIF call overhead doesn't matter.
+frame = %Xav.Frame{
+  type: :video,
+  data: File.read!("test/fixtures/video_converter/frame_480x360.yuv"),
+  format: :yuv420p,
+  width: 480,
+  height: 360,
+  pts: 0
+}
+
+nv12_frame = Xav.VideoConverter.convert(Xav.VideoConverter.new(out_format: :nv12), frame)
+
+iterations = 500
+
+configs = [
+  {frame, [out_format: :rgb24]},
+  {frame, [out_format: :bgr24]},
+  {frame, [out_format: :rgb24, out_width: 240]},
+  {nv12_frame, [out_format: :rgb24]},
+  {nv12_frame, [out_format: :rgb24, out_width: 240]}
+]
+
+IO.puts("Converting a #{frame.width}x#{frame.height} frame #{iterations} times\n")
+
+for {frame, config} <- configs, fast_path <- [false, true] do
+  converter = Xav.VideoConverter.new([fast_path: fast_path] ++ config)
+  frames = List.duplicate(frame, iterations)
+
+  # warm up, the first conversion initializes the converter
+  Xav.VideoConverter.convert(converter, frame)
+
+  {time_us, _frames} = :timer.tc(fn -> Xav.VideoConverter.convert_many(converter, frames) end)
+
+  fps = iterations / (time_us / 1_000_000)
+
+  IO.puts(
+    String.pad_trailing("#{frame.format} #{inspect([fast_path: fast_path] ++ config)}", 70) <>
+      "#{div(time_us, 1000)} ms, #{Float.round(fps, 1)} fps"
+  )
+end
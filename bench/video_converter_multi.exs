@@ -0,0 +1,43 @@
+# Compares producing several renditions of every frame with separate converters
+# and with a single multi-output converter.
+#
+#   mix run bench/video_converter_multi.exs [path]
+#
+# Frames are decoded once, up front, so only the conversion is measured.
+path = List.first(System.argv()) || "test/fixtures/sample_h264.mp4"
+
+frames =
+  path
+  |> Xav.Reader.stream!(out_format: :yuv420p)
+  |> Enum.take(50)
+
+%Xav.Frame{width: width, height: height} = hd(frames)
+
+outputs = [
+  [out_format: :rgb24, out_width: div(width, 2)],
+  [out_format: :rgb24, out_width: 320],
+  [out_format: :rgb24, out_width: 224, out_height: 224]
+]
+
+IO.puts("Converting #{length(frames)} #{width}x#{height} frames from #{path} to:")
+Enum.each(outputs, &IO.puts("  #{inspect(&1)}"))
+IO.puts("")
+
+converters = Enum.map(outputs, &Xav.VideoConverter.new/1)
+multi_converter = Xav.VideoConverter.new_multi(outputs)
+
+runs = [
+  {"separate converters",
+   fn -> Enum.map(converters, &Xav.VideoConverter.convert_many(&1, frames)) end},
+  {"new_multi/2", fn -> Xav.VideoConverter.convert_many(multi_converter, frames) end}
+]
+
+for {name, fun} <- runs do
+  # warm up, the first conversion initializes the scaling contexts
+  fun.()
+
+  {time_us, _frames} = :timer.tc(fun)
+  fps = length(frames) / (time_us / 1_000_000)
+
+  IO.puts(String.pad_trailing(name, 30) <> "#{div(time_us, 1000)} ms, #{Float.round(fps, 1)} fps")
+end
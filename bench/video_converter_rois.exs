@@ -0,0 +1,58 @@
+# Compares extracting regions of interest by converting whole frames to rgb24
+# and slicing them in Nx with converting only the regions.
+#
+#   mix run bench/video_converter_rois.exs [path]
+#
+# Frames are decoded once, up front, so only the conversion is measured.
+path = List.first(System.argv()) || "test/fixtures/sample_h264.mp4"
+
+frames =
+  path
+  |> Xav.Reader.stream!(out_format: :yuv420p)
+  |> Enum.take(50)
+
+%Xav.Frame{width: width, height: height} = hd(frames)
+
+size = div(min(width, height), 4)
+
+rois =
+  for x <- [0, div(width, 2)], y <- [0, div(height, 2)] do
+    {x, y, size, size}
+  end
+
+IO.puts("Extracting #{length(rois)} #{size}x#{size} regions of every frame")
+IO.puts("of #{length(frames)} #{width}x#{height} frames from #{path}\n")
+
+rgb_converter = Xav.VideoConverter.new(out_format: :rgb24)
+roi_converter = Xav.VideoConverter.new(out_format: :rgb24)
+
+runs = [
+  {"rgb24 + Nx.slice",
+   fn ->
+     for frame <- frames do
+       tensor = rgb_converter |> Xav.VideoConverter.convert(frame) |> Xav.Frame.to_nx()
+
+       for {x, y, w, h} <- rois do
+         Nx.slice(tensor, [y, x, 0], [h, w, 3])
+       end
+     end
+   end},
+  {"convert_rois/3",
+   fn ->
+     for frame <- frames do
+       roi_converter
+       |> Xav.VideoConverter.convert_rois(frame, rois)
+       |> Enum.map(&Xav.Frame.to_nx/1)
+     end
+   end}
+]
+
+for {name, fun} <- runs do
+  # warm up, the first conversion initializes the scaling contexts
+  fun.()
+
+  {time_us, _frames} = :timer.tc(fun)
+  fps = length(frames) / (time_us / 1_000_000)
+
+  IO.puts(String.pad_trailing(name, 30) <> "#{div(time_us, 1000)} ms, #{Float.round(fps, 1)} fps")
+end
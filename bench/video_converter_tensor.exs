@@ -0,0 +1,63 @@
+# Compares preparing model inputs from decoded frames by normalizing rgb24 frames
+# with Nx and by converting frames straight to normalized tensors.
+#
+#   mix run bench/video_converter_tensor.exs [path]
+#
+# Frames are decoded once, up front, so only the conversion is measured.
+path = List.first(System.argv()) || "test/fixtures/sample_h264.mp4"
+
+frames =
+  path
+  |> Xav.Reader.stream!(out_format: :yuv420p)
+  |> Enum.take(20)
+
+%Xav.Frame{width: width, height: height} = hd(frames)
+
+mean = [0.485, 0.456, 0.406]
+std = [0.229, 0.224, 0.225]
+
+rgb_converter = Xav.VideoConverter.new(out_format: :rgb24, out_width: 224, out_height: 224)
+
+tensor_converter =
+  Xav.VideoConverter.new(
+    out_width: 224,
+    out_height: 224,
+    tensor: [layout: :chw, mean: mean, std: std]
+  )
+
+IO.puts("Converting #{length(frames)} #{width}x#{height} frames from #{path} to 224x224 CHW f32")
+IO.puts("")
+
+normalize = fn frame ->
+  frame
+  |> Xav.Frame.to_nx()
+  |> Nx.divide(255)
+  |> Nx.subtract(Nx.tensor(mean))
+  |> Nx.divide(Nx.tensor(std))
+  |> Nx.transpose(axes: [:channels, :height, :width])
+end
+
+runs = [
+  {"rgb24 + Nx",
+   fn ->
+     rgb_converter
+     |> Xav.VideoConverter.convert_many(frames)
+     |> Enum.map(normalize)
+   end},
+  {"tensor",
+   fn ->
+     tensor_converter
+     |> Xav.VideoConverter.convert_many(frames)
+     |> Enum.map(&Xav.Frame.to_nx/1)
+   end}
+]
+
+for {name, fun} <- runs do
+  # warm up, the first conversion initializes the scaling contexts
+  fun.()
+
+  {time_us, _tensors} = :timer.tc(fun)
+  fps = length(frames) / (time_us / 1_000_000)
+
+  IO.puts(String.pad_trailing(name, 30) <> "#{div(time_us, 1000)} ms, #{Float.round(fps, 1)} fps")
+end
@@ -0,0 +1,34 @@
+# Measures video conversion throughput for different numbers of threads.
+#
+#   mix run bench/video_converter_threads.exs [path]
+#
+# Frames are decoded once, up front, so only the conversion is measured.
+# Xav.Reader returns rgb24 frames, so that's the input format.
+path = List.first(System.argv()) || "test/fixtures/sample_h264.mp4"
+
+frames = path |> Xav.Reader.stream!() |> Enum.take(50)
+%Xav.Frame{width: width, height: height} = hd(frames)
+
+configs = [
+  [out_format: :yuv420p],
+  [out_width: div(width, 2), out_format: :yuv420p],
+  [out_width: width * 2]
+]
+
+IO.puts("Converting #{length(frames)} #{width}x#{height} frames from #{path}\n")
+
+for config <- configs, threads <- [1, 2, 4, 0] do
+  converter = Xav.VideoConverter.new([threads: threads] ++ config)
+
+  # warm up, the first conversion initializes the scaling context
+  Xav.VideoConverter.convert(converter, hd(frames))
+
+  {time_us, _frames} = :timer.tc(fn -> Xav.VideoConverter.convert_many(converter, frames) end)
+
+  fps = length(frames) / (time_us / 1_000_000)
+
+  IO.puts(
+    String.pad_trailing(inspect([threads: threads] ++ config), 60) <>
+      "#{div(time_us, 1000)} ms, #{Float.round(fps, 1)} fps"
+  )
+end
@@ -3,36 +3,77 @@
 #include <libavutil/samplefmt.h>
 #include <libswresample/swresample.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "audio_converter.h"
+#include "audio_interleave.h"
 #include "channel_layout.h"
 #include "utils.h"
 
+static enum AudioConversion select_conversion(struct ChannelLayout *in_chlayout,
+                                              int in_sample_rate,
+                                              enum AVSampleFormat in_sample_fmt,
+                                              struct ChannelLayout *out_chlayout,
+                                              int out_sample_rate,
+                                              enum AVSampleFormat out_sample_fmt);
+static int alloc_out_data(struct AudioConverter *c, ErlNifBinary *out_data, int samples);
+static void release_out_data(struct AudioConverter *c, ErlNifBinary *out_data);
+
 struct AudioConverter *audio_converter_alloc() {
   struct AudioConverter *converter =
       (struct AudioConverter *)XAV_ALLOC(sizeof(struct AudioConverter));
   converter->swr_ctx = NULL;
+  converter->out_ptrs = NULL;
   return converter;
 }
 
 int audio_converter_init(struct AudioConverter *c, struct ChannelLayout in_chlayout,
                          int in_sample_rate, enum AVSampleFormat in_sample_fmt,
                          struct ChannelLayout out_chlayout, int out_sample_rate,
-                         enum AVSampleFormat out_sample_fmt) {
-  c->swr_ctx = swr_alloc();
+                         enum AVSampleFormat out_sample_fmt, AVDictionary *resampler_options) {
   c->in_sample_rate = in_sample_rate;
   c->out_sample_rate = out_sample_rate;
   c->out_chlayout = out_chlayout;
+  c->in_sample_fmt = in_sample_fmt;
   c->out_sample_fmt = out_sample_fmt;
 
+#if LIBAVUTIL_VERSION_MAJOR >= 58
+  c->out_channels = out_chlayout.layout.nb_channels;
+#else
+  c->out_channels = av_get_channel_layout_nb_channels(out_chlayout.layout);
+#endif
+
+  c->out_sample_size = av_get_bytes_per_sample(out_sample_fmt);
+  if (av_sample_fmt_is_planar(out_sample_fmt)) {
+    c->out_planes = c->out_channels;
+  } else {
+    c->out_planes = 1;
+    c->out_sample_size *= c->out_channels;
+  }
+
+  c->out_ptrs = (uint8_t **)XAV_ALLOC(c->out_planes * sizeof(uint8_t *));
+  if (c->out_ptrs == NULL) {
+    return AVERROR(ENOMEM);
+  }
+
+  c->conversion = select_conversion(&in_chlayout, in_sample_rate, in_sample_fmt, &out_chlayout,
+                                    out_sample_rate, out_sample_fmt);
+  if (c->conversion != AUDIO_CONVERSION_SWR) {
+    XAV_LOG_DEBUG("Skipping swresample, conversion: %d", c->conversion);
+    return 0;
+  }
+
+  c->swr_ctx = swr_alloc();
+  if (c->swr_ctx == NULL) {
+    return AVERROR(ENOMEM);
+  }
+
 #if LIBAVUTIL_VERSION_MAJOR >= 58
   av_opt_set_chlayout(c->swr_ctx, "in_chlayout", &in_chlayout.layout, 0);
   av_opt_set_chlayout(c->swr_ctx, "out_chlayout", &out_chlayout.layout, 0);
-  c->out_channels = out_chlayout.layout.nb_channels;
 #else
   av_opt_set_channel_layout(c->swr_ctx, "in_channel_layout", in_chlayout.layout, 0);
   av_opt_set_channel_layout(c->swr_ctx, "out_channel_layout", out_chlayout.layout, 0);
-  c->out_channels = av_get_channel_layout_nb_channels(out_chlayout.layout);
 #endif
 
   av_opt_set_int(c->swr_ctx, "in_sample_rate", in_sample_rate, 0);
@@ -41,48 +82,99 @@ int audio_converter_init(struct AudioConverter *c, struct ChannelLayout in_chlay
   av_opt_set_sample_fmt(c->swr_ctx, "in_sample_fmt", in_sample_fmt, 0);
   av_opt_set_sample_fmt(c->swr_ctx, "out_sample_fmt", out_sample_fmt, 0);
 
+  if (resampler_options != NULL) {
+    // av_opt_set_dict consumes the options it sets, so it gets a copy
+    AVDictionary *options = NULL;
+    int ret = av_dict_copy(&options, resampler_options, 0);
+    if (ret >= 0) {
+      ret = av_opt_set_dict(c->swr_ctx, &options);
+    }
+    av_dict_free(&options);
+
+    if (ret < 0) {
+      XAV_LOG_DEBUG("Couldn't set resampler options: %d", ret);
+      return ret;
+    }
+  }
+
   return swr_init(c->swr_ctx);
 }
 
-int audio_converter_convert(struct AudioConverter *c, AVFrame *src_frame, uint8_t ***out_data,
-                            int *out_samples, int *out_size) {
+int audio_converter_get_out_samples(struct AudioConverter *c, int in_samples) {
+  if (c->conversion != AUDIO_CONVERSION_SWR) {
+    return in_samples;
+  }
+
+  return swr_get_out_samples(c->swr_ctx, in_samples);
+}
+
+int audio_converter_convert_to(struct AudioConverter *c, AVFrame *src_frame, uint8_t **out,
+                               int max_out_samples) {
+  if (c->conversion == AUDIO_CONVERSION_SWR) {
+    const uint8_t **in = src_frame ? (const uint8_t **)src_frame->extended_data : NULL;
+    int in_samples = src_frame ? src_frame->nb_samples : 0;
+    return swr_convert(c->swr_ctx, out, max_out_samples, in, in_samples);
+  }
 
-#if LIBAVUTIL_VERSION_MAJOR >= 58
-  int out_nb_channels = c->out_chlayout.layout.nb_channels;
-#else
-  int out_nb_channels = av_get_channel_layout_nb_channels(c->out_chlayout.layout);
-#endif
+  // nothing is buffered when swresample is skipped
+  if (src_frame == NULL) {
+    return 0;
+  }
 
-  uint8_t **out_data_tmp = NULL;
-  int max_out_nb_samples = swr_get_out_samples(c->swr_ctx, src_frame->nb_samples);
-  int out_bytes_per_sample = av_get_bytes_per_sample(c->out_sample_fmt);
+  if (src_frame->format != c->in_sample_fmt || src_frame->nb_samples > max_out_samples) {
+    XAV_LOG_DEBUG("Frame doesn't match the converter, can't copy samples.");
+    return AVERROR(EINVAL);
+  }
 
-  // Some parts of ffmpeg require buffers to by divisible by 32
-  // to use fast/aligned SIMD routines - this is what align option is used for.
-  // See https://stackoverflow.com/questions/35678041/what-is-linesize-alignment-meaning
-  // Because we return the binary straight to the Erlang, we can disable it.
-  int ret = av_samples_alloc_array_and_samples(&out_data_tmp, NULL, out_nb_channels,
-                                               max_out_nb_samples, c->out_sample_fmt, 1);
+  if (c->conversion == AUDIO_CONVERSION_INTERLEAVE) {
+    audio_interleave(out[0], (const uint8_t *const *)src_frame->extended_data, c->out_channels,
+                     src_frame->nb_samples, av_get_bytes_per_sample(c->out_sample_fmt));
+  } else {
+    for (int i = 0; i < c->out_planes; i++) {
+      memcpy(out[i], src_frame->extended_data[i],
+             (size_t)src_frame->nb_samples * c->out_sample_size);
+    }
+  }
+
+  return src_frame->nb_samples;
+}
 
+int audio_converter_convert(struct AudioConverter *c, AVFrame *src_frame,
+                            ErlNifBinary *out_data, int *out_samples) {
+  int max_out_nb_samples = audio_converter_get_out_samples(c, src_frame->nb_samples);
+  if (max_out_nb_samples < 0) {
+    return max_out_nb_samples;
+  }
+
+  // Samples are converted straight into the binaries' buffers, so they
+  // don't have to be copied when the binaries are returned to the Erlang.
+  // There is no alignment requirement for the output.
+  int ret = alloc_out_data(c, out_data, max_out_nb_samples);
   if (ret < 0) {
-    XAV_LOG_DEBUG("Couldn't allocate array for out samples.");
     return ret;
   }
 
-  *out_samples = swr_convert(c->swr_ctx, out_data_tmp, max_out_nb_samples,
-                             (const uint8_t **)src_frame->data, src_frame->nb_samples);
+  for (int i = 0; i < c->out_planes; i++) {
+    c->out_ptrs[i] = out_data[i].data;
+  }
+
+  *out_samples = audio_converter_convert_to(c, src_frame, c->out_ptrs, max_out_nb_samples);
 
   if (*out_samples < 0) {
     XAV_LOG_DEBUG("Couldn't convert samples: %d", *out_samples);
-    av_freep(&out_data_tmp[0]);
+    release_out_data(c, out_data);
     return -1;
   }
 
   XAV_LOG_DEBUG("Converted %d samples per channel", *out_samples);
 
-  *out_size = *out_samples * out_bytes_per_sample * out_nb_channels;
-
-  *out_data = out_data_tmp;
+  size_t out_size = (size_t)*out_samples * c->out_sample_size;
+  for (int i = 0; i < c->out_planes; i++) {
+    if (out_size < out_data[i].size && !enif_realloc_binary(&out_data[i], out_size)) {
+      release_out_data(c, out_data);
+      return AVERROR(ENOMEM);
+    }
+  }
 
   return 0;
 }
@@ -95,7 +187,60 @@ void audio_converter_free(struct AudioConverter **converter) {
       swr_free(&c->swr_ctx);
     }
 
+    if (c->out_ptrs != NULL) {
+      XAV_FREE(c->out_ptrs);
+    }
+
     XAV_FREE(c);
     *converter = NULL;
   }
 }
+
+int xav_nif_get_resampler_options(ErlNifEnv *env, ERL_NIF_TERM value, AVDictionary **options) {
+  const AVClass *classes[] = {swr_get_class()};
+  return xav_nif_get_av_options(env, value, classes, 1, options);
+}
+
+static enum AudioConversion select_conversion(struct ChannelLayout *in_chlayout,
+                                              int in_sample_rate,
+                                              enum AVSampleFormat in_sample_fmt,
+                                              struct ChannelLayout *out_chlayout,
+                                              int out_sample_rate,
+                                              enum AVSampleFormat out_sample_fmt) {
+#if LIBAVUTIL_VERSION_MAJOR >= 58
+  int same_layout = av_channel_layout_compare(&in_chlayout->layout, &out_chlayout->layout) == 0;
+#else
+  int same_layout = in_chlayout->layout == out_chlayout->layout;
+#endif
+
+  if (!same_layout || in_sample_rate != out_sample_rate) {
+    return AUDIO_CONVERSION_SWR;
+  } else if (in_sample_fmt == out_sample_fmt) {
+    return AUDIO_CONVERSION_COPY;
+  } else if (av_sample_fmt_is_planar(in_sample_fmt) &&
+             av_get_packed_sample_fmt(in_sample_fmt) == out_sample_fmt) {
+    return AUDIO_CONVERSION_INTERLEAVE;
+  }
+
+  return AUDIO_CONVERSION_SWR;
+}
+
+static int alloc_out_data(struct AudioConverter *c, ErlNifBinary *out_data, int samples) {
+  for (int i = 0; i < c->out_planes; i++) {
+    if (!enif_alloc_binary((size_t)samples * c->out_sample_size, &out_data[i])) {
+      XAV_LOG_DEBUG("Couldn't allocate binary for out samples.");
+      for (int j = 0; j < i; j++) {
+        enif_release_binary(&out_data[j]);
+      }
+      return AVERROR(ENOMEM);
+    }
+  }
+
+  return 0;
+}
+
+static void release_out_data(struct AudioConverter *c, ErlNifBinary *out_data) {
+  for (int i = 0; i < c->out_planes; i++) {
+    enif_release_binary(&out_data[i]);
+  }
+}
@@ -1,42 +1,95 @@
 #ifndef CONVERTER_H
 #define CONVERTER_H
+#include <erl_nif.h>
 #include <libavutil/channel_layout.h>
+#include <libavutil/dict.h>
 #include <libswresample/swresample.h>
 #include <stdint.h>
 
 #include "channel_layout.h"
 
+enum AudioConversion {
+  // resample, remix or change the sample format with swresample
+  AUDIO_CONVERSION_SWR,
+  // input is already in the output format, samples are only copied
+  AUDIO_CONVERSION_COPY,
+  // planar input has to be turned into its packed counterpart
+  AUDIO_CONVERSION_INTERLEAVE
+};
+
 struct AudioConverter {
+  enum AudioConversion conversion;
+  // only allocated for AUDIO_CONVERSION_SWR
   SwrContext *swr_ctx;
   int64_t in_sample_rate;
   int64_t out_sample_rate;
   int64_t out_channels;
   struct ChannelLayout out_chlayout;
+  enum AVSampleFormat in_sample_fmt;
   enum AVSampleFormat out_sample_fmt;
+  // one plane per channel for planar output, a single one otherwise
+  int out_planes;
+  // size of a single sample in every output plane
+  int out_sample_size;
+  // pointers to the output planes passed to swresample
+  uint8_t **out_ptrs;
 };
 
 struct AudioConverter *audio_converter_alloc(void);
 
+/**
+ * Initializes the converter.
+ *
+ * @param resampler_options swresample options (e.g. `filter_size` or `dither_method`)
+ * set on top of the defaults, may be NULL. They are only used when the conversion
+ * goes through swresample.
+ */
 int audio_converter_init(struct AudioConverter *c, struct ChannelLayout in_chlayout,
                          int in_sample_rate, enum AVSampleFormat in_sample_fmt,
                          struct ChannelLayout out_chlayout, int out_sample_rate,
-                         enum AVSampleFormat out_sample_fmt);
+                         enum AVSampleFormat out_sample_fmt, AVDictionary *resampler_options);
 
 /**
  * Converts AVFrame to the output format.
  *
  * @param c audio converter
  * @param src_frame decoded source frame
- * @param out_data buffer where audio samples are written after convertion.
- * We always convert to the packed format, so only *out_data[0] is set.
- * It will be initialized internally and has to be freed with av_freep(&(*out_data[0])).
- * @param out_samples number of samples per channel in out_data buffer.
- * @param out_size size of out_buffer in bytes.
- * This is the same as *out_samples * bytes_per_sample(out_format) * out_channels
+ * swresample is skipped when the sample rate and channel layout don't change
+ * and the output format is either the same as the input one or its packed counterpart.
+ *
+ * @param out_data array of `c->out_planes` binaries where audio samples are written
+ * after convertion - a single one with interleaved samples for packed formats,
+ * or one per channel for planar formats.
+ * They are allocated internally, sized for the worst case and shrunk to the actual
+ * number of converted samples afterwards. On success, the caller owns the binaries
+ * and has to either turn them into terms with enif_make_binary or release them
+ * with enif_release_binary.
+ * @param out_samples number of samples per channel in out_data.
  * @return  0 on success and negative value on error.
  */
-int audio_converter_convert(struct AudioConverter *c, AVFrame *src_frame, uint8_t ***out_data,
-                            int *out_samples, int *out_size);
+int audio_converter_convert(struct AudioConverter *c, AVFrame *src_frame,
+                            ErlNifBinary *out_data, int *out_samples);
+
+/**
+ * Returns the upper bound of the number of samples per channel
+ * the next conversion of `in_samples` samples can output.
+ */
+int audio_converter_get_out_samples(struct AudioConverter *c, int in_samples);
+
+/**
+ * Converts AVFrame into `out` planes, which have room for `max_out_samples` samples.
+ * Passing NULL as the frame drains samples delayed by swresample.
+ *
+ * @return number of samples per channel written to `out` or a negative value on error.
+ */
+int audio_converter_convert_to(struct AudioConverter *c, AVFrame *src_frame, uint8_t **out,
+                               int max_out_samples);
 
 void audio_converter_free(struct AudioConverter **converter);
+
+/**
+ * Reads swresample options out of a list of `{name, value}` binaries.
+ * Fails on options swresample doesn't know, values are only checked by audio_converter_init.
+ */
+int xav_nif_get_resampler_options(ErlNifEnv *env, ERL_NIF_TERM value, AVDictionary **options);
 #endif
@@ -0,0 +1,168 @@
+#include "audio_fifo.h"
+
+#include <libavutil/samplefmt.h>
+
+static int ensure_scratch(struct AudioFifo *f, int samples);
+
+struct AudioFifo *audio_fifo_alloc(int frame_size, int overlap) {
+  struct AudioFifo *f = (struct AudioFifo *)XAV_ALLOC(sizeof(struct AudioFifo));
+  if (f == NULL) {
+    return NULL;
+  }
+
+  f->fifo = NULL;
+  f->frame_size = frame_size;
+  f->overlap = overlap;
+  f->scratch = NULL;
+  f->scratch_samples = 0;
+  audio_fifo_reset(f);
+
+  return f;
+}
+
+int audio_fifo_init(struct AudioFifo *f, struct AudioConverter *c, AVRational time_base) {
+  f->format = c->out_sample_fmt;
+  f->channels = c->out_channels;
+  f->planes = c->out_planes;
+  f->sample_size = c->out_sample_size;
+  f->sample_rate = c->out_sample_rate;
+  f->time_base = time_base;
+
+  f->fifo = av_audio_fifo_alloc(f->format, f->channels, f->frame_size);
+  if (f->fifo == NULL) {
+    return AVERROR(ENOMEM);
+  }
+
+  return 0;
+}
+
+int audio_fifo_write(struct AudioFifo *f, struct AudioConverter *c, AVFrame *frame) {
+  if (frame != NULL && f->first_pts == AV_NOPTS_VALUE) {
+    f->first_pts = frame->pts == AV_NOPTS_VALUE ? 0 : frame->pts;
+  }
+
+  // samples in the output format can go to the fifo as they are
+  if (frame != NULL && c->conversion == AUDIO_CONVERSION_COPY &&
+      frame->format == c->in_sample_fmt) {
+    int ret = av_audio_fifo_write(f->fifo, (void **)frame->extended_data, frame->nb_samples);
+    return ret < 0 ? ret : 0;
+  }
+
+  int max_samples = audio_converter_get_out_samples(c, frame ? frame->nb_samples : 0);
+  if (max_samples <= 0) {
+    return max_samples;
+  }
+
+  int ret = ensure_scratch(f, max_samples);
+  if (ret < 0) {
+    return ret;
+  }
+
+  int samples = audio_converter_convert_to(c, frame, f->scratch, max_samples);
+  if (samples < 0) {
+    return samples;
+  }
+
+  XAV_LOG_DEBUG("Writing %d samples to the audio fifo", samples);
+
+  ret = av_audio_fifo_write(f->fifo, (void **)f->scratch, samples);
+  return ret < 0 ? ret : 0;
+}
+
+int audio_fifo_read(ErlNifEnv *env, struct AudioFifo *f, int eof, ERL_NIF_TERM *frame_term) {
+  int size = av_audio_fifo_size(f->fifo);
+  int samples = f->frame_size;
+
+  if (size < f->frame_size) {
+    // The overlap left after the last frame has already been returned.
+    if (!eof || size <= (f->returned ? f->overlap : 0)) {
+      return 0;
+    }
+    samples = size;
+  }
+
+  ErlNifBinary out_data[f->planes];
+  uint8_t *ptrs[f->planes];
+  for (int i = 0; i < f->planes; i++) {
+    if (!enif_alloc_binary((size_t)f->frame_size * f->sample_size, &out_data[i])) {
+      for (int j = 0; j < i; j++) {
+        enif_release_binary(&out_data[j]);
+      }
+      return AVERROR(ENOMEM);
+    }
+    ptrs[i] = out_data[i].data;
+  }
+
+  if (av_audio_fifo_peek(f->fifo, (void **)ptrs, samples) < samples) {
+    for (int i = 0; i < f->planes; i++) {
+      enif_release_binary(&out_data[i]);
+    }
+    return AVERROR(EIO);
+  }
+
+  if (samples < f->frame_size) {
+    av_samples_set_silence(ptrs, samples, f->frame_size - samples, f->channels, f->format);
+  }
+
+  AVRational sample_time_base = {1, f->sample_rate};
+  int64_t pts = f->first_pts + av_rescale_q(f->offset, sample_time_base, f->time_base);
+  *frame_term =
+      xav_nif_audio_frame_to_term(env, out_data, f->planes, f->frame_size, f->format, pts);
+
+  // the last frame consumes everything, so that it's not returned again
+  int consumed = samples < f->frame_size ? samples : f->frame_size - f->overlap;
+  av_audio_fifo_drain(f->fifo, consumed);
+  f->offset += consumed;
+  f->returned = 1;
+
+  return 1;
+}
+
+void audio_fifo_reset(struct AudioFifo *f) {
+  if (f->fifo != NULL) {
+    av_audio_fifo_reset(f->fifo);
+  }
+
+  f->first_pts = AV_NOPTS_VALUE;
+  f->offset = 0;
+  f->returned = 0;
+}
+
+void audio_fifo_free(struct AudioFifo **f) {
+  if (*f != NULL) {
+    struct AudioFifo *fifo = *f;
+
+    if (fifo->fifo != NULL) {
+      av_audio_fifo_free(fifo->fifo);
+    }
+
+    if (fifo->scratch != NULL) {
+      av_freep(&fifo->scratch[0]);
+      av_freep(&fifo->scratch);
+    }
+
+    XAV_FREE(fifo);
+    *f = NULL;
+  }
+}
+
+static int ensure_scratch(struct AudioFifo *f, int samples) {
+  if (samples <= f->scratch_samples) {
+    return 0;
+  }
+
+  if (f->scratch != NULL) {
+    av_freep(&f->scratch[0]);
+    av_freep(&f->scratch);
+  }
+
+  int ret = av_samples_alloc_array_and_samples(&f->scratch, NULL, f->channels, samples,
+                                               f->format, 0);
+  if (ret < 0) {
+    f->scratch_samples = 0;
+    return ret;
+  }
+
+  f->scratch_samples = samples;
+  return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef XAV_AUDIO_FIFO_H
+#define XAV_AUDIO_FIFO_H
+#include <libavutil/audio_fifo.h>
+
+#include "audio_converter.h"
+#include "utils.h"
+
+/**
+ * Re-chunks converted audio into frames of exactly `frame_size` samples per channel,
+ * with consecutive frames sharing `overlap` samples.
+ *
+ * Frames are converted into an AVAudioFifo and read out of it as soon as
+ * there are enough samples. Their pts is the pts of the first frame written since
+ * the last reset, advanced by the number of samples consumed so far,
+ * so it doesn't drift with the sizes of the decoded frames.
+ */
+struct AudioFifo {
+  AVAudioFifo *fifo;
+  int frame_size;
+  int overlap;
+  // output format, the same as the converter's one
+  enum AVSampleFormat format;
+  int channels;
+  int planes;
+  int sample_size;
+  int sample_rate;
+  // time base of the written frames' and returned frames' pts
+  AVRational time_base;
+  // pts of the first frame written since the last reset, AV_NOPTS_VALUE before that
+  int64_t first_pts;
+  // number of samples consumed before the first sample in the fifo
+  int64_t offset;
+  // whether a frame has been read since the last reset
+  int returned;
+  // converted samples, before they are written to the fifo
+  uint8_t **scratch;
+  int scratch_samples;
+};
+
+struct AudioFifo *audio_fifo_alloc(int frame_size, int overlap);
+
+/**
+ * Allocates the fifo for the converter's output format.
+ */
+int audio_fifo_init(struct AudioFifo *f, struct AudioConverter *c, AVRational time_base);
+
+/**
+ * Converts a frame with the converter and writes its samples to the fifo.
+ * Passing NULL as the frame drains samples delayed by the converter.
+ */
+int audio_fifo_write(struct AudioFifo *f, struct AudioConverter *c, AVFrame *frame);
+
+/**
+ * Reads the next frame out of the fifo, as an audio frame term.
+ *
+ * With `eof` set, samples which haven't been returned yet make up the last frame,
+ * padded with silence to `frame_size`.
+ *
+ * @return 1 when a frame was read, 0 when more samples are needed and a negative value on error.
+ */
+int audio_fifo_read(ErlNifEnv *env, struct AudioFifo *f, int eof, ERL_NIF_TERM *frame_term);
+
+/**
+ * Drops all samples and starts computing pts from the next written frame.
+ */
+void audio_fifo_reset(struct AudioFifo *f);
+
+void audio_fifo_free(struct AudioFifo **f);
+#endif
@@ -0,0 +1,121 @@
+#include "audio_interleave.h"
+
+#include <string.h>
+
+#if defined(__x86_64__)
+// SSE2 is part of the x86-64 baseline, so there is no need for runtime detection
+#include <emmintrin.h>
+#define XAV_INTERLEAVE_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define XAV_INTERLEAVE_NEON 1
+#endif
+
+#define INTERLEAVE_C(type)                                                                        \
+  for (int ch = 0; ch < channels; ch++) {                                                         \
+    const type *s = (const type *)src[ch];                                                        \
+    type *d = (type *)dst + ch;                                                                   \
+    for (int i = start; i < samples; i++) {                                                       \
+      d[i * channels] = s[i];                                                                     \
+    }                                                                                             \
+  }
+
+// Interleaves samples starting from `start`, SIMD kernels use it for the tail.
+static void interleave_c(uint8_t *dst, const uint8_t *const *src, int channels, int start,
+                         int samples, int bytes_per_sample) {
+  switch (bytes_per_sample) {
+  case 1:
+    INTERLEAVE_C(uint8_t);
+    break;
+  case 2:
+    INTERLEAVE_C(uint16_t);
+    break;
+  case 4:
+    INTERLEAVE_C(uint32_t);
+    break;
+  case 8:
+    INTERLEAVE_C(uint64_t);
+    break;
+  }
+}
+
+#if XAV_INTERLEAVE_X86
+// Interleaves 16 bytes of the left and right channel at a time,
+// `unpack_lo` and `unpack_hi` pick the lane width.
+#define INTERLEAVE2_SSE2(unpack_lo, unpack_hi)                                                    \
+  for (; i + step <= samples; i += step) {                                                        \
+    __m128i l = _mm_loadu_si128((const __m128i *)(left + i * bytes_per_sample));                  \
+    __m128i r = _mm_loadu_si128((const __m128i *)(right + i * bytes_per_sample));                 \
+    uint8_t *d = dst + 2 * i * bytes_per_sample;                                                  \
+    _mm_storeu_si128((__m128i *)d, unpack_lo(l, r));                                              \
+    _mm_storeu_si128((__m128i *)(d + 16), unpack_hi(l, r));                                       \
+  }
+
+static int interleave2_simd(uint8_t *dst, const uint8_t *left, const uint8_t *right,
+                            int samples, int bytes_per_sample) {
+  int i = 0;
+  int step = 16 / bytes_per_sample;
+
+  switch (bytes_per_sample) {
+  case 2:
+    INTERLEAVE2_SSE2(_mm_unpacklo_epi16, _mm_unpackhi_epi16);
+    break;
+  case 4:
+    INTERLEAVE2_SSE2(_mm_unpacklo_epi32, _mm_unpackhi_epi32);
+    break;
+  case 8:
+    INTERLEAVE2_SSE2(_mm_unpacklo_epi64, _mm_unpackhi_epi64);
+    break;
+  }
+
+  return i;
+}
+#elif XAV_INTERLEAVE_NEON
+static int interleave2_simd(uint8_t *dst, const uint8_t *left, const uint8_t *right,
+                            int samples, int bytes_per_sample) {
+  int i = 0;
+
+  switch (bytes_per_sample) {
+  case 2:
+    for (; i + 8 <= samples; i += 8) {
+      uint16x8x2_t v = {{vld1q_u16((const uint16_t *)left + i),
+                         vld1q_u16((const uint16_t *)right + i)}};
+      vst2q_u16((uint16_t *)dst + 2 * i, v);
+    }
+    break;
+  case 4:
+    for (; i + 4 <= samples; i += 4) {
+      uint32x4x2_t v = {{vld1q_u32((const uint32_t *)left + i),
+                         vld1q_u32((const uint32_t *)right + i)}};
+      vst2q_u32((uint32_t *)dst + 2 * i, v);
+    }
+    break;
+  case 8:
+    for (; i + 2 <= samples; i += 2) {
+      uint64x2x2_t v = {{vld1q_u64((const uint64_t *)left + i),
+                         vld1q_u64((const uint64_t *)right + i)}};
+      vst2q_u64((uint64_t *)dst + 2 * i, v);
+    }
+    break;
+  }
+
+  return i;
+}
+#endif
+
+void audio_interleave(uint8_t *dst, const uint8_t *const *src, int channels, int samples,
+                      int bytes_per_sample) {
+  if (channels == 1) {
+    memcpy(dst, src[0], (size_t)samples * bytes_per_sample);
+    return;
+  }
+
+  int start = 0;
+#if XAV_INTERLEAVE_X86 || XAV_INTERLEAVE_NEON
+  if (channels == 2) {
+    start = interleave2_simd(dst, src[0], src[1], samples, bytes_per_sample);
+  }
+#endif
+
+  interleave_c(dst, src, channels, start, samples, bytes_per_sample);
+}
@@ -0,0 +1,18 @@
+#ifndef XAV_AUDIO_INTERLEAVE_H
+#define XAV_AUDIO_INTERLEAVE_H
+#include <stdint.h>
+
+/**
+ * Interleaves planar audio samples into a single packed buffer,
+ * which is all that's needed to go from e.g. `fltp` to `flt`
+ * when the sample rate and channel layout stay the same.
+ *
+ * Stereo, the most common case, is handled with SSE2 or NEON kernels
+ * for 2, 4 and 8 byte samples, with a plain C fallback for everything else.
+ *
+ * @param dst packed output, `samples * channels * bytes_per_sample` bytes long
+ * @param src one plane per channel
+ */
+void audio_interleave(uint8_t *dst, const uint8_t *const *src, int channels, int samples,
+                      int bytes_per_sample);
+#endif
@@ -0,0 +1,179 @@
+#include "audio_levels.h"
+
+#include <math.h>
+
+// RFC 6464 levels range from 0 to -127 dBov, the latter meaning digital silence
+#define MAX_LEVEL 127
+
+struct ChannelLevels {
+  double sum_squares;
+  double peak;
+  int zero_crossings;
+};
+
+static int parse_levels(ErlNifEnv *env, ERL_NIF_TERM value, struct AudioLevels *levels);
+static void measure_channel(AVFrame *frame, int channel, int channels,
+                            struct ChannelLevels *out);
+static ERL_NIF_TERM make_floats(ErlNifEnv *env, double *values, int count);
+
+int xav_nif_get_audio_levels(ErlNifEnv *env, ERL_NIF_TERM value, struct AudioLevels **levels) {
+  *levels = NULL;
+  if (enif_is_identical(value, enif_make_atom(env, "nil"))) {
+    return 1;
+  }
+
+  *levels = (struct AudioLevels *)XAV_ALLOC(sizeof(struct AudioLevels));
+  if (*levels == NULL || !parse_levels(env, value, *levels)) {
+    audio_levels_free(levels);
+    return 0;
+  }
+
+  audio_levels_reset(*levels);
+  return 1;
+}
+
+ERL_NIF_TERM audio_levels_frame_to_term(ErlNifEnv *env, struct AudioLevels *levels,
+                                        AVFrame *frame, ERL_NIF_TERM frame_term) {
+  int channels = xav_get_nb_channels(frame);
+  int samples = frame->nb_samples;
+  double rms[channels], peak[channels];
+  double sum_squares = 0.0;
+  int zero_crossings = 0;
+
+  for (int ch = 0; ch < channels; ch++) {
+    struct ChannelLevels channel;
+    measure_channel(frame, ch, channels, &channel);
+
+    rms[ch] = samples > 0 ? sqrt(channel.sum_squares / samples) : 0.0;
+    peak[ch] = channel.peak;
+    sum_squares += channel.sum_squares;
+    zero_crossings += channel.zero_crossings;
+  }
+
+  int count = samples * channels;
+  double dbov = count > 0 && sum_squares > 0.0 ? 10.0 * log10(sum_squares / count) : -INFINITY;
+  int level = dbov < -MAX_LEVEL ? MAX_LEVEL : (dbov > 0.0 ? 0 : (int)lround(-dbov));
+
+  ERL_NIF_TERM voice_term = enif_make_atom(env, "nil");
+  if (levels->vad) {
+    // every channel has one sample less to cross zero with than it has samples
+    double zero_crossing_rate =
+        count > channels ? (double)zero_crossings / (count - channels) : 0.0;
+    int voice =
+        dbov > levels->vad_threshold && zero_crossing_rate < levels->vad_max_zero_crossing_rate;
+
+    if (voice) {
+      levels->hangover_left = (int64_t)levels->vad_hangover * frame->sample_rate / 1000;
+    } else if (levels->hangover_left > 0) {
+      levels->hangover_left -= samples;
+      voice = 1;
+    }
+
+    voice_term = enif_make_atom(env, voice ? "true" : "false");
+  }
+
+  ERL_NIF_TERM keys[] = {enif_make_atom(env, "rms"), enif_make_atom(env, "peak"),
+                         enif_make_atom(env, "level"), enif_make_atom(env, "voice")};
+  ERL_NIF_TERM values[] = {make_floats(env, rms, channels), make_floats(env, peak, channels),
+                           enif_make_int(env, level), voice_term};
+  ERL_NIF_TERM levels_term;
+  enif_make_map_from_arrays(env, keys, values, 4, &levels_term);
+
+  if (levels->payload) {
+    const ERL_NIF_TERM *elems;
+    int arity;
+    enif_get_tuple(env, frame_term, &arity, &elems);
+    return enif_make_tuple(env, 5, elems[0], elems[1], elems[2], elems[3], levels_term);
+  }
+
+  return enif_make_tuple(env, 5, enif_make_atom(env, "nil"),
+                         enif_make_atom(env, av_get_sample_fmt_name(frame->format)),
+                         enif_make_int(env, samples), enif_make_int64(env, frame->pts),
+                         levels_term);
+}
+
+void audio_levels_reset(struct AudioLevels *levels) { levels->hangover_left = 0; }
+
+void audio_levels_free(struct AudioLevels **levels) {
+  if (*levels != NULL) {
+    XAV_FREE(*levels);
+    *levels = NULL;
+  }
+}
+
+static int parse_levels(ErlNifEnv *env, ERL_NIF_TERM value, struct AudioLevels *levels) {
+  const ERL_NIF_TERM *elems;
+  int arity;
+
+  return enif_get_tuple(env, value, &arity, &elems) && arity == 5 &&
+         xav_nif_get_bool(env, elems[0], &levels->vad) &&
+         enif_get_double(env, elems[1], &levels->vad_threshold) &&
+         enif_get_double(env, elems[2], &levels->vad_max_zero_crossing_rate) &&
+         enif_get_int(env, elems[3], &levels->vad_hangover) &&
+         xav_nif_get_bool(env, elems[4], &levels->payload);
+}
+
+// Samples are normalized to the -1.0..1.0 range, unsigned ones are centered around 0 first.
+#define MEASURE(type, offset, scale)                                                              \
+  do {                                                                                            \
+    const type *s = (const type *)data;                                                           \
+    int negative = 0;                                                                             \
+    for (int i = 0; i < frame->nb_samples; i++) {                                                 \
+      double v = ((double)s[i * stride] - (offset)) * (scale);                                    \
+      double a = fabs(v);                                                                         \
+      out->sum_squares += v * v;                                                                  \
+      out->peak = a > out->peak ? a : out->peak;                                                  \
+      out->zero_crossings += i > 0 && (v < 0) != negative;                                        \
+      negative = v < 0;                                                                           \
+    }                                                                                             \
+  } while (0)
+
+static void measure_channel(AVFrame *frame, int channel, int channels,
+                            struct ChannelLevels *out) {
+  const uint8_t *data;
+  int stride;
+
+  if (av_sample_fmt_is_planar(frame->format)) {
+    data = frame->extended_data[channel];
+    stride = 1;
+  } else {
+    data = frame->extended_data[0] + channel * av_get_bytes_per_sample(frame->format);
+    stride = channels;
+  }
+
+  out->sum_squares = 0.0;
+  out->peak = 0.0;
+  out->zero_crossings = 0;
+
+  switch (av_get_packed_sample_fmt(frame->format)) {
+  case AV_SAMPLE_FMT_U8:
+    MEASURE(uint8_t, 128.0, 1.0 / 128.0);
+    break;
+  case AV_SAMPLE_FMT_S16:
+    MEASURE(int16_t, 0.0, 1.0 / 32768.0);
+    break;
+  case AV_SAMPLE_FMT_S32:
+    MEASURE(int32_t, 0.0, 1.0 / 2147483648.0);
+    break;
+  case AV_SAMPLE_FMT_S64:
+    MEASURE(int64_t, 0.0, 1.0 / 9223372036854775808.0);
+    break;
+  case AV_SAMPLE_FMT_FLT:
+    MEASURE(float, 0.0, 1.0);
+    break;
+  case AV_SAMPLE_FMT_DBL:
+    MEASURE(double, 0.0, 1.0);
+    break;
+  default:
+    break;
+  }
+}
+
+static ERL_NIF_TERM make_floats(ErlNifEnv *env, double *values, int count) {
+  ERL_NIF_TERM list = enif_make_list(env, 0);
+  for (int i = count - 1; i >= 0; i--) {
+    list = enif_make_list_cell(env, enif_make_double(env, values[i]), list);
+  }
+
+  return list;
+}
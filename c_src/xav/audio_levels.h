@@ -0,0 +1,57 @@
+#ifndef XAV_AUDIO_LEVELS_H
+#define XAV_AUDIO_LEVELS_H
+#include "utils.h"
+
+/**
+ * Measures audio levels of decoded frames, so that streams which are only monitored
+ * (e.g. to pick the active speaker) don't have to be returned to Erlang as samples.
+ *
+ * Levels are computed per channel, in a single pass over the decoded samples,
+ * before they are resampled or remixed:
+ * - RMS and peak, as linear values in the 0.0..1.0 range,
+ * - the RFC 6464 level of all channels, in -dBov from 0 (the loudest) to 127 (silence).
+ *
+ * Voice activity is detected when the frame is louder than the threshold
+ * and its zero-crossing rate is low enough to rule out most of the noise.
+ * Voice activity lasts for `vad_hangover` milliseconds after the last voice frame,
+ * so that it doesn't flicker between words.
+ */
+struct AudioLevels {
+  int vad;
+  // in dBov
+  double vad_threshold;
+  // fraction of consecutive samples with different signs
+  double vad_max_zero_crossing_rate;
+  // in milliseconds
+  int vad_hangover;
+  // return the frame's samples alongside its levels
+  int payload;
+  // samples left until voice activity ends
+  int64_t hangover_left;
+};
+
+/**
+ * Reads a `{vad, threshold, max_zero_crossing_rate, hangover, payload}` tuple
+ * passed from Elixir. `levels` is set to NULL when the value is nil.
+ *
+ * @return 1 on success and 0 when the value is invalid.
+ */
+int xav_nif_get_audio_levels(ErlNifEnv *env, ERL_NIF_TERM value, struct AudioLevels **levels);
+
+/**
+ * Measures the decoded frame and appends its levels to the audio frame term,
+ * which becomes a `{data, format, samples, pts, levels}` tuple.
+ *
+ * Without payload, `frame_term` is not used and the data is nil, while the format
+ * and the number of samples are the decoded frame's.
+ */
+ERL_NIF_TERM audio_levels_frame_to_term(ErlNifEnv *env, struct AudioLevels *levels,
+                                        AVFrame *frame, ERL_NIF_TERM frame_term);
+
+/**
+ * Forgets about the voice activity of previous frames, e.g. after seeking.
+ */
+void audio_levels_reset(struct AudioLevels *levels);
+
+void audio_levels_free(struct AudioLevels **levels);
+#endif
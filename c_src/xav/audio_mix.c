@@ -0,0 +1,86 @@
+#include "audio_mix.h"
+
+#include <math.h>
+
+#if defined(__x86_64__)
+// SSE2 is part of the x86-64 baseline, so there is no need for runtime detection
+#include <emmintrin.h>
+#define XAV_MIX_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define XAV_MIX_NEON 1
+#endif
+
+// samples louder than this are compressed by the soft clipper
+#define SOFT_CLIP_KNEE 0.8f
+
+void audio_mix_add(float *dst, const float *src, int count, float gain) {
+  int i = 0;
+
+#if XAV_MIX_X86
+  __m128 g = _mm_set1_ps(gain);
+  for (; i + 8 <= count; i += 8) {
+    __m128 d0 = _mm_loadu_ps(dst + i);
+    __m128 d1 = _mm_loadu_ps(dst + i + 4);
+    d0 = _mm_add_ps(d0, _mm_mul_ps(_mm_loadu_ps(src + i), g));
+    d1 = _mm_add_ps(d1, _mm_mul_ps(_mm_loadu_ps(src + i + 4), g));
+    _mm_storeu_ps(dst + i, d0);
+    _mm_storeu_ps(dst + i + 4, d1);
+  }
+#elif XAV_MIX_NEON
+  for (; i + 8 <= count; i += 8) {
+    vst1q_f32(dst + i, vmlaq_n_f32(vld1q_f32(dst + i), vld1q_f32(src + i), gain));
+    vst1q_f32(dst + i + 4, vmlaq_n_f32(vld1q_f32(dst + i + 4), vld1q_f32(src + i + 4), gain));
+  }
+#endif
+
+  for (; i < count; i++) {
+    dst[i] += src[i] * gain;
+  }
+}
+
+static void hard_clip(float *samples, int count) {
+  int i = 0;
+
+#if XAV_MIX_X86
+  __m128 min = _mm_set1_ps(-1.0f);
+  __m128 max = _mm_set1_ps(1.0f);
+  for (; i + 4 <= count; i += 4) {
+    __m128 s = _mm_loadu_ps(samples + i);
+    _mm_storeu_ps(samples + i, _mm_min_ps(_mm_max_ps(s, min), max));
+  }
+#elif XAV_MIX_NEON
+  float32x4_t min = vdupq_n_f32(-1.0f);
+  float32x4_t max = vdupq_n_f32(1.0f);
+  for (; i + 4 <= count; i += 4) {
+    vst1q_f32(samples + i, vminq_f32(vmaxq_f32(vld1q_f32(samples + i), min), max));
+  }
+#endif
+
+  for (; i < count; i++) {
+    samples[i] = samples[i] < -1.0f ? -1.0f : (samples[i] > 1.0f ? 1.0f : samples[i]);
+  }
+}
+
+// Samples above the knee are rare in a well-leveled mix,
+// so they are compressed one by one, without SIMD.
+static void soft_clip(float *samples, int count) {
+  const float range = 1.0f - SOFT_CLIP_KNEE;
+
+  for (int i = 0; i < count; i++) {
+    float level = fabsf(samples[i]);
+    if (level > SOFT_CLIP_KNEE) {
+      // the curve starts with the slope of 1 at the knee and approaches 1.0
+      float clipped = SOFT_CLIP_KNEE + range * tanhf((level - SOFT_CLIP_KNEE) / range);
+      samples[i] = copysignf(clipped, samples[i]);
+    }
+  }
+}
+
+void audio_mix_clip(float *samples, int count, int soft) {
+  if (soft) {
+    soft_clip(samples, count);
+  } else {
+    hard_clip(samples, count);
+  }
+}
@@ -0,0 +1,20 @@
+#ifndef XAV_AUDIO_MIX_H
+#define XAV_AUDIO_MIX_H
+
+/**
+ * Adds `count` samples of `src`, multiplied by `gain`, to `dst`.
+ *
+ * Samples are interleaved floats, so `count` is the number of samples
+ * times the number of channels. Uses SSE2 or NEON when available.
+ */
+void audio_mix_add(float *dst, const float *src, int count, float gain);
+
+/**
+ * Limits samples to the -1.0..1.0 range.
+ *
+ * With `soft` set, samples louder than the knee are compressed with tanh,
+ * which keeps the waveform smooth instead of flattening the peaks.
+ * Otherwise they are just clamped.
+ */
+void audio_mix_clip(float *samples, int count, int soft);
+#endif
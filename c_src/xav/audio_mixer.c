@@ -0,0 +1,394 @@
+#include "audio_mixer.h"
+#include "audio_mix.h"
+
+#include <string.h>
+
+static struct AudioMixerSource *get_source(struct AudioMixer *m, int id);
+static void free_source(struct AudioMixerSource **s);
+static int init_source_converter(struct AudioMixer *m, struct AudioMixerSource *s,
+                                 enum AVSampleFormat in_format);
+static int ensure_capacity(struct AudioMixer *m, struct AudioMixerSource *s, int samples);
+static void consume(struct AudioMixer *m, struct AudioMixerSource *s, int samples);
+static void trim_source(struct AudioMixer *m, struct AudioMixerSource *s);
+static int frame_ready(struct AudioMixer *m, int flush);
+
+struct AudioMixer *audio_mixer_alloc(void) {
+  struct AudioMixer *m = (struct AudioMixer *)XAV_ALLOC(sizeof(struct AudioMixer));
+  if (m == NULL) {
+    return NULL;
+  }
+
+  m->sources = NULL;
+  m->sources_count = 0;
+  m->mix = NULL;
+  m->mix_frame = NULL;
+  m->out_converter = NULL;
+  m->first_pts = AV_NOPTS_VALUE;
+  m->position = 0;
+
+  return m;
+}
+
+int audio_mixer_init(struct AudioMixer *m, int sample_rate, int channels,
+                     enum AVSampleFormat out_format, int frame_size, int max_delay,
+                     AVRational time_base, int soft_clip) {
+  m->sample_rate = sample_rate;
+  m->channels = channels;
+  m->out_format = out_format;
+  m->frame_size = frame_size;
+  m->max_delay = max_delay;
+  // 2 ms, enough for rounding and the resampler's delay, but shorter than any sane frame
+  m->jitter = sample_rate / 500;
+  m->soft_clip = soft_clip;
+  m->time_base = time_base;
+  xav_set_default_channel_layout(&m->chlayout, channels);
+
+  m->mix = (float *)XAV_ALLOC((size_t)frame_size * channels * sizeof(float));
+  m->mix_frame = av_frame_alloc();
+  m->out_converter = audio_converter_alloc();
+  if (m->mix == NULL || m->mix_frame == NULL || m->out_converter == NULL) {
+    return AVERROR(ENOMEM);
+  }
+
+  // the frame only points at the mix buffer, it never owns it
+  m->mix_frame->format = AV_SAMPLE_FMT_FLT;
+  m->mix_frame->nb_samples = frame_size;
+  m->mix_frame->data[0] = (uint8_t *)m->mix;
+  m->mix_frame->extended_data = m->mix_frame->data;
+
+  return audio_converter_init(m->out_converter, m->chlayout, sample_rate, AV_SAMPLE_FMT_FLT,
+                              m->chlayout, sample_rate, out_format, NULL);
+}
+
+int audio_mixer_add_source(struct AudioMixer *m, int in_sample_rate, int in_channels,
+                           float gain) {
+  int id = 0;
+  while (id < m->sources_count && m->sources[id] != NULL) {
+    id++;
+  }
+
+  if (id == m->sources_count) {
+    struct AudioMixerSource **sources = (struct AudioMixerSource **)XAV_REALLOC(
+        m->sources, (id + 1) * sizeof(struct AudioMixerSource *));
+    if (sources == NULL) {
+      return AVERROR(ENOMEM);
+    }
+    m->sources = sources;
+    m->sources_count++;
+  }
+
+  struct AudioMixerSource *s =
+      (struct AudioMixerSource *)XAV_ALLOC(sizeof(struct AudioMixerSource));
+  if (s == NULL) {
+    m->sources[id] = NULL;
+    return AVERROR(ENOMEM);
+  }
+
+  s->ac = NULL;
+  s->in_format = AV_SAMPLE_FMT_NONE;
+  s->in_sample_rate = in_sample_rate;
+  s->in_channels = in_channels;
+  s->gain = gain;
+  s->samples = NULL;
+  s->size = 0;
+  s->capacity = 0;
+  s->start = 0;
+  s->started = 0;
+
+  m->sources[id] = s;
+  return id;
+}
+
+int audio_mixer_remove_source(struct AudioMixer *m, int id) {
+  struct AudioMixerSource *s = get_source(m, id);
+  if (s == NULL) {
+    return AVERROR(EINVAL);
+  }
+
+  free_source(&m->sources[id]);
+  return 0;
+}
+
+int audio_mixer_set_gain(struct AudioMixer *m, int id, float gain) {
+  struct AudioMixerSource *s = get_source(m, id);
+  if (s == NULL) {
+    return AVERROR(EINVAL);
+  }
+
+  s->gain = gain;
+  return 0;
+}
+
+int audio_mixer_get_source_channels(struct AudioMixer *m, int id) {
+  struct AudioMixerSource *s = get_source(m, id);
+  return s == NULL ? AVERROR(EINVAL) : s->in_channels;
+}
+
+int audio_mixer_write(struct AudioMixer *m, int id, AVFrame *frame) {
+  struct AudioMixerSource *s = get_source(m, id);
+  if (s == NULL) {
+    return AVERROR(EINVAL);
+  }
+
+  if (s->ac == NULL || s->in_format != frame->format) {
+    int ret = init_source_converter(m, s, frame->format);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+
+  if (m->first_pts == AV_NOPTS_VALUE) {
+    m->first_pts = frame->pts;
+  }
+
+  AVRational sample_time_base = {1, m->sample_rate};
+  int64_t position = av_rescale_q(frame->pts - m->first_pts, m->time_base, sample_time_base);
+  int64_t end = s->start + s->size;
+  int64_t drop = 0;
+
+  if (!s->started || (s->size == 0 && position >= end)) {
+    // nothing to keep contiguous, missing samples are mixed as silence anyway
+    s->start = position;
+    s->started = 1;
+  } else if (position > end + m->max_delay + m->frame_size) {
+    XAV_LOG_DEBUG("Source %d jumped %ld samples ahead, dropping buffered samples", id,
+                  (long)(position - end));
+    s->size = 0;
+    s->start = position;
+  } else if (position > end + m->jitter) {
+    int gap = (int)(position - end);
+    int ret = ensure_capacity(m, s, s->size + gap);
+    if (ret < 0) {
+      return ret;
+    }
+    memset(s->samples + (size_t)s->size * m->channels, 0,
+           (size_t)gap * m->channels * sizeof(float));
+    s->size += gap;
+  } else if (position < end - m->jitter) {
+    // samples overlapping with the buffered ones, e.g. a retransmission
+    drop = end - position;
+  }
+
+  int max_samples = audio_converter_get_out_samples(s->ac, frame->nb_samples);
+  if (max_samples < 0) {
+    return max_samples;
+  }
+
+  int ret = ensure_capacity(m, s, s->size + max_samples);
+  if (ret < 0) {
+    return ret;
+  }
+
+  float *tail = s->samples + (size_t)s->size * m->channels;
+  uint8_t *out[1] = {(uint8_t *)tail};
+  int samples = audio_converter_convert_to(s->ac, frame, out, max_samples);
+  if (samples < 0) {
+    return samples;
+  }
+
+  if (drop >= samples) {
+    samples = 0;
+  } else if (drop > 0) {
+    memmove(tail, tail + drop * m->channels,
+            (size_t)(samples - drop) * m->channels * sizeof(float));
+    samples -= (int)drop;
+  }
+
+  s->size += samples;
+  trim_source(m, s);
+
+  return 0;
+}
+
+int audio_mixer_read(ErlNifEnv *env, struct AudioMixer *m, int flush, ERL_NIF_TERM *frame_term) {
+  if (!frame_ready(m, flush)) {
+    return 0;
+  }
+
+  int64_t frame_end = m->position + m->frame_size;
+  memset(m->mix, 0, (size_t)m->frame_size * m->channels * sizeof(float));
+
+  for (int i = 0; i < m->sources_count; i++) {
+    struct AudioMixerSource *s = m->sources[i];
+    if (s == NULL || !s->started) {
+      continue;
+    }
+
+    // the part of the frame covered by the source's samples, the rest stays silent
+    int64_t from = s->start > m->position ? s->start : m->position;
+    int64_t to = s->start + s->size < frame_end ? s->start + s->size : frame_end;
+    if (to > from) {
+      audio_mix_add(m->mix + (from - m->position) * m->channels,
+                    s->samples + (from - s->start) * m->channels,
+                    (int)(to - from) * m->channels, s->gain);
+    }
+  }
+
+  audio_mix_clip(m->mix, m->frame_size * m->channels, m->soft_clip);
+
+  ErlNifBinary out_data[m->out_converter->out_planes];
+  int out_samples;
+  int ret = audio_converter_convert(m->out_converter, m->mix_frame, out_data, &out_samples);
+  if (ret < 0) {
+    return ret;
+  }
+
+  AVRational sample_time_base = {1, m->sample_rate};
+  int64_t pts = m->first_pts + av_rescale_q(m->position, sample_time_base, m->time_base);
+  *frame_term = xav_nif_audio_frame_to_term(env, out_data, m->out_converter->out_planes,
+                                            out_samples, m->out_format, pts);
+
+  m->position = frame_end;
+  for (int i = 0; i < m->sources_count; i++) {
+    if (m->sources[i] != NULL) {
+      trim_source(m, m->sources[i]);
+    }
+  }
+
+  return 1;
+}
+
+void audio_mixer_free(struct AudioMixer **m) {
+  if (*m != NULL) {
+    struct AudioMixer *mixer = *m;
+
+    for (int i = 0; i < mixer->sources_count; i++) {
+      free_source(&mixer->sources[i]);
+    }
+
+    if (mixer->sources != NULL) {
+      XAV_FREE(mixer->sources);
+    }
+
+    if (mixer->mix != NULL) {
+      XAV_FREE(mixer->mix);
+    }
+
+    if (mixer->mix_frame != NULL) {
+      av_frame_free(&mixer->mix_frame);
+    }
+
+    audio_converter_free(&mixer->out_converter);
+
+    XAV_FREE(mixer);
+    *m = NULL;
+  }
+}
+
+static struct AudioMixerSource *get_source(struct AudioMixer *m, int id) {
+  if (id < 0 || id >= m->sources_count) {
+    return NULL;
+  }
+
+  return m->sources[id];
+}
+
+static void free_source(struct AudioMixerSource **s) {
+  if (*s != NULL) {
+    struct AudioMixerSource *source = *s;
+
+    audio_converter_free(&source->ac);
+
+    if (source->samples != NULL) {
+      XAV_FREE(source->samples);
+    }
+
+    XAV_FREE(source);
+    *s = NULL;
+  }
+}
+
+// Samples delayed by the previous converter are dropped when the input format changes.
+static int init_source_converter(struct AudioMixer *m, struct AudioMixerSource *s,
+                                 enum AVSampleFormat in_format) {
+  audio_converter_free(&s->ac);
+
+  s->ac = audio_converter_alloc();
+  if (s->ac == NULL) {
+    return AVERROR(ENOMEM);
+  }
+
+  struct ChannelLayout in_chlayout;
+  xav_set_default_channel_layout(&in_chlayout, s->in_channels);
+
+  int ret = audio_converter_init(s->ac, in_chlayout, s->in_sample_rate, in_format, m->chlayout,
+                                 m->sample_rate, AV_SAMPLE_FMT_FLT, NULL);
+  if (ret < 0) {
+    audio_converter_free(&s->ac);
+    return ret;
+  }
+
+  s->in_format = in_format;
+  return 0;
+}
+
+static int ensure_capacity(struct AudioMixer *m, struct AudioMixerSource *s, int samples) {
+  if (samples <= s->capacity) {
+    return 0;
+  }
+
+  // grow geometrically, as sources are written frame by frame
+  int capacity = s->capacity * 2 > samples ? s->capacity * 2 : samples;
+  float *buffer = (float *)XAV_REALLOC(s->samples, (size_t)capacity * m->channels * sizeof(float));
+  if (buffer == NULL) {
+    return AVERROR(ENOMEM);
+  }
+
+  s->samples = buffer;
+  s->capacity = capacity;
+  return 0;
+}
+
+static void consume(struct AudioMixer *m, struct AudioMixerSource *s, int samples) {
+  s->size -= samples;
+  s->start += samples;
+
+  if (s->size > 0) {
+    memmove(s->samples, s->samples + (size_t)samples * m->channels,
+            (size_t)s->size * m->channels * sizeof(float));
+  }
+}
+
+// Drops samples of the part of the timeline which has already been mixed.
+static void trim_source(struct AudioMixer *m, struct AudioMixerSource *s) {
+  if (s->start >= m->position) {
+    return;
+  }
+
+  int64_t late = m->position - s->start;
+  consume(m, s, late < s->size ? (int)late : s->size);
+
+  if (s->size == 0) {
+    s->start = m->position;
+  }
+}
+
+static int frame_ready(struct AudioMixer *m, int flush) {
+  int64_t frame_end = m->position + m->frame_size;
+  int64_t latest = INT64_MIN;
+  int complete = 1;
+
+  for (int i = 0; i < m->sources_count; i++) {
+    struct AudioMixerSource *s = m->sources[i];
+    if (s == NULL) {
+      continue;
+    }
+
+    if (!s->started) {
+      complete = 0;
+      continue;
+    }
+
+    int64_t end = s->start + s->size;
+    latest = end > latest ? end : latest;
+    complete = complete && end >= frame_end;
+  }
+
+  if (latest == INT64_MIN) {
+    return 0;
+  } else if (flush) {
+    return latest > m->position;
+  }
+
+  return complete || latest >= frame_end + m->max_delay;
+}
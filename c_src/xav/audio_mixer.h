@@ -0,0 +1,102 @@
+#ifndef XAV_AUDIO_MIXER_H
+#define XAV_AUDIO_MIXER_H
+#include "audio_converter.h"
+#include "channel_layout.h"
+#include "utils.h"
+
+struct AudioMixerSource {
+  // converts source frames to the mixer's layout and sample rate, in flt,
+  // allocated with the first frame, as that's when the input format is known
+  struct AudioConverter *ac;
+  enum AVSampleFormat in_format;
+  int in_sample_rate;
+  int in_channels;
+  float gain;
+  // converted samples which haven't been mixed yet, interleaved
+  float *samples;
+  // number of buffered samples per channel
+  int size;
+  int capacity;
+  // position of the first buffered sample on the mixer's timeline
+  int64_t start;
+  // whether the source has written any frame
+  int started;
+};
+
+/**
+ * Mixes audio of many sources into frames of exactly `frame_size` samples per channel.
+ *
+ * Every source is converted to flt and buffered on a common timeline, counted
+ * in output samples since the `pts` of the first frame written to the mixer.
+ * Frames are placed on the timeline by their `pts`, so gaps are filled with silence
+ * and samples which arrive after their part of the timeline has been mixed are dropped.
+ *
+ * The next frame is mixed as soon as every source has buffered samples covering it,
+ * or when some source got `max_delay` samples ahead of it - then sources
+ * which are late or missing contribute silence.
+ */
+struct AudioMixer {
+  int sample_rate;
+  int channels;
+  struct ChannelLayout chlayout;
+  enum AVSampleFormat out_format;
+  int frame_size;
+  int max_delay;
+  // differences between the pts and the number of samples written so far
+  // up to this many samples are ignored, e.g. rounding or the resampler's delay
+  int jitter;
+  int soft_clip;
+  // time base of the written frames' and mixed frames' pts
+  AVRational time_base;
+  // pts of the first written frame, AV_NOPTS_VALUE before that
+  int64_t first_pts;
+  // position of the next mixed frame on the timeline
+  int64_t position;
+  // removed sources leave NULLs behind, so that ids stay valid
+  struct AudioMixerSource **sources;
+  int sources_count;
+  // the mixed frame, interleaved flt
+  float *mix;
+  AVFrame *mix_frame;
+  // converts mixed frames from flt to the output format
+  struct AudioConverter *out_converter;
+};
+
+struct AudioMixer *audio_mixer_alloc(void);
+
+int audio_mixer_init(struct AudioMixer *m, int sample_rate, int channels,
+                     enum AVSampleFormat out_format, int frame_size, int max_delay,
+                     AVRational time_base, int soft_clip);
+
+/**
+ * Adds a source and returns its id, or a negative value on error.
+ */
+int audio_mixer_add_source(struct AudioMixer *m, int in_sample_rate, int in_channels, float gain);
+
+int audio_mixer_remove_source(struct AudioMixer *m, int id);
+
+int audio_mixer_set_gain(struct AudioMixer *m, int id, float gain);
+
+/**
+ * Returns the number of channels of the source's frames, or a negative value
+ * when there is no such source.
+ */
+int audio_mixer_get_source_channels(struct AudioMixer *m, int id);
+
+/**
+ * Converts the source's frame and buffers its samples at the frame's `pts`.
+ */
+int audio_mixer_write(struct AudioMixer *m, int id, AVFrame *frame);
+
+/**
+ * Mixes the next frame, as an audio frame term.
+ *
+ * With `flush` set, the frame is mixed out of whatever has been buffered,
+ * until all of the sources' samples are returned.
+ *
+ * @return 1 when a frame was mixed, 0 when more samples are needed and a negative value on error.
+ */
+int audio_mixer_read(ErlNifEnv *env, struct AudioMixer *m, int flush, ERL_NIF_TERM *frame_term);
+
+void audio_mixer_free(struct AudioMixer **m);
+#endif
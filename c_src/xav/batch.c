@@ -0,0 +1,163 @@
+#include "batch.h"
+
+static size_t get_frame_size(struct Batch *batch, AVFrame *frame);
+static ERL_NIF_TERM finish(ErlNifEnv *env, struct Batch *batch);
+
+struct Batch *batch_alloc(int size, struct Tensor *tensor) {
+  struct Batch *batch = (struct Batch *)XAV_ALLOC(sizeof(struct Batch));
+  if (batch == NULL) {
+    return NULL;
+  }
+
+  batch->pts = (int64_t *)XAV_ALLOC(sizeof(int64_t) * size);
+  if (batch->pts == NULL) {
+    XAV_FREE(batch);
+    return NULL;
+  }
+
+  batch->size = size;
+  batch->count = 0;
+  batch->frame_size = 0;
+  batch->width = -1;
+  batch->height = -1;
+  batch->format = AV_PIX_FMT_NONE;
+  batch->tensor = tensor;
+
+  return batch;
+}
+
+int batch_push(ErlNifEnv *env, struct Batch *batch, AVFrame *frame, ERL_NIF_TERM *batch_term) {
+  int ret = 0;
+
+  // A frame that doesn't fit ends the batch early. A full batch is always finished
+  // right away, unless the frame that filled it has just ended the previous one.
+  if (batch->count > 0 &&
+      (batch->count == batch->size || frame->width != batch->width ||
+       frame->height != batch->height || frame->format != batch->format)) {
+    *batch_term = finish(env, batch);
+    ret = 1;
+  }
+
+  if (batch->count == 0) {
+    batch->width = frame->width;
+    batch->height = frame->height;
+    batch->format = frame->format;
+    batch->frame_size = get_frame_size(batch, frame);
+
+    if (!enif_alloc_binary(batch->frame_size * batch->size, &batch->data)) {
+      return -1;
+    }
+  }
+
+  uint8_t *dst = batch->data.data + batch->count * batch->frame_size;
+  if (batch->tensor != NULL) {
+    tensor_fill(batch->tensor, frame, dst);
+  } else if (av_image_copy_to_buffer(dst, batch->frame_size, (const uint8_t *const *)frame->data,
+                                     frame->linesize, frame->format, frame->width, frame->height,
+                                     1) < 0) {
+    // batch_reset only releases the binary once it holds a frame
+    if (batch->count == 0) {
+      enif_release_binary(&batch->data);
+    }
+    return -1;
+  }
+
+  batch->pts[batch->count++] = frame->pts;
+
+  if (ret == 0 && batch->count == batch->size) {
+    *batch_term = finish(env, batch);
+    ret = 1;
+  }
+
+  return ret;
+}
+
+int batch_flush(ErlNifEnv *env, struct Batch *batch, ERL_NIF_TERM *batch_term) {
+  if (batch->count == 0) {
+    return 0;
+  }
+
+  *batch_term = finish(env, batch);
+  return 1;
+}
+
+void batch_reset(struct Batch *batch) {
+  if (batch->count > 0) {
+    enif_release_binary(&batch->data);
+    batch->count = 0;
+  }
+}
+
+int xav_nif_batch_to_struct(ErlNifEnv *env, ERL_NIF_TERM term, ERL_NIF_TERM *batch_struct) {
+  const ERL_NIF_TERM *elems;
+  int arity;
+  if (!enif_get_tuple(env, term, &arity, &elems) || arity != 7 ||
+      !enif_is_identical(elems[0], enif_make_atom(env, "batch"))) {
+    return 0;
+  }
+
+  unsigned int count;
+  enif_get_list_length(env, elems[5], &count);
+
+  ERL_NIF_TERM keys[] = {
+      enif_make_atom(env, "__struct__"), enif_make_atom(env, "data"),
+      enif_make_atom(env, "format"),     enif_make_atom(env, "width"),
+      enif_make_atom(env, "height"),     enif_make_atom(env, "pts"),
+      enif_make_atom(env, "count"),      enif_make_atom(env, "tensor"),
+  };
+
+  ERL_NIF_TERM values[] = {
+      enif_make_atom(env, "Elixir.Xav.Batch"),
+      elems[1],
+      elems[2],
+      elems[3],
+      elems[4],
+      elems[5],
+      enif_make_uint(env, count),
+      elems[6],
+  };
+
+  enif_make_map_from_arrays(env, keys, values, 8, batch_struct);
+  return 1;
+}
+
+void batch_free(struct Batch **batch) {
+  struct Batch *b = *batch;
+  if (b != NULL) {
+    batch_reset(b);
+    XAV_FREE(b->pts);
+    XAV_FREE(b);
+    *batch = NULL;
+  }
+}
+
+static size_t get_frame_size(struct Batch *batch, AVFrame *frame) {
+  if (batch->tensor != NULL) {
+    return tensor_get_size(batch->tensor, frame->width, frame->height);
+  }
+
+  return av_image_get_buffer_size(frame->format, frame->width, frame->height, 1);
+}
+
+// The binary is handed over to Erlang, the next batch allocates a new one.
+static ERL_NIF_TERM finish(ErlNifEnv *env, struct Batch *batch) {
+  if (batch->count < batch->size) {
+    enif_realloc_binary(&batch->data, batch->count * batch->frame_size);
+  }
+
+  ERL_NIF_TERM pts = enif_make_list(env, 0);
+  for (int i = batch->count - 1; i >= 0; i--) {
+    pts = enif_make_list_cell(env, enif_make_int64(env, batch->pts[i]), pts);
+  }
+
+  ERL_NIF_TERM tensor_term = batch->tensor != NULL ? xav_nif_tensor_to_term(env, batch->tensor)
+                                                   : enif_make_atom(env, "nil");
+
+  ERL_NIF_TERM batch_term = enif_make_tuple(
+      env, 7, enif_make_atom(env, "batch"), enif_make_binary(env, &batch->data),
+      enif_make_atom(env, av_get_pix_fmt_name(batch->format)), enif_make_int(env, batch->width),
+      enif_make_int(env, batch->height), pts, tensor_term);
+
+  batch->count = 0;
+  return batch_term;
+}
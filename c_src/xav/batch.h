@@ -0,0 +1,58 @@
+#ifndef XAV_BATCH_H
+#define XAV_BATCH_H
+#include "tensor.h"
+#include "utils.h"
+
+/**
+ * Stacks consecutive video frames into a single binary, frame after frame,
+ * so that a batch can be wrapped as one `{n, ...}` tensor without copying.
+ *
+ * The binary is allocated once per batch, for `size` frames, when the first
+ * frame of the batch comes, and handed over to Erlang when the batch is complete.
+ * All frames of a batch have the same format and resolution.
+ */
+struct Batch {
+  int size;
+  int count;
+  ErlNifBinary data;
+  size_t frame_size;
+  int width;
+  int height;
+  enum AVPixelFormat format;
+  // frames are written as tensors when not NULL, not owned by the batch
+  struct Tensor *tensor;
+  int64_t *pts;
+};
+
+struct Batch *batch_alloc(int size, struct Tensor *tensor);
+
+/**
+ * Writes a frame into the batch. Frames are tightly packed
+ * or, with a tensor, written as tensors.
+ *
+ * When the batch is complete, or the frame can't be added to it as it has
+ * a different format or resolution, the batch is turned into a term,
+ * `batch_term` is set and 1 is returned. In the latter case, the frame starts
+ * the next batch. Returns 0 when the frame was just added and a negative
+ * value on error.
+ */
+int batch_push(ErlNifEnv *env, struct Batch *batch, AVFrame *frame, ERL_NIF_TERM *batch_term);
+
+/**
+ * Turns the frames collected so far into a term, e.g. at the end of stream.
+ *
+ * @return 1 when `batch_term` is set and 0 when the batch is empty.
+ */
+int batch_flush(ErlNifEnv *env, struct Batch *batch, ERL_NIF_TERM *batch_term);
+
+// Drops the frames collected so far, e.g. after seeking.
+void batch_reset(struct Batch *batch);
+
+/**
+ * Builds an %Xav.Batch{} out of a batch term.
+ * Returns 0 when the term is not a batch term.
+ */
+int xav_nif_batch_to_struct(ErlNifEnv *env, ERL_NIF_TERM term, ERL_NIF_TERM *batch_struct);
+
+void batch_free(struct Batch **batch);
+#endif
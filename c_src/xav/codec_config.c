@@ -0,0 +1,88 @@
+#include "codec_config.h"
+
+static int get_discard(ErlNifEnv *env, ERL_NIF_TERM value, enum AVDiscard *discard);
+
+void codec_config_init(struct CodecConfig *config) {
+  config->thread_count = 1;
+  config->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+  config->skip_frame = AVDISCARD_DEFAULT;
+  config->skip_loop_filter = AVDISCARD_DEFAULT;
+  config->skip_idct = AVDISCARD_DEFAULT;
+}
+
+int codec_config_equal(struct CodecConfig *a, struct CodecConfig *b) {
+  return a->thread_count == b->thread_count && a->thread_type == b->thread_type &&
+         a->skip_frame == b->skip_frame && a->skip_loop_filter == b->skip_loop_filter &&
+         a->skip_idct == b->skip_idct;
+}
+
+int xav_nif_get_codec_config(ErlNifEnv *env, const char *key, ERL_NIF_TERM value,
+                             struct CodecConfig *config) {
+  if (strcmp(key, "thread_count") == 0) {
+    return enif_get_int(env, value, &config->thread_count) && config->thread_count >= 0;
+  } else if (strcmp(key, "thread_type") == 0) {
+    char thread_type[16];
+    if (!enif_get_atom(env, value, thread_type, sizeof(thread_type), ERL_NIF_LATIN1)) {
+      return 0;
+    }
+
+    if (strcmp(thread_type, "frame") == 0) {
+      config->thread_type = FF_THREAD_FRAME;
+    } else if (strcmp(thread_type, "slice") == 0) {
+      config->thread_type = FF_THREAD_SLICE;
+    } else if (strcmp(thread_type, "auto") == 0) {
+      config->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    } else {
+      return 0;
+    }
+
+    return 1;
+  } else if (strcmp(key, "skip_frame") == 0) {
+    return get_discard(env, value, &config->skip_frame);
+  } else if (strcmp(key, "skip_loop_filter") == 0) {
+    return get_discard(env, value, &config->skip_loop_filter);
+  } else if (strcmp(key, "skip_idct") == 0) {
+    return get_discard(env, value, &config->skip_idct);
+  }
+
+  return -1;
+}
+
+int codec_config_apply(struct CodecConfig *config, AVCodecContext *c) {
+  int threads = thread_budget_reserve(config->thread_count);
+
+  c->thread_count = threads;
+  c->thread_type = config->thread_type;
+  c->skip_frame = config->skip_frame;
+  c->skip_loop_filter = config->skip_loop_filter;
+  c->skip_idct = config->skip_idct;
+
+  XAV_LOG_DEBUG("Using %d codec threads", threads);
+
+  return threads;
+}
+
+static int get_discard(ErlNifEnv *env, ERL_NIF_TERM value, enum AVDiscard *discard) {
+  char name[16];
+  if (!enif_get_atom(env, value, name, sizeof(name), ERL_NIF_LATIN1)) {
+    return 0;
+  }
+
+  if (strcmp(name, "default") == 0) {
+    *discard = AVDISCARD_DEFAULT;
+  } else if (strcmp(name, "nonref") == 0) {
+    *discard = AVDISCARD_NONREF;
+  } else if (strcmp(name, "bidir") == 0) {
+    *discard = AVDISCARD_BIDIR;
+  } else if (strcmp(name, "nonintra") == 0) {
+    *discard = AVDISCARD_NONINTRA;
+  } else if (strcmp(name, "nonkey") == 0) {
+    *discard = AVDISCARD_NONKEY;
+  } else if (strcmp(name, "all") == 0) {
+    *discard = AVDISCARD_ALL;
+  } else {
+    return 0;
+  }
+
+  return 1;
+}
@@ -0,0 +1,40 @@
+#ifndef XAV_CODEC_CONFIG_H
+#define XAV_CODEC_CONFIG_H
+#include <libavcodec/avcodec.h>
+
+#include "thread_budget.h"
+#include "utils.h"
+
+struct CodecConfig {
+  // 0 means that FFmpeg picks the number of threads on its own,
+  // or one thread per CPU core when a thread budget is set.
+  // Defaults to 1, which is also the libavcodec default.
+  int thread_count;
+  int thread_type;
+  // which frames the codec doesn't reconstruct at all
+  enum AVDiscard skip_frame;
+  enum AVDiscard skip_loop_filter;
+  enum AVDiscard skip_idct;
+};
+
+void codec_config_init(struct CodecConfig *config);
+
+int codec_config_equal(struct CodecConfig *a, struct CodecConfig *b);
+
+/**
+ * Reads a single codec option passed from Elixir.
+ *
+ * @return 1 on success, 0 when the value is invalid and -1 when the key is unknown.
+ */
+int xav_nif_get_codec_config(ErlNifEnv *env, const char *key, ERL_NIF_TERM value,
+                             struct CodecConfig *config);
+
+/**
+ * Applies config to the codec context. Has to be called before avcodec_open2.
+ *
+ * @return the number of threads taken from the thread budget.
+ * They have to be given back with thread_budget_release
+ * once the codec context is freed.
+ */
+int codec_config_apply(struct CodecConfig *config, AVCodecContext *c);
+#endif
@@ -2,18 +2,30 @@
 #include "utils.h"
 #include "video_converter.h"
 
-static int init_converter(struct Decoder *decoder);
+// alignment required by FFmpeg SIMD code, see STRIDE_ALIGN in libavcodec
+#define XAV_BUFFER_ALIGN 64
+
+static int get_buffer(AVCodecContext *c, AVFrame *frame, int flags);
 
 struct Decoder *decoder_alloc() {
   struct Decoder *decoder = (struct Decoder *)XAV_ALLOC(sizeof(struct Decoder));
 
   decoder->codec = NULL;
   decoder->c = NULL;
+  decoder->frame = NULL;
+  decoder->pkt = NULL;
+  decoder->threads = 0;
+  decoder->zero_copy = 0;
+  decoder->pool = NULL;
+  decoder->pool_size = 0;
+  decoder->pool_lock = NULL;
+  decoder->draining = 0;
 
   return decoder;
 }
 
-int decoder_init(struct Decoder *decoder, const AVCodec *codec, int channels) {
+int decoder_init(struct Decoder *decoder, const AVCodec *codec, int channels,
+                 struct CodecConfig *config) {
   decoder->media_type = codec->type;
   decoder->codec = codec;
 
@@ -38,37 +50,67 @@ int decoder_init(struct Decoder *decoder, const AVCodec *codec, int channels) {
     return -1;
   }
 
+  decoder->threads = codec_config_apply(config, decoder->c);
+
+  if (decoder->zero_copy && codec->type == AVMEDIA_TYPE_VIDEO &&
+      (codec->capabilities & AV_CODEC_CAP_DR1)) {
+    decoder->pool_lock = enif_mutex_create("xav_decoder_pool_lock");
+    if (decoder->pool_lock == NULL) {
+      return -1;
+    }
+
+    decoder->c->opaque = decoder;
+    decoder->c->get_buffer2 = get_buffer;
+#if LIBAVCODEC_VERSION_MAJOR < 60
+    decoder->c->thread_safe_callbacks = 1;
+#endif
+  }
+
   return avcodec_open2(decoder->c, decoder->codec, NULL);
 }
 
 int decoder_decode(struct Decoder *decoder, AVPacket *pkt, AVFrame *frame) {
-  int ret;
-  ret = avcodec_send_packet(decoder->c, pkt);
+  int ret = decoder_send_packet(decoder, pkt);
   if (ret != 0) {
-    return -2;
+    return ret;
   }
 
-  return avcodec_receive_frame(decoder->c, frame);
+  return decoder_receive_frame(decoder, frame);
 }
 
-int decoder_flush(struct Decoder *decoder, AVFrame **frames, int *frames_count) {
-  int ret = avcodec_send_packet(decoder->c, NULL);
-  if (ret != 0) {
-    return ret;
+int decoder_send_packet(struct Decoder *decoder, AVPacket *pkt) {
+  if (avcodec_send_packet(decoder->c, pkt) != 0) {
+    return -2;
   }
 
-  while (1) {
-    ret = avcodec_receive_frame(decoder->c, frames[*frames_count]);
-    if (ret == AVERROR_EOF) {
-      break;
-    } else if (ret < 0) {
+  return 0;
+}
+
+int decoder_receive_frame(struct Decoder *decoder, AVFrame *frame) {
+  return avcodec_receive_frame(decoder->c, frame);
+}
+
+int decoder_flush(struct Decoder *decoder, AVFrame *frame) {
+  if (!decoder->draining) {
+    int ret = avcodec_send_packet(decoder->c, NULL);
+    if (ret != 0) {
       return ret;
     }
 
-    *frames_count += 1;
+    decoder->draining = 1;
   }
 
-  return 0;
+  int ret = avcodec_receive_frame(decoder->c, frame);
+  if (ret < 0) {
+    decoder_reset(decoder);
+  }
+
+  return ret;
+}
+
+void decoder_reset(struct Decoder *decoder) {
+  avcodec_flush_buffers(decoder->c);
+  decoder->draining = 0;
 }
 
 void decoder_free_frame(struct Decoder *decoder) {
@@ -89,6 +131,15 @@ void decoder_free(struct Decoder **decoder) {
       avcodec_free_context(&d->c);
     }
 
+    thread_budget_release(d->threads);
+
+    // buffers still referenced by Erlang binaries keep the pool alive
+    av_buffer_pool_uninit(&d->pool);
+
+    if (d->pool_lock != NULL) {
+      enif_mutex_destroy(d->pool_lock);
+    }
+
     if (d->pkt != NULL) {
       av_packet_free(&d->pkt);
     }
@@ -101,3 +152,86 @@ void decoder_free(struct Decoder **decoder) {
     *decoder = NULL;
   }
 }
+
+static void free_buffer(void *opaque, uint8_t *data) { XAV_FREE(opaque); }
+
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+static AVBufferRef *alloc_buffer(size_t size) {
+#else
+static AVBufferRef *alloc_buffer(int size) {
+#endif
+  // enif_alloc doesn't guarantee the alignment FFmpeg needs
+  uint8_t *mem = XAV_ALLOC(size + XAV_BUFFER_ALIGN - 1);
+  if (mem == NULL) {
+    return NULL;
+  }
+
+  uint8_t *data = (uint8_t *)FFALIGN((uintptr_t)mem, XAV_BUFFER_ALIGN);
+  AVBufferRef *buf = av_buffer_create(data, size, free_buffer, mem, 0);
+  if (buf == NULL) {
+    XAV_FREE(mem);
+  }
+
+  return buf;
+}
+
+static int get_buffer(AVCodecContext *c, AVFrame *frame, int flags) {
+  struct Decoder *decoder = (struct Decoder *)c->opaque;
+
+  const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+  if (desc == NULL || (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL))) {
+    return avcodec_default_get_buffer2(c, frame, flags);
+  }
+
+  // Packed layout is only possible when the codec doesn't need
+  // any extra rows/columns and is fine with unpadded lines.
+  int width = frame->width;
+  int height = frame->height;
+  int linesize_align[AV_NUM_DATA_POINTERS];
+  avcodec_align_dimensions2(c, &width, &height, linesize_align);
+  if (width != frame->width || height != frame->height) {
+    return avcodec_default_get_buffer2(c, frame, flags);
+  }
+
+  int linesizes[4];
+  if (av_image_fill_linesizes(linesizes, frame->format, frame->width) < 0) {
+    return avcodec_default_get_buffer2(c, frame, flags);
+  }
+
+  for (int i = 0; i < 4; i++) {
+    if (linesizes[i] % linesize_align[i] != 0) {
+      return avcodec_default_get_buffer2(c, frame, flags);
+    }
+  }
+
+  int size = av_image_get_buffer_size(frame->format, frame->width, frame->height, 1);
+  if (size < 0) {
+    return size;
+  }
+
+  enif_mutex_lock(decoder->pool_lock);
+  if (decoder->pool_size != size) {
+    XAV_LOG_DEBUG("Creating buffer pool with buffer size %d", size);
+    av_buffer_pool_uninit(&decoder->pool);
+    decoder->pool = av_buffer_pool_init(size + AV_INPUT_BUFFER_PADDING_SIZE, alloc_buffer);
+    decoder->pool_size = decoder->pool == NULL ? 0 : size;
+  }
+
+  frame->buf[0] = decoder->pool == NULL ? NULL : av_buffer_pool_get(decoder->pool);
+  enif_mutex_unlock(decoder->pool_lock);
+
+  if (frame->buf[0] == NULL) {
+    return AVERROR(ENOMEM);
+  }
+
+  int ret = av_image_fill_arrays(frame->data, frame->linesize, frame->buf[0]->data, frame->format,
+                                 frame->width, frame->height, 1);
+  if (ret < 0) {
+    av_buffer_unref(&frame->buf[0]);
+    return ret;
+  }
+
+  frame->extended_data = frame->data;
+
+  return 0;
+}
@@ -3,25 +3,50 @@
 
 #include "audio_converter.h"
 #include "channel_layout.h"
+#include "codec_config.h"
 #include "utils.h"
 
-#define MAX_FLUSH_BUFFER 16
-
 struct Decoder {
   enum AVMediaType media_type;
   AVFrame *frame;
   AVPacket *pkt;
   const AVCodec *codec;
   AVCodecContext *c;
+  // number of threads taken from the thread budget
+  int threads;
+  // When set, video frames are decoded into tightly packed buffers
+  // allocated with the BEAM allocator, whenever the codec allows it,
+  // so they can be returned to Erlang without copying.
+  int zero_copy;
+  AVBufferPool *pool;
+  int pool_size;
+  // get_buffer2 can be called from codec threads
+  ErlNifMutex *pool_lock;
+  // whether the end of stream has been signaled and the decoder is being drained
+  int draining;
 };
 
 struct Decoder *decoder_alloc();
 
-int decoder_init(struct Decoder *decoder, const AVCodec *codec, int channels);
+int decoder_init(struct Decoder *decoder, const AVCodec *codec, int channels,
+                 struct CodecConfig *config);
 
 int decoder_decode(struct Decoder *decoder, AVPacket *pkt, AVFrame *frame);
 
-int decoder_flush(struct Decoder *decoder, AVFrame **frames, int *frames_count);
+int decoder_send_packet(struct Decoder *decoder, AVPacket *pkt);
+
+int decoder_receive_frame(struct Decoder *decoder, AVFrame *frame);
+
+/**
+ * Returns the next buffered frame, one frame per call.
+ *
+ * The first call signals the end of stream to the decoder.
+ * Once all frames are returned, AVERROR_EOF is returned
+ * and the decoder is reset, so it can be used again.
+ */
+int decoder_flush(struct Decoder *decoder, AVFrame *frame);
+
+void decoder_reset(struct Decoder *decoder);
 
 void decoder_free_frame(struct Decoder *decoder);
 
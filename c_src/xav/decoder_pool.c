@@ -0,0 +1,168 @@
+#include "decoder_pool.h"
+
+#include <libavutil/time.h>
+
+struct PoolEntry {
+  struct DecoderPoolKey key;
+  struct Decoder *decoder;
+  struct PoolEntry *next;
+};
+
+static ErlNifMutex *lock;
+static struct PoolEntry *entries;
+static struct DecoderPoolStats stats;
+
+static int key_equal(struct DecoderPoolKey *a, struct DecoderPoolKey *b);
+static int open_decoder(struct DecoderPoolKey *key, struct Decoder **decoder);
+
+int decoder_pool_init() {
+  entries = NULL;
+  memset(&stats, 0, sizeof(stats));
+  stats.max_idle = 16;
+
+  lock = enif_mutex_create("xav_decoder_pool_lock");
+  return lock == NULL ? -1 : 0;
+}
+
+void decoder_pool_destroy() {
+  struct PoolEntry *entry = entries;
+  while (entry != NULL) {
+    struct PoolEntry *next = entry->next;
+    decoder_free(&entry->decoder);
+    XAV_FREE(entry);
+    entry = next;
+  }
+
+  entries = NULL;
+  enif_mutex_destroy(lock);
+}
+
+int decoder_pool_checkout(struct DecoderPoolKey *key, struct Decoder **decoder) {
+  enif_mutex_lock(lock);
+
+  struct PoolEntry **prev = &entries;
+  for (struct PoolEntry *entry = entries; entry != NULL; entry = entry->next) {
+    if (key_equal(&entry->key, key)) {
+      *prev = entry->next;
+      stats.idle--;
+      stats.hits++;
+      enif_mutex_unlock(lock);
+
+      *decoder = entry->decoder;
+      XAV_FREE(entry);
+      return 0;
+    }
+
+    prev = &entry->next;
+  }
+
+  stats.misses++;
+  enif_mutex_unlock(lock);
+
+  return open_decoder(key, decoder);
+}
+
+void decoder_pool_checkin(struct DecoderPoolKey *key, struct Decoder *decoder) {
+  // drop references to the frames and packets as soon as possible
+  decoder_free_frame(decoder);
+  decoder_reset(decoder);
+
+  struct PoolEntry *entry = XAV_ALLOC(sizeof(struct PoolEntry));
+  entry->key = *key;
+  entry->decoder = decoder;
+
+  enif_mutex_lock(lock);
+  if (stats.idle >= stats.max_idle) {
+    enif_mutex_unlock(lock);
+    XAV_LOG_DEBUG("Decoder pool is full, freeing decoder");
+    XAV_FREE(entry);
+    decoder_free(&decoder);
+    return;
+  }
+
+  entry->next = entries;
+  entries = entry;
+  stats.idle++;
+  enif_mutex_unlock(lock);
+}
+
+int decoder_pool_prewarm(struct DecoderPoolKey *key, int count) {
+  int added = 0;
+
+  for (int i = 0; i < count; i++) {
+    enif_mutex_lock(lock);
+    int full = stats.idle >= stats.max_idle;
+    enif_mutex_unlock(lock);
+
+    if (full) {
+      break;
+    }
+
+    struct Decoder *decoder;
+    if (open_decoder(key, &decoder) < 0) {
+      return -1;
+    }
+
+    decoder_pool_checkin(key, decoder);
+    added++;
+  }
+
+  return added;
+}
+
+void decoder_pool_set_max_idle(int max_idle) {
+  struct PoolEntry *to_free = NULL;
+
+  enif_mutex_lock(lock);
+  stats.max_idle = max_idle;
+  while (stats.idle > max_idle) {
+    struct PoolEntry *entry = entries;
+    entries = entry->next;
+    entry->next = to_free;
+    to_free = entry;
+    stats.idle--;
+  }
+  enif_mutex_unlock(lock);
+
+  while (to_free != NULL) {
+    struct PoolEntry *next = to_free->next;
+    decoder_free(&to_free->decoder);
+    XAV_FREE(to_free);
+    to_free = next;
+  }
+}
+
+void decoder_pool_get_stats(struct DecoderPoolStats *out) {
+  enif_mutex_lock(lock);
+  *out = stats;
+  enif_mutex_unlock(lock);
+}
+
+static int key_equal(struct DecoderPoolKey *a, struct DecoderPoolKey *b) {
+  return a->codec == b->codec && a->channels == b->channels && a->zero_copy == b->zero_copy &&
+         codec_config_equal(&a->config, &b->config);
+}
+
+static int open_decoder(struct DecoderPoolKey *key, struct Decoder **decoder) {
+  int64_t start = av_gettime_relative();
+
+  struct Decoder *d = decoder_alloc();
+  if (d == NULL) {
+    return -1;
+  }
+
+  d->zero_copy = key->zero_copy;
+
+  if (decoder_init(d, key->codec, key->channels, &key->config) < 0) {
+    decoder_free(&d);
+    return -1;
+  }
+
+  enif_mutex_lock(lock);
+  stats.opens++;
+  stats.open_time_us += av_gettime_relative() - start;
+  enif_mutex_unlock(lock);
+
+  *decoder = d;
+  return 0;
+}
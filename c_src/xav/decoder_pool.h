@@ -0,0 +1,58 @@
+#ifndef XAV_DECODER_POOL_H
+#define XAV_DECODER_POOL_H
+#include "decoder.h"
+
+/**
+ * Global pool of opened decoders.
+ *
+ * Opening a decoder (especially with frame threads) is expensive,
+ * so instead of freeing decoders, they are reset and kept for reuse
+ * by decoders created with the same parameters.
+ */
+struct DecoderPoolKey {
+  const AVCodec *codec;
+  int channels;
+  int zero_copy;
+  struct CodecConfig config;
+};
+
+struct DecoderPoolStats {
+  // checkouts served by an idle decoder
+  uint64_t hits;
+  // checkouts that had to open a new decoder
+  uint64_t misses;
+  // number of opened decoders, including prewarmed ones
+  uint64_t opens;
+  // total time spent opening decoders, in microseconds
+  uint64_t open_time_us;
+  // number of decoders waiting in the pool
+  int idle;
+  int max_idle;
+};
+
+int decoder_pool_init();
+
+void decoder_pool_destroy();
+
+/**
+ * Returns an idle decoder matching the key or opens a new one.
+ */
+int decoder_pool_checkout(struct DecoderPoolKey *key, struct Decoder **decoder);
+
+/**
+ * Resets the decoder and puts it back to the pool.
+ * The decoder is freed when the pool is full.
+ */
+void decoder_pool_checkin(struct DecoderPoolKey *key, struct Decoder *decoder);
+
+/**
+ * Opens `count` decoders and puts them in the pool.
+ *
+ * @return the number of decoders actually added, limited by the pool size.
+ */
+int decoder_pool_prewarm(struct DecoderPoolKey *key, int count);
+
+void decoder_pool_set_max_idle(int max_idle);
+
+void decoder_pool_get_stats(struct DecoderPoolStats *stats);
+#endif
@@ -1,4 +1,32 @@
 #include "encoder.h"
+#include <libavutil/avstring.h>
+#include <limits.h>
+#include <stdlib.h>
+
+// Options for low latency encoding, e.g. for live streaming and video calls,
+// in the format of av_dict_parse_string.
+static const struct {
+  const char *encoder;
+  const char *options;
+} realtime_presets[] = {
+    {"libx264", "preset=veryfast:tune=zerolatency"},
+    {"libx265", "preset=ultrafast:tune=zerolatency"},
+    {"libopenh264", "allow_skip_frames=1"},
+    {"h264_nvenc", "preset=p1:tune=ull:zerolatency=1"},
+    {"hevc_nvenc", "preset=p1:tune=ull:zerolatency=1"},
+    {"h264_videotoolbox", "realtime=1"},
+    {"hevc_videotoolbox", "realtime=1"},
+    {"libvpx", "deadline=realtime:cpu-used=8:lag-in-frames=0"},
+    {"libvpx-vp9", "deadline=realtime:cpu-used=8:lag-in-frames=0:row-mt=1"},
+    {"libaom-av1", "usage=realtime:cpu-used=8:lag-in-frames=0:row-mt=1"},
+    {"libsvtav1", "preset=10"},
+    {"librav1e", "speed=10"},
+    {"libopus", "application=lowdelay"},
+};
+
+static int set_realtime_preset(const AVCodec *codec, AVDictionary **opts);
+static int set_x265_params(struct EncoderConfig *config, AVDictionary **opts);
+static int take_threads(struct Encoder *encoder, AVDictionary **opts);
 
 struct Encoder *encoder_alloc() {
   struct Encoder *encoder = XAV_ALLOC(sizeof(struct Encoder));
@@ -6,6 +34,7 @@ struct Encoder *encoder_alloc() {
   encoder->codec = NULL;
   encoder->num_packets = 0;
   encoder->max_num_packets = 8;
+  encoder->threads = 0;
   encoder->packets = XAV_ALLOC(encoder->max_num_packets * sizeof(AVPacket *));
 
   for (int i = 0; i < encoder->max_num_packets; i++) {
@@ -46,21 +75,29 @@ int encoder_init(struct Encoder *encoder, struct EncoderConfig *config) {
     encoder->c->profile = config->profile;
   }
 
+  // Options go to both the codec context (e.g. `b` or `maxrate`)
+  // and the encoder's private data (e.g. `crf` or `deadline`).
   AVDictionary *opts = NULL;
-  if (strcmp(encoder->codec->name, "libx265") == 0) {
-    char x265_params[256] = "log-level=warning";
-    if (config->gop_size > 0) {
-      sprintf(x265_params + strlen(x265_params), ":keyint=%d", config->gop_size);
-    }
+  int ret = av_dict_copy(&opts, config->options, 0);
 
-    if (config->max_b_frames >= 0) {
-      sprintf(x265_params + strlen(x265_params), ":bframes=%d", config->max_b_frames);
-    }
+  if (ret >= 0 && config->realtime) {
+    ret = set_realtime_preset(encoder->codec, &opts);
+  }
+
+  if (ret >= 0 && strcmp(encoder->codec->name, "libx265") == 0) {
+    ret = set_x265_params(config, &opts);
+  }
+
+  if (ret >= 0) {
+    ret = take_threads(encoder, &opts);
+  }
 
-    av_dict_set(&opts, "x265-params", x265_params, 0);
+  if (ret >= 0) {
+    ret = avcodec_open2(encoder->c, encoder->codec, &opts);
   }
 
-  return avcodec_open2(encoder->c, encoder->codec, &opts);
+  av_dict_free(&opts);
+  return ret;
 }
 
 int encoder_encode(struct Encoder *encoder, AVFrame *frame) {
@@ -92,6 +129,74 @@ int encoder_encode(struct Encoder *encoder, AVFrame *frame) {
   return 0;
 }
 
+static int set_realtime_preset(const AVCodec *codec, AVDictionary **opts) {
+  int count = sizeof(realtime_presets) / sizeof(realtime_presets[0]);
+
+  for (int i = 0; i < count; i++) {
+    if (strcmp(codec->name, realtime_presets[i].encoder) == 0) {
+      // options set explicitly take precedence over the preset
+      return av_dict_parse_string(opts, realtime_presets[i].options, "=", ":",
+                                  AV_DICT_DONT_OVERWRITE);
+    }
+  }
+
+  return 0;
+}
+
+// x265 takes most of its settings as a single string, where later params win,
+// so the user's x265-params are appended to the ones derived from the config.
+static int set_x265_params(struct EncoderConfig *config, AVDictionary **opts) {
+  char x265_params[256] = "log-level=warning";
+  if (config->gop_size > 0) {
+    sprintf(x265_params + strlen(x265_params), ":keyint=%d", config->gop_size);
+  }
+
+  if (config->max_b_frames >= 0) {
+    sprintf(x265_params + strlen(x265_params), ":bframes=%d", config->max_b_frames);
+  }
+
+  AVDictionaryEntry *user_params = av_dict_get(*opts, "x265-params", NULL, 0);
+  if (user_params == NULL) {
+    return av_dict_set(opts, "x265-params", x265_params, 0);
+  }
+
+  char *params = av_asprintf("%s:%s", x265_params, user_params->value);
+  if (params == NULL) {
+    return AVERROR(ENOMEM);
+  }
+
+  return av_dict_set(opts, "x265-params", params, AV_DICT_DONT_STRDUP_VAL);
+}
+
+// Encoders take their threads from the thread budget, so the number of threads
+// is taken here from the `threads` option or the encoder's default (auto for libx264).
+static int take_threads(struct Encoder *encoder, AVDictionary **opts) {
+  int wanted = encoder->c->thread_count;
+
+  AVDictionaryEntry *threads = av_dict_get(*opts, "threads", NULL, 0);
+  if (threads != NULL) {
+    if (strcmp(threads->value, "auto") == 0) {
+      wanted = 0;
+    } else {
+      char *end;
+      long value = strtol(threads->value, &end, 10);
+      if (end == threads->value || *end != '\0' || value < 0 || value > INT_MAX) {
+        return AVERROR(EINVAL);
+      }
+      wanted = (int)value;
+    }
+
+    // the granted number of threads is set on the codec context instead
+    av_dict_set(opts, "threads", NULL, 0);
+  }
+
+  encoder->threads = thread_budget_reserve(wanted);
+  encoder->c->thread_count = encoder->threads;
+
+  XAV_LOG_DEBUG("Using %d encoder threads", encoder->threads);
+  return 0;
+}
+
 void encoder_free(struct Encoder **encoder) {
   if (*encoder != NULL) {
     struct Encoder *e = *encoder;
@@ -104,6 +209,8 @@ void encoder_free(struct Encoder **encoder) {
       av_packet_free(&e->packets[i]);
     }
 
+    thread_budget_release(e->threads);
+
     XAV_FREE(e);
     *encoder = NULL;
   }
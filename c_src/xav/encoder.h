@@ -1,4 +1,5 @@
 #include "channel_layout.h"
+#include "thread_budget.h"
 #include "utils.h"
 #include <libavcodec/avcodec.h>
 
@@ -8,6 +9,8 @@ struct Encoder {
   int num_packets;
   int max_num_packets;
   AVPacket **packets;
+  // number of threads taken from the thread budget
+  int threads;
 };
 
 struct EncoderConfig {
@@ -23,6 +26,10 @@ struct EncoderConfig {
   int profile;
   int sample_rate;
   struct ChannelLayout channel_layout;
+  // AVOptions of the codec context and the encoder, may be NULL
+  AVDictionary *options;
+  // apply the encoder's realtime preset below `options`
+  int realtime;
 };
 
 struct Encoder *encoder_alloc();
@@ -28,12 +28,15 @@ struct Reader *reader_alloc() {
   reader->fmt_ctx = NULL;
   reader->input_format = NULL;
   reader->options = NULL;
+  reader->threads = 0;
+  reader->keyframes_only = 0;
 
   return reader;
 }
 
 int reader_init(struct Reader *reader, unsigned char *path, size_t path_size, int device_flag,
-                enum AVMediaType media_type, AVRational framerate, unsigned int width, unsigned int height) {
+                enum AVMediaType media_type, AVRational framerate, unsigned int width, unsigned int height,
+                struct CodecConfig *config) {
   int ret;
   reader->path = XAV_ALLOC(path_size + 1);
   memcpy(reader->path, path, path_size);
@@ -81,7 +84,20 @@ int reader_init(struct Reader *reader, unsigned char *path, size_t path_size, in
     return -2;
   }
 
+  // Let the demuxer skip other streams. Some demuxers (e.g. mp4)
+  // also honour AVDISCARD_NONKEY and don't even read non-key samples.
+  for (unsigned int i = 0; i < reader->fmt_ctx->nb_streams; i++) {
+    if ((int)i != reader->stream_idx) {
+      reader->fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+    }
+  }
+
+  reader->keyframes_only = config->skip_frame >= AVDISCARD_NONKEY;
+
   AVStream *stream = reader->fmt_ctx->streams[reader->stream_idx];
+  if (reader->keyframes_only) {
+    stream->discard = AVDISCARD_NONKEY;
+  }
 
   // If avg_frame_rate is valid, use it; otherwise, calculate it from time_base.
   if (stream->avg_frame_rate.num != 0 && stream->avg_frame_rate.den != 0) {
@@ -106,6 +122,8 @@ int reader_init(struct Reader *reader, unsigned char *path, size_t path_size, in
     return -2;
   }
 
+  reader->threads = codec_config_apply(config, reader->c);
+
   if (avcodec_open2(reader->c, reader->codec, NULL) < 0) {
     return -2;
   }
@@ -135,6 +153,12 @@ int reader_next_frame(struct Reader *reader) {
   while (!frame_ready && (ret = av_read_frame(reader->fmt_ctx, reader->pkt)) >= 0) {
 
     if (reader->pkt->stream_index != reader->stream_idx) {
+      av_packet_unref(reader->pkt);
+      continue;
+    }
+
+    if (reader->keyframes_only && !(reader->pkt->flags & AV_PKT_FLAG_KEY)) {
+      av_packet_unref(reader->pkt);
       continue;
     }
 
@@ -263,6 +287,8 @@ void reader_free(struct Reader **reader) {
       avcodec_free_context(&r->c);
     }
 
+    thread_budget_release(r->threads);
+
     if (r->pkt != NULL) {
       av_packet_free(&r->pkt);
     }
@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "codec_config.h"
 #include "libavutil/rational.h"
 #include "utils.h"
 
@@ -25,12 +26,17 @@ struct Reader {
   AVDictionary *options;
   enum AVMediaType media_type;
   AVRational framerate;
+  // number of threads taken from the thread budget
+  int threads;
+  // drop non-key packets before they even reach the decoder
+  int keyframes_only;
 };
 
 struct Reader *reader_alloc();
 
 int reader_init(struct Reader *reader, unsigned char *path, size_t path_size, int device_flag,
-                enum AVMediaType media_type, AVRational framerate, unsigned int width, unsigned int height);
+                enum AVMediaType media_type, AVRational framerate, unsigned int width, unsigned int height,
+                struct CodecConfig *config);
 
 int reader_next_frame(struct Reader *reader);
 
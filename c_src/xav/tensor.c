@@ -0,0 +1,192 @@
+#include "tensor.h"
+
+static int parse_tensor(ErlNifEnv *env, ERL_NIF_TERM value, struct Tensor *tensor);
+static int get_floats(ErlNifEnv *env, ERL_NIF_TERM list, float values[3]);
+static uint16_t float_to_half(float value);
+
+int xav_nif_get_tensor(ErlNifEnv *env, ERL_NIF_TERM value, struct Tensor **tensor) {
+  *tensor = NULL;
+  if (enif_is_identical(value, enif_make_atom(env, "nil"))) {
+    return 1;
+  }
+
+  *tensor = (struct Tensor *)XAV_ALLOC(sizeof(struct Tensor));
+  if (!parse_tensor(env, value, *tensor)) {
+    tensor_free(tensor);
+    return 0;
+  }
+
+  return 1;
+}
+
+void tensor_free(struct Tensor **tensor) {
+  if (*tensor != NULL) {
+    XAV_FREE(*tensor);
+    *tensor = NULL;
+  }
+}
+
+static int parse_tensor(ErlNifEnv *env, ERL_NIF_TERM value, struct Tensor *tensor) {
+  const ERL_NIF_TERM *elems;
+  int arity;
+  char type[4], layout[4];
+
+  if (!enif_get_tuple(env, value, &arity, &elems) || arity != 4 ||
+      !enif_get_atom(env, elems[0], type, sizeof(type), ERL_NIF_LATIN1) ||
+      !enif_get_atom(env, elems[1], layout, sizeof(layout), ERL_NIF_LATIN1) ||
+      !get_floats(env, elems[2], tensor->mean) || !get_floats(env, elems[3], tensor->std)) {
+    return 0;
+  }
+
+  if (strcmp(type, "f32") == 0) {
+    tensor->type = TENSOR_F32;
+  } else if (strcmp(type, "f16") == 0) {
+    tensor->type = TENSOR_F16;
+  } else {
+    return 0;
+  }
+
+  if (strcmp(layout, "hwc") == 0) {
+    tensor->channels_first = 0;
+  } else if (strcmp(layout, "chw") == 0) {
+    tensor->channels_first = 1;
+  } else {
+    return 0;
+  }
+
+  for (int c = 0; c < 3; c++) {
+    if (tensor->std[c] == 0.0f) {
+      return 0;
+    }
+
+    for (int v = 0; v < 256; v++) {
+      float normalized = (v / 255.0f - tensor->mean[c]) / tensor->std[c];
+      tensor->lut_f32[c][v] = normalized;
+      tensor->lut_f16[c][v] = float_to_half(normalized);
+    }
+  }
+
+  return 1;
+}
+
+// The compiler generates the loops for both element types from the same code.
+#define FILL_TENSOR(TYPE, LUT)                                                                     \
+  do {                                                                                             \
+    TYPE *out = (TYPE *)data;                                                                      \
+    int plane_size = width * height;                                                               \
+    for (int y = 0; y < height; y++) {                                                             \
+      const uint8_t *src = frame->data[0] + y * frame->linesize[0];                                \
+      if (tensor->channels_first) {                                                                \
+        TYPE *dst = out + y * width;                                                               \
+        for (int x = 0; x < width; x++) {                                                          \
+          dst[x] = LUT[0][src[3 * x]];                                                             \
+          dst[plane_size + x] = LUT[1][src[3 * x + 1]];                                            \
+          dst[2 * plane_size + x] = LUT[2][src[3 * x + 2]];                                        \
+        }                                                                                          \
+      } else {                                                                                     \
+        TYPE *dst = out + y * width * 3;                                                           \
+        for (int x = 0; x < width * 3; x += 3) {                                                   \
+          dst[x] = LUT[0][src[x]];                                                                 \
+          dst[x + 1] = LUT[1][src[x + 1]];                                                         \
+          dst[x + 2] = LUT[2][src[x + 2]];                                                         \
+        }                                                                                          \
+      }                                                                                            \
+    }                                                                                              \
+  } while (0)
+
+size_t tensor_get_size(struct Tensor *tensor, int width, int height) {
+  size_t element_size = tensor->type == TENSOR_F32 ? sizeof(float) : sizeof(uint16_t);
+  return (size_t)width * height * 3 * element_size;
+}
+
+void tensor_fill(struct Tensor *tensor, AVFrame *frame, uint8_t *data) {
+  int width = frame->width;
+  int height = frame->height;
+
+  if (tensor->type == TENSOR_F32) {
+    FILL_TENSOR(float, tensor->lut_f32);
+  } else {
+    FILL_TENSOR(uint16_t, tensor->lut_f16);
+  }
+}
+
+ERL_NIF_TERM xav_nif_tensor_to_term(ErlNifEnv *env, struct Tensor *tensor) {
+  return enif_make_tuple2(env, enif_make_atom(env, tensor->type == TENSOR_F32 ? "f32" : "f16"),
+                          enif_make_atom(env, tensor->channels_first ? "chw" : "hwc"));
+}
+
+ERL_NIF_TERM xav_nif_tensor_frame_to_term(ErlNifEnv *env, struct Tensor *tensor, AVFrame *frame) {
+  ERL_NIF_TERM data_term;
+  unsigned char *data = enif_make_new_binary(
+      env, tensor_get_size(tensor, frame->width, frame->height), &data_term);
+  tensor_fill(tensor, frame, data);
+
+  ERL_NIF_TERM format_term = enif_make_atom(env, av_get_pix_fmt_name(frame->format));
+  ERL_NIF_TERM height_term = enif_make_int(env, frame->height);
+  ERL_NIF_TERM width_term = enif_make_int(env, frame->width);
+  ERL_NIF_TERM pts_term = enif_make_int64(env, frame->pts);
+  return enif_make_tuple(env, 7, data_term, format_term, width_term, height_term, pts_term,
+                         enif_make_atom(env, "nil"), xav_nif_tensor_to_term(env, tensor));
+}
+
+static int get_floats(ErlNifEnv *env, ERL_NIF_TERM list, float values[3]) {
+  unsigned int length;
+  if (!enif_get_list_length(env, list, &length) || length != 3) {
+    return 0;
+  }
+
+  ERL_NIF_TERM head;
+  for (int i = 0; enif_get_list_cell(env, list, &head, &list); i++) {
+    double value;
+    if (!enif_get_double(env, head, &value)) {
+      return 0;
+    }
+    values[i] = (float)value;
+  }
+
+  return 1;
+}
+
+// IEEE 754 single to half precision conversion, rounding to the nearest even.
+static uint16_t float_to_half(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  uint16_t sign = (bits >> 16) & 0x8000;
+  int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  // infinity and NaN
+  if (((bits >> 23) & 0xff) == 0xff) {
+    return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+  }
+
+  if (exponent >= 31) {
+    return sign | 0x7c00;
+  }
+
+  // subnormal numbers, or too small to be represented at all
+  if (exponent <= 0) {
+    if (exponent < -10) {
+      return sign;
+    }
+
+    mantissa |= 0x800000;
+    int shift = 14 - exponent;
+    uint32_t half = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1))) {
+      half++;
+    }
+    return sign | half;
+  }
+
+  // a carry out of the mantissa correctly bumps the exponent
+  uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+  uint32_t rest = mantissa & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+    half++;
+  }
+  return sign | half;
+}
@@ -0,0 +1,56 @@
+#ifndef XAV_TENSOR_H
+#define XAV_TENSOR_H
+#include "utils.h"
+
+enum TensorType { TENSOR_F32, TENSOR_F16 };
+
+/**
+ * Turns rgb24/bgr24 frames into normalized float tensors,
+ * ready to be fed into a model.
+ *
+ * Every channel value `v` becomes `(v / 255 - mean) / std`.
+ * As there are only 256 possible values per channel, they are all computed
+ * upfront, so that a frame is turned into a tensor in a single pass
+ * of table lookups, which also takes care of the HWC to CHW transposition.
+ */
+struct Tensor {
+  enum TensorType type;
+  // channels first (CHW) instead of channels last (HWC)
+  int channels_first;
+  float mean[3];
+  float std[3];
+  // normalized values for every channel, as f32 or f16 depending on the type
+  float lut_f32[3][256];
+  uint16_t lut_f16[3][256];
+};
+
+/**
+ * Reads a `{type, layout, mean, std}` tuple passed from Elixir,
+ * where mean and std are lists of 3 floats, and precomputes the lookup tables.
+ * `tensor` is set to NULL when the value is nil.
+ *
+ * @return 1 on success and 0 when the value is invalid.
+ */
+int xav_nif_get_tensor(ErlNifEnv *env, ERL_NIF_TERM value, struct Tensor **tensor);
+
+size_t tensor_get_size(struct Tensor *tensor, int width, int height);
+
+/**
+ * Writes the frame, which has to be in rgb24 or bgr24, as a tensor into `data`,
+ * which has to be `tensor_get_size` bytes long.
+ */
+void tensor_fill(struct Tensor *tensor, AVFrame *frame, uint8_t *data);
+
+// Returns the `{type, layout}` tuple describing the tensors.
+ERL_NIF_TERM xav_nif_tensor_to_term(ErlNifEnv *env, struct Tensor *tensor);
+
+/**
+ * Builds a video frame term with the frame turned into a tensor.
+ * The frame has to be in rgb24 or bgr24, channels keep their order.
+ *
+ * The term is a `{data, format, width, height, pts, nil, {type, layout}}` tuple.
+ */
+ERL_NIF_TERM xav_nif_tensor_frame_to_term(ErlNifEnv *env, struct Tensor *tensor, AVFrame *frame);
+
+void tensor_free(struct Tensor **tensor);
+#endif
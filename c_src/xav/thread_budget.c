@@ -0,0 +1,62 @@
+#include "thread_budget.h"
+
+#include <libavutil/cpu.h>
+
+static struct ThreadBudget *thread_budget = NULL;
+
+struct ThreadBudget *thread_budget_from_term(ErlNifEnv *env, ERL_NIF_TERM term) {
+  ErlNifBinary bin;
+  if (!enif_inspect_binary(env, term, &bin) || bin.size != sizeof(struct ThreadBudget)) {
+    return NULL;
+  }
+
+  struct ThreadBudget *budget = (struct ThreadBudget *)bin.data;
+  return budget->magic == THREAD_BUDGET_MAGIC ? budget : NULL;
+}
+
+int thread_budget_load(ErlNifEnv *env, ERL_NIF_TERM load_info) {
+  thread_budget = thread_budget_from_term(env, load_info);
+  return thread_budget == NULL ? -1 : 0;
+}
+
+int thread_budget_reserve(int wanted) {
+  int budget = atomic_load(&thread_budget->budget);
+
+  if (wanted == 0) {
+    // Without a limit, "auto" is left to FFmpeg, which might use more threads
+    // than there are cores (e.g. libx264's lookahead threads).
+    if (budget <= 0) {
+      return 0;
+    }
+
+    // otherwise, resolve it on our own, so that we know how many threads are going to be used
+    wanted = av_cpu_count();
+  }
+
+  if (wanted <= 1) {
+    return 1;
+  }
+
+  int in_use = atomic_load(&thread_budget->in_use);
+  int granted;
+  do {
+    int available = budget > 0 ? budget - in_use : wanted;
+    granted = available < wanted ? available : wanted;
+    // a single thread runs on the calling thread, so it's always available
+    if (granted <= 1) {
+      XAV_LOG_DEBUG("Thread budget exhausted, using a single thread");
+      return 1;
+    }
+  } while (!atomic_compare_exchange_weak(&thread_budget->in_use, &in_use, in_use + granted));
+
+  XAV_LOG_DEBUG("Took %d threads from the thread budget", granted);
+  return granted;
+}
+
+void thread_budget_release(int threads) {
+  if (threads > 1) {
+    atomic_fetch_sub(&thread_budget->in_use, threads);
+  }
+}
+
+int thread_budget_get() { return atomic_load(&thread_budget->budget); }
@@ -0,0 +1,59 @@
+#ifndef XAV_THREAD_BUDGET_H
+#define XAV_THREAD_BUDGET_H
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "utils.h"
+
+#define THREAD_BUDGET_MAGIC 0x5841565448524453ULL
+
+/**
+ * Node-wide limit of threads used by codecs and scalers.
+ *
+ * Every NIF library is a separate shared object with its own static variables,
+ * so the counters live in a single resource created by libxavthreadbudget.
+ * Its binary is kept in a persistent term and passed as `load_info` to every library
+ * that creates threads, which keeps a pointer to it (see thread_budget_load).
+ */
+struct ThreadBudget {
+  uint64_t magic;
+  // 0 means no limit
+  atomic_int budget;
+  // threads taken by codecs and scalers running with more than one thread,
+  // except for the ones left to FFmpeg ("auto" without a budget)
+  atomic_int in_use;
+};
+
+/**
+ * Gets the budget from its resource binary.
+ *
+ * @return NULL when the term isn't a thread budget.
+ */
+struct ThreadBudget *thread_budget_from_term(ErlNifEnv *env, ERL_NIF_TERM term);
+
+/**
+ * Attaches this library to the node-wide budget. Has to be called in the library's load.
+ *
+ * @return 0 on success, -1 when load_info isn't a thread budget.
+ */
+int thread_budget_load(ErlNifEnv *env, ERL_NIF_TERM load_info);
+
+/**
+ * Takes threads from the budget. 0 means "auto".
+ *
+ * Without a budget, "auto" is returned as is, so that FFmpeg picks the number of threads,
+ * and it isn't accounted. With a budget, it's resolved to one thread per CPU core.
+ *
+ * @return the number of threads to use, never more than what is left in the budget,
+ * except for a single thread, which is always granted and isn't accounted.
+ * It has to be given back with thread_budget_release.
+ */
+int thread_budget_reserve(int wanted);
+
+void thread_budget_release(int threads);
+
+/**
+ * @return the current budget, 0 when there is no limit.
+ */
+int thread_budget_get();
+#endif
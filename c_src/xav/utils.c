@@ -1,8 +1,47 @@
 #include "utils.h"
 #include <libavutil/mathematics.h>
 #include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
 #include <stdint.h>
 
+// Keeps a reference to the AVFrame whose buffer backs a resource binary.
+// Every NIF library compiling this file opens its own resource type.
+struct XavFrameRef {
+  AVFrame *frame;
+};
+
+static ErlNifResourceType *xav_frame_resource_type;
+
+static void free_xav_frame_ref(ErlNifEnv *env, void *obj) {
+  struct XavFrameRef *frame_ref = (struct XavFrameRef *)obj;
+  av_frame_free(&frame_ref->frame);
+}
+
+static int is_packed_contiguous(AVFrame *frame, int size) {
+  if (frame->buf[0] == NULL) {
+    return 0;
+  }
+
+  int linesizes[4];
+  if (av_image_fill_linesizes(linesizes, frame->format, frame->width) < 0) {
+    return 0;
+  }
+
+  uint8_t *data[4] = {NULL};
+  if (av_image_fill_pointers(data, frame->format, frame->height, frame->data[0], linesizes) < 0) {
+    return 0;
+  }
+
+  for (int i = 0; i < 4; i++) {
+    if (linesizes[i] != frame->linesize[i] || data[i] != frame->data[i]) {
+      return 0;
+    }
+  }
+
+  AVBufferRef *buf = frame->buf[0];
+  return frame->data[0] >= buf->data && frame->data[0] + size <= buf->data + buf->size;
+}
+
 ERL_NIF_TERM xav_nif_ok(ErlNifEnv *env, ERL_NIF_TERM data_term) {
   ERL_NIF_TERM ok_term = enif_make_atom(env, "ok");
   return enif_make_tuple(env, 2, ok_term, data_term);
@@ -49,16 +88,77 @@ int xav_nif_get_string(ErlNifEnv *env, ERL_NIF_TERM term, char **value) {
   return 1;
 }
 
-ERL_NIF_TERM xav_nif_audio_frame_to_term(ErlNifEnv *env, uint8_t **out_data, int out_samples,
-                                         int out_size, enum AVSampleFormat out_format, int pts) {
+int xav_nif_get_bool(ErlNifEnv *env, ERL_NIF_TERM term, int *value) {
+  char atom[6];
+  if (!enif_get_atom(env, term, atom, sizeof(atom), ERL_NIF_LATIN1)) {
+    return 0;
+  }
+
+  if (strcmp(atom, "true") == 0) {
+    *value = 1;
+  } else if (strcmp(atom, "false") == 0) {
+    *value = 0;
+  } else {
+    return 0;
+  }
+
+  return 1;
+}
+
+// Reads a `{num, den}` tuple of positive integers.
+int xav_nif_get_rational(ErlNifEnv *env, ERL_NIF_TERM term, AVRational *value) {
+  const ERL_NIF_TERM *elems;
+  int arity;
+  if (!enif_get_tuple(env, term, &arity, &elems) || arity != 2) {
+    return 0;
+  }
+
+  return enif_get_int(env, elems[0], &value->num) && enif_get_int(env, elems[1], &value->den) &&
+         value->num > 0 && value->den > 0;
+}
+
+// Reads a frame layout atom - `planes` sets `value` to 1 and `packed` to 0.
+int xav_nif_get_frame_layout(ErlNifEnv *env, ERL_NIF_TERM term, int *value) {
+  char atom[7];
+  if (!enif_get_atom(env, term, atom, sizeof(atom), ERL_NIF_LATIN1)) {
+    return 0;
+  }
+
+  if (strcmp(atom, "planes") == 0) {
+    *value = 1;
+  } else if (strcmp(atom, "packed") == 0) {
+    *value = 0;
+  } else {
+    return 0;
+  }
+
+  return 1;
+}
+
+int xav_nif_open_frame_resource_type(ErlNifEnv *env) {
+  xav_frame_resource_type =
+      enif_open_resource_type(env, NULL, "XavFrame", free_xav_frame_ref, ERL_NIF_RT_CREATE, NULL);
+  return xav_frame_resource_type == NULL ? -1 : 0;
+}
+
+ERL_NIF_TERM xav_nif_audio_frame_to_term(ErlNifEnv *env, ErlNifBinary *out_data, int planes,
+                                         int out_samples, enum AVSampleFormat out_format,
+                                         int64_t pts) {
   ERL_NIF_TERM data_term;
 
-  unsigned char *ptr = enif_make_new_binary(env, out_size, &data_term);
-  memcpy(ptr, out_data[0], out_size);
+  // planar formats are returned as a list of binaries, one per channel
+  if (av_sample_fmt_is_planar(out_format)) {
+    data_term = enif_make_list(env, 0);
+    for (int i = planes - 1; i >= 0; i--) {
+      data_term = enif_make_list_cell(env, enif_make_binary(env, &out_data[i]), data_term);
+    }
+  } else {
+    data_term = enif_make_binary(env, &out_data[0]);
+  }
 
   ERL_NIF_TERM samples_term = enif_make_int(env, out_samples);
   ERL_NIF_TERM format_term = enif_make_atom(env, av_get_sample_fmt_name(out_format));
-  ERL_NIF_TERM pts_term = enif_make_int(env, pts);
+  ERL_NIF_TERM pts_term = enif_make_int64(env, pts);
 
   return enif_make_tuple(env, 4, data_term, format_term, samples_term, pts_term);
 }
@@ -80,6 +180,273 @@ ERL_NIF_TERM xav_nif_video_frame_to_term(ErlNifEnv *env, AVFrame *frame) {
   return enif_make_tuple(env, 5, data_term, format_term, width_term, height_term, pts_term);
 }
 
+ERL_NIF_TERM xav_nif_video_frame_ref_to_term(ErlNifEnv *env, AVFrame *frame) {
+  int payload_size = av_image_get_buffer_size(frame->format, frame->width, frame->height, 1);
+
+  // The binary has to be a single, tightly packed buffer,
+  // otherwise we have no choice but to copy.
+  if (!is_packed_contiguous(frame, payload_size)) {
+    XAV_LOG_DEBUG("Frame is not packed, falling back to copying");
+    return xav_nif_video_frame_to_term(env, frame);
+  }
+
+  struct XavFrameRef *frame_ref =
+      enif_alloc_resource(xav_frame_resource_type, sizeof(struct XavFrameRef));
+  frame_ref->frame = av_frame_clone(frame);
+  if (frame_ref->frame == NULL) {
+    enif_release_resource(frame_ref);
+    return xav_nif_video_frame_to_term(env, frame);
+  }
+
+  // The binary keeps the resource, and so the AVFrame buffer, alive
+  // until it is garbage collected.
+  ERL_NIF_TERM data_term =
+      enif_make_resource_binary(env, frame_ref, frame_ref->frame->data[0], payload_size);
+  enif_release_resource(frame_ref);
+
+  ERL_NIF_TERM format_term = enif_make_atom(env, av_get_pix_fmt_name(frame->format));
+  ERL_NIF_TERM height_term = enif_make_int(env, frame->height);
+  ERL_NIF_TERM width_term = enif_make_int(env, frame->width);
+  ERL_NIF_TERM pts_term = enif_make_int64(env, frame->pts);
+  return enif_make_tuple(env, 5, data_term, format_term, width_term, height_term, pts_term);
+}
+
+// Size of a plane in bytes, based on the frame linesizes.
+// The last row is not padded, e.g. (height / 2 - 1) * linesize + width / 2
+// for the chroma planes of yuv420p.
+int xav_get_plane_size(const AVFrame *frame, int plane) {
+  const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+  int bytewidth = av_image_get_linesize(frame->format, frame->width, plane);
+  if (desc == NULL || bytewidth < 0) {
+    return -1;
+  }
+
+  int height = frame->height;
+  if (plane == 1 || plane == 2) {
+    height = -((-height) >> desc->log2_chroma_h);
+  }
+
+  return frame->linesize[plane] * (height - 1) + bytewidth;
+}
+
+ERL_NIF_TERM xav_nif_video_frame_to_planes_term(ErlNifEnv *env, AVFrame *frame, int zero_copy) {
+  int planes = av_pix_fmt_count_planes(frame->format);
+
+  // flipped frames can't be represented as a binary per plane
+  for (int i = 0; i < planes; i++) {
+    if (frame->linesize[i] <= 0) {
+      XAV_LOG_DEBUG("Frame has a negative linesize, falling back to packing");
+      return xav_nif_video_frame_to_term(env, frame);
+    }
+  }
+
+  struct XavFrameRef *frame_ref = NULL;
+  if (zero_copy) {
+    frame_ref = enif_alloc_resource(xav_frame_resource_type, sizeof(struct XavFrameRef));
+    frame_ref->frame = av_frame_clone(frame);
+    if (frame_ref->frame == NULL) {
+      enif_release_resource(frame_ref);
+      frame_ref = NULL;
+    }
+  }
+
+  ERL_NIF_TERM plane_terms[4];
+  ERL_NIF_TERM linesize_terms[4];
+
+  for (int i = 0; i < planes; i++) {
+    int linesize = frame->linesize[i];
+    int size = xav_get_plane_size(frame, i);
+
+    AVBufferRef *buf = frame_ref == NULL ? NULL : av_frame_get_plane_buffer(frame, i);
+    if (buf != NULL && frame->data[i] + size <= buf->data + buf->size) {
+      // every binary keeps the resource, and so the whole frame, alive
+      plane_terms[i] = enif_make_resource_binary(env, frame_ref, frame->data[i], size);
+    } else {
+      // keep the stride, so that the frame can be passed on as is
+      unsigned char *ptr = enif_make_new_binary(env, size, &plane_terms[i]);
+      int bytewidth = av_image_get_linesize(frame->format, frame->width, i);
+      av_image_copy_plane(ptr, linesize, frame->data[i], linesize, bytewidth,
+                          (size - bytewidth) / linesize + 1);
+    }
+
+    linesize_terms[i] = enif_make_int(env, linesize);
+  }
+
+  if (frame_ref != NULL) {
+    enif_release_resource(frame_ref);
+  }
+
+  ERL_NIF_TERM planes_term = enif_make_list_from_array(env, plane_terms, planes);
+  ERL_NIF_TERM linesizes_term = enif_make_list_from_array(env, linesize_terms, planes);
+  ERL_NIF_TERM format_term = enif_make_atom(env, av_get_pix_fmt_name(frame->format));
+  ERL_NIF_TERM height_term = enif_make_int(env, frame->height);
+  ERL_NIF_TERM width_term = enif_make_int(env, frame->width);
+  ERL_NIF_TERM pts_term = enif_make_int64(env, frame->pts);
+  return enif_make_tuple(env, 6, planes_term, format_term, width_term, height_term, pts_term,
+                         linesizes_term);
+}
+
+char *xav_nif_get_video_frame_data(ErlNifEnv *env, ERL_NIF_TERM data, ERL_NIF_TERM linesizes,
+                                   AVFrame *frame) {
+  ErlNifBinary bin;
+
+  if (!enif_is_list(env, linesizes)) {
+    if (!enif_inspect_binary(env, data, &bin)) {
+      return "failed_to_inspect_binary";
+    }
+
+    int ret = av_image_fill_arrays(frame->data, frame->linesize, bin.data, frame->format,
+                                   frame->width, frame->height, 1);
+    if (ret < 0) {
+      return "failed_to_fill_arrays";
+    }
+
+    if (ret > bin.size) {
+      return "invalid_frame_size";
+    }
+
+    return NULL;
+  }
+
+  int planes = av_pix_fmt_count_planes(frame->format);
+  if (planes < 0) {
+    return "failed_to_fill_arrays";
+  }
+
+  unsigned int planes_count, linesizes_count;
+  if (!enif_get_list_length(env, data, &planes_count) ||
+      !enif_get_list_length(env, linesizes, &linesizes_count) || planes_count != planes ||
+      linesizes_count != planes) {
+    return "invalid_planes";
+  }
+
+  memset(frame->data, 0, sizeof(frame->data));
+  memset(frame->linesize, 0, sizeof(frame->linesize));
+
+  ERL_NIF_TERM plane, linesize;
+  for (int i = 0; enif_get_list_cell(env, data, &plane, &data) &&
+                  enif_get_list_cell(env, linesizes, &linesize, &linesizes);
+       i++) {
+    if (!enif_inspect_binary(env, plane, &bin)) {
+      return "failed_to_inspect_binary";
+    }
+
+    if (!enif_get_int(env, linesize, &frame->linesize[i])) {
+      return "failed_to_get_int";
+    }
+
+    int bytewidth = av_image_get_linesize(frame->format, frame->width, i);
+    int size = xav_get_plane_size(frame, i);
+    if (frame->linesize[i] < bytewidth || size < 0 || bin.size < size) {
+      return "invalid_frame_size";
+    }
+
+    frame->data[i] = bin.data;
+  }
+
+  return NULL;
+}
+
+// Builds an %Xav.Frame{} out of a frame tuple returned by xav_nif_video_frame_to_term,
+// xav_nif_video_frame_to_planes_term or xav_nif_audio_frame_to_term.
+// Used when frames are sent in messages, as there is no Elixir code
+// in between to do the conversion.
+ERL_NIF_TERM xav_nif_frame_to_struct(ErlNifEnv *env, ERL_NIF_TERM frame_term) {
+  const ERL_NIF_TERM *elems;
+  int arity;
+  enif_get_tuple(env, frame_term, &arity, &elems);
+
+  ERL_NIF_TERM nil = enif_make_atom(env, "nil");
+  ERL_NIF_TERM keys[] = {
+      enif_make_atom(env, "__struct__"), enif_make_atom(env, "type"),
+      enif_make_atom(env, "data"),       enif_make_atom(env, "format"),
+      enif_make_atom(env, "width"),      enif_make_atom(env, "height"),
+      enif_make_atom(env, "samples"),    enif_make_atom(env, "pts"),
+      enif_make_atom(env, "linesizes"),  enif_make_atom(env, "tensor"),
+      enif_make_atom(env, "levels"),
+  };
+
+  ERL_NIF_TERM values[11];
+  values[0] = enif_make_atom(env, "Elixir.Xav.Frame");
+  values[2] = elems[0];
+  values[3] = elems[1];
+
+  // audio frames with levels are 5-tuples too, but end with a map instead of pts
+  if (arity >= 5 && !enif_is_map(env, elems[4])) {
+    values[1] = enif_make_atom(env, "video");
+    values[4] = elems[2];
+    values[5] = elems[3];
+    values[6] = nil;
+    values[7] = elems[4];
+    values[8] = arity >= 6 ? elems[5] : nil;
+    values[9] = arity == 7 ? elems[6] : nil;
+    values[10] = nil;
+  } else {
+    values[1] = enif_make_atom(env, "audio");
+    values[4] = nil;
+    values[5] = nil;
+    values[6] = elems[2];
+    values[7] = elems[3];
+    values[8] = nil;
+    values[9] = nil;
+    values[10] = arity == 5 ? elems[4] : nil;
+  }
+
+  ERL_NIF_TERM frame;
+  enif_make_map_from_arrays(env, keys, values, 11, &frame);
+  return frame;
+}
+
+int xav_nif_get_av_options(ErlNifEnv *env, ERL_NIF_TERM value, const AVClass **classes,
+                           int classes_count, AVDictionary **options) {
+  *options = NULL;
+  ERL_NIF_TERM head, tail = value;
+
+  while (enif_get_list_cell(env, tail, &head, &tail)) {
+    const ERL_NIF_TERM *elems;
+    int arity;
+    char *name = NULL, *option_value = NULL;
+
+    if (!enif_get_tuple(env, head, &arity, &elems) || arity != 2 ||
+        !xav_nif_get_string(env, elems[0], &name)) {
+      av_dict_free(options);
+      return 0;
+    }
+
+    if (!xav_nif_get_string(env, elems[1], &option_value)) {
+      XAV_FREE(name);
+      av_dict_free(options);
+      return 0;
+    }
+
+    int known = 0;
+    for (int i = 0; i < classes_count && !known; i++) {
+      known = classes[i] != NULL &&
+              av_opt_find(&classes[i], name, NULL, 0, AV_OPT_SEARCH_FAKE_OBJ) != NULL;
+    }
+
+    if (!known) {
+      XAV_LOG_DEBUG("Unknown option: %s", name);
+    }
+
+    int ret = known ? av_dict_set(options, name, option_value, 0) : -1;
+    XAV_FREE(name);
+    XAV_FREE(option_value);
+
+    if (ret < 0) {
+      av_dict_free(options);
+      return 0;
+    }
+  }
+
+  if (!enif_is_empty_list(env, tail)) {
+    av_dict_free(options);
+    return 0;
+  }
+
+  return 1;
+}
+
 ERL_NIF_TERM xav_nif_packet_to_term(ErlNifEnv *env, AVPacket *packet) {
   ERL_NIF_TERM data_term;
 
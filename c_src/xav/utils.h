@@ -27,8 +27,27 @@ ERL_NIF_TERM xav_nif_error(ErlNifEnv *env, char *reason);
 ERL_NIF_TERM xav_nif_raise(ErlNifEnv *env, char *msg);
 int xav_nif_get_atom(ErlNifEnv *env, ERL_NIF_TERM term, char **value);
 int xav_nif_get_string(ErlNifEnv *env, ERL_NIF_TERM term, char **value);
+int xav_nif_get_bool(ErlNifEnv *env, ERL_NIF_TERM term, int *value);
+int xav_nif_get_frame_layout(ErlNifEnv *env, ERL_NIF_TERM term, int *value);
+int xav_nif_get_rational(ErlNifEnv *env, ERL_NIF_TERM term, AVRational *value);
+int xav_nif_open_frame_resource_type(ErlNifEnv *env);
 ERL_NIF_TERM xav_nif_video_frame_to_term(ErlNifEnv *env, AVFrame *frame);
-ERL_NIF_TERM xav_nif_audio_frame_to_term(ErlNifEnv *env, uint8_t **out_data, int out_samples,
-                                         int out_size, enum AVSampleFormat out_format, int pts);
+ERL_NIF_TERM xav_nif_video_frame_ref_to_term(ErlNifEnv *env, AVFrame *frame);
+ERL_NIF_TERM xav_nif_video_frame_to_planes_term(ErlNifEnv *env, AVFrame *frame, int zero_copy);
+char *xav_nif_get_video_frame_data(ErlNifEnv *env, ERL_NIF_TERM data, ERL_NIF_TERM linesizes,
+                                   AVFrame *frame);
+ERL_NIF_TERM xav_nif_audio_frame_to_term(ErlNifEnv *env, ErlNifBinary *out_data, int planes,
+                                         int out_samples, enum AVSampleFormat out_format,
+                                         int64_t pts);
+ERL_NIF_TERM xav_nif_frame_to_struct(ErlNifEnv *env, ERL_NIF_TERM frame_term);
+
+/**
+ * Reads AVOptions out of a list of `{name, value}` binaries, e.g. passed as
+ * `[{"filter_size", "16"}]` from Elixir. Fails on options none of the `classes`
+ * (which may contain NULLs) know, values are only checked when the options are applied.
+ */
+int xav_nif_get_av_options(ErlNifEnv *env, ERL_NIF_TERM value, const AVClass **classes,
+                           int classes_count, AVDictionary **options);
 ERL_NIF_TERM xav_nif_packet_to_term(ErlNifEnv *env, AVPacket *packet);
 int xav_get_nb_channels(const AVFrame *frame);
+int xav_get_plane_size(const AVFrame *frame, int plane);
@@ -7,16 +7,182 @@ static inline unsigned int video_converter_resolution_changed(struct VideoConver
          converter->in_height != frame->height;
 }
 
+static int get_dst_buffer(struct VideoConverter *converter) {
+  AVFrame *dst_frame = converter->dst_frame;
+
+  // The previous buffer might still be referenced by an Erlang binary.
+  if (dst_frame->buf[0] != NULL && av_frame_is_writable(dst_frame)) {
+    return 0;
+  }
+
+  av_buffer_unref(&dst_frame->buf[0]);
+  dst_frame->buf[0] = av_buffer_pool_get(converter->dst_pool);
+  if (dst_frame->buf[0] == NULL) {
+    return AVERROR(ENOMEM);
+  }
+
+  return av_image_fill_arrays(dst_frame->data, dst_frame->linesize, dst_frame->buf[0]->data,
+                              dst_frame->format, dst_frame->width, dst_frame->height, 1);
+}
+
+static struct SwsContext *alloc_threaded_context(struct VideoConverter *converter,
+                                                 AVFrame *dst_frame) {
+#if XAV_SWS_THREADS
+  struct SwsContext *sws_ctx = sws_alloc_context();
+  if (sws_ctx == NULL) {
+    return NULL;
+  }
+
+  av_opt_set_int(sws_ctx, "srcw", converter->in_width, 0);
+  av_opt_set_int(sws_ctx, "srch", converter->in_height, 0);
+  av_opt_set_int(sws_ctx, "src_format", converter->in_format, 0);
+  av_opt_set_int(sws_ctx, "dstw", dst_frame->width, 0);
+  av_opt_set_int(sws_ctx, "dsth", dst_frame->height, 0);
+  av_opt_set_int(sws_ctx, "dst_format", dst_frame->format, 0);
+  av_opt_set_int(sws_ctx, "sws_flags", SWS_BILINEAR, 0);
+  av_opt_set_int(sws_ctx, "threads", converter->threads, 0);
+
+  if (sws_init_context(sws_ctx, NULL, NULL) < 0) {
+    sws_freeContext(sws_ctx);
+    return NULL;
+  }
+
+  return sws_ctx;
+#else
+  return sws_getContext(converter->in_width, converter->in_height, converter->in_format,
+                        dst_frame->width, dst_frame->height, dst_frame->format, SWS_BILINEAR,
+                        NULL, NULL, NULL);
+#endif
+}
+
+static void cache_entry_free(struct VideoConverterEntry *entry) {
+  sws_freeContext(entry->sws_ctx);
+  yuv_to_rgb_free(&entry->yuv_to_rgb);
+  av_frame_free(&entry->dst_frame);
+  av_buffer_pool_uninit(&entry->dst_pool);
+}
+
+// Moves the current conversion state to the cache, evicting the least recently used entry.
+static void cache_put(struct VideoConverter *converter) {
+  struct VideoConverterEntry current = {.in_width = converter->in_width,
+                                        .in_height = converter->in_height,
+                                        .in_format = converter->in_format,
+                                        .sws_ctx = converter->sws_ctx,
+                                        .yuv_to_rgb = converter->yuv_to_rgb,
+                                        .dst_frame = converter->dst_frame,
+                                        .dst_pool = converter->dst_pool,
+                                        .last_used = ++converter->cache_clock};
+
+  converter->sws_ctx = NULL;
+  converter->yuv_to_rgb = NULL;
+  converter->dst_frame = NULL;
+  converter->dst_pool = NULL;
+
+  // the converter failed to initialize, there's nothing worth keeping
+  if (current.sws_ctx == NULL && current.yuv_to_rgb == NULL) {
+    cache_entry_free(&current);
+    return;
+  }
+
+  struct VideoConverterEntry *slot = &converter->cache[0];
+  for (int i = 0; i < VIDEO_CONVERTER_CACHE_SIZE; i++) {
+    if (converter->cache[i].dst_frame == NULL) {
+      slot = &converter->cache[i];
+      break;
+    } else if (converter->cache[i].last_used < slot->last_used) {
+      slot = &converter->cache[i];
+    }
+  }
+
+  if (slot->dst_frame != NULL) {
+    cache_entry_free(slot);
+  }
+
+  *slot = current;
+}
+
+// Restores the conversion state for the given input from the cache.
+// Returns 1 on hit and 0 on miss.
+static int cache_take(struct VideoConverter *converter, AVFrame *frame) {
+  for (int i = 0; i < VIDEO_CONVERTER_CACHE_SIZE; i++) {
+    struct VideoConverterEntry *entry = &converter->cache[i];
+    if (entry->dst_frame != NULL && entry->in_width == frame->width &&
+        entry->in_height == frame->height && entry->in_format == frame->format) {
+      converter->in_width = entry->in_width;
+      converter->in_height = entry->in_height;
+      converter->in_format = entry->in_format;
+      converter->sws_ctx = entry->sws_ctx;
+      converter->yuv_to_rgb = entry->yuv_to_rgb;
+      converter->dst_frame = entry->dst_frame;
+      converter->dst_pool = entry->dst_pool;
+
+      entry->dst_frame = NULL;
+      entry->sws_ctx = NULL;
+      entry->yuv_to_rgb = NULL;
+      entry->dst_pool = NULL;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
 struct VideoConverter *video_converter_alloc() {
   struct VideoConverter *converter =
       (struct VideoConverter *)XAV_ALLOC(sizeof(struct VideoConverter));
   if (converter) {
     converter->sws_ctx = NULL;
+    // not initialized yet, the first converted frame initializes the converter
+    converter->in_width = 0;
+    converter->in_height = 0;
+    converter->in_format = AV_PIX_FMT_NONE;
+    converter->out_width = -1;
+    converter->out_height = -1;
+    converter->out_format = AV_PIX_FMT_NONE;
     converter->dst_frame = av_frame_alloc();
+    converter->zero_copy = 0;
+    converter->dst_pool = NULL;
+    converter->threads = 1;
+    converter->reserved_threads = 0;
+    converter->fast_path = 0;
+    converter->yuv_to_rgb = NULL;
+    converter->cache_clock = 0;
+    converter->cache_hits = 0;
+    converter->cache_misses = 0;
+    converter->crop_x = 0;
+    converter->crop_y = 0;
+    converter->crop_width = 0;
+    converter->crop_height = 0;
+    converter->crop_frame = NULL;
+    for (int i = 0; i < VIDEO_CONVERTER_CACHE_SIZE; i++) {
+      converter->cache[i].dst_frame = NULL;
+    }
   }
   return converter;
 }
 
+void video_converter_get_out_size(struct VideoConverter *converter, int in_width, int in_height,
+                                  int *width, int *height) {
+  int out_width = converter->out_width;
+  int out_height = converter->out_height;
+
+  if (out_width == -1 && out_height == -1) {
+    *width = in_width;
+    *height = in_height;
+  } else if (out_width == -1) {
+    int w = in_width * out_height / in_height;
+    *width = w + (w % 2);
+    *height = out_height;
+  } else if (out_height == -1) {
+    int h = in_height * out_width / in_width;
+    *width = out_width;
+    *height = h + (h % 2);
+  } else {
+    *width = out_width;
+    *height = out_height;
+  }
+}
+
 int video_converter_init(struct VideoConverter *converter, int in_width, int in_height,
                          enum AVPixelFormat in_format, int out_width, int out_height,
                          enum AVPixelFormat out_format) {
@@ -33,33 +199,54 @@ int video_converter_init(struct VideoConverter *converter, int in_width, int in_
 
   dst_frame->format = out_format;
 
-  if (out_width == -1 && out_height == -1) {
-    dst_frame->width = in_width;
-    dst_frame->height = in_height;
-  } else if (out_width == -1) {
-    int width = in_width * out_height / in_height;
-    width = width + (width % 2);
+  video_converter_get_out_size(converter, in_width, in_height, &dst_frame->width,
+                               &dst_frame->height);
 
-    dst_frame->width = width;
-    dst_frame->height = out_height;
-  } else if (out_height == -1) {
-    int height = in_height * out_width / in_width;
-    height = height + (height % 2);
+  int ret;
+  if (converter->zero_copy) {
+    av_buffer_pool_uninit(&converter->dst_pool);
 
-    dst_frame->width = out_width;
-    dst_frame->height = height;
+    int size = av_image_get_buffer_size(out_format, dst_frame->width, dst_frame->height, 1);
+    if (size < 0)
+      return size;
+
+    // sws_scale might overread/overwrite the end of the last plane
+    converter->dst_pool = av_buffer_pool_init(size + AV_INPUT_BUFFER_PADDING_SIZE, NULL);
+    if (converter->dst_pool == NULL)
+      return AVERROR(ENOMEM);
+
+    ret = get_dst_buffer(converter);
   } else {
-    dst_frame->width = out_width;
-    dst_frame->height = out_height;
+    ret = av_frame_get_buffer(dst_frame, 0);
   }
 
-  int ret = av_frame_get_buffer(dst_frame, 0);
   if (ret < 0)
     return ret;
 
-  converter->sws_ctx =
-      sws_getContext(in_width, in_height, in_format, dst_frame->width, dst_frame->height,
-                     dst_frame->format, SWS_BILINEAR, NULL, NULL, NULL);
+  converter->sws_ctx = NULL;
+  yuv_to_rgb_free(&converter->yuv_to_rgb);
+
+  if (converter->fast_path &&
+      yuv_to_rgb_init(&converter->yuv_to_rgb, in_width, in_height, in_format, dst_frame->width,
+                      dst_frame->height, dst_frame->format) == 0) {
+    return 0;
+  }
+
+#if XAV_SWS_THREADS
+  // threads are taken once and kept when the converter switches to another input
+  if (converter->threads != 1 && converter->reserved_threads == 0) {
+    converter->reserved_threads = thread_budget_reserve(converter->threads);
+    converter->threads = converter->reserved_threads;
+  }
+#endif
+
+  if (converter->threads == 1) {
+    converter->sws_ctx =
+        sws_getContext(in_width, in_height, in_format, dst_frame->width, dst_frame->height,
+                       dst_frame->format, SWS_BILINEAR, NULL, NULL, NULL);
+  } else {
+    converter->sws_ctx = alloc_threaded_context(converter, dst_frame);
+  }
 
   if (!converter->sws_ctx) {
     XAV_LOG_DEBUG("Couldn't get sws context");
@@ -69,14 +256,100 @@ int video_converter_init(struct VideoConverter *converter, int in_width, int in_
   return 0;
 }
 
+void video_converter_set_crop(struct VideoConverter *converter, int x, int y, int width,
+                              int height) {
+  converter->crop_x = x;
+  converter->crop_y = y;
+  converter->crop_width = width;
+  converter->crop_height = height;
+}
+
+// Points the crop frame at the cropped region of `src_frame`, without copying it.
+// The offsets of the chroma planes are rounded down according to the subsampling.
+static int crop(struct VideoConverter *converter, AVFrame *src_frame) {
+  if (converter->crop_x < 0 || converter->crop_y < 0 || converter->crop_width <= 0 ||
+      converter->crop_height <= 0 ||
+      converter->crop_x + converter->crop_width > src_frame->width ||
+      converter->crop_y + converter->crop_height > src_frame->height) {
+    return AVERROR(EINVAL);
+  }
+
+  if (converter->crop_frame == NULL) {
+    converter->crop_frame = av_frame_alloc();
+    if (converter->crop_frame == NULL) {
+      return AVERROR(ENOMEM);
+    }
+  }
+
+  AVFrame *frame = converter->crop_frame;
+  int ret = av_frame_ref(frame, src_frame);
+  if (ret < 0) {
+    return ret;
+  }
+
+  frame->crop_left = converter->crop_x;
+  frame->crop_top = converter->crop_y;
+  frame->crop_right = src_frame->width - converter->crop_x - converter->crop_width;
+  frame->crop_bottom = src_frame->height - converter->crop_y - converter->crop_height;
+
+  // keep the exact offsets, even if they break the alignment of the planes
+  ret = av_frame_apply_cropping(frame, AV_FRAME_CROP_UNALIGNED);
+  if (ret < 0) {
+    av_frame_unref(frame);
+  }
+
+  return ret;
+}
+
+static int convert(struct VideoConverter *converter, AVFrame *src_frame);
+
 int video_converter_convert(struct VideoConverter *converter, AVFrame *src_frame) {
+  if (converter->crop_width == 0) {
+    return convert(converter, src_frame);
+  }
+
+  int ret = crop(converter, src_frame);
+  if (ret < 0) {
+    return ret;
+  }
+
+  ret = convert(converter, converter->crop_frame);
+  av_frame_unref(converter->crop_frame);
+  return ret;
+}
+
+static int convert(struct VideoConverter *converter, AVFrame *src_frame) {
   int ret;
 
   if (video_converter_resolution_changed(converter, src_frame)) {
     XAV_LOG_DEBUG("Frame resolution changed");
-    sws_freeContext(converter->sws_ctx);
-    ret = video_converter_init(converter, src_frame->width, src_frame->height, src_frame->format,
-                               converter->out_width, converter->out_height, converter->out_format);
+    // the very first frame is not an input change
+    int initialized = converter->in_format != AV_PIX_FMT_NONE;
+    cache_put(converter);
+
+    if (cache_take(converter, src_frame)) {
+      converter->cache_hits++;
+    } else {
+      converter->cache_misses += initialized;
+
+      converter->dst_frame = av_frame_alloc();
+      if (converter->dst_frame == NULL) {
+        return AVERROR(ENOMEM);
+      }
+
+      ret = video_converter_init(converter, src_frame->width, src_frame->height,
+                                 src_frame->format, converter->out_width, converter->out_height,
+                                 converter->out_format);
+      if (ret < 0) {
+        // make sure the next frame retries the initialization
+        converter->in_format = AV_PIX_FMT_NONE;
+        return ret;
+      }
+    }
+  }
+
+  if (converter->zero_copy) {
+    ret = get_dst_buffer(converter);
     if (ret < 0) {
       return ret;
     }
@@ -84,6 +357,18 @@ int video_converter_convert(struct VideoConverter *converter, AVFrame *src_frame
 
   converter->dst_frame->pts = src_frame->pts;
 
+  if (converter->yuv_to_rgb != NULL) {
+    yuv_to_rgb_convert(converter->yuv_to_rgb, src_frame, converter->dst_frame);
+    return 0;
+  }
+
+#if XAV_SWS_THREADS
+  // slice threads are only used by the frame API
+  if (converter->threads != 1) {
+    return sws_scale_frame(converter->sws_ctx, converter->dst_frame, src_frame);
+  }
+#endif
+
   // is this (const uint8_t * const*) cast really correct?
   return sws_scale(converter->sws_ctx, (const uint8_t *const *)src_frame->data, src_frame->linesize,
                    0, src_frame->height, converter->dst_frame->data,
@@ -97,10 +382,25 @@ void video_converter_free(struct VideoConverter **converter) {
       sws_freeContext((*converter)->sws_ctx);
     }
 
+    yuv_to_rgb_free(&vc->yuv_to_rgb);
+
+    for (int i = 0; i < VIDEO_CONVERTER_CACHE_SIZE; i++) {
+      if (vc->cache[i].dst_frame != NULL) {
+        cache_entry_free(&vc->cache[i]);
+      }
+    }
+
     if (vc->dst_frame != NULL) {
       av_frame_free(&(*converter)->dst_frame);
     }
 
+    av_frame_free(&vc->crop_frame);
+
+    // buffers still referenced by Erlang binaries keep the pool alive
+    av_buffer_pool_uninit(&vc->dst_pool);
+
+    thread_budget_release(vc->reserved_threads);
+
     XAV_FREE(vc);
     *converter = NULL;
   }
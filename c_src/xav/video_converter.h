@@ -1,10 +1,32 @@
 
 #include <libavutil/channel_layout.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
 #include <libswresample/swresample.h>
 #include <libswscale/swscale.h>
 #include <stdint.h>
 
+#include "thread_budget.h"
+#include "yuv_to_rgb.h"
+
+// libswscale can process slices of a frame in parallel since 6.1 (FFmpeg 5.0)
+#define XAV_SWS_THREADS (LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100))
+
+// number of inactive inputs kept by a converter
+#define VIDEO_CONVERTER_CACHE_SIZE 3
+
+// Conversion state for a single input resolution and format.
+struct VideoConverterEntry {
+  int in_width;
+  int in_height;
+  enum AVPixelFormat in_format;
+  struct SwsContext *sws_ctx;
+  struct YuvToRgb *yuv_to_rgb;
+  AVFrame *dst_frame;
+  AVBufferPool *dst_pool;
+  uint64_t last_used;
+};
+
 struct VideoConverter {
   struct SwsContext *sws_ctx;
   int in_width;
@@ -14,6 +36,38 @@ struct VideoConverter {
   int out_height;
   enum AVPixelFormat out_format;
   AVFrame *dst_frame;
+  // When set, every converted frame gets its own, tightly packed buffer
+  // so that it can be handed over to Erlang without copying.
+  int zero_copy;
+  AVBufferPool *dst_pool;
+  // Number of threads used for scaling, 0 means one per CPU core.
+  // Has to be set before init and is ignored on older libswscale.
+  // The first init clamps it to what is left in the thread budget.
+  int threads;
+  // threads taken from the thread budget, 0 until they are needed
+  // or when the number of threads is left to libswscale
+  int reserved_threads;
+  // Whether to use hand-written kernels for the most common conversions
+  // instead of swscale. Has to be set before init.
+  int fast_path;
+  // set instead of sws_ctx when the conversion is handled by the kernels
+  struct YuvToRgb *yuv_to_rgb;
+  // Recently used inputs, so that switching back to them (e.g. simulcast layers)
+  // doesn't require rebuilding the scaling context and destination buffers.
+  // A slot is empty when its dst_frame is NULL.
+  struct VideoConverterEntry cache[VIDEO_CONVERTER_CACHE_SIZE];
+  uint64_t cache_clock;
+  uint64_t cache_hits;
+  uint64_t cache_misses;
+  // Region of the input frame to convert, disabled when crop_width is 0.
+  // Only this region is scaled, the rest of the frame is never touched.
+  // Can be changed between conversions - the cropped size is the converter's input size.
+  int crop_x;
+  int crop_y;
+  int crop_width;
+  int crop_height;
+  // a reference to the converted frame with cropping applied
+  AVFrame *crop_frame;
 };
 
 struct VideoConverter *video_converter_alloc();
@@ -22,6 +76,24 @@ int video_converter_init(struct VideoConverter *converter, int in_width, int in_
                          enum AVPixelFormat in_format, int out_width, int out_height,
                          enum AVPixelFormat out_format);
 
+/**
+ * Computes the size of the converted frame for the given input size,
+ * keeping the aspect ratio when only one of the output dimensions is set.
+ */
+void video_converter_get_out_size(struct VideoConverter *converter, int in_width, int in_height,
+                                  int *width, int *height);
+
+/**
+ * Sets the region of the input frame to convert. A width of 0 disables cropping.
+ */
+void video_converter_set_crop(struct VideoConverter *converter, int x, int y, int width,
+                              int height);
+
+/**
+ * Converts a frame, (re)initializing the converter on input changes.
+ * A converter that was only allocated, with the out_* fields set,
+ * is initialized with the first frame.
+ */
 int video_converter_convert(struct VideoConverter *converter, AVFrame *src_frame);
 
 void video_converter_free(struct VideoConverter **converter);
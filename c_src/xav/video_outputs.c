@@ -0,0 +1,152 @@
+#include "video_outputs.h"
+
+#include <libavutil/pixdesc.h>
+
+static AVFrame *get_source_frame(struct VideoOutputs *outputs, int output, AVFrame *src_frame);
+
+int xav_nif_get_video_outputs(ErlNifEnv *env, ERL_NIF_TERM value, struct VideoOutputs *outputs) {
+  unsigned int count;
+  if (!enif_get_list_length(env, value, &count) || count == 0) {
+    return 0;
+  }
+
+  video_outputs_free(outputs);
+  outputs->converters = XAV_ALLOC(sizeof(struct VideoConverter *) * count);
+
+  ERL_NIF_TERM output;
+  while (enif_get_list_cell(env, value, &output, &value)) {
+    const ERL_NIF_TERM *elems;
+    int arity;
+    char format[32];
+    int width, height;
+
+    if (!enif_get_tuple(env, output, &arity, &elems) || arity != 4 ||
+        !enif_get_atom(env, elems[0], format, sizeof(format), ERL_NIF_LATIN1) ||
+        !enif_get_int(env, elems[1], &width) || !enif_get_int(env, elems[2], &height)) {
+      return 0;
+    }
+
+    enum AVPixelFormat pix_fmt = AV_PIX_FMT_NONE;
+    if (strcmp(format, "nil") != 0) {
+      pix_fmt = av_get_pix_fmt(format);
+      if (pix_fmt == AV_PIX_FMT_NONE) {
+        return 0;
+      }
+    }
+
+    struct VideoConverter *converter = video_converter_alloc();
+    if (converter == NULL) {
+      return 0;
+    }
+
+    converter->out_format = pix_fmt;
+    converter->out_width = width;
+    converter->out_height = height;
+    outputs->converters[outputs->count++] = converter;
+
+    if (!enif_is_identical(elems[3], enif_make_atom(env, "nil")) &&
+        !xav_nif_get_crop(env, elems[3], converter)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+int xav_nif_get_crop(ErlNifEnv *env, ERL_NIF_TERM value, struct VideoConverter *converter) {
+  const ERL_NIF_TERM *elems;
+  int arity;
+  int x, y, width, height;
+
+  if (!enif_get_tuple(env, value, &arity, &elems) || arity != 4 ||
+      !enif_get_int(env, elems[0], &x) || !enif_get_int(env, elems[1], &y) ||
+      !enif_get_int(env, elems[2], &width) || !enif_get_int(env, elems[3], &height) || x < 0 ||
+      y < 0 || width <= 0 || height <= 0) {
+    return 0;
+  }
+
+  video_converter_set_crop(converter, x, y, width, height);
+  return 1;
+}
+
+void video_outputs_configure(struct VideoOutputs *outputs, int zero_copy, int threads,
+                             int fast_path) {
+  for (int i = 0; i < outputs->count; i++) {
+    outputs->converters[i]->zero_copy = zero_copy;
+    outputs->converters[i]->threads = threads;
+    outputs->converters[i]->fast_path = fast_path;
+  }
+}
+
+int video_outputs_convert(struct VideoOutputs *outputs, AVFrame *src_frame) {
+  for (int i = 0; i < outputs->count; i++) {
+    struct VideoConverter *converter = outputs->converters[i];
+
+    // no format means the format of the input frame,
+    // not the one of the rendition it is scaled from
+    if (converter->out_format == AV_PIX_FMT_NONE) {
+      converter->out_format = src_frame->format;
+    }
+
+    int ret = video_converter_convert(converter, get_source_frame(outputs, i, src_frame));
+    if (ret < 0) {
+      return ret;
+    }
+  }
+
+  return 0;
+}
+
+void video_outputs_free(struct VideoOutputs *outputs) {
+  for (int i = 0; i < outputs->count; i++) {
+    video_converter_free(&outputs->converters[i]);
+  }
+
+  if (outputs->converters != NULL) {
+    XAV_FREE(outputs->converters);
+  }
+
+  outputs->converters = NULL;
+  outputs->count = 0;
+}
+
+static AVFrame *get_source_frame(struct VideoOutputs *outputs, int output, AVFrame *src_frame) {
+  struct VideoConverter *converter = outputs->converters[output];
+
+  if (converter->crop_width > 0) {
+    return src_frame;
+  }
+
+  int width, height;
+  video_converter_get_out_size(converter, src_frame->width, src_frame->height, &width, &height);
+
+  AVFrame *source = src_frame;
+  for (int i = 0; i < output; i++) {
+    AVFrame *frame = outputs->converters[i]->dst_frame;
+
+    // a region of the frame can't be scaled to the whole frame
+    if (outputs->converters[i]->crop_width > 0) {
+      continue;
+    }
+
+    // Don't scale from renditions that lost information,
+    // e.g. a color output from a grayscale one.
+    if (frame->format != src_frame->format && frame->format != converter->out_format) {
+      continue;
+    }
+
+    // The output has to have the same size as if it was scaled from the input frame.
+    // Rounding might make it differ by a pixel when only one dimension is set.
+    // Its pixels aren't the same though, as they get resampled twice.
+    int frame_width, frame_height;
+    video_converter_get_out_size(converter, frame->width, frame->height, &frame_width,
+                                 &frame_height);
+
+    if (frame_width == width && frame_height == height && frame->width >= width &&
+        frame->height >= height && frame->width * frame->height < source->width * source->height) {
+      source = frame;
+    }
+  }
+
+  return source;
+}
@@ -0,0 +1,51 @@
+#ifndef XAV_VIDEO_OUTPUTS_H
+#define XAV_VIDEO_OUTPUTS_H
+#include "utils.h"
+#include "video_converter.h"
+
+/**
+ * A set of converters producing several renditions of the same frame,
+ * e.g. a preview, a thumbnail and a model input.
+ *
+ * Outputs are converted in order. Every output is scaled from the smallest
+ * frame that is at least as big as the output - either the input frame,
+ * or one of the renditions converted before it. This way, a thumbnail
+ * listed after a preview is scaled down from the preview, not from the full frame.
+ * Cropped outputs are always converted from the input frame, and other outputs
+ * are never scaled from them.
+ */
+struct VideoOutputs {
+  struct VideoConverter **converters;
+  int count;
+};
+
+/**
+ * Reads a non-empty list of `{format | nil, width | -1, height | -1, crop | nil}` tuples
+ * passed from Elixir.
+ * Outputs have to be freed with video_outputs_free, also when reading fails.
+ *
+ * @return 1 on success and 0 when the value is invalid.
+ */
+int xav_nif_get_video_outputs(ErlNifEnv *env, ERL_NIF_TERM value, struct VideoOutputs *outputs);
+
+/**
+ * Reads an `{x, y, width, height}` crop rectangle into the converter.
+ *
+ * @return 1 on success and 0 when the value is invalid.
+ */
+int xav_nif_get_crop(ErlNifEnv *env, ERL_NIF_TERM value, struct VideoConverter *converter);
+
+/**
+ * Sets the options shared by all of the converters. Has to be called before the first conversion.
+ */
+void video_outputs_configure(struct VideoOutputs *outputs, int zero_copy, int threads,
+                             int fast_path);
+
+/**
+ * Converts `src_frame` with all of the converters.
+ * Converted frames are available in the converters' `dst_frame`.
+ */
+int video_outputs_convert(struct VideoOutputs *outputs, AVFrame *src_frame);
+
+void video_outputs_free(struct VideoOutputs *outputs);
+#endif
@@ -0,0 +1,257 @@
+#include "worker_pool.h"
+
+#include <libavutil/cpu.h>
+
+#include "thread_budget.h"
+
+struct WorkerJob {
+  worker_job_fn run;
+  void *arg;
+  struct WorkerJob *next;
+};
+
+struct SerialQueue {
+  ErlNifMutex *lock;
+  void *resource;
+  struct WorkerJob *head;
+  struct WorkerJob *tail;
+  int jobs;
+  int max_jobs;
+  // whether the queue is in the pool's ready list or being run
+  int scheduled;
+  struct SerialQueue *next;
+};
+
+struct WorkerPool {
+  ErlNifMutex *lock;
+  ErlNifCond *cond;
+  ErlNifTid *threads;
+  int threads_count;
+  int stop;
+  // queues with pending jobs
+  struct SerialQueue *head;
+  struct SerialQueue *tail;
+};
+
+static struct WorkerPool pool;
+
+static int start_threads();
+static void *worker_main(void *arg);
+static void enqueue_ready(struct SerialQueue *queue);
+static void run_next_job(struct SerialQueue *queue);
+
+int worker_pool_init() {
+  pool.threads = NULL;
+  pool.threads_count = 0;
+  pool.stop = 0;
+  pool.head = NULL;
+  pool.tail = NULL;
+
+  pool.lock = enif_mutex_create("xav_worker_pool_lock");
+  if (pool.lock == NULL) {
+    return -1;
+  }
+
+  pool.cond = enif_cond_create("xav_worker_pool_cond");
+  if (pool.cond == NULL) {
+    enif_mutex_destroy(pool.lock);
+    return -1;
+  }
+
+  return 0;
+}
+
+void worker_pool_destroy() {
+  enif_mutex_lock(pool.lock);
+  pool.stop = 1;
+  enif_cond_broadcast(pool.cond);
+  enif_mutex_unlock(pool.lock);
+
+  for (int i = 0; i < pool.threads_count; i++) {
+    enif_thread_join(pool.threads[i], NULL);
+  }
+
+  if (pool.threads != NULL) {
+    XAV_FREE(pool.threads);
+  }
+
+  enif_cond_destroy(pool.cond);
+  enif_mutex_destroy(pool.lock);
+}
+
+struct SerialQueue *serial_queue_alloc(void *resource, int max_jobs) {
+  struct SerialQueue *queue = (struct SerialQueue *)XAV_ALLOC(sizeof(struct SerialQueue));
+  if (queue == NULL) {
+    return NULL;
+  }
+
+  queue->lock = enif_mutex_create("xav_serial_queue_lock");
+  if (queue->lock == NULL) {
+    XAV_FREE(queue);
+    return NULL;
+  }
+
+  queue->resource = resource;
+  queue->head = NULL;
+  queue->tail = NULL;
+  queue->jobs = 0;
+  queue->max_jobs = max_jobs;
+  queue->scheduled = 0;
+  queue->next = NULL;
+
+  return queue;
+}
+
+int serial_queue_push(struct SerialQueue *queue, worker_job_fn run, void *arg) {
+  enif_mutex_lock(pool.lock);
+  int ret = pool.threads_count == 0 ? start_threads() : 0;
+  enif_mutex_unlock(pool.lock);
+
+  if (ret < 0) {
+    return -2;
+  }
+
+  enif_mutex_lock(queue->lock);
+  if (queue->jobs >= queue->max_jobs) {
+    enif_mutex_unlock(queue->lock);
+    return -1;
+  }
+
+  struct WorkerJob *job = (struct WorkerJob *)XAV_ALLOC(sizeof(struct WorkerJob));
+  job->run = run;
+  job->arg = arg;
+  job->next = NULL;
+
+  if (queue->tail == NULL) {
+    queue->head = job;
+  } else {
+    queue->tail->next = job;
+  }
+  queue->tail = job;
+  queue->jobs++;
+
+  int schedule = !queue->scheduled;
+  if (schedule) {
+    queue->scheduled = 1;
+    enif_keep_resource(queue->resource);
+  }
+  enif_mutex_unlock(queue->lock);
+
+  if (schedule) {
+    enqueue_ready(queue);
+  }
+
+  return 0;
+}
+
+void serial_queue_free(struct SerialQueue **queue) {
+  struct SerialQueue *q = *queue;
+  if (q != NULL) {
+    // The owner resource is kept while there are pending jobs,
+    // so the queue is always empty here.
+    enif_mutex_destroy(q->lock);
+    XAV_FREE(q);
+    *queue = NULL;
+  }
+}
+
+static int start_threads() {
+  // Workers only wait for the codecs, which take their threads from the budget,
+  // so they aren't accounted. The pool is still capped at the budget, as otherwise
+  // every library would start a thread per CPU core.
+  int threads_count = av_cpu_count();
+  int budget = thread_budget_get();
+  if (budget > 0 && budget < threads_count) {
+    threads_count = budget;
+  }
+
+  pool.threads = (ErlNifTid *)XAV_ALLOC(sizeof(ErlNifTid) * threads_count);
+
+  for (int i = 0; i < threads_count; i++) {
+    if (enif_thread_create("xav_worker", &pool.threads[i], worker_main, NULL, NULL) != 0) {
+      break;
+    }
+    pool.threads_count++;
+  }
+
+  XAV_LOG_DEBUG("Started %d worker threads", pool.threads_count);
+
+  if (pool.threads_count == 0) {
+    XAV_FREE(pool.threads);
+    pool.threads = NULL;
+    return -1;
+  }
+
+  return 0;
+}
+
+static void *worker_main(void *arg) {
+  enif_mutex_lock(pool.lock);
+
+  while (1) {
+    while (!pool.stop && pool.head == NULL) {
+      enif_cond_wait(pool.cond, pool.lock);
+    }
+
+    if (pool.stop) {
+      break;
+    }
+
+    struct SerialQueue *queue = pool.head;
+    pool.head = queue->next;
+    if (pool.head == NULL) {
+      pool.tail = NULL;
+    }
+    queue->next = NULL;
+
+    enif_mutex_unlock(pool.lock);
+    run_next_job(queue);
+    enif_mutex_lock(pool.lock);
+  }
+
+  enif_mutex_unlock(pool.lock);
+  return NULL;
+}
+
+static void enqueue_ready(struct SerialQueue *queue) {
+  enif_mutex_lock(pool.lock);
+  if (pool.tail == NULL) {
+    pool.head = queue;
+  } else {
+    pool.tail->next = queue;
+  }
+  pool.tail = queue;
+  enif_cond_signal(pool.cond);
+  enif_mutex_unlock(pool.lock);
+}
+
+static void run_next_job(struct SerialQueue *queue) {
+  enif_mutex_lock(queue->lock);
+  struct WorkerJob *job = queue->head;
+  queue->head = job->next;
+  if (queue->head == NULL) {
+    queue->tail = NULL;
+  }
+  queue->jobs--;
+  enif_mutex_unlock(queue->lock);
+
+  job->run(job->arg);
+  XAV_FREE(job);
+
+  // Run one job at a time and go to the back of the ready list,
+  // so that a busy queue doesn't starve the others.
+  enif_mutex_lock(queue->lock);
+  int reschedule = queue->head != NULL;
+  if (!reschedule) {
+    queue->scheduled = 0;
+  }
+  void *resource = queue->resource;
+  enif_mutex_unlock(queue->lock);
+
+  if (reschedule) {
+    enqueue_ready(queue);
+  } else {
+    // this might run the resource destructor, which frees the queue
+    enif_release_resource(resource);
+  }
+}
@@ -0,0 +1,46 @@
+#ifndef XAV_WORKER_POOL_H
+#define XAV_WORKER_POOL_H
+#include "utils.h"
+
+/**
+ * A pool of native threads shared by all resources of a NIF library.
+ *
+ * Jobs are pushed to serial queues. Jobs from a single queue are run
+ * one at a time, in order, while different queues are processed
+ * in parallel.
+ *
+ * A queue keeps its owner resource alive for as long as it has jobs,
+ * so the resource destructor never runs concurrently with a job.
+ */
+struct SerialQueue;
+
+typedef void (*worker_job_fn)(void *arg);
+
+/**
+ * Has to be called once, in the NIF load callback.
+ * Threads are started lazily, on the first push, one per CPU core,
+ * but no more than the thread budget at that time (see thread_budget.h).
+ */
+int worker_pool_init();
+
+/**
+ * Stops and joins all threads. Has to be called in the NIF unload callback.
+ */
+void worker_pool_destroy();
+
+struct SerialQueue *serial_queue_alloc(void *resource, int max_jobs);
+
+/**
+ * Schedules `run(arg)` on the pool.
+ *
+ * @return 0 on success, -1 when the queue is full
+ * and -2 when the pool couldn't be started.
+ * When push fails, the job is not taken over and the caller has to free `arg`.
+ */
+int serial_queue_push(struct SerialQueue *queue, worker_job_fn run, void *arg);
+
+/**
+ * Has to be called from the owner resource destructor.
+ */
+void serial_queue_free(struct SerialQueue **queue);
+#endif
@@ -0,0 +1,332 @@
+#include "xav_audio_mixer.h"
+
+ErlNifResourceType *xav_audio_mixer_resource_type;
+
+static struct XavAudioMixer *get_mixer(ErlNifEnv *env, ERL_NIF_TERM term) {
+  struct XavAudioMixer *xav_audio_mixer;
+  if (!enif_get_resource(env, term, xav_audio_mixer_resource_type, (void **)&xav_audio_mixer)) {
+    return NULL;
+  }
+
+  return xav_audio_mixer;
+}
+
+ERL_NIF_TERM new (ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 7) {
+    return xav_nif_raise(env, "invalid_arg_count");
+  }
+
+  int sample_rate, channels, frame_size, max_delay, soft_clip;
+  AVRational time_base;
+  char *format = NULL;
+
+  if (!enif_get_int(env, argv[0], &sample_rate) || !enif_get_int(env, argv[1], &channels) ||
+      !enif_get_int(env, argv[3], &frame_size) || !enif_get_int(env, argv[4], &max_delay)) {
+    return xav_nif_raise(env, "failed_to_get_int");
+  }
+
+  if (!xav_nif_get_rational(env, argv[5], &time_base)) {
+    return xav_nif_raise(env, "invalid_time_base");
+  }
+
+  if (!xav_nif_get_bool(env, argv[6], &soft_clip)) {
+    return xav_nif_raise(env, "failed_to_get_bool");
+  }
+
+  if (!xav_nif_get_atom(env, argv[2], &format)) {
+    return xav_nif_raise(env, "failed_to_get_atom");
+  }
+
+  enum AVSampleFormat out_format = av_get_sample_fmt(format);
+  XAV_FREE(format);
+
+  if (out_format == AV_SAMPLE_FMT_NONE) {
+    return xav_nif_raise(env, "unknown_out_format");
+  }
+
+  ERL_NIF_TERM ret;
+  struct XavAudioMixer *xav_audio_mixer =
+      enif_alloc_resource(xav_audio_mixer_resource_type, sizeof(struct XavAudioMixer));
+  xav_audio_mixer->mixer = audio_mixer_alloc();
+  xav_audio_mixer->frame = av_frame_alloc();
+  xav_audio_mixer->lock = enif_mutex_create("xav_audio_mixer_lock");
+
+  if (xav_audio_mixer->mixer == NULL || xav_audio_mixer->frame == NULL ||
+      xav_audio_mixer->lock == NULL) {
+    ret = xav_nif_raise(env, "failed_to_allocate_mixer");
+    goto release;
+  }
+
+  if (audio_mixer_init(xav_audio_mixer->mixer, sample_rate, channels, out_format, frame_size,
+                       max_delay, time_base, soft_clip) < 0) {
+    ret = xav_nif_raise(env, "failed_to_init_mixer");
+    goto release;
+  }
+
+  ret = enif_make_resource(env, xav_audio_mixer);
+
+release:
+  enif_release_resource(xav_audio_mixer);
+
+  return ret;
+}
+
+ERL_NIF_TERM add_source(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 4) {
+    return xav_nif_raise(env, "invalid_arg_count");
+  }
+
+  struct XavAudioMixer *xav_audio_mixer = get_mixer(env, argv[0]);
+  if (xav_audio_mixer == NULL) {
+    return xav_nif_raise(env, "couldnt_get_mixer_resource");
+  }
+
+  int in_sample_rate, in_channels;
+  double gain;
+  if (!enif_get_int(env, argv[1], &in_sample_rate) || !enif_get_int(env, argv[2], &in_channels)) {
+    return xav_nif_raise(env, "failed_to_get_int");
+  }
+
+  if (!enif_get_double(env, argv[3], &gain)) {
+    return xav_nif_raise(env, "failed_to_get_double");
+  }
+
+  enif_mutex_lock(xav_audio_mixer->lock);
+  int id = audio_mixer_add_source(xav_audio_mixer->mixer, in_sample_rate, in_channels, gain);
+  enif_mutex_unlock(xav_audio_mixer->lock);
+
+  if (id < 0) {
+    return xav_nif_raise(env, "failed_to_add_source");
+  }
+
+  return enif_make_int(env, id);
+}
+
+ERL_NIF_TERM remove_source(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 2) {
+    return xav_nif_raise(env, "invalid_arg_count");
+  }
+
+  struct XavAudioMixer *xav_audio_mixer = get_mixer(env, argv[0]);
+  if (xav_audio_mixer == NULL) {
+    return xav_nif_raise(env, "couldnt_get_mixer_resource");
+  }
+
+  int id;
+  if (!enif_get_int(env, argv[1], &id)) {
+    return xav_nif_raise(env, "failed_to_get_int");
+  }
+
+  enif_mutex_lock(xav_audio_mixer->lock);
+  int ret = audio_mixer_remove_source(xav_audio_mixer->mixer, id);
+  enif_mutex_unlock(xav_audio_mixer->lock);
+
+  if (ret < 0) {
+    return xav_nif_raise(env, "unknown_source");
+  }
+
+  return enif_make_atom(env, "ok");
+}
+
+ERL_NIF_TERM set_gain(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 3) {
+    return xav_nif_raise(env, "invalid_arg_count");
+  }
+
+  struct XavAudioMixer *xav_audio_mixer = get_mixer(env, argv[0]);
+  if (xav_audio_mixer == NULL) {
+    return xav_nif_raise(env, "couldnt_get_mixer_resource");
+  }
+
+  int id;
+  double gain;
+  if (!enif_get_int(env, argv[1], &id) || !enif_get_double(env, argv[2], &gain)) {
+    return xav_nif_raise(env, "failed_to_get_number");
+  }
+
+  enif_mutex_lock(xav_audio_mixer->lock);
+  int ret = audio_mixer_set_gain(xav_audio_mixer->mixer, id, gain);
+  enif_mutex_unlock(xav_audio_mixer->lock);
+
+  if (ret < 0) {
+    return xav_nif_raise(env, "unknown_source");
+  }
+
+  return enif_make_atom(env, "ok");
+}
+
+// Points the frame at samples given either as a packed binary
+// or as a list of binaries, one per channel.
+// Returns NULL on success or the reason of the failure.
+static char *get_frame_data(ErlNifEnv *env, ERL_NIF_TERM data, AVFrame *frame, int channels,
+                            uint8_t **planes) {
+  size_t plane_size = (size_t)frame->nb_samples * av_get_bytes_per_sample(frame->format);
+  ErlNifBinary bin;
+
+  if (!av_sample_fmt_is_planar(frame->format)) {
+    if (!enif_inspect_binary(env, data, &bin)) {
+      return "failed_to_inspect_binary";
+    }
+
+    if (bin.size < plane_size * channels) {
+      return "invalid_frame_size";
+    }
+
+    planes[0] = bin.data;
+    return NULL;
+  }
+
+  unsigned int planes_count;
+  if (!enif_get_list_length(env, data, &planes_count) || (int)planes_count != channels) {
+    return "invalid_planes";
+  }
+
+  ERL_NIF_TERM plane;
+  for (int i = 0; enif_get_list_cell(env, data, &plane, &data); i++) {
+    if (!enif_inspect_binary(env, plane, &bin)) {
+      return "failed_to_inspect_binary";
+    }
+
+    if (bin.size < plane_size) {
+      return "invalid_frame_size";
+    }
+
+    planes[i] = bin.data;
+  }
+
+  return NULL;
+}
+
+// Writes the frame to the source. Has to be called with the mixer's lock held,
+// as both the source and the mixer's frame are shared with other processes.
+// Returns NULL on success or the reason of the failure.
+static char *write_locked(ErlNifEnv *env, struct XavAudioMixer *xav_audio_mixer, int id,
+                          ERL_NIF_TERM data, enum AVSampleFormat format, int samples,
+                          int64_t pts) {
+  int channels = audio_mixer_get_source_channels(xav_audio_mixer->mixer, id);
+  if (channels < 0) {
+    return "unknown_source";
+  }
+
+  AVFrame *frame = xav_audio_mixer->frame;
+  frame->format = format;
+  frame->nb_samples = samples;
+  frame->pts = pts;
+
+  uint8_t *planes[channels];
+  char *reason = get_frame_data(env, data, frame, channels, planes);
+  if (reason != NULL) {
+    return reason;
+  }
+
+  frame->extended_data = planes;
+  int ret = audio_mixer_write(xav_audio_mixer->mixer, id, frame);
+  frame->extended_data = frame->data;
+
+  return ret < 0 ? "failed_to_write" : NULL;
+}
+
+ERL_NIF_TERM write_frame(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 6) {
+    return xav_nif_raise(env, "invalid_arg_count");
+  }
+
+  struct XavAudioMixer *xav_audio_mixer = get_mixer(env, argv[0]);
+  if (xav_audio_mixer == NULL) {
+    return xav_nif_raise(env, "couldnt_get_mixer_resource");
+  }
+
+  int id, samples;
+  ErlNifSInt64 pts;
+  if (!enif_get_int(env, argv[1], &id) || !enif_get_int(env, argv[4], &samples) ||
+      !enif_get_int64(env, argv[5], &pts)) {
+    return xav_nif_raise(env, "failed_to_get_int");
+  }
+
+  char *format_name;
+  if (!xav_nif_get_atom(env, argv[3], &format_name)) {
+    return xav_nif_raise(env, "failed_to_get_atom");
+  }
+
+  enum AVSampleFormat format = av_get_sample_fmt(format_name);
+  XAV_FREE(format_name);
+
+  if (format == AV_SAMPLE_FMT_NONE) {
+    return xav_nif_raise(env, "unknown_format");
+  }
+
+  enif_mutex_lock(xav_audio_mixer->lock);
+  char *reason = write_locked(env, xav_audio_mixer, id, argv[2], format, samples, pts);
+  enif_mutex_unlock(xav_audio_mixer->lock);
+
+  if (reason != NULL) {
+    return xav_nif_raise(env, reason);
+  }
+
+  return enif_make_atom(env, "ok");
+}
+
+ERL_NIF_TERM mix(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 2) {
+    return xav_nif_raise(env, "invalid_arg_count");
+  }
+
+  struct XavAudioMixer *xav_audio_mixer = get_mixer(env, argv[0]);
+  if (xav_audio_mixer == NULL) {
+    return xav_nif_raise(env, "couldnt_get_mixer_resource");
+  }
+
+  int flush;
+  if (!xav_nif_get_bool(env, argv[1], &flush)) {
+    return xav_nif_raise(env, "failed_to_get_bool");
+  }
+
+  ERL_NIF_TERM frames = enif_make_list(env, 0);
+  ERL_NIF_TERM frame_term;
+  int ret;
+
+  enif_mutex_lock(xav_audio_mixer->lock);
+  while ((ret = audio_mixer_read(env, xav_audio_mixer->mixer, flush, &frame_term)) == 1) {
+    frames = enif_make_list_cell(env, frame_term, frames);
+  }
+  enif_mutex_unlock(xav_audio_mixer->lock);
+
+  if (ret < 0) {
+    return xav_nif_raise(env, "failed_to_mix");
+  }
+
+  ERL_NIF_TERM result;
+  enif_make_reverse_list(env, frames, &result);
+  return result;
+}
+
+void free_xav_audio_mixer(ErlNifEnv *env, void *obj) {
+  XAV_LOG_DEBUG("Freeing XavAudioMixer object");
+  struct XavAudioMixer *xav_audio_mixer = (struct XavAudioMixer *)obj;
+  audio_mixer_free(&xav_audio_mixer->mixer);
+
+  if (xav_audio_mixer->frame != NULL) {
+    av_frame_free(&xav_audio_mixer->frame);
+  }
+
+  if (xav_audio_mixer->lock != NULL) {
+    enif_mutex_destroy(xav_audio_mixer->lock);
+  }
+}
+
+// Everything that takes the lock runs on dirty schedulers,
+// as it might have to wait for a mix running in another process.
+static ErlNifFunc xav_funcs[] = {{"new", 7, new},
+                                 {"add_source", 4, add_source, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+                                 {"remove_source", 2, remove_source, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+                                 {"set_gain", 3, set_gain, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+                                 {"write", 6, write_frame, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+                                 {"mix", 2, mix, ERL_NIF_DIRTY_JOB_CPU_BOUND}};
+
+static int load(ErlNifEnv *env, void **priv, ERL_NIF_TERM load_info) {
+  xav_audio_mixer_resource_type = enif_open_resource_type(
+      env, NULL, "XavAudioMixer", free_xav_audio_mixer, ERL_NIF_RT_CREATE, NULL);
+  return 0;
+}
+
+ERL_NIF_INIT(Elixir.Xav.AudioMixer.NIF, xav_funcs, &load, NULL, NULL, NULL);
@@ -0,0 +1,11 @@
+#include "audio_mixer.h"
+#include "utils.h"
+
+struct XavAudioMixer {
+  struct AudioMixer *mixer;
+  // wraps the binaries of the written frame, never owns any buffers
+  AVFrame *frame;
+  // sources are usually written by separate processes,
+  // while another one adds and removes them and mixes them
+  ErlNifMutex *lock;
+};
@@ -1,19 +1,56 @@
 #include "xav_decoder.h"
 #include "audio_converter.h"
 
+#include <limits.h>
+
 ErlNifResourceType *xav_decoder_resource_type;
 
+// growable array of frame terms
+struct FrameTerms {
+  ERL_NIF_TERM *terms;
+  int count;
+  int max;
+};
+
+struct DecodeJob {
+  struct XavDecoder *xav_decoder;
+  ErlNifPid pid;
+  // keeps the packet data alive and is used to build the reply
+  ErlNifEnv *env;
+  ERL_NIF_TERM data;
+  int pts;
+  int dts;
+};
+
 static int init_audio_converter(struct XavDecoder *xav_decoder);
 static int init_video_converter(struct XavDecoder *xav_decoder, AVFrame *frame);
-
-void free_frames(AVFrame **frames, int size) {
-  for (int i = 0; i < size; i++) {
-    av_frame_unref(frames[i]);
-  }
-}
+static char *get_options(ErlNifEnv *env, ERL_NIF_TERM options, struct XavDecoder *xav_decoder,
+                         struct CodecConfig *codec_config);
+static ERL_NIF_TERM video_frame_to_term(ErlNifEnv *env, struct XavDecoder *xav_decoder,
+                                        AVFrame *frame);
+static char *output_video_frame(ErlNifEnv *env, struct XavDecoder *xav_decoder, AVFrame *frame,
+                                ERL_NIF_TERM *frame_term);
+static char *convert(ErlNifEnv *env, struct XavDecoder *xav_decoder, AVFrame *frame,
+                     ERL_NIF_TERM *frame_term);
+static char *convert_outputs(ErlNifEnv *env, struct XavDecoder *xav_decoder, AVFrame *frame,
+                             ERL_NIF_TERM *frame_term);
+static char *read_audio_fifo(ErlNifEnv *env, struct XavDecoder *xav_decoder, AVFrame *frame,
+                             ERL_NIF_TERM *frame_term);
+static ERL_NIF_TERM frame_to_struct(ErlNifEnv *env, ERL_NIF_TERM frame_term);
+static ERL_NIF_TERM do_decode(ErlNifEnv *env, struct XavDecoder *xav_decoder, ErlNifBinary *data,
+                              int pts, int dts);
+static void frame_terms_init(struct FrameTerms *frames, int max);
+static void frame_terms_append(struct FrameTerms *frames, ERL_NIF_TERM term);
+static void append_frame_term(ErlNifEnv *env, struct XavDecoder *xav_decoder,
+                              struct FrameTerms *frames, ERL_NIF_TERM term);
+static char *decode_packet(ErlNifEnv *env, struct XavDecoder *xav_decoder, ErlNifBinary *data,
+                           int pts, int dts, struct FrameTerms *frames);
+static void run_decode_job(void *arg);
+static char *flush_frames(ErlNifEnv *env, struct XavDecoder *xav_decoder, int max,
+                          struct FrameTerms *frames, int *eof);
 
 ERL_NIF_TERM new (ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
-  if (argc != 7) {
+  if (argc != 8) {
     return xav_nif_raise(env, "invalid_arg_count");
   }
 
@@ -21,6 +58,7 @@ ERL_NIF_TERM new (ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
   char *codec_name = NULL;
   char *out_format = NULL;
   int channels;
+  struct CodecConfig codec_config;
 
   // resolve codec
   if (!xav_nif_get_atom(env, argv[0], &codec_name)) {
@@ -101,19 +139,96 @@ ERL_NIF_TERM new (ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
   xav_decoder->out_audio_fmt = out_audo_fmt;
   xav_decoder->out_sample_rate = out_sample_rate;
   xav_decoder->out_channels = out_channels;
+  xav_decoder->frame_size = 0;
+  xav_decoder->frame_overlap = 0;
+  xav_decoder->resampler_options = NULL;
+  xav_decoder->time_base = (AVRational){0, 0};
+  xav_decoder->fifo = NULL;
+  xav_decoder->levels = NULL;
+  xav_decoder->zero_copy = 0;
+  xav_decoder->planes = 0;
+  xav_decoder->tensor = NULL;
+  xav_decoder->batch_size = 0;
+  xav_decoder->batch = NULL;
+  xav_decoder->async_queue_size = 16;
+  xav_decoder->pooled = 0;
+  xav_decoder->converter_threads = 1;
+  xav_decoder->fast_path = 1;
+  xav_decoder->outputs.converters = NULL;
+  xav_decoder->outputs.count = 0;
+  xav_decoder->lock = NULL;
+  xav_decoder->queue = NULL;
+
+  codec_config_init(&codec_config);
+  char *reason = get_options(env, argv[7], xav_decoder, &codec_config);
+  if (reason != NULL) {
+    ret = xav_nif_raise(env, reason);
+    goto release;
+  }
+
+  if (xav_decoder->frame_size > 0 && codec->type != AVMEDIA_TYPE_AUDIO) {
+    ret = xav_nif_raise(env, "frame_size_requires_audio_codec");
+    goto release;
+  }
+
+  if (xav_decoder->frame_size > 0 && xav_decoder->frame_overlap >= xav_decoder->frame_size) {
+    ret = xav_nif_raise(env, "invalid_frame_overlap");
+    goto release;
+  }
+
+  if (xav_decoder->levels != NULL &&
+      (codec->type != AVMEDIA_TYPE_AUDIO || xav_decoder->frame_size > 0)) {
+    ret = xav_nif_raise(env, "invalid_levels");
+    goto release;
+  }
+
+  video_outputs_configure(&xav_decoder->outputs, xav_decoder->zero_copy,
+                          xav_decoder->converter_threads, xav_decoder->fast_path);
+
+  if (xav_decoder->batch_size > 0) {
+    xav_decoder->batch = batch_alloc(xav_decoder->batch_size, xav_decoder->tensor);
+    if (xav_decoder->batch == NULL) {
+      ret = xav_nif_raise(env, "failed_to_allocate_batch");
+      goto release;
+    }
+  }
 
-  xav_decoder->decoder = decoder_alloc();
-  if (xav_decoder->decoder == NULL) {
+  xav_decoder->lock = enif_mutex_create("xav_decoder_lock");
+  xav_decoder->queue = serial_queue_alloc(xav_decoder, xav_decoder->async_queue_size);
+  if (xav_decoder->lock == NULL || xav_decoder->queue == NULL) {
     ret = xav_nif_raise(env, "failed_to_allocate_decoder");
-    goto clean;
+    goto release;
   }
 
-  if (decoder_init(xav_decoder->decoder, codec, channels)) {
-    ret = xav_nif_raise(env, "failed_to_init_decoder");
-    goto clean;
+  if (xav_decoder->pooled) {
+    struct DecoderPoolKey *key = &xav_decoder->pool_key;
+    key->codec = codec;
+    key->channels = channels;
+    key->zero_copy = xav_decoder->zero_copy;
+    key->config = codec_config;
+
+    if (decoder_pool_checkout(key, &xav_decoder->decoder) < 0) {
+      ret = xav_nif_raise(env, "failed_to_init_decoder");
+      goto release;
+    }
+  } else {
+    xav_decoder->decoder = decoder_alloc();
+    if (xav_decoder->decoder == NULL) {
+      ret = xav_nif_raise(env, "failed_to_allocate_decoder");
+      goto release;
+    }
+
+    xav_decoder->decoder->zero_copy = xav_decoder->zero_copy;
+
+    if (decoder_init(xav_decoder->decoder, codec, channels, &codec_config)) {
+      ret = xav_nif_raise(env, "failed_to_init_decoder");
+      goto release;
+    }
   }
 
   ret = enif_make_resource(env, xav_decoder);
+
+release:
   enif_release_resource(xav_decoder);
 
 clean:
@@ -125,64 +240,122 @@ clean:
   return ret;
 }
 
-ERL_NIF_TERM convert(ErlNifEnv *env, struct XavDecoder *xav_decoder, AVFrame *frame) {
-  ERL_NIF_TERM frame_term;
+// Returns NULL on success or the reason of the failure.
+// Doesn't raise, as it is also called outside of NIF calls, from worker threads.
+static char *convert(ErlNifEnv *env, struct XavDecoder *xav_decoder, AVFrame *frame,
+                     ERL_NIF_TERM *frame_term) {
   int ret;
 
   if (xav_decoder->decoder->media_type == AVMEDIA_TYPE_VIDEO) {
     XAV_LOG_DEBUG("Converting video to RGB");
 
+    if (xav_decoder->outputs.count > 0) {
+      return convert_outputs(env, xav_decoder, frame, frame_term);
+    }
+
     // no pixel format conversion and no scaling
     if (xav_decoder->out_video_fmt == AV_PIX_FMT_NONE && xav_decoder->out_width == -1 &&
         xav_decoder->out_height == -1) {
-      return xav_nif_video_frame_to_term(env, frame);
+      return output_video_frame(env, xav_decoder, frame, frame_term);
     }
 
     if (xav_decoder->vc == NULL) {
       ret = init_video_converter(xav_decoder, frame);
       if (ret < 0) {
-        return xav_nif_raise(env, "failed_to_init_converter");
+        return "failed_to_init_converter";
       }
     }
 
     ret = video_converter_convert(xav_decoder->vc, frame);
     if (ret < 0) {
-      return xav_nif_raise(env, "failed_to_convert");
+      return "failed_to_convert";
     }
 
-    frame_term = xav_nif_video_frame_to_term(env, xav_decoder->vc->dst_frame);
+    return output_video_frame(env, xav_decoder, xav_decoder->vc->dst_frame, frame_term);
 
   } else if (xav_decoder->decoder->media_type == AVMEDIA_TYPE_AUDIO) {
     XAV_LOG_DEBUG("Converting audio to desired out format");
 
-    uint8_t **out_data;
-    int out_samples;
-    int out_size;
+    struct AudioLevels *levels = xav_decoder->levels;
+    if (levels != NULL && !levels->payload) {
+      *frame_term = audio_levels_frame_to_term(env, levels, frame, enif_make_atom(env, "nil"));
+      return NULL;
+    }
 
     if (xav_decoder->ac == NULL) {
       ret = init_audio_converter(xav_decoder);
       if (ret < 0) {
-        return xav_nif_raise(env, "failed_to_init_converter");
+        return "failed_to_init_converter";
       }
     }
 
-    ret = audio_converter_convert(xav_decoder->ac, frame, &out_data, &out_samples, &out_size);
+    if (xav_decoder->fifo != NULL) {
+      return read_audio_fifo(env, xav_decoder, frame, frame_term);
+    }
+
+    ErlNifBinary out_data[xav_decoder->ac->out_planes];
+    int out_samples;
+
+    ret = audio_converter_convert(xav_decoder->ac, frame, out_data, &out_samples);
     if (ret < 0) {
-      return xav_nif_raise(env, "failed_to_decode");
+      return "failed_to_decode";
     }
 
-    frame_term = xav_nif_audio_frame_to_term(env, out_data, out_samples, out_size,
-                                             xav_decoder->out_audio_fmt, frame->pts);
+    *frame_term = xav_nif_audio_frame_to_term(env, out_data, xav_decoder->ac->out_planes,
+                                              out_samples, xav_decoder->out_audio_fmt, frame->pts);
 
-    av_freep(&out_data[0]);
+    if (levels != NULL) {
+      *frame_term = audio_levels_frame_to_term(env, levels, frame, *frame_term);
+    }
   }
 
-  return frame_term;
+  return NULL;
 }
 
-ERL_NIF_TERM decode(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
-  ERL_NIF_TERM frame_term;
+// Converts a video frame to every output, the result is a list of frame terms.
+static char *convert_outputs(ErlNifEnv *env, struct XavDecoder *xav_decoder, AVFrame *frame,
+                             ERL_NIF_TERM *frame_term) {
+  struct VideoOutputs *outputs = &xav_decoder->outputs;
+
+  if (video_outputs_convert(outputs, frame) < 0) {
+    return "failed_to_convert";
+  }
+
+  *frame_term = enif_make_list(env, 0);
+  for (int i = outputs->count - 1; i >= 0; i--) {
+    ERL_NIF_TERM out_term =
+        video_frame_to_term(env, xav_decoder, outputs->converters[i]->dst_frame);
+    *frame_term = enif_make_list_cell(env, out_term, *frame_term);
+  }
+
+  return NULL;
+}
+
+// Writes an audio frame (or the samples delayed by the converter, when NULL) to the fifo
+// and reads all complete frames out of it. The result is a list of frame terms.
+// At the end of stream, the remaining samples are read as well.
+static char *read_audio_fifo(ErlNifEnv *env, struct XavDecoder *xav_decoder, AVFrame *frame,
+                             ERL_NIF_TERM *frame_term) {
+  if (audio_fifo_write(xav_decoder->fifo, xav_decoder->ac, frame) < 0) {
+    return "failed_to_convert";
+  }
+
+  ERL_NIF_TERM frames = enif_make_list(env, 0);
+  ERL_NIF_TERM out_term;
+  int ret;
+  while ((ret = audio_fifo_read(env, xav_decoder->fifo, frame == NULL, &out_term)) == 1) {
+    frames = enif_make_list_cell(env, out_term, frames);
+  }
+
+  if (ret < 0) {
+    return "failed_to_read_fifo";
+  }
 
+  enif_make_reverse_list(env, frames, frame_term);
+  return NULL;
+}
+
+ERL_NIF_TERM decode(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
   if (argc != 4) {
     return xav_nif_raise(env, "invalid_arg_count");
   }
@@ -207,8 +380,19 @@ ERL_NIF_TERM decode(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
     return xav_nif_raise(env, "couldnt_get_int");
   }
 
-  xav_decoder->decoder->pkt->data = data.data;
-  xav_decoder->decoder->pkt->size = data.size;
+  enif_mutex_lock(xav_decoder->lock);
+  ERL_NIF_TERM ret = do_decode(env, xav_decoder, &data, pts, dts);
+  enif_mutex_unlock(xav_decoder->lock);
+
+  return ret;
+}
+
+static ERL_NIF_TERM do_decode(ErlNifEnv *env, struct XavDecoder *xav_decoder, ErlNifBinary *data,
+                              int pts, int dts) {
+  ERL_NIF_TERM frame_term;
+
+  xav_decoder->decoder->pkt->data = data->data;
+  xav_decoder->decoder->pkt->size = data->size;
   xav_decoder->decoder->pkt->pts = pts;
   xav_decoder->decoder->pkt->dts = dts;
 
@@ -225,13 +409,128 @@ ERL_NIF_TERM decode(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
     return xav_nif_raise(env, "failed_to_decode");
   }
 
-  frame_term = convert(env, xav_decoder, xav_decoder->decoder->frame);
+  char *reason = convert(env, xav_decoder, xav_decoder->decoder->frame, &frame_term);
 
   decoder_free_frame(xav_decoder->decoder);
 
+  if (reason != NULL) {
+    return xav_nif_raise(env, reason);
+  }
+
+  // the frame went into a batch or the audio fifo, which are not complete yet
+  if (enif_is_atom(env, frame_term) || enif_is_empty_list(env, frame_term)) {
+    return enif_make_atom(env, "ok");
+  }
+
   return xav_nif_ok(env, frame_term);
 }
 
+ERL_NIF_TERM decode_many(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 2) {
+    return xav_nif_raise(env, "invalid_arg_count");
+  }
+
+  struct XavDecoder *xav_decoder;
+  if (!enif_get_resource(env, argv[0], xav_decoder_resource_type, (void **)&xav_decoder)) {
+    return xav_nif_raise(env, "couldnt_get_decoder_resource");
+  }
+
+  unsigned int packets_count;
+  if (!enif_get_list_length(env, argv[1], &packets_count)) {
+    return xav_nif_raise(env, "couldnt_get_list");
+  }
+
+  ERL_NIF_TERM ret;
+
+  // Most packets produce exactly one frame so start with that
+  // and grow when a packet produces more.
+  struct FrameTerms frames;
+  frame_terms_init(&frames, packets_count);
+
+  enif_mutex_lock(xav_decoder->lock);
+
+  ERL_NIF_TERM list = argv[1];
+  ERL_NIF_TERM packet_term;
+  while (enif_get_list_cell(env, list, &packet_term, &list)) {
+    const ERL_NIF_TERM *packet;
+    int arity;
+    if (!enif_get_tuple(env, packet_term, &arity, &packet) || arity != 3) {
+      ret = xav_nif_raise(env, "invalid_packet");
+      goto clean;
+    }
+
+    ErlNifBinary data;
+    if (!enif_inspect_binary(env, packet[0], &data)) {
+      ret = xav_nif_raise(env, "couldnt_inspect_binary");
+      goto clean;
+    }
+
+    int pts, dts;
+    if (!enif_get_int(env, packet[1], &pts) || !enif_get_int(env, packet[2], &dts)) {
+      ret = xav_nif_raise(env, "couldnt_get_int");
+      goto clean;
+    }
+
+    char *reason = decode_packet(env, xav_decoder, &data, pts, dts, &frames);
+    if (reason != NULL && strcmp(reason, "no_keyframe") == 0) {
+      ret = xav_nif_error(env, reason);
+      goto clean;
+    } else if (reason != NULL) {
+      ret = xav_nif_raise(env, reason);
+      goto clean;
+    }
+  }
+
+  ret = xav_nif_ok(env, enif_make_list_from_array(env, frames.terms, frames.count));
+
+clean:
+  enif_mutex_unlock(xav_decoder->lock);
+  XAV_FREE(frames.terms);
+
+  return ret;
+}
+
+ERL_NIF_TERM decode_async(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 4) {
+    return xav_nif_raise(env, "invalid_arg_count");
+  }
+
+  struct XavDecoder *xav_decoder;
+  if (!enif_get_resource(env, argv[0], xav_decoder_resource_type, (void **)&xav_decoder)) {
+    return xav_nif_raise(env, "couldnt_get_decoder_resource");
+  }
+
+  if (!enif_is_binary(env, argv[1])) {
+    return xav_nif_raise(env, "couldnt_inspect_binary");
+  }
+
+  struct DecodeJob *job = XAV_ALLOC(sizeof(struct DecodeJob));
+  job->xav_decoder = xav_decoder;
+  enif_self(env, &job->pid);
+
+  if (!enif_get_int(env, argv[2], &job->pts) || !enif_get_int(env, argv[3], &job->dts)) {
+    XAV_FREE(job);
+    return xav_nif_raise(env, "couldnt_get_int");
+  }
+
+  // Refc binaries are not copied, only referenced from the job env.
+  job->env = enif_alloc_env();
+  job->data = enif_make_copy(job->env, argv[1]);
+
+  int ret = serial_queue_push(xav_decoder->queue, run_decode_job, job);
+  if (ret == -1) {
+    enif_free_env(job->env);
+    XAV_FREE(job);
+    return xav_nif_error(env, "queue_full");
+  } else if (ret < 0) {
+    enif_free_env(job->env);
+    XAV_FREE(job);
+    return xav_nif_raise(env, "failed_to_start_worker_pool");
+  }
+
+  return enif_make_atom(env, "ok");
+}
+
 ERL_NIF_TERM flush(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
   if (argc != 1) {
     return xav_nif_raise(env, "invalid_arg_count");
@@ -242,27 +541,63 @@ ERL_NIF_TERM flush(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
     return xav_nif_raise(env, "couldnt_get_decoder_resource");
   }
 
-  AVFrame *frames[MAX_FLUSH_BUFFER];
-  int frames_count = 0;
+  ERL_NIF_TERM ret;
+  struct FrameTerms frames;
+  frame_terms_init(&frames, 1);
+  int eof;
+
+  enif_mutex_lock(xav_decoder->lock);
+  char *reason = flush_frames(env, xav_decoder, INT_MAX, &frames, &eof);
+  enif_mutex_unlock(xav_decoder->lock);
+
+  if (reason != NULL && strcmp(reason, "failed_to_flush") == 0) {
+    ret = xav_nif_error(env, reason);
+  } else if (reason != NULL) {
+    ret = xav_nif_raise(env, reason);
+  } else {
+    ret = xav_nif_ok(env, enif_make_list_from_array(env, frames.terms, frames.count));
+  }
+
+  XAV_FREE(frames.terms);
+  return ret;
+}
 
-  for (int i = 0; i < MAX_FLUSH_BUFFER; i++) {
-    frames[i] = av_frame_alloc();
+ERL_NIF_TERM flush_next(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 2) {
+    return xav_nif_raise(env, "invalid_arg_count");
   }
 
-  int ret = decoder_flush(xav_decoder->decoder, frames, &frames_count);
-  if (ret < 0) {
-    free_frames(frames, MAX_FLUSH_BUFFER);
-    return xav_nif_error(env, "failed_to_flush");
+  struct XavDecoder *xav_decoder;
+  if (!enif_get_resource(env, argv[0], xav_decoder_resource_type, (void **)&xav_decoder)) {
+    return xav_nif_raise(env, "couldnt_get_decoder_resource");
   }
 
-  ERL_NIF_TERM frame_terms[frames_count];
-  for (int i = 0; i < frames_count; i++) {
-    frame_terms[i] = convert(env, xav_decoder, frames[i]);
+  int max_frames;
+  if (!enif_get_int(env, argv[1], &max_frames) || max_frames < 1) {
+    return xav_nif_raise(env, "invalid_max_frames");
   }
 
-  free_frames(frames, MAX_FLUSH_BUFFER);
+  ERL_NIF_TERM ret;
+  struct FrameTerms frames;
+  // max_frames is only an upper bound, so don't preallocate all of it
+  frame_terms_init(&frames, max_frames < 16 ? max_frames : 16);
+  int eof;
+
+  enif_mutex_lock(xav_decoder->lock);
+  char *reason = flush_frames(env, xav_decoder, max_frames, &frames, &eof);
+  enif_mutex_unlock(xav_decoder->lock);
+
+  if (reason != NULL && strcmp(reason, "failed_to_flush") == 0) {
+    ret = xav_nif_error(env, reason);
+  } else if (reason != NULL) {
+    ret = xav_nif_raise(env, reason);
+  } else {
+    ERL_NIF_TERM list = enif_make_list_from_array(env, frames.terms, frames.count);
+    ret = enif_make_tuple2(env, enif_make_atom(env, eof ? "eof" : "ok"), list);
+  }
 
-  return xav_nif_ok(env, enif_make_list_from_array(env, frame_terms, frames_count));
+  XAV_FREE(frames.terms);
+  return ret;
 }
 
 ERL_NIF_TERM pixel_formats(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
@@ -323,6 +658,386 @@ ERL_NIF_TERM list_decoders(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
   return result;
 }
 
+static void frame_terms_init(struct FrameTerms *frames, int max) {
+  frames->max = max > 0 ? max : 1;
+  frames->count = 0;
+  frames->terms = XAV_ALLOC(sizeof(ERL_NIF_TERM) * frames->max);
+}
+
+static void frame_terms_append(struct FrameTerms *frames, ERL_NIF_TERM term) {
+  if (frames->count == frames->max) {
+    frames->max *= 2;
+    frames->terms = XAV_REALLOC(frames->terms, sizeof(ERL_NIF_TERM) * frames->max);
+  }
+
+  frames->terms[frames->count++] = term;
+}
+
+// Appends a converted frame term, skipping batches that are not complete yet.
+// Audio frames read out of the fifo come as a list and are appended one by one.
+static void append_frame_term(ErlNifEnv *env, struct XavDecoder *xav_decoder,
+                              struct FrameTerms *frames, ERL_NIF_TERM term) {
+  if (enif_is_atom(env, term)) {
+    return;
+  }
+
+  if (xav_decoder->fifo == NULL) {
+    frame_terms_append(frames, term);
+    return;
+  }
+
+  ERL_NIF_TERM head;
+  while (enif_get_list_cell(env, term, &head, &term)) {
+    frame_terms_append(frames, head);
+  }
+}
+
+// Sends a packet to the decoder and converts every frame it produced.
+// Returns NULL on success or the reason of the failure.
+static char *decode_packet(ErlNifEnv *env, struct XavDecoder *xav_decoder, ErlNifBinary *data,
+                           int pts, int dts, struct FrameTerms *frames) {
+  struct Decoder *decoder = xav_decoder->decoder;
+
+  decoder->pkt->data = data->data;
+  decoder->pkt->size = data->size;
+  decoder->pkt->pts = pts;
+  decoder->pkt->dts = dts;
+
+  if (decoder_send_packet(decoder, decoder->pkt) != 0) {
+    decoder_free_frame(decoder);
+    return "no_keyframe";
+  }
+
+  // drain every frame the packet produced
+  int ret;
+  while ((ret = decoder_receive_frame(decoder, decoder->frame)) == 0) {
+    ERL_NIF_TERM frame_term;
+    char *reason = convert(env, xav_decoder, decoder->frame, &frame_term);
+    decoder_free_frame(decoder);
+
+    if (reason != NULL) {
+      return reason;
+    }
+
+    append_frame_term(env, xav_decoder, frames, frame_term);
+  }
+
+  decoder_free_frame(decoder);
+
+  if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+    return "failed_to_decode";
+  }
+
+  return NULL;
+}
+
+// Drains up to `max` frames buffered in the decoder, converting them one by one,
+// so that only a single decoded frame is kept at a time.
+// Sets `eof` when there are no more frames - the decoder is reset then.
+static char *flush_frames(ErlNifEnv *env, struct XavDecoder *xav_decoder, int max,
+                          struct FrameTerms *frames, int *eof) {
+  struct Decoder *decoder = xav_decoder->decoder;
+  *eof = 0;
+
+  while (frames->count < max) {
+    ERL_NIF_TERM frame_term;
+    int ret = decoder_flush(decoder, decoder->frame);
+    if (ret == AVERROR_EOF) {
+      // the last, possibly incomplete batch
+      if (xav_decoder->batch != NULL && batch_flush(env, xav_decoder->batch, &frame_term)) {
+        frame_terms_append(frames, frame_term);
+      }
+
+      // samples delayed by the converter and the last, padded frame
+      if (xav_decoder->fifo != NULL) {
+        char *reason = read_audio_fifo(env, xav_decoder, NULL, &frame_term);
+        audio_fifo_reset(xav_decoder->fifo);
+        if (reason != NULL) {
+          return reason;
+        }
+        append_frame_term(env, xav_decoder, frames, frame_term);
+      }
+
+      if (xav_decoder->levels != NULL) {
+        audio_levels_reset(xav_decoder->levels);
+      }
+
+      *eof = 1;
+      return NULL;
+    } else if (ret < 0) {
+      return "failed_to_flush";
+    }
+
+    char *reason = convert(env, xav_decoder, decoder->frame, &frame_term);
+    decoder_free_frame(decoder);
+
+    if (reason != NULL) {
+      decoder_reset(decoder);
+      if (xav_decoder->batch != NULL) {
+        batch_reset(xav_decoder->batch);
+      }
+      if (xav_decoder->fifo != NULL) {
+        audio_fifo_reset(xav_decoder->fifo);
+      }
+      return reason;
+    }
+
+    append_frame_term(env, xav_decoder, frames, frame_term);
+  }
+
+  return NULL;
+}
+
+// Runs on a worker pool thread.
+static void run_decode_job(void *arg) {
+  struct DecodeJob *job = (struct DecodeJob *)arg;
+  struct XavDecoder *xav_decoder = job->xav_decoder;
+  ErlNifEnv *env = job->env;
+
+  ErlNifBinary data;
+  enif_inspect_binary(env, job->data, &data);
+
+  struct FrameTerms frames;
+  frame_terms_init(&frames, 1);
+
+  enif_mutex_lock(xav_decoder->lock);
+  char *reason = decode_packet(env, xav_decoder, &data, job->pts, job->dts, &frames);
+  enif_mutex_unlock(xav_decoder->lock);
+
+  ERL_NIF_TERM result;
+  if (reason == NULL) {
+    ERL_NIF_TERM list = enif_make_list(env, 0);
+    for (int i = frames.count - 1; i >= 0; i--) {
+      const ERL_NIF_TERM *elems;
+      int arity;
+      int samples;
+
+      // Sometimes, audio converter might not return data immediately.
+      if (enif_get_tuple(env, frames.terms[i], &arity, &elems) &&
+          (arity == 4 || (arity == 5 && enif_is_map(env, elems[4]))) &&
+          enif_get_int(env, elems[2], &samples) && samples == 0) {
+        continue;
+      }
+
+      list = enif_make_list_cell(env, frame_to_struct(env, frames.terms[i]), list);
+    }
+
+    result = xav_nif_ok(env, list);
+  } else {
+    result = xav_nif_error(env, reason);
+  }
+
+  ERL_NIF_TERM msg = enif_make_tuple3(env, enif_make_atom(env, "xav_decoder"),
+                                      enif_make_resource(env, xav_decoder), result);
+  enif_send(NULL, &job->pid, env, msg);
+
+  XAV_FREE(frames.terms);
+  enif_free_env(env);
+  XAV_FREE(job);
+}
+
+// Builds an %Xav.Frame{} out of a frame term, a list of them out of the output renditions,
+// or an %Xav.Batch{} out of a batch term.
+static ERL_NIF_TERM frame_to_struct(ErlNifEnv *env, ERL_NIF_TERM frame_term) {
+  ERL_NIF_TERM batch;
+  if (xav_nif_batch_to_struct(env, frame_term, &batch)) {
+    return batch;
+  }
+
+  if (!enif_is_list(env, frame_term)) {
+    return xav_nif_frame_to_struct(env, frame_term);
+  }
+
+  ERL_NIF_TERM frames = enif_make_list(env, 0);
+  ERL_NIF_TERM head;
+  while (enif_get_list_cell(env, frame_term, &head, &frame_term)) {
+    frames = enif_make_list_cell(env, xav_nif_frame_to_struct(env, head), frames);
+  }
+
+  ERL_NIF_TERM reversed;
+  enif_make_reverse_list(env, frames, &reversed);
+  return reversed;
+}
+
+static ERL_NIF_TERM video_frame_to_term(ErlNifEnv *env, struct XavDecoder *xav_decoder,
+                                        AVFrame *frame) {
+  if (xav_decoder->tensor != NULL) {
+    return xav_nif_tensor_frame_to_term(env, xav_decoder->tensor, frame);
+  }
+
+  if (xav_decoder->planes) {
+    return xav_nif_video_frame_to_planes_term(env, frame, xav_decoder->zero_copy);
+  }
+
+  if (xav_decoder->zero_copy) {
+    return xav_nif_video_frame_ref_to_term(env, frame);
+  }
+
+  return xav_nif_video_frame_to_term(env, frame);
+}
+
+static char *output_video_frame(ErlNifEnv *env, struct XavDecoder *xav_decoder, AVFrame *frame,
+                                ERL_NIF_TERM *frame_term) {
+  if (xav_decoder->batch == NULL) {
+    *frame_term = video_frame_to_term(env, xav_decoder, frame);
+    return NULL;
+  }
+
+  int ret = batch_push(env, xav_decoder->batch, frame, frame_term);
+  if (ret < 0) {
+    return "failed_to_batch_frame";
+  } else if (ret == 0) {
+    *frame_term = enif_make_atom(env, "nil");
+  }
+
+  return NULL;
+}
+
+ERL_NIF_TERM prewarm(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 4) {
+    return xav_nif_raise(env, "invalid_arg_count");
+  }
+
+  char *codec_name;
+  if (!xav_nif_get_atom(env, argv[0], &codec_name)) {
+    return xav_nif_raise(env, "failed_to_get_atom");
+  }
+
+  const AVCodec *codec = avcodec_find_decoder_by_name(codec_name);
+  XAV_FREE(codec_name);
+  if (codec == NULL) {
+    return xav_nif_raise(env, "unknown_codec");
+  }
+
+  struct DecoderPoolKey key;
+  key.codec = codec;
+
+  int count;
+  if (!enif_get_int(env, argv[1], &key.channels) || !enif_get_int(env, argv[2], &count)) {
+    return xav_nif_raise(env, "failed_to_get_int");
+  }
+
+  // only the codec options and zero_copy matter here
+  struct XavDecoder options = {0};
+  codec_config_init(&key.config);
+  char *reason = get_options(env, argv[3], &options, &key.config);
+  video_outputs_free(&options.outputs);
+  tensor_free(&options.tensor);
+  audio_levels_free(&options.levels);
+  av_dict_free(&options.resampler_options);
+  if (reason != NULL) {
+    return xav_nif_raise(env, reason);
+  }
+  key.zero_copy = options.zero_copy;
+
+  int added = decoder_pool_prewarm(&key, count);
+  if (added < 0) {
+    return xav_nif_raise(env, "failed_to_init_decoder");
+  }
+
+  return enif_make_int(env, added);
+}
+
+ERL_NIF_TERM set_pool_size(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 1) {
+    return xav_nif_raise(env, "invalid_arg_count");
+  }
+
+  int size;
+  if (!enif_get_int(env, argv[0], &size) || size < 0) {
+    return xav_nif_raise(env, "invalid_pool_size");
+  }
+
+  decoder_pool_set_max_idle(size);
+  return enif_make_atom(env, "ok");
+}
+
+ERL_NIF_TERM pool_stats(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  struct DecoderPoolStats stats;
+  decoder_pool_get_stats(&stats);
+
+  ERL_NIF_TERM keys[] = {enif_make_atom(env, "hits"),  enif_make_atom(env, "misses"),
+                         enif_make_atom(env, "opens"), enif_make_atom(env, "open_time_us"),
+                         enif_make_atom(env, "idle"),  enif_make_atom(env, "max_idle")};
+  ERL_NIF_TERM values[] = {enif_make_uint64(env, stats.hits),
+                           enif_make_uint64(env, stats.misses),
+                           enif_make_uint64(env, stats.opens),
+                           enif_make_uint64(env, stats.open_time_us),
+                           enif_make_int(env, stats.idle),
+                           enif_make_int(env, stats.max_idle)};
+
+  ERL_NIF_TERM map;
+  enif_make_map_from_arrays(env, keys, values, 6, &map);
+  return map;
+}
+
+static char *get_options(ErlNifEnv *env, ERL_NIF_TERM options, struct XavDecoder *xav_decoder,
+                         struct CodecConfig *codec_config) {
+  if (!enif_is_map(env, options)) {
+    return "failed_to_get_map";
+  }
+
+  ErlNifMapIterator iter;
+  ERL_NIF_TERM key, value;
+  char key_name[32];
+  char *reason = NULL;
+
+  enif_map_iterator_create(env, options, &iter, ERL_NIF_MAP_ITERATOR_FIRST);
+
+  while (reason == NULL && enif_map_iterator_get_pair(env, &iter, &key, &value)) {
+    int ret = -1;
+    if (!enif_get_atom(env, key, key_name, sizeof(key_name), ERL_NIF_LATIN1)) {
+      reason = "failed_to_get_map_key";
+    } else if (strcmp(key_name, "zero_copy") == 0) {
+      ret = xav_nif_get_bool(env, value, &xav_decoder->zero_copy);
+    } else if (strcmp(key_name, "frame_layout") == 0) {
+      ret = xav_nif_get_frame_layout(env, value, &xav_decoder->planes);
+    } else if (strcmp(key_name, "outputs") == 0) {
+      ret = xav_nif_get_video_outputs(env, value, &xav_decoder->outputs);
+    } else if (strcmp(key_name, "tensor") == 0) {
+      ret = xav_nif_get_tensor(env, value, &xav_decoder->tensor);
+    } else if (strcmp(key_name, "frame_size") == 0) {
+      ret = enif_get_int(env, value, &xav_decoder->frame_size) && xav_decoder->frame_size > 0;
+    } else if (strcmp(key_name, "resampler") == 0) {
+      av_dict_free(&xav_decoder->resampler_options);
+      ret = xav_nif_get_resampler_options(env, value, &xav_decoder->resampler_options);
+    } else if (strcmp(key_name, "levels") == 0) {
+      audio_levels_free(&xav_decoder->levels);
+      ret = xav_nif_get_audio_levels(env, value, &xav_decoder->levels);
+    } else if (strcmp(key_name, "frame_overlap") == 0) {
+      ret = enif_get_int(env, value, &xav_decoder->frame_overlap) &&
+            xav_decoder->frame_overlap >= 0;
+    } else if (strcmp(key_name, "time_base") == 0) {
+      ret = xav_nif_get_rational(env, value, &xav_decoder->time_base);
+    } else if (strcmp(key_name, "batch_size") == 0) {
+      ret = enif_get_int(env, value, &xav_decoder->batch_size) && xav_decoder->batch_size > 0;
+    } else if (strcmp(key_name, "converter_threads") == 0) {
+      ret = enif_get_int(env, value, &xav_decoder->converter_threads);
+    } else if (strcmp(key_name, "fast_path") == 0) {
+      ret = xav_nif_get_bool(env, value, &xav_decoder->fast_path);
+    } else if (strcmp(key_name, "pooled") == 0) {
+      ret = xav_nif_get_bool(env, value, &xav_decoder->pooled);
+    } else if (strcmp(key_name, "async_queue_size") == 0) {
+      ret = enif_get_int(env, value, &xav_decoder->async_queue_size) &&
+            xav_decoder->async_queue_size > 0;
+    } else {
+      ret = xav_nif_get_codec_config(env, key_name, value, codec_config);
+    }
+
+    if (ret == -1 && reason == NULL) {
+      reason = "unknown_config_key";
+    } else if (ret == 0) {
+      reason = "couldnt_read_value";
+    }
+
+    enif_map_iterator_next(env, &iter);
+  }
+
+  enif_map_iterator_destroy(env, &iter);
+
+  return reason;
+}
+
 static int init_audio_converter(struct XavDecoder *xav_decoder) {
   xav_decoder->ac = audio_converter_alloc();
 
@@ -355,9 +1070,25 @@ static int init_audio_converter(struct XavDecoder *xav_decoder) {
     xav_set_default_channel_layout(&out_chlayout, xav_decoder->out_channels);
   }
 
-  return audio_converter_init(xav_decoder->ac, in_chlayout, xav_decoder->decoder->c->sample_rate,
-                              xav_decoder->decoder->c->sample_fmt, out_chlayout, out_sample_rate,
-                              xav_decoder->out_audio_fmt);
+  int ret =
+      audio_converter_init(xav_decoder->ac, in_chlayout, xav_decoder->decoder->c->sample_rate,
+                           xav_decoder->decoder->c->sample_fmt, out_chlayout, out_sample_rate,
+                           xav_decoder->out_audio_fmt, xav_decoder->resampler_options);
+  if (ret < 0 || xav_decoder->frame_size == 0) {
+    return ret;
+  }
+
+  AVRational time_base = xav_decoder->time_base;
+  if (time_base.num == 0) {
+    time_base = (AVRational){1, xav_decoder->decoder->c->sample_rate};
+  }
+
+  xav_decoder->fifo = audio_fifo_alloc(xav_decoder->frame_size, xav_decoder->frame_overlap);
+  if (xav_decoder->fifo == NULL) {
+    return -1;
+  }
+
+  return audio_fifo_init(xav_decoder->fifo, xav_decoder->ac, time_base);
 }
 
 static int init_video_converter(struct XavDecoder *xav_decoder, AVFrame *frame) {
@@ -371,6 +1102,10 @@ static int init_video_converter(struct XavDecoder *xav_decoder, AVFrame *frame)
   if (out_format == AV_PIX_FMT_NONE)
     out_format = frame->format;
 
+  xav_decoder->vc->zero_copy = xav_decoder->zero_copy;
+  xav_decoder->vc->threads = xav_decoder->converter_threads;
+  xav_decoder->vc->fast_path = xav_decoder->fast_path;
+
   return video_converter_init(xav_decoder->vc, frame->width, frame->height, frame->format,
                               xav_decoder->out_width, xav_decoder->out_height, out_format);
 }
@@ -378,7 +1113,10 @@ static int init_video_converter(struct XavDecoder *xav_decoder, AVFrame *frame)
 void free_xav_decoder(ErlNifEnv *env, void *obj) {
   XAV_LOG_DEBUG("Freeing XavDecoder object");
   struct XavDecoder *xav_decoder = (struct XavDecoder *)obj;
-  if (xav_decoder->decoder != NULL) {
+  if (xav_decoder->decoder != NULL && xav_decoder->pooled) {
+    decoder_pool_checkin(&xav_decoder->pool_key, xav_decoder->decoder);
+    xav_decoder->decoder = NULL;
+  } else if (xav_decoder->decoder != NULL) {
     decoder_free(&xav_decoder->decoder);
   }
 
@@ -389,19 +1127,58 @@ void free_xav_decoder(ErlNifEnv *env, void *obj) {
   if (xav_decoder->vc != NULL) {
     video_converter_free(&xav_decoder->vc);
   }
+
+  audio_fifo_free(&xav_decoder->fifo);
+  audio_levels_free(&xav_decoder->levels);
+  av_dict_free(&xav_decoder->resampler_options);
+  video_outputs_free(&xav_decoder->outputs);
+  batch_free(&xav_decoder->batch);
+  tensor_free(&xav_decoder->tensor);
+
+  if (xav_decoder->queue != NULL) {
+    serial_queue_free(&xav_decoder->queue);
+  }
+
+  if (xav_decoder->lock != NULL) {
+    enif_mutex_destroy(xav_decoder->lock);
+  }
 }
 
-static ErlNifFunc xav_funcs[] = {{"new", 7, new},
+static ErlNifFunc xav_funcs[] = {{"new", 8, new},
                                  {"decode", 4, decode, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+                                 {"decode_many", 2, decode_many, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+                                 {"decode_async", 4, decode_async},
                                  {"flush", 1, flush, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+                                 {"flush_next", 2, flush_next, ERL_NIF_DIRTY_JOB_CPU_BOUND},
                                  {"pixel_formats", 0, pixel_formats},
                                  {"sample_formats", 0, sample_formats},
-                                 {"list_decoders", 0, list_decoders}};
+                                 {"list_decoders", 0, list_decoders},
+                                 {"prewarm", 4, prewarm, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+                                 {"set_pool_size", 1, set_pool_size},
+                                 {"pool_stats", 0, pool_stats}};
 
 static int load(ErlNifEnv *env, void **priv, ERL_NIF_TERM load_info) {
   xav_decoder_resource_type =
       enif_open_resource_type(env, NULL, "XavDecoder", free_xav_decoder, ERL_NIF_RT_CREATE, NULL);
-  return 0;
+
+  if (xav_nif_open_frame_resource_type(env) < 0) {
+    return -1;
+  }
+
+  if (thread_budget_load(env, load_info) < 0) {
+    return -1;
+  }
+
+  if (decoder_pool_init() < 0) {
+    return -1;
+  }
+
+  return worker_pool_init();
+}
+
+static void unload(ErlNifEnv *env, void *priv) {
+  worker_pool_destroy();
+  decoder_pool_destroy();
 }
 
-ERL_NIF_INIT(Elixir.Xav.Decoder.NIF, xav_funcs, &load, NULL, NULL, NULL);
+ERL_NIF_INIT(Elixir.Xav.Decoder.NIF, xav_funcs, &load, NULL, NULL, &unload);
@@ -1,6 +1,11 @@
 #include "audio_converter.h"
-#include "decoder.h"
-#include "video_converter.h"
+#include "audio_fifo.h"
+#include "audio_levels.h"
+#include "batch.h"
+#include "decoder_pool.h"
+#include "tensor.h"
+#include "video_outputs.h"
+#include "worker_pool.h"
 
 #include <libavutil/pixfmt.h>
 
@@ -11,9 +16,40 @@ struct XavDecoder {
   enum AVPixelFormat out_video_fmt;
   int out_width;
   int out_height;
+  int converter_threads;
+  int fast_path;
+  // when set, every frame is converted to all of the outputs instead of using vc
+  struct VideoOutputs outputs;
   // Audio params
   struct AudioConverter *ac;
   enum AVSampleFormat out_audio_fmt;
   int out_sample_rate;
   int out_channels;
+  // swresample options set on top of the defaults, NULL when there are none
+  AVDictionary *resampler_options;
+  // return audio frames of exactly `frame_size` samples, 0 when disabled
+  int frame_size;
+  int frame_overlap;
+  // time base of audio packets' pts, {0, 0} for 1 / sample rate
+  AVRational time_base;
+  struct AudioFifo *fifo;
+  // return audio frames with their levels, NULL when disabled
+  struct AudioLevels *levels;
+  // return video frames as resource binaries instead of copying them
+  int zero_copy;
+  // return video frames as a list of planes, keeping their linesizes
+  int planes;
+  // return video frames as normalized float tensors, NULL when disabled
+  struct Tensor *tensor;
+  // stack video frames into batches of `batch_size` frames, NULL when disabled
+  int batch_size;
+  struct Batch *batch;
+  // Serializes access to the decoder between
+  // the NIF calls and the async decode jobs.
+  ErlNifMutex *lock;
+  struct SerialQueue *queue;
+  int async_queue_size;
+  // whether the decoder is taken from and returned to the decoder pool
+  int pooled;
+  struct DecoderPoolKey pool_key;
 };
\ No newline at end of file
@@ -3,7 +3,20 @@
 
 ErlNifResourceType *xav_encoder_resource_type;
 
+struct EncodeJob {
+  struct XavEncoder *xav_encoder;
+  ErlNifPid pid;
+  // keeps the frame data alive and is used to build the reply
+  ErlNifEnv *env;
+  ERL_NIF_TERM data;
+  ERL_NIF_TERM linesizes;
+  int pts;
+};
+
+static char *fill_frame(ErlNifEnv *, struct XavEncoder *, ERL_NIF_TERM, ERL_NIF_TERM, int);
+static void run_encode_job(void *);
 static ERL_NIF_TERM packets_to_term(ErlNifEnv *, struct Encoder *);
+static ERL_NIF_TERM packet_to_struct(ErlNifEnv *, ERL_NIF_TERM);
 static int get_profile(enum AVCodecID, const char *);
 static ERL_NIF_TERM codec_get_profiles(ErlNifEnv *, const AVCodec *);
 static ERL_NIF_TERM codec_get_sample_formats(ErlNifEnv *, const AVCodec *);
@@ -23,6 +36,10 @@ ERL_NIF_TERM new (ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
   char *codec_name = NULL, *format = NULL, *profile = NULL;
   char *channel_layout = NULL;
   int codec_id = 0;
+  // validated once the codec is known
+  ERL_NIF_TERM options = enif_make_list(env, 0);
+  int async_queue_size = 16;
+  struct XavEncoder *xav_encoder = NULL;
 
   ErlNifMapIterator iter;
   ERL_NIF_TERM key, value;
@@ -67,6 +84,13 @@ ERL_NIF_TERM new (ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
       err = enif_get_int(env, value, &encoder_config.sample_rate);
     } else if (strcmp(config_name, "channel_layout") == 0) {
       err = xav_nif_get_string(env, value, &channel_layout);
+    } else if (strcmp(config_name, "options") == 0) {
+      options = value;
+      err = enif_is_list(env, value);
+    } else if (strcmp(config_name, "realtime") == 0) {
+      err = xav_nif_get_bool(env, value, &encoder_config.realtime);
+    } else if (strcmp(config_name, "async_queue_size") == 0) {
+      err = enif_get_int(env, value, &async_queue_size) && async_queue_size > 0;
     } else {
       ret = xav_nif_raise(env, "unknown_config_key");
       goto clean;
@@ -91,6 +115,12 @@ ERL_NIF_TERM new (ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
     goto clean;
   }
 
+  const AVClass *classes[] = {avcodec_get_class(), encoder_config.codec->priv_class};
+  if (!xav_nif_get_av_options(env, options, classes, 2, &encoder_config.options)) {
+    ret = xav_nif_raise(env, "invalid_options");
+    goto clean;
+  }
+
   if (encoder_config.codec->type == AVMEDIA_TYPE_VIDEO) {
     encoder_config.format = av_get_pix_fmt(format);
     if (encoder_config.format == AV_PIX_FMT_NONE) {
@@ -118,8 +148,13 @@ ERL_NIF_TERM new (ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
     }
   }
 
-  struct XavEncoder *xav_encoder =
-      enif_alloc_resource(xav_encoder_resource_type, sizeof(struct XavEncoder));
+  xav_encoder = enif_alloc_resource(xav_encoder_resource_type, sizeof(struct XavEncoder));
+  // everything is set before the first failure, so that the destructor can run
+  xav_encoder->encoder = NULL;
+  xav_encoder->frame = NULL;
+  xav_encoder->lock = NULL;
+  xav_encoder->queue = NULL;
+  xav_encoder->async_queue_size = async_queue_size;
 
   xav_encoder->encoder = encoder_alloc();
   if (encoder_init(xav_encoder->encoder, &encoder_config) < 0) {
@@ -129,6 +164,13 @@ ERL_NIF_TERM new (ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
 
   xav_encoder->frame = av_frame_alloc();
 
+  xav_encoder->lock = enif_mutex_create("xav_encoder_lock");
+  xav_encoder->queue = serial_queue_alloc(xav_encoder, xav_encoder->async_queue_size);
+  if (xav_encoder->frame == NULL || xav_encoder->lock == NULL || xav_encoder->queue == NULL) {
+    ret = xav_nif_raise(env, "failed_to_allocate_encoder");
+    goto clean;
+  }
+
   if (encoder_config.codec->type == AVMEDIA_TYPE_AUDIO) {
     xav_encoder->frame->format = encoder_config.format;
     xav_encoder->frame->nb_samples = xav_encoder->encoder->c->frame_size;
@@ -149,9 +191,11 @@ ERL_NIF_TERM new (ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
   }
 
   ret = enif_make_resource(env, xav_encoder);
-  enif_release_resource(xav_encoder);
 
 clean:
+  // on failure, this frees the encoder through its destructor
+  if (xav_encoder != NULL)
+    enif_release_resource(xav_encoder);
   if (codec_name)
     XAV_FREE(codec_name);
   if (format)
@@ -162,15 +206,14 @@ clean:
     XAV_FREE(profile);
   if (channel_layout)
     XAV_FREE(channel_layout);
+  av_dict_free(&encoder_config.options);
   enif_map_iterator_destroy(env, &iter);
 
   return ret;
 }
 
 ERL_NIF_TERM encode(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
-  int ret;
-
-  if (argc != 3) {
+  if (argc != 4) {
     return xav_nif_raise(env, "invalid_arg_count");
   }
 
@@ -179,47 +222,61 @@ ERL_NIF_TERM encode(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
     return xav_nif_raise(env, "invalid_resource");
   }
 
-  ErlNifBinary input;
-  if (!enif_inspect_binary(env, argv[1], &input)) {
-    return xav_nif_raise(env, "failed_to_inspect_binary");
-  }
-
   int pts;
-  if (!enif_get_int(env, argv[2], &pts)) {
+  if (!enif_get_int(env, argv[3], &pts)) {
     return xav_nif_raise(env, "failed_to_get_int");
   }
 
-  AVFrame *frame = xav_encoder->frame;
-  if (xav_encoder->encoder->codec->type == AVMEDIA_TYPE_VIDEO) {
-    frame->width = xav_encoder->encoder->c->width;
-    frame->height = xav_encoder->encoder->c->height;
-    frame->format = xav_encoder->encoder->c->pix_fmt;
-    frame->pts = pts;
-
-    ret = av_image_fill_arrays(frame->data, frame->linesize, input.data, frame->format,
-                               frame->width, frame->height, 1);
-    if (ret < 0) {
-      return xav_nif_raise(env, "failed_to_fill_arrays");
-    }
-  } else {
-    frame->pts = pts;
-    frame->nb_samples = input.size / av_get_bytes_per_sample(xav_encoder->encoder->c->sample_fmt);
+  ERL_NIF_TERM ret;
+  enif_mutex_lock(xav_encoder->lock);
 
-    int nb_channels = xav_get_nb_channels(frame);
-    ret = av_samples_fill_arrays(frame->data, frame->linesize, input.data, nb_channels,
-                                 frame->nb_samples, xav_encoder->encoder->c->sample_fmt, 1);
+  char *reason = fill_frame(env, xav_encoder, argv[1], argv[2], pts);
+  if (reason == NULL && encoder_encode(xav_encoder->encoder, xav_encoder->frame) < 0) {
+    reason = "failed_to_encode";
+  }
 
-    if (ret < 0) {
-      return xav_nif_raise(env, "failed_to_fill_arrays");
-    }
+  ret = reason == NULL ? packets_to_term(env, xav_encoder->encoder) : xav_nif_raise(env, reason);
+  enif_mutex_unlock(xav_encoder->lock);
+
+  return ret;
+}
+
+ERL_NIF_TERM encode_async(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 4) {
+    return xav_nif_raise(env, "invalid_arg_count");
   }
 
-  ret = encoder_encode(xav_encoder->encoder, frame);
-  if (ret < 0) {
-    return xav_nif_raise(env, "failed_to_encode");
+  struct XavEncoder *xav_encoder;
+  if (!enif_get_resource(env, argv[0], xav_encoder_resource_type, (void **)&xav_encoder)) {
+    return xav_nif_raise(env, "invalid_resource");
   }
 
-  return packets_to_term(env, xav_encoder->encoder);
+  struct EncodeJob *job = XAV_ALLOC(sizeof(struct EncodeJob));
+  job->xav_encoder = xav_encoder;
+  enif_self(env, &job->pid);
+
+  if (!enif_get_int(env, argv[3], &job->pts)) {
+    XAV_FREE(job);
+    return xav_nif_raise(env, "failed_to_get_int");
+  }
+
+  // Refc binaries are not copied, only referenced from the job env.
+  job->env = enif_alloc_env();
+  job->data = enif_make_copy(job->env, argv[1]);
+  job->linesizes = enif_make_copy(job->env, argv[2]);
+
+  int ret = serial_queue_push(xav_encoder->queue, run_encode_job, job);
+  if (ret == -1) {
+    enif_free_env(job->env);
+    XAV_FREE(job);
+    return xav_nif_error(env, "queue_full");
+  } else if (ret < 0) {
+    enif_free_env(job->env);
+    XAV_FREE(job);
+    return xav_nif_raise(env, "failed_to_start_worker_pool");
+  }
+
+  return enif_make_atom(env, "ok");
 }
 
 ERL_NIF_TERM flush(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
@@ -232,12 +289,17 @@ ERL_NIF_TERM flush(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
     return xav_nif_raise(env, "invalid_resource");
   }
 
-  int ret = encoder_encode(xav_encoder->encoder, NULL);
-  if (ret < 0) {
-    return xav_nif_raise(env, "failed_to_encode");
+  ERL_NIF_TERM ret;
+  enif_mutex_lock(xav_encoder->lock);
+
+  if (encoder_encode(xav_encoder->encoder, NULL) < 0) {
+    ret = xav_nif_raise(env, "failed_to_encode");
+  } else {
+    ret = packets_to_term(env, xav_encoder->encoder);
   }
 
-  return packets_to_term(env, xav_encoder->encoder);
+  enif_mutex_unlock(xav_encoder->lock);
+  return ret;
 }
 
 ERL_NIF_TERM list_encoders(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
@@ -279,6 +341,88 @@ void free_xav_encoder(ErlNifEnv *env, void *obj) {
   if (xav_encoder->frame != NULL) {
     av_frame_free(&xav_encoder->frame);
   }
+
+  if (xav_encoder->queue != NULL) {
+    serial_queue_free(&xav_encoder->queue);
+  }
+
+  if (xav_encoder->lock != NULL) {
+    enif_mutex_destroy(xav_encoder->lock);
+  }
+}
+
+// Points the encoder's frame at the frame data passed from Elixir.
+// Returns NULL on success or the reason of the failure.
+static char *fill_frame(ErlNifEnv *env, struct XavEncoder *xav_encoder, ERL_NIF_TERM data,
+                        ERL_NIF_TERM linesizes, int pts) {
+  AVFrame *frame = xav_encoder->frame;
+  AVCodecContext *c = xav_encoder->encoder->c;
+
+  frame->pts = pts;
+
+  if (xav_encoder->encoder->codec->type == AVMEDIA_TYPE_VIDEO) {
+    frame->width = c->width;
+    frame->height = c->height;
+    frame->format = c->pix_fmt;
+
+    // Either a packed binary or a list of planes with their linesizes.
+    // The frame is not backed by buffers, so the encoder copies it if it needs to keep it.
+    return xav_nif_get_video_frame_data(env, data, linesizes, frame);
+  }
+
+  ErlNifBinary input;
+  if (!enif_inspect_binary(env, data, &input)) {
+    return "failed_to_inspect_binary";
+  }
+
+  frame->nb_samples = input.size / av_get_bytes_per_sample(c->sample_fmt);
+
+  int nb_channels = xav_get_nb_channels(frame);
+  if (av_samples_fill_arrays(frame->data, frame->linesize, input.data, nb_channels,
+                             frame->nb_samples, c->sample_fmt, 1) < 0) {
+    return "failed_to_fill_arrays";
+  }
+
+  return NULL;
+}
+
+// Runs on a worker pool thread.
+static void run_encode_job(void *arg) {
+  struct EncodeJob *job = (struct EncodeJob *)arg;
+  struct XavEncoder *xav_encoder = job->xav_encoder;
+  ErlNifEnv *env = job->env;
+  ERL_NIF_TERM result;
+
+  enif_mutex_lock(xav_encoder->lock);
+
+  char *reason = fill_frame(env, xav_encoder, job->data, job->linesizes, job->pts);
+  if (reason == NULL && encoder_encode(xav_encoder->encoder, xav_encoder->frame) < 0) {
+    reason = "failed_to_encode";
+  }
+
+  if (reason == NULL) {
+    ERL_NIF_TERM packets = packets_to_term(env, xav_encoder->encoder);
+    ERL_NIF_TERM list = enif_make_list(env, 0);
+    ERL_NIF_TERM head;
+
+    while (enif_get_list_cell(env, packets, &head, &packets)) {
+      list = enif_make_list_cell(env, packet_to_struct(env, head), list);
+    }
+
+    enif_make_reverse_list(env, list, &list);
+    result = xav_nif_ok(env, list);
+  } else {
+    result = xav_nif_error(env, reason);
+  }
+
+  enif_mutex_unlock(xav_encoder->lock);
+
+  ERL_NIF_TERM msg = enif_make_tuple3(env, enif_make_atom(env, "xav_encoder"),
+                                      enif_make_resource(env, xav_encoder), result);
+  enif_send(NULL, &job->pid, env, msg);
+
+  enif_free_env(env);
+  XAV_FREE(job);
 }
 
 static ERL_NIF_TERM packets_to_term(ErlNifEnv *env, struct Encoder *encoder) {
@@ -297,6 +441,23 @@ static ERL_NIF_TERM packets_to_term(ErlNifEnv *env, struct Encoder *encoder) {
   return ret;
 }
 
+// Builds an %Xav.Packet{} out of a packet term.
+static ERL_NIF_TERM packet_to_struct(ErlNifEnv *env, ERL_NIF_TERM packet_term) {
+  const ERL_NIF_TERM *elems;
+  int arity;
+  enif_get_tuple(env, packet_term, &arity, &elems);
+
+  ERL_NIF_TERM keys[] = {enif_make_atom(env, "__struct__"), enif_make_atom(env, "data"),
+                         enif_make_atom(env, "dts"), enif_make_atom(env, "pts"),
+                         enif_make_atom(env, "keyframe?")};
+  ERL_NIF_TERM values[] = {enif_make_atom(env, "Elixir.Xav.Packet"), elems[0], elems[1],
+                           elems[2], elems[3]};
+
+  ERL_NIF_TERM packet;
+  enif_make_map_from_arrays(env, keys, values, 5, &packet);
+  return packet;
+}
+
 static int get_profile(enum AVCodecID codec, const char *profile_name) {
   const AVCodecDescriptor *desc = avcodec_descriptor_get(codec);
   const AVProfile *profile = desc->profiles;
@@ -371,15 +532,23 @@ static ERL_NIF_TERM codec_get_sample_rates(ErlNifEnv *env, const AVCodec *codec)
   return result;
 }
 
-static ErlNifFunc xav_funcs[] = {{"new", 2, new},
-                                 {"encode", 3, encode},
-                                 {"flush", 1, flush},
+static ErlNifFunc xav_funcs[] = {{"new", 2, new, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+                                 {"encode", 4, encode, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+                                 {"encode_async", 4, encode_async},
+                                 {"flush", 1, flush, ERL_NIF_DIRTY_JOB_CPU_BOUND},
                                  {"list_encoders", 0, list_encoders}};
 
 static int load(ErlNifEnv *env, void **priv, ERL_NIF_TERM load_info) {
   xav_encoder_resource_type =
       enif_open_resource_type(env, NULL, "XavEncoder", free_xav_encoder, ERL_NIF_RT_CREATE, NULL);
-  return 0;
+
+  if (thread_budget_load(env, load_info) < 0) {
+    return -1;
+  }
+
+  return worker_pool_init();
 }
 
-ERL_NIF_INIT(Elixir.Xav.Encoder.NIF, xav_funcs, &load, NULL, NULL, NULL);
+static void unload(ErlNifEnv *env, void *priv) { worker_pool_destroy(); }
+
+ERL_NIF_INIT(Elixir.Xav.Encoder.NIF, xav_funcs, &load, NULL, NULL, &unload);
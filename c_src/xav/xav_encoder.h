@@ -1,8 +1,14 @@
 #include "encoder.h"
 #include "utils.h"
+#include "worker_pool.h"
 #include <libavutil/pixfmt.h>
 
 struct XavEncoder {
   struct Encoder *encoder;
   AVFrame *frame;
+  // Serializes access to the encoder between
+  // the NIF calls and the async encode jobs.
+  ErlNifMutex *lock;
+  struct SerialQueue *queue;
+  int async_queue_size;
 };
@@ -2,11 +2,15 @@
 
 static int init_audio_converter(struct XavReader *xav_reader);
 static int init_video_converter(struct XavReader *xav_reader, AVFrame *frame);
+static char *read_video_frame(struct XavReader *xav_reader);
+static ERL_NIF_TERM read_fifo_frame(ErlNifEnv *env, struct XavReader *xav_reader);
+static char *get_options(ErlNifEnv *env, ERL_NIF_TERM options, struct XavReader *xav_reader,
+                         struct CodecConfig *codec_config);
 
 ErlNifResourceType *xav_reader_resource_type;
 
 ERL_NIF_TERM new (ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
-  if (argc != 9) {
+  if (argc != 10) {
     return xav_nif_raise(env, "invalid_arg_count");
   }
 
@@ -87,24 +91,75 @@ ERL_NIF_TERM new (ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
   xav_reader->out_format = out_format;
   xav_reader->out_sample_rate = out_sample_rate;
   xav_reader->out_channels = out_channels;
+  xav_reader->frame_size = 0;
+  xav_reader->frame_overlap = 0;
+  xav_reader->resampler_options = NULL;
+  xav_reader->fifo = NULL;
+  xav_reader->fifo_eof = 0;
+  xav_reader->levels = NULL;
+  xav_reader->zero_copy = 0;
+  xav_reader->converter_threads = 1;
+  xav_reader->fast_path = 1;
+  xav_reader->tensor = NULL;
+  xav_reader->batch = NULL;
+
+  ERL_NIF_TERM ret_term;
+  struct CodecConfig codec_config;
+  codec_config_init(&codec_config);
+  char *reason = get_options(env, argv[9], xav_reader, &codec_config);
+  if (reason != NULL) {
+    ret_term = xav_nif_raise(env, reason);
+    goto release;
+  }
+
+  if (xav_reader->frame_size > 0 && xav_reader->frame_overlap >= xav_reader->frame_size) {
+    ret_term = xav_nif_raise(env, "invalid_frame_overlap");
+    goto release;
+  }
+
+  if (xav_reader->levels != NULL && xav_reader->frame_size > 0) {
+    ret_term = xav_nif_raise(env, "invalid_levels");
+    goto release;
+  }
 
   xav_reader->reader = reader_alloc();
   if (xav_reader->reader == NULL) {
-    return xav_nif_raise(env, "couldnt_allocate_reader");
+    ret_term = xav_nif_raise(env, "couldnt_allocate_reader");
+    goto release;
   }
 
-  int ret = reader_init(xav_reader->reader, bin.data, bin.size, device_flag, media_type, framerate, width, height);
+  int ret = reader_init(xav_reader->reader, bin.data, bin.size, device_flag, media_type, framerate,
+                        width, height, &codec_config);
 
   if (ret == -1) {
-    return xav_nif_error(env, "couldnt_open_avformat_input");
+    ret_term = xav_nif_error(env, "couldnt_open_avformat_input");
+    goto release;
   } else if (ret == -2) {
-    return xav_nif_raise(env, "couldnt_create_new_reader");
+    ret_term = xav_nif_raise(env, "couldnt_create_new_reader");
+    goto release;
+  }
+
+  if (xav_reader->levels != NULL && xav_reader->reader->media_type != AVMEDIA_TYPE_AUDIO) {
+    ret_term = xav_nif_raise(env, "invalid_levels");
+    goto release;
   }
 
   if (xav_reader->reader->media_type == AVMEDIA_TYPE_AUDIO) {
     ret = init_audio_converter(xav_reader);
     if (ret < 0) {
-      return xav_nif_raise(env, "couldnt_init_converter");
+      ret_term = xav_nif_raise(env, "couldnt_init_converter");
+      goto release;
+    }
+
+    if (xav_reader->frame_size > 0) {
+      AVRational time_base =
+          xav_reader->reader->fmt_ctx->streams[xav_reader->reader->stream_idx]->time_base;
+      xav_reader->fifo = audio_fifo_alloc(xav_reader->frame_size, xav_reader->frame_overlap);
+      if (xav_reader->fifo == NULL ||
+          audio_fifo_init(xav_reader->fifo, xav_reader->ac, time_base) < 0) {
+        ret_term = xav_nif_raise(env, "couldnt_init_fifo");
+        goto release;
+      }
     }
   }
 
@@ -114,7 +169,6 @@ ERL_NIF_TERM new (ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
       enif_make_int64(env, xav_reader->reader->fmt_ctx->duration / AV_TIME_BASE);
   ERL_NIF_TERM codec_term = enif_make_atom(env, xav_reader->reader->codec->name);
   ERL_NIF_TERM xav_term = enif_make_resource(env, xav_reader);
-  enif_release_resource(xav_reader);
 
   if (xav_reader->reader->media_type == AVMEDIA_TYPE_AUDIO) {
     ERL_NIF_TERM in_sample_rate_term = enif_make_int(env, xav_reader->reader->c->sample_rate);
@@ -132,9 +186,9 @@ ERL_NIF_TERM new (ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
         enif_make_atom(env, av_get_sample_fmt_name(xav_reader->ac->out_sample_fmt));
     ERL_NIF_TERM out_sample_rate_term = enif_make_int(env, xav_reader->ac->out_sample_rate);
     ERL_NIF_TERM out_channels_term = enif_make_int(env, xav_reader->ac->out_channels);
-    return enif_make_tuple(env, 11, ok_term, xav_term, in_format_term, out_format_term,
-                           in_sample_rate_term, out_sample_rate_term, in_channels_term,
-                           out_channels_term, bit_rate_term, duration_term, codec_term);
+    ret_term = enif_make_tuple(env, 11, ok_term, xav_term, in_format_term, out_format_term,
+                               in_sample_rate_term, out_sample_rate_term, in_channels_term,
+                               out_channels_term, bit_rate_term, duration_term, codec_term);
 
   } else if (xav_reader->reader->media_type == AVMEDIA_TYPE_VIDEO) {
     ERL_NIF_TERM in_format_term =
@@ -144,11 +198,16 @@ ERL_NIF_TERM new (ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
     ERL_NIF_TERM framerate_den_term = enif_make_int(env, xav_reader->reader->framerate.den);
     ERL_NIF_TERM framerate_term = enif_make_tuple(env, 2, framerate_num_term, framerate_den_term);
 
-    return enif_make_tuple(env, 8, ok_term, xav_term, in_format_term, out_format_term,
-                           bit_rate_term, duration_term, codec_term, framerate_term);
+    ret_term = enif_make_tuple(env, 8, ok_term, xav_term, in_format_term, out_format_term,
+                               bit_rate_term, duration_term, codec_term, framerate_term);
   } else {
-    return xav_nif_raise(env, "unknown_media_type");
+    ret_term = xav_nif_raise(env, "unknown_media_type");
   }
+
+release:
+  // on failure, this frees the reader and gives its threads back to the thread budget
+  enif_release_resource(xav_reader);
+  return ret_term;
 }
 
 ERL_NIF_TERM next_frame(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
@@ -163,48 +222,60 @@ ERL_NIF_TERM next_frame(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
     return xav_nif_raise(env, "couldnt_get_reader_resource");
   }
 
-  int ret = reader_next_frame(xav_reader->reader);
-
-  if (ret == AVERROR_EOF) {
-    return xav_nif_error(env, "eof");
-  } else if (ret != 0) {
-    return xav_nif_raise(env, "receive_frame");
-  }
-
   // convert
   if (xav_reader->reader->media_type == AVMEDIA_TYPE_VIDEO) {
-    XAV_LOG_DEBUG("Converting video to RGB");
+    char *reason = read_video_frame(xav_reader);
+    if (reason != NULL && strcmp(reason, "eof") == 0) {
+      return xav_nif_error(env, reason);
+    } else if (reason != NULL) {
+      return xav_nif_raise(env, reason);
+    }
 
-    if (xav_reader->vc == NULL) {
-      ret = init_video_converter(xav_reader, xav_reader->reader->frame);
-      if (ret < 0) {
-        return xav_nif_raise(env, "failed_to_init_converter");
-      }
+    if (xav_reader->tensor != NULL) {
+      frame_term =
+          xav_nif_tensor_frame_to_term(env, xav_reader->tensor, xav_reader->vc->dst_frame);
+    } else if (xav_reader->zero_copy) {
+      frame_term = xav_nif_video_frame_ref_to_term(env, xav_reader->vc->dst_frame);
+    } else {
+      frame_term = xav_nif_video_frame_to_term(env, xav_reader->vc->dst_frame);
     }
+  } else if (xav_reader->fifo != NULL) {
+    return read_fifo_frame(env, xav_reader);
+  } else if (xav_reader->reader->media_type == AVMEDIA_TYPE_AUDIO) {
+    int ret = reader_next_frame(xav_reader->reader);
 
-    ret = video_converter_convert(xav_reader->vc, xav_reader->reader->frame);
-    if (ret <= 0) {
-      return xav_nif_raise(env, "failed_to_read");
+    if (ret == AVERROR_EOF) {
+      return xav_nif_error(env, "eof");
+    } else if (ret != 0) {
+      return xav_nif_raise(env, "receive_frame");
+    }
+
+    struct AudioLevels *levels = xav_reader->levels;
+    if (levels != NULL && !levels->payload) {
+      frame_term = audio_levels_frame_to_term(env, levels, xav_reader->reader->frame,
+                                              enif_make_atom(env, "nil"));
+      reader_free_frame(xav_reader->reader);
+      return xav_nif_ok(env, frame_term);
     }
 
-    frame_term = xav_nif_video_frame_to_term(env, xav_reader->vc->dst_frame);
-  } else if (xav_reader->reader->media_type == AVMEDIA_TYPE_AUDIO) {
     XAV_LOG_DEBUG("Converting audio to desired out format");
 
-    uint8_t **out_data;
+    ErlNifBinary out_data[xav_reader->ac->out_planes];
     int out_samples;
-    int out_size;
 
-    ret = audio_converter_convert(xav_reader->ac, xav_reader->reader->frame, &out_data,
-                                  &out_samples, &out_size);
+    ret = audio_converter_convert(xav_reader->ac, xav_reader->reader->frame, out_data,
+                                  &out_samples);
     if (ret < 0) {
       return xav_nif_raise(env, "failed_to_read");
     }
 
-    frame_term =
-        xav_nif_audio_frame_to_term(env, out_data, out_samples, out_size,
-                                    xav_reader->ac->out_sample_fmt, xav_reader->reader->frame->pts);
-    av_freep(&out_data[0]);
+    frame_term = xav_nif_audio_frame_to_term(env, out_data, xav_reader->ac->out_planes,
+                                             out_samples, xav_reader->ac->out_sample_fmt,
+                                             xav_reader->reader->frame->pts);
+
+    if (levels != NULL) {
+      frame_term = audio_levels_frame_to_term(env, levels, xav_reader->reader->frame, frame_term);
+    }
   }
 
   reader_free_frame(xav_reader->reader);
@@ -212,6 +283,96 @@ ERL_NIF_TERM next_frame(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
   return xav_nif_ok(env, frame_term);
 }
 
+// Reads audio frames into the fifo until it has a complete frame.
+// At the end of stream, samples delayed by the converter and the last, padded frame
+// are read before returning eof.
+static ERL_NIF_TERM read_fifo_frame(ErlNifEnv *env, struct XavReader *xav_reader) {
+  ERL_NIF_TERM frame_term;
+
+  while (1) {
+    int ret = audio_fifo_read(env, xav_reader->fifo, xav_reader->fifo_eof, &frame_term);
+    if (ret == 1) {
+      return xav_nif_ok(env, frame_term);
+    } else if (ret < 0) {
+      return xav_nif_raise(env, "failed_to_read_fifo");
+    } else if (xav_reader->fifo_eof) {
+      return xav_nif_error(env, "eof");
+    }
+
+    ret = reader_next_frame(xav_reader->reader);
+    if (ret == AVERROR_EOF) {
+      xav_reader->fifo_eof = 1;
+      ret = audio_fifo_write(xav_reader->fifo, xav_reader->ac, NULL);
+    } else if (ret != 0) {
+      return xav_nif_raise(env, "receive_frame");
+    } else {
+      ret = audio_fifo_write(xav_reader->fifo, xav_reader->ac, xav_reader->reader->frame);
+      reader_free_frame(xav_reader->reader);
+    }
+
+    if (ret < 0) {
+      return xav_nif_raise(env, "failed_to_read");
+    }
+  }
+}
+
+ERL_NIF_TERM next_batch(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 2) {
+    return xav_nif_raise(env, "invalid_arg_count");
+  }
+
+  struct XavReader *xav_reader;
+  if (!enif_get_resource(env, argv[0], xav_reader_resource_type, (void **)&xav_reader)) {
+    return xav_nif_raise(env, "couldnt_get_reader_resource");
+  }
+
+  int size;
+  if (!enif_get_int(env, argv[1], &size) || size < 1) {
+    return xav_nif_raise(env, "invalid_batch_size");
+  }
+
+  if (xav_reader->reader->media_type != AVMEDIA_TYPE_VIDEO) {
+    return xav_nif_raise(env, "unsupported_media_type");
+  }
+
+  // A frame that didn't fit into the previous batch, because of a resolution change,
+  // is kept for the next one, so the batch can only be replaced when it's empty.
+  struct Batch *batch = xav_reader->batch;
+  if (batch != NULL && batch->count == 0 && batch->size != size) {
+    batch_free(&xav_reader->batch);
+  }
+
+  if (xav_reader->batch == NULL) {
+    xav_reader->batch = batch_alloc(size, xav_reader->tensor);
+    if (xav_reader->batch == NULL) {
+      return xav_nif_raise(env, "failed_to_allocate_batch");
+    }
+  }
+
+  ERL_NIF_TERM batch_term;
+  while (1) {
+    char *reason = read_video_frame(xav_reader);
+    if (reason != NULL && strcmp(reason, "eof") == 0) {
+      if (batch_flush(env, xav_reader->batch, &batch_term)) {
+        return xav_nif_ok(env, batch_term);
+      }
+
+      return xav_nif_error(env, reason);
+    } else if (reason != NULL) {
+      return xav_nif_raise(env, reason);
+    }
+
+    int ret = batch_push(env, xav_reader->batch, xav_reader->vc->dst_frame, &batch_term);
+    reader_free_frame(xav_reader->reader);
+
+    if (ret < 0) {
+      return xav_nif_raise(env, "failed_to_batch_frame");
+    } else if (ret == 1) {
+      return xav_nif_ok(env, batch_term);
+    }
+  }
+}
+
 ERL_NIF_TERM seek(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
   ERL_NIF_TERM frame_term;
 
@@ -235,9 +396,76 @@ ERL_NIF_TERM seek(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
     return xav_nif_raise(env, "failed to seek");
   }
 
+  if (xav_reader->batch != NULL) {
+    batch_reset(xav_reader->batch);
+  }
+
+  if (xav_reader->fifo != NULL) {
+    audio_fifo_reset(xav_reader->fifo);
+    xav_reader->fifo_eof = 0;
+  }
+
+  if (xav_reader->levels != NULL) {
+    audio_levels_reset(xav_reader->levels);
+  }
+
   return enif_make_atom(env, "ok");
 }
 
+static char *get_options(ErlNifEnv *env, ERL_NIF_TERM options, struct XavReader *xav_reader,
+                         struct CodecConfig *codec_config) {
+  if (!enif_is_map(env, options)) {
+    return "failed_to_get_map";
+  }
+
+  ErlNifMapIterator iter;
+  ERL_NIF_TERM key, value;
+  char key_name[32];
+  char *reason = NULL;
+
+  enif_map_iterator_create(env, options, &iter, ERL_NIF_MAP_ITERATOR_FIRST);
+
+  while (reason == NULL && enif_map_iterator_get_pair(env, &iter, &key, &value)) {
+    int ret = -1;
+    if (!enif_get_atom(env, key, key_name, sizeof(key_name), ERL_NIF_LATIN1)) {
+      reason = "failed_to_get_map_key";
+    } else if (strcmp(key_name, "zero_copy") == 0) {
+      ret = xav_nif_get_bool(env, value, &xav_reader->zero_copy);
+    } else if (strcmp(key_name, "converter_threads") == 0) {
+      ret = enif_get_int(env, value, &xav_reader->converter_threads);
+    } else if (strcmp(key_name, "fast_path") == 0) {
+      ret = xav_nif_get_bool(env, value, &xav_reader->fast_path);
+    } else if (strcmp(key_name, "tensor") == 0) {
+      ret = xav_nif_get_tensor(env, value, &xav_reader->tensor);
+    } else if (strcmp(key_name, "frame_size") == 0) {
+      ret = enif_get_int(env, value, &xav_reader->frame_size) && xav_reader->frame_size > 0;
+    } else if (strcmp(key_name, "resampler") == 0) {
+      av_dict_free(&xav_reader->resampler_options);
+      ret = xav_nif_get_resampler_options(env, value, &xav_reader->resampler_options);
+    } else if (strcmp(key_name, "levels") == 0) {
+      audio_levels_free(&xav_reader->levels);
+      ret = xav_nif_get_audio_levels(env, value, &xav_reader->levels);
+    } else if (strcmp(key_name, "frame_overlap") == 0) {
+      ret = enif_get_int(env, value, &xav_reader->frame_overlap) &&
+            xav_reader->frame_overlap >= 0;
+    } else {
+      ret = xav_nif_get_codec_config(env, key_name, value, codec_config);
+    }
+
+    if (ret == -1 && reason == NULL) {
+      reason = "unknown_config_key";
+    } else if (ret == 0) {
+      reason = "couldnt_read_value";
+    }
+
+    enif_map_iterator_next(env, &iter);
+  }
+
+  enif_map_iterator_destroy(env, &iter);
+
+  return reason;
+}
+
 static int init_audio_converter(struct XavReader *xav_reader) {
   xav_reader->ac = audio_converter_alloc();
 
@@ -297,7 +525,35 @@ static int init_audio_converter(struct XavReader *xav_reader) {
 
   return audio_converter_init(xav_reader->ac, in_chlayout, xav_reader->reader->c->sample_rate,
                               xav_reader->reader->c->sample_fmt, out_chlayout, out_sample_rate,
-                              out_sample_fmt);
+                              out_sample_fmt, xav_reader->resampler_options);
+}
+
+// Reads the next video frame and converts it to rgb24, into the video converter's frame.
+// Returns NULL on success or the reason of the failure, "eof" at the end of the stream.
+static char *read_video_frame(struct XavReader *xav_reader) {
+  int ret = reader_next_frame(xav_reader->reader);
+
+  if (ret == AVERROR_EOF) {
+    return "eof";
+  } else if (ret != 0) {
+    return "receive_frame";
+  }
+
+  XAV_LOG_DEBUG("Converting video to RGB");
+
+  if (xav_reader->vc == NULL) {
+    ret = init_video_converter(xav_reader, xav_reader->reader->frame);
+    if (ret < 0) {
+      return "failed_to_init_converter";
+    }
+  }
+
+  ret = video_converter_convert(xav_reader->vc, xav_reader->reader->frame);
+  if (ret <= 0) {
+    return "failed_to_read";
+  }
+
+  return NULL;
 }
 
 static int init_video_converter(struct XavReader *xav_reader, AVFrame *frame) {
@@ -307,6 +563,10 @@ static int init_video_converter(struct XavReader *xav_reader, AVFrame *frame) {
     return -1;
   }
 
+  xav_reader->vc->zero_copy = xav_reader->zero_copy;
+  xav_reader->vc->threads = xav_reader->converter_threads;
+  xav_reader->vc->fast_path = xav_reader->fast_path;
+
   return video_converter_init(xav_reader->vc, frame->width, frame->height, frame->format,
                               frame->width, frame->height, AV_PIX_FMT_RGB24);
 }
@@ -325,6 +585,12 @@ void free_xav_reader(ErlNifEnv *env, void *obj) {
   if (xav_reader->vc != NULL) {
     video_converter_free(&xav_reader->vc);
   }
+
+  audio_fifo_free(&xav_reader->fifo);
+  audio_levels_free(&xav_reader->levels);
+  av_dict_free(&xav_reader->resampler_options);
+  batch_free(&xav_reader->batch);
+  tensor_free(&xav_reader->tensor);
 }
 
 /* Wraps av_log_set_level(int). The level integer is validated on the
@@ -348,8 +614,9 @@ ERL_NIF_TERM set_log_level(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 }
 
 static ErlNifFunc xav_funcs[] = {
-    {"new", 9, new},
+    {"new", 10, new},
     {"next_frame", 1, next_frame, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+    {"next_batch", 2, next_batch, ERL_NIF_DIRTY_JOB_CPU_BOUND},
     {"seek", 2, seek, ERL_NIF_DIRTY_JOB_CPU_BOUND},
     {"set_log_level", 1, set_log_level}};
 
@@ -357,7 +624,12 @@ static int load(ErlNifEnv *env, void **priv, ERL_NIF_TERM load_info) {
 
   xav_reader_resource_type =
       enif_open_resource_type(env, NULL, "XavReader", free_xav_reader, ERL_NIF_RT_CREATE, NULL);
-  return 0;
+
+  if (thread_budget_load(env, load_info) < 0) {
+    return -1;
+  }
+
+  return xav_nif_open_frame_resource_type(env);
 }
 
 ERL_NIF_INIT(Elixir.Xav.Reader.NIF, xav_funcs, &load, NULL, NULL, NULL);
@@ -1,5 +1,9 @@
 #include "audio_converter.h"
+#include "audio_fifo.h"
+#include "audio_levels.h"
+#include "batch.h"
 #include "reader.h"
+#include "tensor.h"
 #include "video_converter.h"
 
 struct XavReader {
@@ -9,4 +13,22 @@ struct XavReader {
   char *out_format;
   int out_sample_rate;
   int out_channels;
+  // swresample options set on top of the defaults, NULL when there are none
+  AVDictionary *resampler_options;
+  // return audio frames of exactly `frame_size` samples, 0 when disabled
+  int frame_size;
+  int frame_overlap;
+  struct AudioFifo *fifo;
+  // whether the fifo got the last samples of the stream
+  int fifo_eof;
+  // return audio frames with their levels, NULL when disabled
+  struct AudioLevels *levels;
+  // return video frames as resource binaries instead of copying them
+  int zero_copy;
+  int converter_threads;
+  int fast_path;
+  // return video frames as normalized float tensors, NULL when disabled
+  struct Tensor *tensor;
+  // frames collected by next_batch, allocated on its first call
+  struct Batch *batch;
 };
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "xav_thread_budget.h"
+
+ErlNifResourceType *xav_thread_budget_resource_type;
+
+ERL_NIF_TERM new (ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 0) {
+    return xav_nif_raise(env, "invalid_arg_count");
+  }
+
+  struct ThreadBudget *budget =
+      enif_alloc_resource(xav_thread_budget_resource_type, sizeof(struct ThreadBudget));
+  budget->magic = THREAD_BUDGET_MAGIC;
+  atomic_init(&budget->budget, 0);
+  atomic_init(&budget->in_use, 0);
+
+  // The binary points directly at the counters,
+  // so that other libraries can use them without knowing the resource type.
+  ERL_NIF_TERM budget_term =
+      enif_make_resource_binary(env, budget, budget, sizeof(struct ThreadBudget));
+  enif_release_resource(budget);
+
+  return budget_term;
+}
+
+ERL_NIF_TERM set(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 2) {
+    return xav_nif_raise(env, "invalid_arg_count");
+  }
+
+  struct ThreadBudget *budget = thread_budget_from_term(env, argv[0]);
+  if (budget == NULL) {
+    return xav_nif_raise(env, "invalid_thread_budget");
+  }
+
+  int threads;
+  if (!enif_get_int(env, argv[1], &threads) || threads < 0) {
+    return xav_nif_raise(env, "invalid_thread_budget");
+  }
+
+  atomic_store(&budget->budget, threads);
+  return enif_make_atom(env, "ok");
+}
+
+ERL_NIF_TERM stats(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 1) {
+    return xav_nif_raise(env, "invalid_arg_count");
+  }
+
+  struct ThreadBudget *budget = thread_budget_from_term(env, argv[0]);
+  if (budget == NULL) {
+    return xav_nif_raise(env, "invalid_thread_budget");
+  }
+
+  ERL_NIF_TERM keys[] = {enif_make_atom(env, "budget"), enif_make_atom(env, "in_use")};
+  ERL_NIF_TERM values[] = {enif_make_int(env, atomic_load(&budget->budget)),
+                           enif_make_int(env, atomic_load(&budget->in_use))};
+  ERL_NIF_TERM stats_term;
+  enif_make_map_from_arrays(env, keys, values, 2, &stats_term);
+
+  return stats_term;
+}
+
+static ErlNifFunc xav_funcs[] = {{"new", 0, new}, {"set", 2, set}, {"stats", 1, stats}};
+
+static int load(ErlNifEnv *env, void **priv, ERL_NIF_TERM load_info) {
+  // the counters are never freed, as the budget lives in a persistent term
+  xav_thread_budget_resource_type = enif_open_resource_type(
+      env, NULL, "XavThreadBudget", NULL, ERL_NIF_RT_CREATE, NULL);
+  return xav_thread_budget_resource_type == NULL ? -1 : 0;
+}
+
+ERL_NIF_INIT(Elixir.Xav.ThreadBudget.NIF, xav_funcs, &load, NULL, NULL, NULL);
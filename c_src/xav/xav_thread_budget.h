@@ -0,0 +1,2 @@
+#include "thread_budget.h"
+#include "utils.h"
@@ -2,74 +2,242 @@
 
 ErlNifResourceType *xav_video_converter_resource_type;
 
-static int init_video_converter(struct XavVideoConverter *converter) {
-  converter->vc = video_converter_alloc();
-  if (converter->vc == NULL) {
-    return -1;
+ERL_NIF_TERM new (ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 6) {
+    return xav_nif_error(env, "invalid_arg_count");
   }
 
-  AVFrame *in_frame = converter->frame;
+  int zero_copy;
+  if (!xav_nif_get_bool(env, argv[1], &zero_copy)) {
+    return xav_nif_raise(env, "failed_to_get_bool");
+  }
 
-  enum AVPixelFormat out_pix_fmt = converter->out_format;
-  if (out_pix_fmt == AV_PIX_FMT_NONE) {
-    out_pix_fmt = in_frame->format;
+  int threads;
+  if (!enif_get_int(env, argv[2], &threads)) {
+    return xav_nif_raise(env, "failed_to_get_int");
   }
 
-  return video_converter_init(converter->vc, in_frame->width, in_frame->height, in_frame->format,
-                              converter->out_width, converter->out_height, out_pix_fmt);
-}
+  int fast_path;
+  if (!xav_nif_get_bool(env, argv[3], &fast_path)) {
+    return xav_nif_raise(env, "failed_to_get_bool");
+  }
 
-ERL_NIF_TERM new (ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
-  if (argc != 3) {
-    return xav_nif_error(env, "invalid_arg_count");
+  int planes;
+  if (!xav_nif_get_frame_layout(env, argv[4], &planes)) {
+    return xav_nif_raise(env, "invalid_frame_layout");
   }
 
   ERL_NIF_TERM ret;
-  enum AVPixelFormat pix_fmt = AV_PIX_FMT_NONE;
+  struct XavVideoConverter *xav_video_converter =
+      enif_alloc_resource(xav_video_converter_resource_type, sizeof(struct XavVideoConverter));
+  xav_video_converter->outputs.converters = NULL;
+  xav_video_converter->outputs.count = 0;
+  xav_video_converter->frame = av_frame_alloc();
+  xav_video_converter->zero_copy = zero_copy;
+  xav_video_converter->threads = threads;
+  xav_video_converter->fast_path = fast_path;
+  xav_video_converter->planes = planes;
+  xav_video_converter->tensor = NULL;
+  xav_video_converter->in_format_atom = enif_make_atom(env, "nil");
+  xav_video_converter->in_format = AV_PIX_FMT_NONE;
+
+  if (!xav_nif_get_video_outputs(env, argv[0], &xav_video_converter->outputs)) {
+    ret = xav_nif_raise(env, "invalid_outputs");
+    goto release;
+  }
+
+  if (!xav_nif_get_tensor(env, argv[5], &xav_video_converter->tensor)) {
+    ret = xav_nif_raise(env, "invalid_tensor");
+    goto release;
+  }
+
+  video_outputs_configure(&xav_video_converter->outputs, zero_copy, threads, fast_path);
+
+  ret = enif_make_resource(env, xav_video_converter);
+
+release:
+  enif_release_resource(xav_video_converter);
+
+  return ret;
+}
+
+// the binary is owned by Erlang
+static void release_nothing(void *opaque, uint8_t *data) {}
+
+// Returns NULL on success or the reason of the failure.
+static char *get_in_format(ErlNifEnv *env, struct XavVideoConverter *converter,
+                           ERL_NIF_TERM format_term, enum AVPixelFormat *pix_fmt) {
+  // atoms are not bound to any env, so they can be compared across calls
+  if (enif_is_identical(format_term, converter->in_format_atom)) {
+    *pix_fmt = converter->in_format;
+    return NULL;
+  }
+
+  char *format;
+  if (!xav_nif_get_atom(env, format_term, &format)) {
+    return "failed_to_get_atom";
+  }
+
+  *pix_fmt = av_get_pix_fmt(format);
+  XAV_FREE(format);
+
+  if (*pix_fmt == AV_PIX_FMT_NONE) {
+    return "unknown_format";
+  }
+
+  converter->in_format_atom = format_term;
+  converter->in_format = *pix_fmt;
+  return NULL;
+}
+
+// Reads a frame given as data, width, height, format atom and linesizes into converter->frame.
+// Data is either a packed binary (linesizes are nil) or a list of plane binaries.
+// The frame has to be released with release_frame, also on failure.
+// Returns NULL on success or the reason of the failure.
+static char *get_frame(ErlNifEnv *env, struct XavVideoConverter *converter,
+                       const ERL_NIF_TERM frame[5]) {
   int width, height;
-  char *format = NULL;
+  enum AVPixelFormat pix_fmt;
 
-  if (!xav_nif_get_atom(env, argv[0], &format)) {
-    return xav_nif_raise(env, "failed_to_get_atom");
+  if (!enif_get_int(env, frame[1], &width) || !enif_get_int(env, frame[2], &height)) {
+    return "failed_to_get_int";
   }
 
-  if (strcmp(format, "nil") != 0) {
-    pix_fmt = av_get_pix_fmt(format);
-    if (pix_fmt == AV_PIX_FMT_NONE) {
-      ret = xav_nif_raise(env, "unknown_format");
-      goto clean;
+  char *reason = get_in_format(env, converter, frame[3], &pix_fmt);
+  if (reason != NULL) {
+    return reason;
+  }
+
+  AVFrame *src_frame = converter->frame;
+  src_frame->width = width;
+  src_frame->height = height;
+  src_frame->format = pix_fmt;
+
+  reason = xav_nif_get_video_frame_data(env, frame[0], frame[4], src_frame);
+  if (reason != NULL) {
+    return reason;
+  }
+
+  // Threaded scaling and cropping take a reference to the source frame,
+  // which would copy the whole frame if it wasn't backed by buffers.
+  // Planes of a packed binary are wrapped separately, just like plane binaries.
+  for (int i = 0; i < 4 && src_frame->data[i] != NULL; i++) {
+    src_frame->buf[i] = av_buffer_create(src_frame->data[i], xav_get_plane_size(src_frame, i),
+                                         release_nothing, NULL, AV_BUFFER_FLAG_READONLY);
+    if (src_frame->buf[i] == NULL) {
+      return "failed_to_allocate_buffer";
     }
   }
 
-  if (!enif_get_int(env, argv[1], &width)) {
-    ret = xav_nif_raise(env, "failed_to_get_int");
-    goto clean;
+  return NULL;
+}
+
+static void release_frame(struct XavVideoConverter *converter) {
+  for (int i = 0; i < 4; i++) {
+    av_buffer_unref(&converter->frame->buf[i]);
   }
+}
 
-  if (!enif_get_int(env, argv[2], &height)) {
-    ret = xav_nif_raise(env, "failed_to_get_int");
-    goto clean;
+static ERL_NIF_TERM output_to_term(ErlNifEnv *env, struct XavVideoConverter *converter,
+                                   AVFrame *dst_frame) {
+  if (converter->tensor != NULL) {
+    return xav_nif_tensor_frame_to_term(env, converter->tensor, dst_frame);
+  } else if (converter->planes) {
+    return xav_nif_video_frame_to_planes_term(env, dst_frame, converter->zero_copy);
+  } else if (converter->zero_copy) {
+    return xav_nif_video_frame_ref_to_term(env, dst_frame);
+  } else {
+    return xav_nif_video_frame_to_term(env, dst_frame);
   }
+}
 
-  struct XavVideoConverter *xav_video_converter =
-      enif_alloc_resource(xav_video_converter_resource_type, sizeof(struct XavVideoConverter));
-  xav_video_converter->vc = NULL;
-  xav_video_converter->frame = av_frame_alloc();
-  xav_video_converter->out_format = pix_fmt;
-  xav_video_converter->out_width = width;
-  xav_video_converter->out_height = height;
+static char *convert_error(int ret) {
+  if (ret == AVERROR(ENOMEM)) {
+    return "failed_to_allocate_buffer";
+  } else if (ret == AVERROR(EINVAL) || ret == AVERROR(ERANGE)) {
+    return "invalid_crop";
+  }
 
-  ret = enif_make_resource(env, xav_video_converter);
-  enif_release_resource(xav_video_converter);
+  return "failed_to_convert";
+}
 
-clean:
-  XAV_FREE(format);
+// Converts a single frame (see get_frame).
+// The result is a list with the frame converted to every output.
+// Returns NULL on success or the reason of the failure.
+static char *convert_frame(ErlNifEnv *env, struct XavVideoConverter *converter,
+                           const ERL_NIF_TERM frame[5], ERL_NIF_TERM *frame_term) {
+  char *reason = get_frame(env, converter, frame);
+  if (reason == NULL) {
+    int ret = video_outputs_convert(&converter->outputs, converter->frame);
+    if (ret < 0) {
+      reason = convert_error(ret);
+    }
+  }
 
-  return ret;
+  release_frame(converter);
+
+  if (reason != NULL) {
+    return reason;
+  }
+
+  *frame_term = enif_make_list(env, 0);
+  for (int i = converter->outputs.count - 1; i >= 0; i--) {
+    AVFrame *dst_frame = converter->outputs.converters[i]->dst_frame;
+    *frame_term = enif_make_list_cell(env, output_to_term(env, converter, dst_frame), *frame_term);
+  }
+
+  return NULL;
+}
+
+// Converts every region of interest of a single frame with the first output.
+// The result is a list with a converted frame per region.
+// Returns NULL on success or the reason of the failure.
+static char *convert_frame_rois(ErlNifEnv *env, struct XavVideoConverter *converter,
+                                const ERL_NIF_TERM frame[5], ERL_NIF_TERM rois,
+                                ERL_NIF_TERM *frame_term) {
+  struct VideoConverter *vc = converter->outputs.converters[0];
+
+  // the configured crop is restored once all of the regions are converted
+  int crop_x = vc->crop_x, crop_y = vc->crop_y;
+  int crop_width = vc->crop_width, crop_height = vc->crop_height;
+
+  char *reason = get_frame(env, converter, frame);
+
+  // no format means the format of the input frame
+  if (reason == NULL && vc->out_format == AV_PIX_FMT_NONE) {
+    vc->out_format = converter->frame->format;
+  }
+
+  ERL_NIF_TERM frames = enif_make_list(env, 0);
+  ERL_NIF_TERM roi;
+  while (reason == NULL && enif_get_list_cell(env, rois, &roi, &rois)) {
+    if (!xav_nif_get_crop(env, roi, vc)) {
+      reason = "invalid_crop";
+      break;
+    }
+
+    int ret = video_converter_convert(vc, converter->frame);
+    if (ret < 0) {
+      reason = convert_error(ret);
+      break;
+    }
+
+    frames = enif_make_list_cell(env, output_to_term(env, converter, vc->dst_frame), frames);
+  }
+
+  release_frame(converter);
+  video_converter_set_crop(vc, crop_x, crop_y, crop_width, crop_height);
+
+  if (reason != NULL) {
+    return reason;
+  }
+
+  enif_make_reverse_list(env, frames, frame_term);
+  return NULL;
 }
 
 ERL_NIF_TERM convert(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
-  if (argc != 5) {
+  if (argc != 6) {
     return xav_nif_raise(env, "invalid_arg_count");
   }
 
@@ -79,85 +247,168 @@ ERL_NIF_TERM convert(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
     return xav_nif_raise(env, "couldnt_get_converter_resource");
   }
 
-  ERL_NIF_TERM ret;
-  ErlNifBinary in_data;
-  int width, height;
-  char *format = NULL;
-  enum AVPixelFormat pix_fmt;
+  ERL_NIF_TERM frame_term;
+  char *reason = convert_frame(env, xav_video_converter, &argv[1], &frame_term);
+  if (reason != NULL) {
+    return xav_nif_raise(env, reason);
+  }
 
-  if (!enif_inspect_binary(env, argv[1], &in_data)) {
-    return xav_nif_raise(env, "failed_to_inspect_binary");
+  return frame_term;
+}
+
+ERL_NIF_TERM convert_rois(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 7) {
+    return xav_nif_raise(env, "invalid_arg_count");
   }
 
-  if (!enif_get_int(env, argv[2], &width)) {
-    return xav_nif_raise(env, "failed_to_get_int");
+  struct XavVideoConverter *xav_video_converter;
+  if (!enif_get_resource(env, argv[0], xav_video_converter_resource_type,
+                         (void **)&xav_video_converter)) {
+    return xav_nif_raise(env, "couldnt_get_converter_resource");
   }
 
-  if (!enif_get_int(env, argv[3], &height)) {
-    return xav_nif_raise(env, "failed_to_get_int");
+  if (!enif_is_list(env, argv[6])) {
+    return xav_nif_raise(env, "couldnt_get_list");
   }
 
-  if (!xav_nif_get_atom(env, argv[4], &format)) {
-    return xav_nif_raise(env, "failed_to_get_atom");
+  ERL_NIF_TERM frames_term;
+  char *reason = convert_frame_rois(env, xav_video_converter, &argv[1], argv[6], &frames_term);
+  if (reason != NULL) {
+    return xav_nif_raise(env, reason);
   }
 
-  pix_fmt = av_get_pix_fmt(format);
-  if (pix_fmt == AV_PIX_FMT_NONE) {
-    ret = xav_nif_raise(env, "unknown_format");
-    goto clean;
+  return frames_term;
+}
+
+ERL_NIF_TERM convert_many(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 2) {
+    return xav_nif_raise(env, "invalid_arg_count");
   }
 
-  AVFrame *src_frame = xav_video_converter->frame;
-  src_frame->width = width;
-  src_frame->height = height;
-  src_frame->format = pix_fmt;
+  struct XavVideoConverter *xav_video_converter;
+  if (!enif_get_resource(env, argv[0], xav_video_converter_resource_type,
+                         (void **)&xav_video_converter)) {
+    return xav_nif_raise(env, "couldnt_get_converter_resource");
+  }
 
-  int int_ret = av_image_fill_arrays(src_frame->data, src_frame->linesize, in_data.data,
-                                     src_frame->format, width, height, 1);
+  unsigned int frames_count;
+  if (!enif_get_list_length(env, argv[1], &frames_count)) {
+    return xav_nif_raise(env, "couldnt_get_list");
+  }
 
-  if (int_ret < 0) {
-    ret = xav_nif_raise(env, "failed_to_fill_arrays");
-    goto clean;
+  if (frames_count == 0) {
+    return enif_make_list(env, 0);
   }
 
-  if (xav_video_converter->vc == NULL) {
-    if (init_video_converter(xav_video_converter) < 0) {
-      ret = xav_nif_raise(env, "failed_to_init_converter");
+  ERL_NIF_TERM ret;
+  ERL_NIF_TERM *frame_terms = XAV_ALLOC(sizeof(ERL_NIF_TERM) * frames_count);
+
+  ERL_NIF_TERM list = argv[1];
+  ERL_NIF_TERM frame_term;
+  for (unsigned int i = 0; enif_get_list_cell(env, list, &frame_term, &list); i++) {
+    const ERL_NIF_TERM *frame;
+    int arity;
+    if (!enif_get_tuple(env, frame_term, &arity, &frame) || arity != 5) {
+      ret = xav_nif_raise(env, "invalid_frame");
       goto clean;
     }
-  }
 
-  if (video_converter_convert(xav_video_converter->vc, src_frame) < 0) {
-    ret = xav_nif_raise(env, "failed_to_convert");
-    goto clean;
+    char *reason = convert_frame(env, xav_video_converter, frame, &frame_terms[i]);
+    if (reason != NULL) {
+      ret = xav_nif_raise(env, reason);
+      goto clean;
+    }
   }
 
-  ret = xav_nif_video_frame_to_term(env, xav_video_converter->vc->dst_frame);
+  ret = enif_make_list_from_array(env, frame_terms, frames_count);
 
 clean:
-  if (format != NULL)
-    XAV_FREE(format);
-
+  XAV_FREE(frame_terms);
   return ret;
 }
 
+ERL_NIF_TERM stats(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 1) {
+    return xav_nif_raise(env, "invalid_arg_count");
+  }
+
+  struct XavVideoConverter *xav_video_converter;
+  if (!enif_get_resource(env, argv[0], xav_video_converter_resource_type,
+                         (void **)&xav_video_converter)) {
+    return xav_nif_raise(env, "couldnt_get_converter_resource");
+  }
+
+  uint64_t cache_hits = 0, cache_misses = 0;
+  for (int i = 0; i < xav_video_converter->outputs.count; i++) {
+    cache_hits += xav_video_converter->outputs.converters[i]->cache_hits;
+    cache_misses += xav_video_converter->outputs.converters[i]->cache_misses;
+  }
+
+  ERL_NIF_TERM keys[] = {enif_make_atom(env, "cache_hits"), enif_make_atom(env, "cache_misses")};
+  ERL_NIF_TERM values[] = {enif_make_uint64(env, cache_hits), enif_make_uint64(env, cache_misses)};
+
+  ERL_NIF_TERM map;
+  enif_make_map_from_arrays(env, keys, values, 2, &map);
+  return map;
+}
+
+// Only used by tests. Returns `[{kernel, matches_c}]` for every yuv to rgb row kernel
+// available on this CPU, as conversions only ever use the best of them.
+ERL_NIF_TERM check_yuv_kernels(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]) {
+  if (argc != 3) {
+    return xav_nif_raise(env, "invalid_arg_count");
+  }
+
+  ErlNifBinary y, u, v;
+  if (!enif_inspect_binary(env, argv[0], &y) || !enif_inspect_binary(env, argv[1], &u) ||
+      !enif_inspect_binary(env, argv[2], &v)) {
+    return xav_nif_raise(env, "failed_to_inspect_binary");
+  }
+
+  if (y.size == 0 || u.size < y.size || v.size < y.size) {
+    return xav_nif_raise(env, "invalid_planes");
+  }
+
+  const char *kernels[] = {"c", "ssse3", "avx2", "neon"};
+  ERL_NIF_TERM results = enif_make_list(env, 0);
+
+  for (int i = sizeof(kernels) / sizeof(kernels[0]) - 1; i >= 0; i--) {
+    int match = yuv_to_rgb_check_kernel(kernels[i], y.data, u.data, v.data, (int)y.size);
+    if (match >= 0) {
+      ERL_NIF_TERM result = enif_make_tuple(env, 2, enif_make_atom(env, kernels[i]),
+                                            enif_make_atom(env, match ? "true" : "false"));
+      results = enif_make_list_cell(env, result, results);
+    }
+  }
+
+  return results;
+}
+
 void free_xav_video_converter(ErlNifEnv *env, void *obj) {
   XAV_LOG_DEBUG("Freeing XavVideoConverter object");
   struct XavVideoConverter *xav_video_converter = (struct XavVideoConverter *)obj;
-  if (xav_video_converter->vc != NULL) {
-    video_converter_free(&xav_video_converter->vc);
-  }
+  video_outputs_free(&xav_video_converter->outputs);
+  tensor_free(&xav_video_converter->tensor);
 
   av_frame_free(&xav_video_converter->frame);
 }
 
-static ErlNifFunc xav_funcs[] = {{"new", 3, new},
-                                 {"convert", 5, convert, ERL_NIF_DIRTY_JOB_CPU_BOUND}};
+static ErlNifFunc xav_funcs[] = {{"new", 6, new},
+                                 {"convert", 6, convert, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+                                 {"convert_many", 2, convert_many, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+                                 {"convert_rois", 7, convert_rois, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+                                 {"stats", 1, stats},
+                                 {"check_yuv_kernels", 3, check_yuv_kernels}};
 
 static int load(ErlNifEnv *env, void **priv, ERL_NIF_TERM load_info) {
   xav_video_converter_resource_type = enif_open_resource_type(
       env, NULL, "XavVideoConverter", free_xav_video_converter, ERL_NIF_RT_CREATE, NULL);
-  return 0;
+
+  if (thread_budget_load(env, load_info) < 0) {
+    return -1;
+  }
+
+  return xav_nif_open_frame_resource_type(env);
 }
 
 ERL_NIF_INIT(Elixir.Xav.VideoConverter.NIF, xav_funcs, &load, NULL, NULL, NULL);
\ No newline at end of file
@@ -1,10 +1,19 @@
+#include "tensor.h"
 #include "utils.h"
-#include "video_converter.h"
+#include "video_outputs.h"
 
 struct XavVideoConverter {
-  struct VideoConverter *vc;
-  enum AVPixelFormat out_format;
-  int out_width;
-  int out_height;
+  // every converted frame is returned in all of the outputs
+  struct VideoOutputs outputs;
+  int zero_copy;
+  int threads;
+  int fast_path;
+  // return frames as a list of planes, keeping their linesizes
+  int planes;
+  // return frames as normalized float tensors, NULL when disabled
+  struct Tensor *tensor;
   AVFrame *frame;
+  // the last seen input format, to avoid looking it up for every frame
+  ERL_NIF_TERM in_format_atom;
+  enum AVPixelFormat in_format;
 };
\ No newline at end of file
@@ -0,0 +1,425 @@
+#include "yuv_to_rgb.h"
+#include "utils.h"
+
+#include <libavutil/common.h>
+#include <libavutil/cpu.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define XAV_YUV_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define XAV_YUV_NEON 1
+#endif
+
+// BT.601 limited range to full range RGB, in fixed point scaled by 64:
+//   R = 1.164 (Y - 16) + 1.596 (V - 128)
+//   G = 1.164 (Y - 16) - 0.391 (U - 128) - 0.813 (V - 128)
+//   B = 1.164 (Y - 16) + 2.018 (U - 128)
+// The luma term needs more precision, so it's computed as (Y * 257 * YG) >> 16,
+// which maps to a single unsigned high multiply in SIMD.
+// All intermediate values but B fit in 16 bits. B can only overflow
+// when it would be clipped to 255 anyway, so SIMD kernels use saturating
+// arithmetic and give the same results as the C version.
+#define YG 18997
+// rounding minus 16 * 1.164 * 64
+#define YB (32 - 1192)
+#define CRV 102
+#define CGU 25
+#define CGV 52
+#define CBU 129
+
+// Converts a single row. Chroma is subsampled horizontally when `chroma_shift` is 1.
+typedef void (*yuv_row_fn)(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst,
+                           int width, int chroma_shift, int bgr);
+
+struct YuvToRgb {
+  yuv_row_fn row;
+  // 2x downscale, otherwise 1:1
+  int downscale;
+  int nv12;
+  int bgr;
+  // luma and deinterleaved chroma rows
+  uint8_t *tmp_y;
+  uint8_t *tmp_u;
+  uint8_t *tmp_v;
+};
+
+static void yuv_row_c(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst,
+                      int width, int chroma_shift, int bgr) {
+  int r_idx = bgr ? 2 : 0;
+  int b_idx = bgr ? 0 : 2;
+
+  for (int i = 0; i < width; i++) {
+    int c = ((y[i] * 257 * YG) >> 16) + YB;
+    int cu = u[i >> chroma_shift] - 128;
+    int cv = v[i >> chroma_shift] - 128;
+
+    dst[3 * i + r_idx] = av_clip_uint8((c + CRV * cv) >> 6);
+    dst[3 * i + 1] = av_clip_uint8((c - CGU * cu - CGV * cv) >> 6);
+    dst[3 * i + b_idx] = av_clip_uint8((c + CBU * cu) >> 6);
+  }
+}
+
+#if XAV_YUV_X86
+// pshufb masks interleaving 16 R, G and B bytes into 48 bytes of packed RGB,
+// indexed by the output vector and the channel
+static const int8_t rgb24_masks[3][3][16] = {
+    {{0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5},
+     {-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1},
+     {-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1}},
+    {{-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1},
+     {5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10},
+     {-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1}},
+    {{-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1},
+     {-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1},
+     {10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15}}};
+
+__attribute__((target("ssse3"))) static inline void
+store_rgb24_ssse3(uint8_t *dst, __m128i r, __m128i g, __m128i b) {
+  for (int i = 0; i < 3; i++) {
+    __m128i out =
+        _mm_or_si128(_mm_shuffle_epi8(r, _mm_loadu_si128((const __m128i *)rgb24_masks[i][0])),
+                     _mm_shuffle_epi8(g, _mm_loadu_si128((const __m128i *)rgb24_masks[i][1])));
+    out = _mm_or_si128(out,
+                       _mm_shuffle_epi8(b, _mm_loadu_si128((const __m128i *)rgb24_masks[i][2])));
+    _mm_storeu_si128((__m128i *)(dst + 16 * i), out);
+  }
+}
+
+// y holds 8 luma values multiplied by 257, u and v 8 unsigned 16-bit values
+static inline void yuv8_to_rgb_sse2(__m128i y, __m128i u, __m128i v, __m128i *r, __m128i *g,
+                                    __m128i *b) {
+  __m128i c = _mm_add_epi16(_mm_mulhi_epu16(y, _mm_set1_epi16(YG)), _mm_set1_epi16(YB));
+  u = _mm_sub_epi16(u, _mm_set1_epi16(128));
+  v = _mm_sub_epi16(v, _mm_set1_epi16(128));
+
+  *r = _mm_srai_epi16(_mm_adds_epi16(c, _mm_mullo_epi16(v, _mm_set1_epi16(CRV))), 6);
+  *g = _mm_subs_epi16(_mm_subs_epi16(c, _mm_mullo_epi16(u, _mm_set1_epi16(CGU))),
+                      _mm_mullo_epi16(v, _mm_set1_epi16(CGV)));
+  *g = _mm_srai_epi16(*g, 6);
+  *b = _mm_srai_epi16(_mm_adds_epi16(c, _mm_mullo_epi16(u, _mm_set1_epi16(CBU))), 6);
+}
+
+__attribute__((target("ssse3"))) static void yuv_row_ssse3(const uint8_t *y, const uint8_t *u,
+                                                           const uint8_t *v, uint8_t *dst,
+                                                           int width, int chroma_shift, int bgr) {
+  const __m128i zero = _mm_setzero_si128();
+  int i = 0;
+
+  for (; i + 16 <= width; i += 16) {
+    __m128i y8 = _mm_loadu_si128((const __m128i *)(y + i));
+    __m128i u8, v8;
+
+    if (chroma_shift) {
+      u8 = _mm_loadl_epi64((const __m128i *)(u + i / 2));
+      v8 = _mm_loadl_epi64((const __m128i *)(v + i / 2));
+      u8 = _mm_unpacklo_epi8(u8, u8);
+      v8 = _mm_unpacklo_epi8(v8, v8);
+    } else {
+      u8 = _mm_loadu_si128((const __m128i *)(u + i));
+      v8 = _mm_loadu_si128((const __m128i *)(v + i));
+    }
+
+    __m128i r_lo, g_lo, b_lo, r_hi, g_hi, b_hi;
+    yuv8_to_rgb_sse2(_mm_unpacklo_epi8(y8, y8), _mm_unpacklo_epi8(u8, zero),
+                     _mm_unpacklo_epi8(v8, zero), &r_lo, &g_lo, &b_lo);
+    yuv8_to_rgb_sse2(_mm_unpackhi_epi8(y8, y8), _mm_unpackhi_epi8(u8, zero),
+                     _mm_unpackhi_epi8(v8, zero), &r_hi, &g_hi, &b_hi);
+
+    __m128i r = _mm_packus_epi16(r_lo, r_hi);
+    __m128i g = _mm_packus_epi16(g_lo, g_hi);
+    __m128i b = _mm_packus_epi16(b_lo, b_hi);
+
+    store_rgb24_ssse3(dst + 3 * i, bgr ? b : r, g, bgr ? r : b);
+  }
+
+  yuv_row_c(y + i, u + (i >> chroma_shift), v + (i >> chroma_shift), dst + 3 * i, width - i,
+            chroma_shift, bgr);
+}
+
+__attribute__((target("avx2"))) static inline void
+yuv16_to_rgb_avx2(__m256i y, __m256i u, __m256i v, __m256i *r, __m256i *g, __m256i *b) {
+  __m256i c = _mm256_mulhi_epu16(y, _mm256_set1_epi16(YG));
+  c = _mm256_add_epi16(c, _mm256_set1_epi16(YB));
+  u = _mm256_sub_epi16(u, _mm256_set1_epi16(128));
+  v = _mm256_sub_epi16(v, _mm256_set1_epi16(128));
+
+  *r = _mm256_srai_epi16(_mm256_adds_epi16(c, _mm256_mullo_epi16(v, _mm256_set1_epi16(CRV))), 6);
+  *g = _mm256_subs_epi16(_mm256_subs_epi16(c, _mm256_mullo_epi16(u, _mm256_set1_epi16(CGU))),
+                         _mm256_mullo_epi16(v, _mm256_set1_epi16(CGV)));
+  *g = _mm256_srai_epi16(*g, 6);
+  *b = _mm256_srai_epi16(_mm256_adds_epi16(c, _mm256_mullo_epi16(u, _mm256_set1_epi16(CBU))), 6);
+}
+
+__attribute__((target("avx2"))) static void yuv_row_avx2(const uint8_t *y, const uint8_t *u,
+                                                         const uint8_t *v, uint8_t *dst,
+                                                         int width, int chroma_shift, int bgr) {
+  const __m256i zero = _mm256_setzero_si256();
+  int i = 0;
+
+  for (; i + 32 <= width; i += 32) {
+    __m256i y8 = _mm256_loadu_si256((const __m256i *)(y + i));
+    __m256i u8, v8;
+
+    if (chroma_shift) {
+      // duplicate every chroma byte into both bytes of a 16-bit lane
+      __m256i u16 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(u + i / 2)));
+      __m256i v16 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(v + i / 2)));
+      u8 = _mm256_or_si256(u16, _mm256_slli_epi16(u16, 8));
+      v8 = _mm256_or_si256(v16, _mm256_slli_epi16(v16, 8));
+    } else {
+      u8 = _mm256_loadu_si256((const __m256i *)(u + i));
+      v8 = _mm256_loadu_si256((const __m256i *)(v + i));
+    }
+
+    // unpack and pack work within 128-bit lanes, so the pixel order is preserved
+    __m256i r_lo, g_lo, b_lo, r_hi, g_hi, b_hi;
+    yuv16_to_rgb_avx2(_mm256_unpacklo_epi8(y8, y8), _mm256_unpacklo_epi8(u8, zero),
+                      _mm256_unpacklo_epi8(v8, zero), &r_lo, &g_lo, &b_lo);
+    yuv16_to_rgb_avx2(_mm256_unpackhi_epi8(y8, y8), _mm256_unpackhi_epi8(u8, zero),
+                      _mm256_unpackhi_epi8(v8, zero), &r_hi, &g_hi, &b_hi);
+
+    __m256i r = _mm256_packus_epi16(r_lo, r_hi);
+    __m256i g = _mm256_packus_epi16(g_lo, g_hi);
+    __m256i b = _mm256_packus_epi16(b_lo, b_hi);
+
+    if (bgr) {
+      __m256i tmp = r;
+      r = b;
+      b = tmp;
+    }
+
+    store_rgb24_ssse3(dst + 3 * i, _mm256_castsi256_si128(r), _mm256_castsi256_si128(g),
+                      _mm256_castsi256_si128(b));
+    store_rgb24_ssse3(dst + 3 * i + 48, _mm256_extracti128_si256(r, 1),
+                      _mm256_extracti128_si256(g, 1), _mm256_extracti128_si256(b, 1));
+  }
+
+  yuv_row_ssse3(y + i, u + (i >> chroma_shift), v + (i >> chroma_shift), dst + 3 * i, width - i,
+                chroma_shift, bgr);
+}
+#endif
+
+#if XAV_YUV_NEON
+// c already includes the rounding term
+static inline uint8x8_t narrow_neon(int16x8_t x) { return vqshrun_n_s16(x, 6); }
+
+static void yuv_row_neon(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst,
+                         int width, int chroma_shift, int bgr) {
+  int i = 0;
+
+  for (; i + 16 <= width; i += 16) {
+    uint8x16_t y8 = vld1q_u8(y + i);
+    uint8x16_t u8, v8;
+
+    if (chroma_shift) {
+      uint8x8_t uh = vld1_u8(u + i / 2);
+      uint8x8_t vh = vld1_u8(v + i / 2);
+      uint8x8x2_t uz = vzip_u8(uh, uh);
+      uint8x8x2_t vz = vzip_u8(vh, vh);
+      u8 = vcombine_u8(uz.val[0], uz.val[1]);
+      v8 = vcombine_u8(vz.val[0], vz.val[1]);
+    } else {
+      u8 = vld1q_u8(u + i);
+      v8 = vld1q_u8(v + i);
+    }
+
+    uint8x8_t r[2], g[2], b[2];
+    for (int h = 0; h < 2; h++) {
+      uint8x8_t yh = h == 0 ? vget_low_u8(y8) : vget_high_u8(y8);
+      uint8x8_t uh = h == 0 ? vget_low_u8(u8) : vget_high_u8(u8);
+      uint8x8_t vh = h == 0 ? vget_low_u8(v8) : vget_high_u8(v8);
+
+      uint16x8_t y16 = vaddw_u8(vshll_n_u8(yh, 8), yh);
+      uint16x4_t c_lo = vshrn_n_u32(vmull_n_u16(vget_low_u16(y16), YG), 16);
+      uint16x4_t c_hi = vshrn_n_u32(vmull_n_u16(vget_high_u16(y16), YG), 16);
+      int16x8_t c = vaddq_s16(vreinterpretq_s16_u16(vcombine_u16(c_lo, c_hi)), vdupq_n_s16(YB));
+
+      // wrapping unsigned subtraction reinterpreted as signed gives the right result
+      int16x8_t cu = vreinterpretq_s16_u16(vsubl_u8(uh, vdup_n_u8(128)));
+      int16x8_t cv = vreinterpretq_s16_u16(vsubl_u8(vh, vdup_n_u8(128)));
+
+      r[h] = narrow_neon(vqaddq_s16(c, vmulq_n_s16(cv, CRV)));
+      g[h] = narrow_neon(vqsubq_s16(vqsubq_s16(c, vmulq_n_s16(cu, CGU)), vmulq_n_s16(cv, CGV)));
+      b[h] = narrow_neon(vqaddq_s16(c, vmulq_n_s16(cu, CBU)));
+    }
+
+    uint8x16x3_t rgb;
+    rgb.val[bgr ? 2 : 0] = vcombine_u8(r[0], r[1]);
+    rgb.val[1] = vcombine_u8(g[0], g[1]);
+    rgb.val[bgr ? 0 : 2] = vcombine_u8(b[0], b[1]);
+    vst3q_u8(dst + 3 * i, rgb);
+  }
+
+  yuv_row_c(y + i, u + (i >> chroma_shift), v + (i >> chroma_shift), dst + 3 * i, width - i,
+            chroma_shift, bgr);
+}
+#endif
+
+static yuv_row_fn select_row_fn() {
+#if XAV_YUV_X86
+  int flags = av_get_cpu_flags();
+  if (flags & AV_CPU_FLAG_AVX2) {
+    return yuv_row_avx2;
+  } else if (flags & AV_CPU_FLAG_SSSE3) {
+    return yuv_row_ssse3;
+  }
+#elif XAV_YUV_NEON
+  return yuv_row_neon;
+#endif
+  return yuv_row_c;
+}
+
+int yuv_to_rgb_init(struct YuvToRgb **ctx, int in_width, int in_height,
+                    enum AVPixelFormat in_format, int out_width, int out_height,
+                    enum AVPixelFormat out_format) {
+  if (in_format != AV_PIX_FMT_YUV420P && in_format != AV_PIX_FMT_NV12) {
+    return AVERROR(ENOSYS);
+  }
+
+  if (out_format != AV_PIX_FMT_RGB24 && out_format != AV_PIX_FMT_BGR24) {
+    return AVERROR(ENOSYS);
+  }
+
+  if (in_width % 2 != 0 || in_height % 2 != 0) {
+    return AVERROR(ENOSYS);
+  }
+
+  int downscale;
+  if (out_width == in_width && out_height == in_height) {
+    downscale = 0;
+  } else if (out_width * 2 == in_width && out_height * 2 == in_height) {
+    downscale = 1;
+  } else {
+    return AVERROR(ENOSYS);
+  }
+
+  struct YuvToRgb *c = XAV_ALLOC(sizeof(struct YuvToRgb));
+  if (c == NULL) {
+    return AVERROR(ENOMEM);
+  }
+
+  c->row = select_row_fn();
+  c->downscale = downscale;
+  c->nv12 = in_format == AV_PIX_FMT_NV12;
+  c->bgr = out_format == AV_PIX_FMT_BGR24;
+
+  // at most out_width samples per row, in both modes
+  c->tmp_y = XAV_ALLOC(3 * out_width);
+  if (c->tmp_y == NULL) {
+    XAV_FREE(c);
+    return AVERROR(ENOMEM);
+  }
+  c->tmp_u = c->tmp_y + out_width;
+  c->tmp_v = c->tmp_u + out_width;
+
+  XAV_LOG_DEBUG("Using %s yuv to rgb conversion", c->row == yuv_row_c ? "C" : "SIMD");
+
+  *ctx = c;
+  return 0;
+}
+
+static void deinterleave(const uint8_t *uv, uint8_t *u, uint8_t *v, int samples) {
+  for (int i = 0; i < samples; i++) {
+    u[i] = uv[2 * i];
+    v[i] = uv[2 * i + 1];
+  }
+}
+
+static void downscale_luma(const uint8_t *y0, const uint8_t *y1, uint8_t *dst, int width) {
+  for (int i = 0; i < width; i++) {
+    dst[i] = (y0[2 * i] + y0[2 * i + 1] + y1[2 * i] + y1[2 * i + 1] + 2) >> 2;
+  }
+}
+
+void yuv_to_rgb_convert(struct YuvToRgb *ctx, const AVFrame *src, AVFrame *dst) {
+  int width = dst->width;
+
+  for (int row = 0; row < dst->height; row++) {
+    const uint8_t *y, *u, *v;
+    int chroma_shift;
+    int chroma_row;
+
+    if (ctx->downscale) {
+      // chroma planes already have the output resolution
+      const uint8_t *y0 = src->data[0] + 2 * row * src->linesize[0];
+      downscale_luma(y0, y0 + src->linesize[0], ctx->tmp_y, width);
+      y = ctx->tmp_y;
+      chroma_shift = 0;
+      chroma_row = row;
+    } else {
+      y = src->data[0] + row * src->linesize[0];
+      chroma_shift = 1;
+      chroma_row = row / 2;
+    }
+
+    if (ctx->nv12) {
+      // two consecutive rows share the same chroma row
+      if (ctx->downscale || row % 2 == 0) {
+        deinterleave(src->data[1] + chroma_row * src->linesize[1], ctx->tmp_u, ctx->tmp_v,
+                     width >> chroma_shift);
+      }
+      u = ctx->tmp_u;
+      v = ctx->tmp_v;
+    } else {
+      u = src->data[1] + chroma_row * src->linesize[1];
+      v = src->data[2] + chroma_row * src->linesize[2];
+    }
+
+    ctx->row(y, u, v, dst->data[0] + row * dst->linesize[0], width, chroma_shift, ctx->bgr);
+  }
+}
+
+static yuv_row_fn get_row_fn(const char *name) {
+  if (strcmp(name, "c") == 0) {
+    return yuv_row_c;
+  }
+#if XAV_YUV_X86
+  int flags = av_get_cpu_flags();
+  if (strcmp(name, "ssse3") == 0 && (flags & AV_CPU_FLAG_SSSE3)) {
+    return yuv_row_ssse3;
+  } else if (strcmp(name, "avx2") == 0 && (flags & AV_CPU_FLAG_AVX2)) {
+    return yuv_row_avx2;
+  }
+#elif XAV_YUV_NEON
+  if (strcmp(name, "neon") == 0) {
+    return yuv_row_neon;
+  }
+#endif
+  return NULL;
+}
+
+int yuv_to_rgb_check_kernel(const char *name, const uint8_t *y, const uint8_t *u,
+                            const uint8_t *v, int width) {
+  yuv_row_fn row = get_row_fn(name);
+  if (row == NULL) {
+    return -1;
+  }
+
+  uint8_t *expected = XAV_ALLOC(6 * width);
+  if (expected == NULL) {
+    return 0;
+  }
+  uint8_t *actual = expected + 3 * width;
+
+  int match = 1;
+  for (int chroma_shift = 0; chroma_shift <= 1 && match; chroma_shift++) {
+    for (int bgr = 0; bgr <= 1 && match; bgr++) {
+      yuv_row_c(y, u, v, expected, width, chroma_shift, bgr);
+      row(y, u, v, actual, width, chroma_shift, bgr);
+      match = memcmp(expected, actual, 3 * width) == 0;
+    }
+  }
+
+  XAV_FREE(expected);
+  return match;
+}
+
+void yuv_to_rgb_free(struct YuvToRgb **ctx) {
+  if (*ctx != NULL) {
+    XAV_FREE((*ctx)->tmp_y);
+    XAV_FREE(*ctx);
+    *ctx = NULL;
+  }
+}
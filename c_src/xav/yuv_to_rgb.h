@@ -0,0 +1,39 @@
+#ifndef XAV_YUV_TO_RGB_H
+#define XAV_YUV_TO_RGB_H
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#include <stdint.h>
+
+/**
+ * Hand-written conversion of yuv420p/nv12 frames to rgb24/bgr24,
+ * either 1:1 or with an exact 2x downscale.
+ *
+ * Uses BT.601 limited range coefficients, the same as swscale does by default.
+ * Rows are converted with SSSE3, AVX2 or NEON kernels, picked at runtime
+ * based on the CPU capabilities, with a plain C fallback.
+ */
+struct YuvToRgb;
+
+/**
+ * Returns 0 when the conversion is supported and `ctx` was allocated,
+ * or AVERROR(ENOSYS) when swscale has to be used instead.
+ */
+int yuv_to_rgb_init(struct YuvToRgb **ctx, int in_width, int in_height,
+                    enum AVPixelFormat in_format, int out_width, int out_height,
+                    enum AVPixelFormat out_format);
+
+void yuv_to_rgb_convert(struct YuvToRgb *ctx, const AVFrame *src, AVFrame *dst);
+
+void yuv_to_rgb_free(struct YuvToRgb **ctx);
+
+/**
+ * Converts `width` pixels with the row kernel called `name` ("c", "ssse3", "avx2" or "neon")
+ * and compares the output with the C version, for every chroma subsampling and output order.
+ * Conversions only use the best kernel supported by the CPU, so this is used by tests
+ * to cover the other ones. `u` and `v` have to hold `width` samples.
+ *
+ * @return 1 when the outputs match, 0 when they don't and -1 when the kernel isn't available.
+ */
+int yuv_to_rgb_check_kernel(const char *name, const uint8_t *y, const uint8_t *u,
+                            const uint8_t *v, int width);
+#endif
@@ -112,6 +112,57 @@ defmodule Xav do
     Xav.Reader.NIF.set_log_level(level)
   end
 
+  @doc """
+  Sets the node-wide limit of threads used by codecs and scalers.
+
+  Every `Xav.Decoder`, `Xav.Reader`, `Xav.Encoder` and `Xav.VideoConverter`
+  takes its threads from a single budget shared by the whole node when it is
+  created (or, for scaling, when it converts its first frame) and gives them
+  back when it is garbage collected. A thread count of `0` (auto) takes
+  one thread per CPU core. Once the budget is exhausted, new instances
+  still get a single thread, so they can always be created.
+
+  Without a budget, `0` is left to FFmpeg, which might use more threads than
+  there are cores (e.g. `libx264`'s lookahead threads), and isn't accounted.
+
+  Encoders take the number of threads from the `threads` option in `:options`,
+  or from the encoder's default, which is one thread per CPU core for e.g. `libx264`.
+
+  The worker threads running `Xav.Decoder.decode_async/3` and `Xav.Encoder.encode_async/2`
+  only wait for the codecs, like dirty schedulers do, so they aren't taken from the budget.
+  Instead, each of these pools is capped at the budget when it is started,
+  i.e. on the first asynchronous call, and keeps its size afterwards.
+
+  `0` disables the limit, which is the default. See `thread_budget/0` for the current usage.
+
+  To configure the budget at application start, use the `:thread_budget` key
+  in your application env:
+
+      # config/runtime.exs
+      config :xav, thread_budget: 16
+
+  ## Examples
+
+      iex> Xav.set_thread_budget(8)
+      :ok
+
+      iex> Xav.set_thread_budget(0)
+      :ok
+
+  """
+  @spec set_thread_budget(non_neg_integer()) :: :ok
+  def set_thread_budget(budget) when is_integer(budget) and budget >= 0 do
+    Xav.ThreadBudget.NIF.set(Xav.ThreadBudget.get(), budget)
+  end
+
+  @doc """
+  Returns the node-wide thread budget and the number of threads taken from it.
+
+  Instances running on a single thread aren't accounted.
+  """
+  @spec thread_budget() :: %{budget: non_neg_integer(), in_use: non_neg_integer()}
+  def thread_budget(), do: Xav.ThreadBudget.NIF.stats(Xav.ThreadBudget.get())
+
   @doc """
   Get all available pixel formats.
 
@@ -6,6 +6,7 @@ defmodule Xav.Application do
   @impl true
   def start(_type, _args) do
     maybe_set_log_level()
+    maybe_set_thread_budget()
 
     Supervisor.start_link([], strategy: :one_for_one, name: Xav.Supervisor)
   end
@@ -16,4 +17,11 @@ defmodule Xav.Application do
       level -> Xav.set_log_level(level)
     end
   end
+
+  defp maybe_set_thread_budget do
+    case Application.get_env(:xav, :thread_budget) do
+      nil -> :ok
+      budget -> Xav.set_thread_budget(budget)
+    end
+  end
 end
@@ -0,0 +1,86 @@
+defmodule Xav.AudioLevelsOptions do
+  @moduledoc false
+
+  # Options shared by all of the modules that can return audio frames with their levels.
+
+  @vad_schema [
+    threshold: [
+      type: :integer,
+      default: -45,
+      doc: "level in dBov (e.g. `-45`) above which a frame might contain voice"
+    ],
+    max_zero_crossing_rate: [
+      type: :float,
+      default: 0.3,
+      doc: """
+      maximum fraction of consecutive samples with different signs in a voice frame,
+      higher rates are typical for noise and fricatives
+      """
+    ],
+    hangover: [
+      type: :non_neg_integer,
+      default: 200,
+      doc: "time in milliseconds for which voice activity lasts after the last voice frame"
+    ]
+  ]
+
+  @schema [
+    payload: [
+      type: :boolean,
+      default: true,
+      doc: """
+      return the frame's samples alongside its levels. When `false`, frames
+      have `nil` data and aren't converted at all, which makes monitoring streams
+      (e.g. to pick the active speaker) much cheaper. Their `format` and `samples`
+      are then the decoded ones
+      """
+    ],
+    vad: [
+      type: :keyword_list,
+      keys: @vad_schema,
+      doc: """
+      detect voice activity, setting `voice` in the levels. Pass `[]` to use
+      the defaults
+      """
+    ]
+  ]
+
+  @spec option() :: Keyword.t()
+  def option() do
+    [
+      type: :keyword_list,
+      keys: @schema,
+      doc: """
+      measure audio levels of every frame, returned in its `levels` field
+      (see `t:Xav.Frame.levels/0`)
+
+      Levels are measured natively, in a single pass over the decoded samples,
+      before they are converted to `out_format`, `out_sample_rate` and `out_channels`.
+      Can't be combined with `frame_size`.
+      """
+    ]
+  end
+
+  @spec to_nif(Keyword.t() | nil) :: tuple() | nil
+  def to_nif(nil), do: nil
+
+  def to_nif(levels) do
+    case levels[:vad] do
+      nil ->
+        {false, 0.0, 0.0, 0, levels[:payload]}
+
+      vad ->
+        {true, vad[:threshold] * 1.0, vad[:max_zero_crossing_rate], vad[:hangover],
+         levels[:payload]}
+    end
+  end
+
+  @spec validate!(Keyword.t()) :: Keyword.t()
+  def validate!(opts) do
+    if Keyword.has_key?(opts, :levels) and Keyword.has_key?(opts, :frame_size) do
+      raise ArgumentError, "`levels` can't be combined with `frame_size`"
+    end
+
+    Keyword.update(opts, :levels, nil, &to_nif/1)
+  end
+end
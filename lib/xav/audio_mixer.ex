@@ -0,0 +1,217 @@
+defmodule Xav.AudioMixer do
+  @moduledoc """
+  Mixes audio of many sources, e.g. tracks of a conference call, into a single stream.
+
+  Frames of every source are converted to the mixer's sample rate and channels,
+  and placed on a common timeline by their `pts`, so sources don't have to be
+  written in lockstep. Mixed frames always have exactly `frame_size` samples per channel.
+
+  A frame is mixed as soon as all of the sources have written samples covering it,
+  or when some source got `max_delay` ahead of it. Then, sources which are late,
+  paused (e.g. Opus DTX) or haven't written anything yet contribute silence.
+  Samples of a source which arrive after their part of the timeline has been mixed
+  are dropped.
+
+  Samples are summed as floats, with per-source gain, and clipped afterwards.
+
+  ```elixir
+  mixer = Xav.AudioMixer.new(out_format: :s16, out_sample_rate: 48_000, out_channels: 2)
+  alice = Xav.AudioMixer.add_source(mixer, in_channels: 1)
+  bob = Xav.AudioMixer.add_source(mixer, in_channels: 1, gain: 0.8)
+
+  :ok = Xav.AudioMixer.write(mixer, alice, alice_frame)
+  :ok = Xav.AudioMixer.write(mixer, bob, bob_frame)
+  frames = Xav.AudioMixer.mix(mixer)
+  ```
+
+  A mixer can be shared by many processes, e.g. one per track writing its frames
+  and another one mixing them. Calls are serialized by the mixer.
+  """
+
+  alias Xav.AudioMixer.NIF
+  alias Xav.Frame
+
+  @type t() :: %__MODULE__{
+          mixer: reference(),
+          out_format: Frame.audio_format(),
+          out_sample_rate: pos_integer(),
+          out_channels: pos_integer(),
+          frame_size: pos_integer()
+        }
+
+  @typedoc """
+  Id of a source, unique among the mixer's sources.
+  Ids of removed sources are reused.
+  """
+  @type source() :: non_neg_integer()
+
+  @enforce_keys [:mixer, :out_format, :out_sample_rate, :out_channels, :frame_size]
+  defstruct @enforce_keys
+
+  @mixer_schema [
+    out_format: [
+      type: :atom,
+      default: :s16,
+      doc: "sample format of the mixed frames, either packed or planar"
+    ],
+    out_sample_rate: [
+      type: :pos_integer,
+      default: 48_000,
+      doc: "sample rate of the mixed frames"
+    ],
+    out_channels: [
+      type: :pos_integer,
+      default: 2,
+      doc: "number of channels of the mixed frames"
+    ],
+    frame_size: [
+      type: :pos_integer,
+      default: 960,
+      doc: "number of samples per channel in every mixed frame, 20 ms of 48 kHz audio by default"
+    ],
+    max_delay: [
+      type: :non_neg_integer,
+      default: 100,
+      doc: """
+      time in milliseconds the mixer waits for sources which are behind the others,
+      before mixing them as silence
+
+      This is the latency added on top of the frame size when any of the sources
+      is late or paused.
+      """
+    ],
+    time_base: [
+      type: {:tuple, [:pos_integer, :pos_integer]},
+      doc: """
+      time base of the written and mixed frames' `pts`, as a `{numerator, denominator}` tuple
+
+      Defaults to `{1, out_sample_rate}`. Mixed frames' `pts` starts at the `pts`
+      of the first frame written to the mixer.
+      """
+    ],
+    soft_clip: [
+      type: :boolean,
+      default: true,
+      doc: """
+      compress samples louder than 80% of the full scale with a smooth curve,
+      instead of clamping them, which avoids harsh distortion when several loud
+      sources overlap
+      """
+    ]
+  ]
+
+  @source_schema [
+    in_sample_rate: [
+      type: :pos_integer,
+      doc: "sample rate of the source's frames, defaults to the mixer's one"
+    ],
+    in_channels: [
+      type: :pos_integer,
+      doc: "number of channels of the source's frames, defaults to the mixer's one"
+    ],
+    gain: [
+      type: {:custom, __MODULE__, :validate_gain, []},
+      default: 1.0,
+      doc: "linear gain applied to the source's samples, e.g. `0.5` for -6 dB"
+    ]
+  ]
+
+  @doc """
+  Creates a new audio mixer.
+
+  The following options can be passed:\n#{NimbleOptions.docs(@mixer_schema)}
+  """
+  @spec new(Keyword.t()) :: t()
+  def new(opts \\ []) do
+    opts = NimbleOptions.validate!(opts, @mixer_schema)
+    sample_rate = opts[:out_sample_rate]
+
+    mixer =
+      NIF.new(
+        sample_rate,
+        opts[:out_channels],
+        opts[:out_format],
+        opts[:frame_size],
+        div(opts[:max_delay] * sample_rate, 1000),
+        opts[:time_base] || {1, sample_rate},
+        opts[:soft_clip]
+      )
+
+    %__MODULE__{
+      mixer: mixer,
+      out_format: opts[:out_format],
+      out_sample_rate: sample_rate,
+      out_channels: opts[:out_channels],
+      frame_size: opts[:frame_size]
+    }
+  end
+
+  @doc """
+  Adds a new source to the mixer.
+
+  Frames written to the source can be in any sample format, which can also
+  change between frames.
+
+  The following options can be passed:\n#{NimbleOptions.docs(@source_schema)}
+  """
+  @spec add_source(t(), Keyword.t()) :: source()
+  def add_source(%__MODULE__{} = mixer, opts \\ []) do
+    opts = NimbleOptions.validate!(opts, @source_schema)
+
+    NIF.add_source(
+      mixer.mixer,
+      opts[:in_sample_rate] || mixer.out_sample_rate,
+      opts[:in_channels] || mixer.out_channels,
+      opts[:gain]
+    )
+  end
+
+  @doc """
+  Removes a source from the mixer, dropping its samples which haven't been mixed yet.
+  """
+  @spec remove_source(t(), source()) :: :ok
+  def remove_source(%__MODULE__{mixer: mixer}, source), do: NIF.remove_source(mixer, source)
+
+  @doc """
+  Changes the gain of a source, starting with the next mixed frame.
+  """
+  @spec set_gain(t(), source(), number()) :: :ok
+  def set_gain(%__MODULE__{mixer: mixer}, source, gain) when is_number(gain) and gain >= 0 do
+    NIF.set_gain(mixer, source, gain * 1.0)
+  end
+
+  @doc """
+  Writes an audio frame of a source to the mixer.
+
+  The frame's `pts` has to be in the mixer's `time_base`.
+  """
+  @spec write(t(), source(), Frame.t()) :: :ok
+  def write(%__MODULE__{mixer: mixer}, source, %Frame{type: :audio} = frame) do
+    NIF.write(mixer, source, frame.data, frame.format, frame.samples, frame.pts)
+  end
+
+  @doc """
+  Returns all of the frames which can be mixed out of the written samples.
+  """
+  @spec mix(t()) :: [Frame.t()]
+  def mix(%__MODULE__{mixer: mixer}), do: mixer |> NIF.mix(false) |> to_frames()
+
+  @doc """
+  Mixes all of the written samples, without waiting for late sources.
+
+  The last frame is padded with silence. Use it at the end of the stream.
+  """
+  @spec flush(t()) :: [Frame.t()]
+  def flush(%__MODULE__{mixer: mixer}), do: mixer |> NIF.mix(true) |> to_frames()
+
+  @doc false
+  def validate_gain(gain) when is_number(gain) and gain >= 0, do: {:ok, gain * 1.0}
+
+  def validate_gain(gain) do
+    {:error, "expected gain to be a non-negative number, got: #{inspect(gain)}"}
+  end
+
+  defp to_frames(frames) do
+    Enum.map(frames, fn {data, format, samples, pts} -> Frame.new(data, format, samples, pts) end)
+  end
+end
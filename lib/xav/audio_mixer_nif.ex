@@ -0,0 +1,24 @@
+defmodule Xav.AudioMixer.NIF do
+  @moduledoc false
+
+  @compile {:autoload, false}
+  @on_load :__on_load__
+
+  def __on_load__ do
+    path = :filename.join(:code.priv_dir(:xav), ~c"libxavaudiomixer")
+    :ok = :erlang.load_nif(path, 0)
+  end
+
+  def new(_sample_rate, _channels, _format, _frame_size, _max_delay, _time_base, _soft_clip),
+    do: :erlang.nif_error(:undef)
+
+  def add_source(_mixer, _in_sample_rate, _in_channels, _gain), do: :erlang.nif_error(:undef)
+
+  def remove_source(_mixer, _source), do: :erlang.nif_error(:undef)
+
+  def set_gain(_mixer, _source, _gain), do: :erlang.nif_error(:undef)
+
+  def write(_mixer, _source, _data, _format, _samples, _pts), do: :erlang.nif_error(:undef)
+
+  def mix(_mixer, _flush), do: :erlang.nif_error(:undef)
+end
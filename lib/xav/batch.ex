@@ -0,0 +1,96 @@
+defmodule Xav.Batch do
+  @moduledoc """
+  Consecutive video frames stacked into a single binary.
+
+  Frames are laid out one after another, each one tightly packed
+  (or written as a tensor, see `t:Xav.Frame.tensor/0`), so that the whole
+  batch can be wrapped as a single tensor without copying.
+  All frames of a batch have the same format and resolution.
+
+  See `Xav.Reader.next_batch/2` and the `batch_size` option of `Xav.Decoder.new/2`.
+  """
+
+  alias Xav.Frame
+
+  @type t() :: %__MODULE__{
+          data: binary(),
+          format: Frame.video_format(),
+          width: pos_integer(),
+          height: pos_integer(),
+          count: pos_integer(),
+          pts: [integer()],
+          tensor: Frame.tensor() | nil
+        }
+
+  defstruct [:data, :format, :width, :height, :count, :pts, :tensor]
+
+  @doc false
+  @spec from_nif(tuple()) :: t()
+  def from_nif({:batch, data, format, width, height, pts, tensor}) do
+    %__MODULE__{
+      data: data,
+      format: format,
+      width: width,
+      height: height,
+      count: length(pts),
+      pts: pts,
+      tensor: tensor
+    }
+  end
+
+  if Code.ensure_loaded?(Nx) do
+    @doc """
+    Converts a batch to an Nx tensor, without copying its data.
+
+    Dimension names of the newly created tensor are `[:batch, :height, :width, :channels]`,
+    or `[:batch, :channels, :height, :width]` for batches of `:chw` tensors.
+
+    The only supported pixel formats are:
+      * `:rgb24`
+      * `:bgr24`
+    """
+    @spec to_nx(t()) :: Nx.Tensor.t()
+    def to_nx(%__MODULE__{tensor: {type, :hwc}} = batch) do
+      batch.data
+      |> Nx.from_binary(type)
+      |> Nx.reshape({batch.count, batch.height, batch.width, 3},
+        names: [:batch, :height, :width, :channels]
+      )
+    end
+
+    def to_nx(%__MODULE__{tensor: {type, :chw}} = batch) do
+      batch.data
+      |> Nx.from_binary(type)
+      |> Nx.reshape({batch.count, 3, batch.height, batch.width},
+        names: [:batch, :channels, :height, :width]
+      )
+    end
+
+    def to_nx(%__MODULE__{format: format, tensor: nil} = batch)
+        when format in [:rgb24, :bgr24] do
+      batch.data
+      |> Nx.from_binary(:u8)
+      |> Nx.reshape({batch.count, batch.height, batch.width, 3},
+        names: [:batch, :height, :width, :channels]
+      )
+    end
+  end
+
+  @doc """
+  Splits a batch into frames.
+
+  Every frame is a sub-binary of the batch, so this doesn't copy any data either.
+  """
+  @spec to_frames(t()) :: [Frame.t()]
+  def to_frames(%__MODULE__{} = batch) do
+    frame_size = div(byte_size(batch.data), batch.count)
+
+    batch.pts
+    |> Enum.with_index()
+    |> Enum.map(fn {pts, i} ->
+      data = binary_part(batch.data, i * frame_size, frame_size)
+      frame = Frame.new(data, batch.format, batch.width, batch.height, pts)
+      %Frame{frame | tensor: batch.tensor}
+    end)
+  end
+end
@@ -3,6 +3,8 @@ defmodule Xav.Decoder do
   Audio/video decoder.
   """
 
+  alias Xav.{AudioLevelsOptions, ResamplerOptions, TensorOptions}
+
   @typedoc """
   Supported codecs.
 
@@ -30,6 +32,11 @@ defmodule Xav.Decoder do
 
       To get the list of supported pixel formats use `Xav.pixel_formats/0`,
       and for sample formats `Xav.sample_formats/0`.
+
+      Audio defaults to the packed counterpart of the decoded sample format.
+      Planar sample formats return one binary per channel (see `t:Xav.Frame.data/0`).
+      When neither the sample rate nor the number of channels change,
+      samples are returned as decoded, or only interleaved, without resampling.
       """
     ],
     out_sample_rate: [
@@ -47,20 +54,21 @@ defmodule Xav.Decoder do
 
       If not specified, the number of channels of the input stream will be used.
 
-      Audio samples are always in the packed form -
-      samples from different channels are interleaved in the same, single binary:
+      Packed sample formats interleave samples from different channels
+      in the same, single binary:
 
       ```
       <<c10, c20, c30, c11, c21, c31, c12, c22, c32>>
       ```
 
-      An alternative would be to return a list of binaries, where
-      each binary represents different channel:
+      Planar sample formats (e.g. `:fltp`) return a list of binaries,
+      one per channel (see `t:Xav.Frame.data/0`):
+
       ```
       [
-        <<c10, c11, c12, c13, c14>>,
-        <<c20, c21, c22, c23, c24>>,
-        <<c30, c31, c32, c33, c34>>
+        <<c10, c11, c12>>,
+        <<c20, c21, c22>>,
+        <<c30, c31, c32>>
       ]
       ```
       """
@@ -72,7 +80,254 @@ defmodule Xav.Decoder do
     out_height: [
       type: :pos_integer,
       doc: "Scale the output video frame to the provided height."
-    ]
+    ],
+    outputs: [
+      type:
+        {:list,
+         {:keyword_list,
+          [
+            out_format: [type: :atom],
+            out_width: [type: :pos_integer],
+            out_height: [type: :pos_integer],
+            crop: [
+              type:
+                {:tuple, [:non_neg_integer, :non_neg_integer, :pos_integer, :pos_integer]}
+            ]
+          ]}},
+      doc: """
+      Convert every video frame to multiple outputs at once,
+      e.g. a preview, a thumbnail and a model input.
+
+      Each output takes `out_format`, `out_width` and `out_height`, which work
+      the same as the options above, and at least one of them has to be provided.
+      An output can also take a `crop` region, see `Xav.VideoConverter.new/1`.
+      Can't be combined with `out_format`, `out_width` and `out_height`.
+
+      Decoding returns a list of frames, one per output, in place of every frame.
+      All of the outputs are produced in a single NIF call. Each output is scaled
+      from the smallest frame that is at least as big as the output - either the decoded frame,
+      or one of the outputs listed before it. List bigger outputs first, so that
+      e.g. a thumbnail is scaled down from the preview instead of from the full frame.
+      See also `Xav.VideoConverter.new_multi/2`.
+      """
+    ],
+    thread_count: [
+      type: :non_neg_integer,
+      default: 1,
+      doc: """
+      Number of threads used by the decoder.
+
+      `0` lets FFmpeg pick the number of threads based on the number of CPU cores.
+      When a node-wide thread budget is set (see `Xav.set_thread_budget/1`), `0` means
+      one thread per CPU core and the number of threads is clamped to what is left in the budget.
+      """
+    ],
+    thread_type: [
+      type: {:in, [:frame, :slice, :auto]},
+      default: :auto,
+      doc: """
+      Threading model used when `thread_count` is not `1`.
+
+      `:frame` decodes multiple frames in parallel, which scales best
+      but delays output by one frame per thread. `:slice` decodes slices
+      of a single frame in parallel and adds no latency, but only helps for
+      streams encoded with multiple slices. `:auto` allows both and lets
+      the codec decide.
+      """
+    ],
+    skip_frame: [
+      type: {:in, [:default, :nonref, :bidir, :nonintra, :nonkey, :all]},
+      doc: """
+      Frames the decoder skips entirely - they are neither reconstructed nor converted.
+
+      * `:nonref` - skip frames that are not used as a reference
+      * `:bidir` - skip B-frames
+      * `:nonintra` - skip all but intra frames
+      * `:nonkey` - skip all but keyframes
+      * `:all` - skip all frames
+
+      Skipped frames don't produce any output, so `decode/3` returns `:ok` for them.
+
+      Not every codec supports every mode.
+      """
+    ],
+    skip_loop_filter: [
+      type: {:in, [:default, :nonref, :bidir, :nonintra, :nonkey, :all]},
+      doc: """
+      Frames for which the in-loop (deblocking) filter is skipped.
+      Takes the same values as `skip_frame`. Trades quality for speed.
+      """
+    ],
+    skip_idct: [
+      type: {:in, [:default, :nonref, :bidir, :nonintra, :nonkey, :all]},
+      doc: """
+      Frames for which IDCT is skipped.
+      Takes the same values as `skip_frame`. Trades quality for speed.
+      """
+    ],
+    async_queue_size: [
+      type: :pos_integer,
+      default: 16,
+      doc: """
+      Maximum number of packets queued with `decode_async/3` that haven't been decoded yet.
+      """
+    ],
+    zero_copy: [
+      type: :boolean,
+      default: false,
+      doc: """
+      Return video frames without copying them out of FFmpeg buffers.
+
+      The frame data is a binary pointing directly at the FFmpeg buffer,
+      which is released once the binary is garbage collected.
+      Keep in mind that holding a reference to such a binary
+      (or any sub-binary of it) keeps the whole frame in memory.
+
+      When no conversion or scaling is requested, the decoder writes frames
+      directly into tightly packed buffers allocated with the BEAM allocator,
+      if the codec allows it. This depends on the codec and the resolution -
+      e.g. H264 always requires extra padding rows, while VP8 at 640x480 doesn't.
+      Frames whose planes are not laid out as a single, tightly packed buffer
+      are still copied.
+      """
+    ],
+    pooled: [
+      type: :boolean,
+      default: false,
+      doc: """
+      Take an already opened decoder from the decoder pool instead of opening a new one.
+
+      When the decoder is garbage collected, the underlying FFmpeg decoder is reset
+      and returned to the pool, so that it can be reused by the next decoder created
+      with the same codec, `channels`, `zero_copy` and codec options
+      (`thread_count`, `thread_type`, `skip_*`).
+      This makes creating decoders much cheaper in workloads where streams come and go
+      frequently. See `prewarm/3`, `pool_stats/0` and `set_pool_size/1`.
+      """
+    ],
+    converter_threads: [
+      type: :non_neg_integer,
+      default: 1,
+      doc: """
+      Number of threads used to convert video frames to the output format.
+
+      `0` uses one thread per CPU core. Each frame is split into horizontal
+      slices that are scaled in parallel, which helps with large frames
+      (e.g. 4K to 1080p). Requires FFmpeg 5.0 or newer, older versions
+      always use a single thread.
+      """
+    ],
+    fast_path: [
+      type: :boolean,
+      default: true,
+      doc: """
+      Use hand-written SIMD kernels instead of swscale for the most common conversions:
+      `yuv420p`/`nv12` to `rgb24`/`bgr24`, either 1:1 or with an exact 2x downscale.
+      The kernels use a box filter for downscaling, so the output might slightly
+      differ from swscale's. Other conversions always use swscale.
+      The kernels always run on a single thread, regardless of `converter_threads`.
+      """
+    ],
+    frame_layout: [
+      type: {:in, [:packed, :planes]},
+      default: :packed,
+      doc: """
+      Layout of the returned video frames.
+
+      `:packed` returns a single binary with tightly packed planes, which
+      requires copying every frame row by row out of the decoder's buffers
+      (or the converter's, when converting).
+      `:planes` returns a list of binaries, one per plane, with rows laid out as
+      in the decoder's buffers, and their `linesizes` (see `t:Xav.Frame.data/0`).
+      Combined with `zero_copy`, the planes point directly at the decoder's buffers,
+      so frames are never copied.
+
+      Such frames can be passed to `Xav.VideoConverter.convert/2`
+      and `Xav.Encoder.encode/2` as they are.
+      """
+    ],
+    tensor: TensorOptions.option(),
+    batch_size: [
+      type: :pos_integer,
+      doc: """
+      Stack video frames into batches of `batch_size` frames (see `Xav.Batch`).
+
+      Frames are written, one by one, into a single binary allocated once per batch.
+      `decode/3` returns `:ok` until a batch is complete, and then `{:ok, batch}`.
+      The same goes for `decode_many/2`, `decode_async/3` and flushing, which
+      return lists of batches instead of frames. Flushing also returns the last,
+      incomplete batch. So does a change of the resolution - the first frame in
+      the new resolution starts the next batch.
+
+      Can be combined with `tensor` but not with `outputs` and `frame_layout: :planes`.
+      """
+    ],
+    frame_size: [
+      type: :pos_integer,
+      doc: """
+      Return audio frames of exactly `frame_size` samples per channel,
+      e.g. 960 samples for 20 ms of 48 kHz audio.
+
+      Converted samples are collected in a FIFO and read out as soon as there are enough
+      of them, so `decode/3` returns `{:ok, frames}` with any number of frames,
+      or `:ok` when there are none. Flushing also returns the samples delayed by the resampler
+      and the last frame, padded with silence.
+
+      Only audio decoders are supported.
+      """
+    ],
+    frame_overlap: [
+      type: :non_neg_integer,
+      default: 0,
+      doc: """
+      Number of samples per channel shared by consecutive frames when `frame_size` is set,
+      e.g. for sliding windows. Has to be lower than `frame_size`.
+      """
+    ],
+    time_base: [
+      type: {:tuple, [:pos_integer, :pos_integer]},
+      doc: """
+      Time base of packets' `pts`, as a `{numerator, denominator}` tuple.
+
+      Used to compute the `pts` of frames returned with `frame_size`, which is
+      the `pts` of the first decoded frame advanced by the number of samples returned so far.
+      Defaults to `{1, sample_rate}` of the decoded audio.
+      """
+    ],
+    resampler: ResamplerOptions.option(),
+    levels: AudioLevelsOptions.option()
+  ]
+
+  @pool_key_options [
+    :channels,
+    :thread_count,
+    :thread_type,
+    :skip_frame,
+    :skip_loop_filter,
+    :skip_idct,
+    :zero_copy
+  ]
+
+  @nif_options [
+    :thread_count,
+    :thread_type,
+    :skip_frame,
+    :skip_loop_filter,
+    :skip_idct,
+    :zero_copy,
+    :async_queue_size,
+    :pooled,
+    :converter_threads,
+    :fast_path,
+    :frame_layout,
+    :outputs,
+    :tensor,
+    :batch_size,
+    :frame_size,
+    :frame_overlap,
+    :time_base,
+    :resampler,
+    :levels
   ]
 
   @doc """
@@ -84,7 +339,15 @@ defmodule Xav.Decoder do
   """
   @spec new(codec(), Keyword.t()) :: t()
   def new(codec, opts \\ []) when is_atom(codec) do
-    opts = NimbleOptions.validate!(opts, @decoder_options_schema)
+    opts =
+      opts
+      |> NimbleOptions.validate!(@decoder_options_schema)
+      |> validate_outputs!()
+      |> validate_tensor!()
+      |> validate_batch_size!()
+      |> validate_frame_size!()
+      |> AudioLevelsOptions.validate!()
+      |> Keyword.update(:resampler, [], &ResamplerOptions.to_nif/1)
 
     Xav.Decoder.NIF.new(
       codec,
@@ -93,10 +356,66 @@ defmodule Xav.Decoder do
       opts[:out_sample_rate] || 0,
       opts[:out_channels] || 0,
       opts[:out_width] || -1,
-      opts[:out_height] || -1
+      opts[:out_height] || -1,
+      opts |> Keyword.take(@nif_options) |> Map.new()
     )
   end
 
+  @doc """
+  Opens `count` decoders and puts them into the decoder pool.
+
+  Decoders created later on with `pooled: true` and matching options
+  will be taken from the pool instead of being opened.
+  This is useful to avoid CPU spikes when a lot of streams are expected to start at once.
+
+  `opts` take the subset of `new/2` options that identifies pooled decoders:
+  #{Enum.map_join(@pool_key_options, ", ", &"`#{&1}`")}.
+
+  Returns the number of decoders that were added, which might be lower than `count`
+  when the pool is full.
+  """
+  @spec prewarm(codec(), non_neg_integer(), Keyword.t()) :: non_neg_integer()
+  def prewarm(codec, count, opts \\ []) when is_atom(codec) and is_integer(count) do
+    opts = NimbleOptions.validate!(opts, Keyword.take(@decoder_options_schema, @pool_key_options))
+
+    Xav.Decoder.NIF.prewarm(
+      codec,
+      opts[:channels] || -1,
+      count,
+      opts |> Keyword.take(@nif_options) |> Map.new()
+    )
+  end
+
+  @doc """
+  Returns statistics of the decoder pool.
+
+  * `hits` - decoders created with `pooled: true` that were taken from the pool
+  * `misses` - decoders created with `pooled: true` that had to be opened
+  * `opens` - the number of decoders opened for the pool, including prewarmed ones
+  * `open_time_us` - total time spent on opening them, in microseconds
+  * `idle` - decoders currently waiting in the pool
+  * `max_idle` - the pool size, see `set_pool_size/1`
+  """
+  @spec pool_stats() :: %{
+          hits: non_neg_integer(),
+          misses: non_neg_integer(),
+          opens: non_neg_integer(),
+          open_time_us: non_neg_integer(),
+          idle: non_neg_integer(),
+          max_idle: non_neg_integer()
+        }
+  def pool_stats(), do: Xav.Decoder.NIF.pool_stats()
+
+  @doc """
+  Sets the maximum number of idle decoders kept in the decoder pool. Defaults to 16.
+
+  Decoders returned to a full pool are freed. Lowering the size frees
+  the excess idle decoders immediately.
+  """
+  @spec set_pool_size(non_neg_integer()) :: :ok
+  def set_pool_size(size) when is_integer(size) and size >= 0,
+    do: Xav.Decoder.NIF.set_pool_size(size)
+
   @doc """
   Decodes an audio/video frame.
 
@@ -107,7 +426,7 @@ defmodule Xav.Decoder do
   In both cases, `:ok` term is returned and more data needs to be provided.
   """
   @spec decode(t(), binary(), pts: integer(), dts: integer()) ::
-          :ok | {:ok, Xav.Frame.t()} | {:error, atom()}
+          :ok | {:ok, Xav.Frame.t() | [Xav.Frame.t()] | Xav.Batch.t()} | {:error, atom()}
   def decode(decoder, data, opts \\ []) do
     pts = opts[:pts] || 0
     dts = opts[:dts] || 0
@@ -116,11 +435,30 @@ defmodule Xav.Decoder do
       :ok ->
         :ok
 
+      # Audio frames with levels, possibly without data.
+      {:ok, {_data, _format, 0, _pts, %{}}} ->
+        :ok
+
+      {:ok, {_data, _format, _samples, _pts, %{}} = frame} ->
+        {:ok, to_frame(frame)}
+
       {:ok, {data, format, width, height, pts}} ->
         {:ok, Xav.Frame.new(data, format, width, height, pts)}
 
+      {:ok, {planes, format, width, height, pts, linesizes}} ->
+        {:ok, Xav.Frame.new(planes, format, width, height, pts, linesizes)}
+
+      {:ok, {_data, _format, _width, _height, _pts, nil, _tensor} = frame} ->
+        {:ok, to_frame(frame)}
+
+      {:ok, {:batch, _data, _format, _width, _height, _pts, _tensor} = batch} ->
+        {:ok, Xav.Batch.from_nif(batch)}
+
+      {:ok, renditions} when is_list(renditions) ->
+        {:ok, Enum.map(renditions, &to_frame/1)}
+
       # Sometimes, audio converter might not return data immediately.
-      {:ok, {"", _format, _samples, _pts}} ->
+      {:ok, {_data, _format, 0, _pts}} ->
         :ok
 
       {:ok, {data, format, samples, pts}} ->
@@ -131,6 +469,56 @@ defmodule Xav.Decoder do
     end
   end
 
+  @doc """
+  Queues a packet for decoding on a native thread pool.
+
+  Unlike `decode/3`, this function returns immediately and doesn't occupy
+  a dirty scheduler. The packet is decoded by a pool of native threads
+  (one per CPU core) shared by all decoders. Packets of a single decoder
+  are always decoded in order.
+
+  Once the packet is decoded, the calling process receives a message:
+
+  ```
+  {:xav_decoder, decoder, {:ok, [Xav.Frame.t()]} | {:error, reason}}
+  ```
+
+  Every successfully queued packet results in exactly one message.
+  The list of frames might be empty, e.g. when the decoder needs more data.
+
+  If there are already `async_queue_size` packets waiting for this decoder,
+  `{:error, :queue_full}` is returned and the packet is dropped. Wait for
+  some of the replies before queueing more packets.
+
+  `decode/3`, `decode_many/2` and `flush/1` can be mixed with this function,
+  but they don't wait for queued packets, so wait for all replies first.
+  """
+  @spec decode_async(t(), binary(), pts: integer(), dts: integer()) ::
+          :ok | {:error, :queue_full}
+  def decode_async(decoder, data, opts \\ []) do
+    Xav.Decoder.NIF.decode_async(decoder, data, opts[:pts] || 0, opts[:dts] || 0)
+  end
+
+  @doc """
+  Decodes a list of packets in a single call.
+
+  Every packet is a `{data, pts, dts}` tuple.
+
+  Unlike `decode/3`, the decoder is fully drained after every packet,
+  so all produced frames are returned in the order they were decoded.
+  The number of returned frames doesn't have to match the number of packets.
+
+  This is cheaper than calling `decode/3` for every packet, as all of the
+  packets are decoded in a single NIF call.
+  """
+  @spec decode_many(t(), [{binary(), integer(), integer()}]) ::
+          {:ok, [Xav.Frame.t()]} | {:error, atom()}
+  def decode_many(decoder, packets) do
+    with {:ok, frames} <- Xav.Decoder.NIF.decode_many(decoder, packets) do
+      {:ok, to_frames(frames)}
+    end
+  end
+
   @doc """
   Flushes the decoder.
 
@@ -140,12 +528,38 @@ defmodule Xav.Decoder do
   @spec flush(t()) :: {:ok, [Xav.Frame.t()]} | {:error, atom()}
   def flush(decoder) do
     with {:ok, frames} <- Xav.Decoder.NIF.flush(decoder) do
-      frames =
-        Enum.map(frames, fn {data, format, width, height, pts} ->
-          Xav.Frame.new(data, format, width, height, pts)
-        end)
+      {:ok, to_frames(frames)}
+    end
+  end
 
-      {:ok, frames}
+  @doc """
+  Flushes the decoder incrementally.
+
+  Works like `flush/1`, but returns at most `max_frames` frames per call,
+  so that only a bounded number of frames is kept in memory at a time.
+  Keep calling this function while it returns `{:ok, frames}`.
+  `{:eof, frames}` is returned with the last frames (possibly none),
+  after which the decoder can be used to decode a new stream.
+
+  ```elixir
+  defp drain(decoder) do
+    case Xav.Decoder.flush_next(decoder, 4) do
+      {:ok, frames} ->
+        process(frames)
+        drain(decoder)
+
+      {:eof, frames} ->
+        process(frames)
+    end
+  end
+  ```
+  """
+  @spec flush_next(t(), pos_integer()) ::
+          {:ok, [Xav.Frame.t()]} | {:eof, [Xav.Frame.t()]} | {:error, atom()}
+  def flush_next(decoder, max_frames \\ 1) when is_integer(max_frames) and max_frames > 0 do
+    case Xav.Decoder.NIF.flush_next(decoder, max_frames) do
+      {:error, _reason} = error -> error
+      {status, frames} -> {status, to_frames(frames)}
     end
   end
 
@@ -158,4 +572,105 @@ defmodule Xav.Decoder do
       {:error, reason} -> raise "Failed to flush decoder: #{inspect(reason)}"
     end
   end
+
+  defp validate_outputs!(opts) do
+    case Keyword.fetch(opts, :outputs) do
+      :error ->
+        opts
+
+      {:ok, outputs} ->
+        if Enum.any?([:out_format, :out_width, :out_height], &Keyword.has_key?(opts, &1)) do
+          raise ArgumentError,
+                "`outputs` can't be combined with `out_format`, `out_width` and `out_height`"
+        end
+
+        if outputs == [] or Enum.any?(outputs, &(&1 == [])) do
+          raise ArgumentError,
+                "Every output requires at least one of `out_format`, `out_width`, " <>
+                  "`out_height` or `crop`"
+        end
+
+        outputs =
+          Enum.map(
+            outputs,
+            &{&1[:out_format], &1[:out_width] || -1, &1[:out_height] || -1, &1[:crop]}
+          )
+
+        Keyword.put(opts, :outputs, outputs)
+    end
+  end
+
+  defp validate_tensor!(opts) do
+    case Keyword.fetch(opts, :tensor) do
+      :error ->
+        opts
+
+      {:ok, tensor} ->
+        if Keyword.has_key?(opts, :outputs) do
+          raise ArgumentError, "`tensor` can't be combined with `outputs`"
+        end
+
+        out_format = TensorOptions.out_format!(tensor, opts[:out_format])
+
+        opts
+        |> Keyword.put(:out_format, out_format)
+        |> Keyword.put(:tensor, TensorOptions.to_nif(tensor))
+    end
+  end
+
+  defp validate_batch_size!(opts) do
+    if Keyword.has_key?(opts, :batch_size) and
+         (Keyword.has_key?(opts, :outputs) or opts[:frame_layout] == :planes) do
+      raise ArgumentError,
+            "`batch_size` can't be combined with `outputs` or `frame_layout: :planes`"
+    end
+
+    opts
+  end
+
+  defp validate_frame_size!(opts) do
+    cond do
+      not Keyword.has_key?(opts, :frame_size) ->
+        if opts[:frame_overlap] > 0 or Keyword.has_key?(opts, :time_base) do
+          raise ArgumentError, "`frame_overlap` and `time_base` require `frame_size`"
+        end
+
+        Keyword.delete(opts, :frame_overlap)
+
+      opts[:frame_overlap] >= opts[:frame_size] ->
+        raise ArgumentError, "`frame_overlap` has to be lower than `frame_size`"
+
+      true ->
+        opts
+    end
+  end
+
+  defp to_frames(frames) do
+    frames
+    |> Enum.map(&to_frame/1)
+    |> Enum.reject(&is_nil/1)
+  end
+
+  defp to_frame({_data, _format, 0, _pts, %{}}), do: nil
+
+  defp to_frame({data, format, samples, pts, %{} = levels}),
+    do: %Xav.Frame{Xav.Frame.new(data, format, samples, pts) | levels: levels}
+
+  defp to_frame({data, format, width, height, pts}),
+    do: Xav.Frame.new(data, format, width, height, pts)
+
+  defp to_frame({planes, format, width, height, pts, linesizes}),
+    do: Xav.Frame.new(planes, format, width, height, pts, linesizes)
+
+  defp to_frame({:batch, _data, _format, _width, _height, _pts, _tensor} = batch),
+    do: Xav.Batch.from_nif(batch)
+
+  defp to_frame({data, format, width, height, pts, nil, tensor}),
+    do: %Xav.Frame{Xav.Frame.new(data, format, width, height, pts) | tensor: tensor}
+
+  defp to_frame(renditions) when is_list(renditions), do: Enum.map(renditions, &to_frame/1)
+
+  # Sometimes, audio converter might not return data immediately.
+  defp to_frame({_data, _format, 0, _pts}), do: nil
+  defp to_frame({data, format, samples, pts}), do: Xav.Frame.new(data, format, samples, pts)
 end
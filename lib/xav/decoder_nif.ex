@@ -6,7 +6,7 @@ defmodule Xav.Decoder.NIF do
 
   def __on_load__ do
     path = :filename.join(:code.priv_dir(:xav), ~c"libxavdecoder")
-    :ok = :erlang.load_nif(path, 0)
+    :ok = :erlang.load_nif(path, Xav.ThreadBudget.get())
   end
 
   def new(
@@ -16,18 +16,31 @@ defmodule Xav.Decoder.NIF do
         _out_sample_rate,
         _out_channels,
         _out_width,
-        _out_height
+        _out_height,
+        _options
       ) do
     :erlang.nif_error(:undef)
   end
 
   def decode(_decoder, _data, _pts, _dts), do: :erlang.nif_error(:undef)
 
+  def decode_many(_decoder, _packets), do: :erlang.nif_error(:undef)
+
+  def decode_async(_decoder, _data, _pts, _dts), do: :erlang.nif_error(:undef)
+
   def flush(_decoder), do: :erlang.nif_error(:undef)
 
+  def flush_next(_decoder, _max_frames), do: :erlang.nif_error(:undef)
+
   def pixel_formats(), do: :erlang.nif_error(:undef)
 
   def sample_formats(), do: :erlang.nif_error(:undef)
 
   def list_decoders(), do: :erlang.nif_error(:undef)
+
+  def prewarm(_codec, _channels, _count, _options), do: :erlang.nif_error(:undef)
+
+  def pool_stats(), do: :erlang.nif_error(:undef)
+
+  def set_pool_size(_size), do: :erlang.nif_error(:undef)
 end
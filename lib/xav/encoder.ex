@@ -8,6 +8,56 @@ defmodule Xav.Encoder do
   @type codec :: atom()
   @type encoder_options :: Keyword.t()
 
+  @async_queue_size_option [
+    type: :pos_integer,
+    default: 16,
+    doc: """
+    Maximum number of frames waiting to be encoded by `encode_async/2`.
+    """
+  ]
+
+  @realtime_option [
+    type: :boolean,
+    default: false,
+    doc: """
+    Tune the encoder for low latency, e.g. for live streaming and video calls.
+
+    Applies a preset of the encoder's options, which `options` take precedence over:
+
+      * `libx264` - `preset: :veryfast, tune: :zerolatency`
+      * `libx265` - `preset: :ultrafast, tune: :zerolatency`
+      * `libopenh264` - `allow_skip_frames: true`
+      * `h264_nvenc`, `hevc_nvenc` - `preset: :p1, tune: :ull, zerolatency: true`
+      * `h264_videotoolbox`, `hevc_videotoolbox` - `realtime: true`
+      * `libvpx` - `deadline: :realtime, "cpu-used": 8, "lag-in-frames": 0`
+      * `libvpx-vp9` - same as `libvpx` and `"row-mt": true`
+      * `libaom-av1` - `usage: :realtime, "cpu-used": 8, "lag-in-frames": 0, "row-mt": true`
+      * `libsvtav1` - `preset: 10`
+      * `librav1e` - `speed: 10`
+      * `libopus` - `application: :lowdelay`
+
+    Other encoders are left as they are.
+    """
+  ]
+
+  @options_option [
+    type: {:custom, __MODULE__, :validate_options, []},
+    default: [],
+    doc: """
+    FFmpeg options of the encoder, e.g. `[crf: 23, maxrate: 2_000_000, bufsize: 1_000_000]`
+    for `libx264` or `[deadline: :realtime, "cpu-used": 8]` for `libvpx`.
+
+    These can be both generic codec options (e.g. `b`, `maxrate`, `bufsize`, `g`)
+    and the encoder's private ones (e.g. `preset`, `tune`, `crf`). Values can be atoms,
+    numbers, booleans or strings. Unknown option names raise when the encoder is created,
+    invalid values make the encoder fail to initialize. See `ffmpeg -h encoder=<name>`
+    for the options of an encoder.
+
+    Encoder threads (`threads`) are taken from the node-wide thread budget,
+    see `Xav.set_thread_budget/1`.
+    """
+  ]
+
   @video_encoder_schema [
     width: [
       type: :pos_integer,
@@ -66,7 +116,10 @@ defmodule Xav.Encoder do
 
       To get the list of available profiles for an encoder, see `Xav.list_encoders/0`
       """
-    ]
+    ],
+    realtime: @realtime_option,
+    options: @options_option,
+    async_queue_size: @async_queue_size_option
   ]
 
   @audio_encoder_schema [
@@ -100,7 +153,10 @@ defmodule Xav.Encoder do
 
       For possible values, check [this](https://ffmpeg.org/ffmpeg-utils.html#Channel-Layout).
       """
-    ]
+    ],
+    realtime: @realtime_option,
+    options: @options_option,
+    async_queue_size: @async_queue_size_option
   ]
 
   @doc """
@@ -133,6 +189,8 @@ defmodule Xav.Encoder do
           |> Map.new()
       end
 
+    nif_options = Map.update!(nif_options, :options, &options_to_nif/1)
+
     if codec_id do
       Xav.Encoder.NIF.new(nil, Map.put(nif_options, :codec_id, codec_id))
     else
@@ -143,16 +201,48 @@ defmodule Xav.Encoder do
   @doc """
   Encodes a frame.
 
+  Video frames can be either tightly packed or made of planes
+  (see `t:Xav.Frame.data/0`), e.g. as returned by a decoder with `frame_layout: :planes`.
+
   The return value may be an empty list in case the encoder
   needs more frames to produce a packet.
   """
   @spec encode(t(), Xav.Frame.t()) :: [Xav.Packet.t()]
   def encode(encoder, frame) do
     encoder
-    |> Xav.Encoder.NIF.encode(frame.data, frame.pts)
+    |> Xav.Encoder.NIF.encode(frame.data, frame.linesizes, frame.pts)
     |> to_packets()
   end
 
+  @doc """
+  Queues a frame for encoding on a native thread pool.
+
+  Unlike `encode/2`, this function returns immediately and doesn't occupy
+  a dirty scheduler, so encoding can be pipelined with capturing or decoding
+  the next frames. Frames are encoded by a pool of native threads (one per CPU core)
+  shared by all encoders. Frames of a single encoder are always encoded in order.
+
+  Once the frame is encoded, the calling process receives a message:
+
+  ```
+  {:xav_encoder, encoder, {:ok, [Xav.Packet.t()]} | {:error, reason}}
+  ```
+
+  Every successfully queued frame results in exactly one message.
+  The list of packets might be empty, e.g. when the encoder needs more frames.
+
+  If there are already `async_queue_size` frames waiting for this encoder,
+  `{:error, :queue_full}` is returned and the frame is dropped. Wait for
+  some of the replies before queueing more frames.
+
+  `encode/2` and `flush/1` can be mixed with this function, but they don't wait
+  for queued frames, so wait for all replies before flushing.
+  """
+  @spec encode_async(t(), Xav.Frame.t()) :: :ok | {:error, :queue_full}
+  def encode_async(encoder, frame) do
+    Xav.Encoder.NIF.encode_async(encoder, frame.data, frame.linesizes, frame.pts)
+  end
+
   @doc """
   Flush the encoder.
   """
@@ -163,6 +253,31 @@ defmodule Xav.Encoder do
     |> to_packets()
   end
 
+  @doc false
+  def validate_options(options) do
+    valid? =
+      Keyword.keyword?(options) and
+        Enum.all?(options, fn {_name, value} ->
+          is_atom(value) or is_number(value) or is_binary(value)
+        end)
+
+    if valid? do
+      {:ok, options}
+    else
+      {:error,
+       "expected options to be a keyword list of atoms, numbers or strings, " <>
+         "got: #{inspect(options)}"}
+    end
+  end
+
+  defp options_to_nif(options) do
+    Enum.map(options, fn
+      {name, true} -> {Atom.to_string(name), "1"}
+      {name, false} -> {Atom.to_string(name), "0"}
+      {name, value} -> {Atom.to_string(name), to_string(value)}
+    end)
+  end
+
   defp to_packets(result) do
     Enum.map(result, fn {data, dts, pts, keyframe?} ->
       %Xav.Packet{data: data, dts: dts, pts: pts, keyframe?: keyframe?}
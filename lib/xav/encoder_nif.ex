@@ -6,12 +6,14 @@ defmodule Xav.Encoder.NIF do
 
   def __on_load__ do
     path = :filename.join(:code.priv_dir(:xav), ~c"libxavencoder")
-    :ok = :erlang.load_nif(path, 0)
+    :ok = :erlang.load_nif(path, Xav.ThreadBudget.get())
   end
 
   def new(_codec, _params), do: :erlang.nif_error(:undef)
 
-  def encode(_encoder, _data, _pts), do: :erlang.nif_error(:undef)
+  def encode(_encoder, _data, _linesizes, _pts), do: :erlang.nif_error(:undef)
+
+  def encode_async(_encoder, _data, _linesizes, _pts), do: :erlang.nif_error(:undef)
 
   def flush(_encoder), do: :erlang.nif_error(:undef)
 
@@ -24,14 +24,58 @@ defmodule Xav.Frame do
   @type width :: non_neg_integer() | nil
   @type height :: non_neg_integer() | nil
 
+  @typedoc """
+  Frame data.
+
+  It's a single binary with all planes tightly packed one after another,
+  or, for video frames with `linesizes` set, a list of binaries - one per plane.
+  Rows of a plane are `linesize` bytes apart, which might include padding
+  after the actual pixels. The last row of a plane doesn't have to be padded.
+
+  Audio frames in a planar sample format (e.g. `:fltp`) are a list of binaries,
+  one per channel. Otherwise, samples of all channels are interleaved in a single binary.
+  """
+  @type data() :: binary() | [binary()]
+
+  @typedoc """
+  Element type and layout of a video frame returned as a normalized float tensor.
+
+  The frame's data is then a binary of native-endian floats, in `:hwc`
+  (height, width, channels) or `:chw` (channels, height, width) order.
+  """
+  @type tensor() :: {:f32 | :f16, :hwc | :chw}
+
+  @typedoc """
+  Region of a video frame, as an `{x, y, width, height}` tuple.
+  """
+  @type crop() :: {non_neg_integer(), non_neg_integer(), pos_integer(), pos_integer()}
+
+  @typedoc """
+  Levels of an audio frame, measured on its decoded samples.
+
+  * `rms` and `peak` - linear values in the `0.0..1.0` range, one per decoded channel
+  * `level` - level of all channels in -dBov, as in RFC 6464, from `0` (the loudest)
+    to `127` (silence)
+  * `voice` - whether the frame contains voice, `nil` when voice activity detection is disabled
+  """
+  @type levels() :: %{
+          rms: [float()],
+          peak: [float()],
+          level: 0..127,
+          voice: boolean() | nil
+        }
+
   @type t() :: %__MODULE__{
           type: :audio | :video,
-          data: binary(),
+          data: data(),
           format: format(),
           width: width(),
           height: height(),
           samples: integer() | nil,
-          pts: integer()
+          pts: integer(),
+          linesizes: [pos_integer()] | nil,
+          tensor: tensor() | nil,
+          levels: levels() | nil
         }
 
   defstruct [
@@ -41,7 +85,10 @@ defmodule Xav.Frame do
     :width,
     :height,
     :samples,
-    :pts
+    :pts,
+    :linesizes,
+    :tensor,
+    :levels
   ]
 
   @doc """
@@ -59,7 +106,16 @@ defmodule Xav.Frame do
     }
   end
 
-  @spec new(binary(), format(), integer(), integer()) :: t()
+  @doc """
+  Creates a new video frame out of a list of planes and their linesizes.
+  """
+  @spec new([binary()], video_format(), width(), height(), integer(), [pos_integer()]) :: t()
+  def new(planes, format, width, height, pts, linesizes)
+      when is_list(planes) and length(planes) == length(linesizes) do
+    %__MODULE__{new(planes, format, width, height, pts) | linesizes: linesizes}
+  end
+
+  @spec new(data(), format(), integer(), integer()) :: t()
   def new(data, format, samples, pts) do
     %__MODULE__{
       type: :audio,
@@ -79,15 +135,41 @@ defmodule Xav.Frame do
     For video frames, the only supported pixel formats are:
       * `:rgb24`
       * `:bgr24`
+
+    Video frames made of planes (see `t:data/0`) are not supported.
+
+    Video frames returned as tensors (see `t:tensor/0`) are only wrapped,
+    with dimension names following their layout.
+
+    Audio frames in a planar sample format are stacked into a tensor
+    with dimension names `[:channels, :samples]`.
     """
     @spec to_nx(t()) :: Nx.Tensor.t()
-    def to_nx(%__MODULE__{type: :video, format: format} = frame)
+    def to_nx(%__MODULE__{type: :video, tensor: {type, :hwc}} = frame) do
+      frame.data
+      |> Nx.from_binary(type)
+      |> Nx.reshape({frame.height, frame.width, 3}, names: [:height, :width, :channels])
+    end
+
+    def to_nx(%__MODULE__{type: :video, tensor: {type, :chw}} = frame) do
+      frame.data
+      |> Nx.from_binary(type)
+      |> Nx.reshape({3, frame.height, frame.width}, names: [:channels, :height, :width])
+    end
+
+    def to_nx(%__MODULE__{type: :video, format: format, linesizes: nil} = frame)
         when format in [:rgb24, :bgr24] do
       frame.data
       |> Nx.from_binary(:u8)
       |> Nx.reshape({frame.height, frame.width, 3}, names: [:height, :width, :channels])
     end
 
+    def to_nx(%__MODULE__{type: :audio, data: planes} = frame) when is_list(planes) do
+      planes
+      |> Enum.map(&Nx.from_binary(&1, normalize_format(frame.format)))
+      |> Nx.stack(names: [:channels, :samples])
+    end
+
     def to_nx(%__MODULE__{type: :audio} = frame) do
       Nx.from_binary(frame.data, normalize_format(frame.format))
     end
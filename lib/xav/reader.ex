@@ -3,6 +3,8 @@ defmodule Xav.Reader do
   Audio/video file reader.
   """
 
+  alias Xav.{AudioLevelsOptions, ResamplerOptions, TensorOptions}
+
   @reader_options_schema [
     read: [
       type: {:in, [:audio, :video]},
@@ -20,6 +22,11 @@ defmodule Xav.Reader do
       The output format of the audio samples. For a list of available
       sample formats check `Xav.sample_formats/0`.
 
+      Defaults to the packed counterpart of the decoded format. Planar formats
+      return one binary per channel (see `t:Xav.Frame.data/0`).
+      When neither the sample rate nor the number of channels change,
+      samples are returned as decoded, or only interleaved, without resampling.
+
       For video samples, it is always `:rgb24`.
       """
     ],
@@ -38,7 +45,125 @@ defmodule Xav.Reader do
         "the framerate a a 2-element tuple with the first element beign the nominator and the second element the denominator. Will only be used when reading from a device."
     ],
     width: [type: :non_neg_integer, default: 0, doc: "the width of the device resolution. Only used when reading from a device."],
-    height: [type: :non_neg_integer,default: 0,  doc: "the height of the device resolution. Only used when reading from a device."]
+    height: [type: :non_neg_integer,default: 0,  doc: "the height of the device resolution. Only used when reading from a device."],
+    thread_count: [
+      type: :non_neg_integer,
+      default: 1,
+      doc: """
+      Number of threads used to decode the stream.
+
+      `0` lets FFmpeg pick the number of threads based on the number of CPU cores.
+      When a node-wide thread budget is set (see `Xav.set_thread_budget/1`), `0` means
+      one thread per CPU core and the number of threads is clamped to what is left in the budget.
+      """
+    ],
+    thread_type: [
+      type: {:in, [:frame, :slice, :auto]},
+      default: :auto,
+      doc: """
+      Threading model used when `thread_count` is not `1`.
+
+      `:frame` decodes multiple frames in parallel, which scales best
+      but delays output by one frame per thread. `:slice` decodes slices
+      of a single frame in parallel and adds no latency, but only helps for
+      streams encoded with multiple slices. `:auto` allows both and lets
+      the codec decide.
+      """
+    ],
+    skip_frame: [
+      type: {:in, [:default, :nonref, :bidir, :nonintra, :nonkey, :all]},
+      doc: """
+      Frames the decoder skips entirely - they are neither reconstructed nor converted.
+
+      * `:nonref` - skip frames that are not used as a reference
+      * `:bidir` - skip B-frames
+      * `:nonintra` - skip all but intra frames
+      * `:nonkey` - skip all but keyframes
+      * `:all` - skip all frames
+
+      With `:nonkey` (or `:all`), non-key packets are dropped before reaching the decoder,
+      so a keyframe-only scan runs at demuxing speed.
+
+      Not every codec supports every mode.
+      """
+    ],
+    skip_loop_filter: [
+      type: {:in, [:default, :nonref, :bidir, :nonintra, :nonkey, :all]},
+      doc: """
+      Frames for which the in-loop (deblocking) filter is skipped.
+      Takes the same values as `skip_frame`. Trades quality for speed.
+      """
+    ],
+    skip_idct: [
+      type: {:in, [:default, :nonref, :bidir, :nonintra, :nonkey, :all]},
+      doc: """
+      Frames for which IDCT is skipped.
+      Takes the same values as `skip_frame`. Trades quality for speed.
+      """
+    ],
+    zero_copy: [
+      type: :boolean,
+      default: false,
+      doc: """
+      Return video frames without copying them out of FFmpeg buffers.
+
+      The frame data is a binary pointing directly at the FFmpeg buffer,
+      which is released once the binary is garbage collected.
+      Keep in mind that holding a reference to such a binary
+      (or any sub-binary of it) keeps the whole frame in memory.
+
+      Frames whose planes are not laid out as a single, tightly packed buffer
+      are still copied.
+      """
+    ],
+    converter_threads: [
+      type: :non_neg_integer,
+      default: 1,
+      doc: """
+      Number of threads used to convert video frames to the output format.
+
+      `0` uses one thread per CPU core. Each frame is split into horizontal
+      slices that are scaled in parallel, which helps with large frames
+      (e.g. 4K to 1080p). Requires FFmpeg 5.0 or newer, older versions
+      always use a single thread.
+      """
+    ],
+    fast_path: [
+      type: :boolean,
+      default: true,
+      doc: """
+      Use hand-written SIMD kernels instead of swscale for the most common conversions:
+      `yuv420p`/`nv12` to `rgb24`/`bgr24`, either 1:1 or with an exact 2x downscale.
+      The kernels use a box filter for downscaling, so the output might slightly
+      differ from swscale's. Other conversions always use swscale.
+      The kernels always run on a single thread, regardless of `converter_threads`.
+      """
+    ],
+    tensor: TensorOptions.option(),
+    frame_size: [
+      type: :pos_integer,
+      doc: """
+      Return audio frames of exactly `frame_size` samples per channel,
+      e.g. 480_000 samples for 30 s windows of 16 kHz audio.
+
+      Converted samples are collected in a FIFO and read out as soon as there are enough
+      of them. The last frame of the stream includes the samples delayed by the resampler
+      and is padded with silence. Frames' `pts` is the `pts` of the first decoded frame
+      advanced by the number of samples returned so far.
+
+      Only used when reading audio.
+      """
+    ],
+    frame_overlap: [
+      type: :non_neg_integer,
+      default: 0,
+      doc: """
+      Number of samples per channel shared by consecutive frames when `frame_size` is set,
+      e.g. for sliding windows. Has to be lower than `frame_size`.
+      """
+    ],
+    resampler: ResamplerOptions.option(),
+    levels: AudioLevelsOptions.option()
   ]
 
   @type t() :: %__MODULE__{
@@ -70,6 +195,22 @@ defmodule Xav.Reader do
     end
   end
 
+  @nif_options [
+    :thread_count,
+    :thread_type,
+    :skip_frame,
+    :skip_loop_filter,
+    :skip_idct,
+    :zero_copy,
+    :converter_threads,
+    :fast_path,
+    :tensor,
+    :frame_size,
+    :frame_overlap,
+    :resampler,
+    :levels
+  ]
+
   @doc """
   Creates a new audio/video reader.
 
@@ -102,11 +243,21 @@ defmodule Xav.Reader do
   @spec next_frame(t()) :: {:ok, Xav.Frame.t()} | {:error, :eof}
   def next_frame(%__MODULE__{reader: ref} = reader) do
     case Xav.Reader.NIF.next_frame(ref) do
+      {:ok, {_data, _format, 0, _pts, %{}}} ->
+        next_frame(reader)
+
+      {:ok, {data, format, samples, pts, %{} = levels}} ->
+        format = normalize_format(format)
+        {:ok, %Xav.Frame{Xav.Frame.new(data, format, samples, pts) | levels: levels}}
+
       {:ok, {data, format, width, height, pts}} ->
         format = normalize_format(format)
         {:ok, Xav.Frame.new(data, format, width, height, pts)}
 
-      {:ok, {"", _format, _samples, _pts}} ->
+      {:ok, {data, format, width, height, pts, nil, tensor}} ->
+        {:ok, %Xav.Frame{Xav.Frame.new(data, format, width, height, pts) | tensor: tensor}}
+
+      {:ok, {_data, _format, 0, _pts}} ->
         # Sometimes, audio converter might not return data immediately.
         # Hence, call until we succeed.
         next_frame(reader)
@@ -120,6 +271,27 @@ defmodule Xav.Reader do
     end
   end
 
+  @doc """
+  Reads and decodes the next `count` video frames into a single `Xav.Batch`.
+
+  The batch binary is allocated once and frames are converted straight into it,
+  so the batch can be turned into a tensor with `Xav.Batch.to_nx/1` without
+  any further copies. With the `tensor` option, frames are stored as tensors.
+
+  The last batch of the stream might have fewer frames. So does a batch
+  followed by a change of the resolution - the first frame in the new resolution
+  starts the next batch. Such a frame is kept by the reader, so the next batch
+  has the size requested by the call that read it.
+
+  Only video streams are supported.
+  """
+  @spec next_batch(t(), pos_integer()) :: {:ok, Xav.Batch.t()} | {:error, :eof}
+  def next_batch(%__MODULE__{reader: ref}, count) when is_integer(count) and count > 0 do
+    with {:ok, batch} <- Xav.Reader.NIF.next_batch(ref, count) do
+      {:ok, Xav.Batch.from_nif(batch)}
+    end
+  end
+
   @doc """
   Seeks the reader to the given time in seconds
   """
@@ -156,6 +328,10 @@ defmodule Xav.Reader do
   end
 
   defp do_create_reader(path, opts) do
+    if opts[:read] == :video and Keyword.has_key?(opts, :levels) do
+      raise ArgumentError, "`levels` can only be used when reading audio"
+    end
+
     out_sample_rate = opts[:out_sample_rate] || 0
     out_channels = opts[:out_channels] || 0
     framerate = opts[:framerate]
@@ -171,7 +347,13 @@ defmodule Xav.Reader do
            out_channels,
            framerate,
            width,
-           height
+           height,
+           opts
+           |> Keyword.take(@nif_options)
+           |> Keyword.update(:tensor, nil, &TensorOptions.to_nif/1)
+           |> Keyword.update(:resampler, [], &ResamplerOptions.to_nif/1)
+           |> AudioLevelsOptions.validate!()
+           |> Map.new()
          ) do
       {:ok, reader, in_format, out_format, in_sample_rate, out_sample_rate, in_channels,
        out_channels, bit_rate, duration, codec} ->
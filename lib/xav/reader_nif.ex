@@ -6,14 +6,27 @@ defmodule Xav.Reader.NIF do
 
   def __on_load__ do
     path = :filename.join(:code.priv_dir(:xav), ~c"libxavreader")
-    :ok = :erlang.load_nif(path, 0)
+    :ok = :erlang.load_nif(path, Xav.ThreadBudget.get())
   end
 
-  def new(_path, _device, _video, _out_format, _out_sample_rate, _out_channels, _framerate, _width, _height),
-    do: :erlang.nif_error(:undef)
+  def new(
+        _path,
+        _device,
+        _video,
+        _out_format,
+        _out_sample_rate,
+        _out_channels,
+        _framerate,
+        _width,
+        _height,
+        _options
+      ),
+      do: :erlang.nif_error(:undef)
 
   def next_frame(_reader), do: :erlang.nif_error(:undef)
 
+  def next_batch(_reader, _count), do: :erlang.nif_error(:undef)
+
   def seek(_reader, _time_in_seconds), do: :erlang.nif_error(:undef)
 
   def set_log_level(_level), do: :erlang.nif_error(:undef)
@@ -0,0 +1,83 @@
+defmodule Xav.ResamplerOptions do
+  @moduledoc false
+
+  # Options shared by all of the modules that convert audio with swresample.
+
+  @presets [
+    fast: [filter_size: 8, phase_shift: 6, linear_interp: 0, cutoff: 0.9],
+    default: [],
+    high: [filter_size: 64, phase_shift: 12, linear_interp: 1, cutoff: 0.98],
+    soxr: [resampler: :soxr, precision: 28]
+  ]
+
+  @schema [
+    preset: [
+      type: {:in, Keyword.keys(@presets)},
+      default: :default,
+      doc: """
+      named set of swresample options, trading quality for speed:
+
+        * `:fast` - short filter (`filter_size: 8`, `phase_shift: 6`) without
+          interpolation between filter phases, well suited for speech recognition
+          and other workloads where the highest frequencies don't matter
+        * `:default` - FFmpeg's defaults (`filter_size: 32`, `phase_shift: 10`)
+        * `:high` - long filter (`filter_size: 64`, `phase_shift: 12`) with a cutoff
+          closer to the Nyquist frequency
+        * `:soxr` - the SoX resampler with 28 bits of precision, requires FFmpeg
+          built with libsoxr
+      """
+    ],
+    options: [
+      type: {:custom, __MODULE__, :validate_options, []},
+      default: [],
+      doc: """
+      raw swresample options, applied on top of the preset, e.g.
+      `[dither_method: :triangular, filter_size: 16]`. Values can be atoms, numbers
+      or strings. See the `Resampler Options` section of the FFmpeg documentation
+      for the available ones
+      """
+    ]
+  ]
+
+  @spec option() :: Keyword.t()
+  def option() do
+    [
+      type: :keyword_list,
+      keys: @schema,
+      doc: """
+      quality of resampling and dithering done by swresample
+
+      Only used when audio has to be resampled, remixed or converted to a different
+      sample format. Changing just the layout between planar and packed
+      doesn't go through swresample. Unknown option names raise when the NIF is created,
+      invalid values make the converter fail to initialize.
+      """
+    ]
+  end
+
+  def validate_options(options) do
+    valid? =
+      Keyword.keyword?(options) and
+        Enum.all?(options, fn {_name, value} ->
+          is_atom(value) or is_number(value) or is_binary(value)
+        end)
+
+    if valid? do
+      {:ok, options}
+    else
+      {:error,
+       "expected options to be a keyword list of atoms, numbers or strings, " <>
+         "got: #{inspect(options)}"}
+    end
+  end
+
+  @spec to_nif(Keyword.t() | nil) :: [{String.t(), String.t()}]
+  def to_nif(nil), do: []
+
+  def to_nif(resampler) do
+    @presets
+    |> Keyword.fetch!(resampler[:preset])
+    |> Keyword.merge(resampler[:options])
+    |> Enum.map(fn {name, value} -> {Atom.to_string(name), to_string(value)} end)
+  end
+end
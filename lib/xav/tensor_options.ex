@@ -0,0 +1,88 @@
+defmodule Xav.TensorOptions do
+  @moduledoc false
+
+  # Options shared by all of the modules that can return frames as tensors.
+
+  @channels_doc "list of 3 numbers, one per channel, in the order of the output pixel format"
+
+  @schema [
+    type: [
+      type: {:in, [:f32, :f16]},
+      default: :f32,
+      doc: "type of the tensor elements"
+    ],
+    layout: [
+      type: {:in, [:hwc, :chw]},
+      default: :hwc,
+      doc: """
+      order of the tensor dimensions, either `:hwc` (height, width, channels)
+      or `:chw` (channels, height, width)
+      """
+    ],
+    mean: [
+      type: {:custom, __MODULE__, :validate_channels, [:mean]},
+      default: [0.0, 0.0, 0.0],
+      doc: "mean subtracted from the channel values, " <> @channels_doc
+    ],
+    std: [
+      type: {:custom, __MODULE__, :validate_channels, [:std]},
+      default: [1.0, 1.0, 1.0],
+      doc: "standard deviation the channel values are divided by, " <> @channels_doc
+    ]
+  ]
+
+  @formats [:rgb24, :bgr24]
+
+  @spec option() :: Keyword.t()
+  def option() do
+    [
+      type: :keyword_list,
+      keys: @schema,
+      doc: """
+      return video frames as normalized float tensors, ready to be fed into a model
+
+      Every channel value `v` becomes `(v / 255 - mean) / std`, so `mean` and `std`
+      are expected in the `0..1` range (e.g. `[0.485, 0.456, 0.406]` and
+      `[0.229, 0.224, 0.225]` for ImageNet models). Normalization and the layout change
+      are done in the same pass that produces the frame's binary, and
+      `Xav.Frame.to_nx/1` only wraps it. Only `:rgb24` and `:bgr24` output formats
+      are supported, `:rgb24` is used unless `out_format` says otherwise.
+      Tensors are always copied out of the converter, regardless of `zero_copy`
+      and `frame_layout`.
+      """
+    ]
+  end
+
+  def validate_channels([_, _, _] = values, name) do
+    cond do
+      not Enum.all?(values, &is_number/1) ->
+        {:error, "expected #{name} to be a list of 3 numbers, got: #{inspect(values)}"}
+
+      name == :std and Enum.any?(values, &(&1 == 0)) ->
+        {:error, "expected std to be non-zero, got: #{inspect(values)}"}
+
+      true ->
+        {:ok, Enum.map(values, &(&1 * 1.0))}
+    end
+  end
+
+  def validate_channels(values, name) do
+    {:error, "expected #{name} to be a list of 3 numbers, got: #{inspect(values)}"}
+  end
+
+  # Returns the output format to use with tensor output, raising on an unsupported one.
+  @spec out_format!(Keyword.t() | nil, atom()) :: atom()
+  def out_format!(nil, out_format), do: out_format
+  def out_format!(_tensor, nil), do: :rgb24
+  def out_format!(_tensor, out_format) when out_format in @formats, do: out_format
+
+  def out_format!(_tensor, out_format) do
+    raise ArgumentError,
+          "tensor output requires `out_format` to be one of #{inspect(@formats)}, " <>
+            "got: #{inspect(out_format)}"
+  end
+
+  @spec to_nif(Keyword.t() | nil) :: tuple() | nil
+  def to_nif(nil), do: nil
+  def to_nif(tensor), do: {tensor[:type], tensor[:layout], tensor[:mean], tensor[:std]}
+end
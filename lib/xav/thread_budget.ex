@@ -0,0 +1,29 @@
+defmodule Xav.ThreadBudget do
+  @moduledoc false
+
+  # Every NIF library is a separate shared object, so the thread counters
+  # can't be kept in any of them. Instead, they are created once per node
+  # and passed to every library that creates threads when it is loaded.
+
+  @key {__MODULE__, :budget}
+
+  @spec get() :: binary()
+  def get() do
+    case :persistent_term.get(@key, nil) do
+      nil -> :global.trans({@key, self()}, &get_or_create/0, [node()])
+      budget -> budget
+    end
+  end
+
+  defp get_or_create() do
+    case :persistent_term.get(@key, nil) do
+      nil ->
+        budget = Xav.ThreadBudget.NIF.new()
+        :persistent_term.put(@key, budget)
+        budget
+
+      budget ->
+        budget
+    end
+  end
+end
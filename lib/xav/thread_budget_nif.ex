@@ -0,0 +1,17 @@
+defmodule Xav.ThreadBudget.NIF do
+  @moduledoc false
+
+  @compile {:autoload, false}
+  @on_load :__on_load__
+
+  def __on_load__ do
+    path = :filename.join(:code.priv_dir(:xav), ~c"libxavthreadbudget")
+    :ok = :erlang.load_nif(path, 0)
+  end
+
+  def new(), do: :erlang.nif_error(:undef)
+
+  def set(_budget, _threads), do: :erlang.nif_error(:undef)
+
+  def stats(_budget), do: :erlang.nif_error(:undef)
+end
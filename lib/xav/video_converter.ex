@@ -5,17 +5,20 @@ defmodule Xav.VideoConverter do
   It supports pixel format conversion and/or scaling.
   """
 
-  alias Xav.Frame
+  alias Xav.{Frame, TensorOptions}
   alias Xav.VideoConverter.NIF
 
   @type t :: %__MODULE__{
           converter: reference(),
           out_format: Frame.video_format(),
           out_width: Frame.width(),
-          out_height: Frame.height()
+          out_height: Frame.height(),
+          outputs: non_neg_integer() | nil,
+          tensor: Frame.tensor() | nil,
+          crop: Frame.crop() | nil
         }
 
-  @converter_schema [
+  @output_schema [
     out_width: [
       type: :pos_integer,
       required: false,
@@ -36,10 +39,75 @@ defmodule Xav.VideoConverter do
       type: :atom,
       required: false,
       doc: "video format to convert to (e.g. `:rgb24`)"
+    ],
+    crop: [
+      type: {:tuple, [:non_neg_integer, :non_neg_integer, :pos_integer, :pos_integer]},
+      required: false,
+      doc: """
+      region of the input frame to convert, as an `{x, y, width, height}` tuple
+
+      Only the region is converted and scaled, the rest of the frame is never touched.
+      `out_width` and `out_height` refer to the size of the converted region.
+      For formats with subsampled chroma (e.g. `yuv420p`), the chroma planes are cropped
+      starting at `x` and `y` rounded down to the subsampling. Converting a frame
+      that doesn't contain the whole region raises.
+      """
     ]
   ]
 
-  defstruct [:converter, :out_format, :out_width, :out_height]
+  @shared_schema [
+    zero_copy: [
+      type: :boolean,
+      default: false,
+      doc: """
+      return converted frames without copying them out of the converter
+
+      The frame data is a binary pointing directly at the converter's output buffer,
+      which is released once the binary is garbage collected.
+      """
+    ],
+    threads: [
+      type: :non_neg_integer,
+      default: 1,
+      doc: """
+      number of threads used for conversion, `0` means one per CPU core
+
+      Each frame is split into horizontal slices that are scaled in parallel,
+      which helps with large frames (e.g. 4K to 1080p).
+      Requires FFmpeg 5.0 or newer, older versions always use a single thread.
+      Threads are taken from the node-wide thread budget, see `Xav.set_thread_budget/1`.
+      """
+    ],
+    fast_path: [
+      type: :boolean,
+      default: true,
+      doc: """
+      use hand-written SIMD kernels for the most common conversions
+
+      Applies to `yuv420p`/`nv12` to `rgb24`/`bgr24` conversions, either 1:1
+      or with an exact 2x downscale. The kernels use a box filter for downscaling,
+      so the output might slightly differ from swscale's.
+      Other conversions always use swscale. The kernels always run on a single thread.
+      """
+    ],
+    frame_layout: [
+      type: {:in, [:packed, :planes]},
+      default: :packed,
+      doc: """
+      layout of the converted frames
+
+      `:packed` returns a single binary with tightly packed planes.
+      `:planes` returns a list of binaries, one per plane, with rows laid out
+      as in the converter's output buffer (see `t:Xav.Frame.data/0`),
+      so that they can be passed to `Xav.Encoder.encode/2` without repacking.
+      Combined with `zero_copy`, the planes point directly at the output buffer.
+      """
+    ]
+  ]
+
+  @converter_schema @output_schema ++ @shared_schema ++ [tensor: TensorOptions.option()]
+
+  defstruct [:converter, :out_format, :out_width, :out_height, :outputs, :tensor, :crop]
 
   @doc """
   Creates a new video converter.
@@ -49,35 +117,181 @@ defmodule Xav.VideoConverter do
   @spec new(Keyword.t()) :: t()
   def new(converter_opts) do
     opts = NimbleOptions.validate!(converter_opts, @converter_schema)
+    tensor = opts[:tensor]
+    opts = Keyword.put(opts, :out_format, TensorOptions.out_format!(tensor, opts[:out_format]))
 
-    if is_nil(opts[:out_format]) and is_nil(opts[:out_width]) and is_nil(opts[:out_height]) do
-      raise "At least one of `out_format`, `out_width` or `out_height` must be provided"
-    end
-
-    converter = NIF.new(opts[:out_format], opts[:out_width] || -1, opts[:out_height] || -1)
+    output = validate_output!(opts)
 
     %__MODULE__{
-      converter: converter,
+      converter: do_new([output], opts),
       out_format: opts[:out_format],
       out_width: opts[:out_width],
-      out_height: opts[:out_height]
+      out_height: opts[:out_height],
+      tensor: tensor && {tensor[:type], tensor[:layout]},
+      crop: opts[:crop]
     }
   end
 
+  @doc """
+  Creates a new video converter that converts every frame to multiple outputs at once,
+  e.g. a preview, a thumbnail and a model input.
+
+  Each output takes `out_width`, `out_height`, `out_format` and `crop`, just like `new/1`,
+  and at least one of them has to be provided. `opts` take the remaining options
+  of `new/1`, which apply to all of the outputs, except for `tensor`.
+
+  `convert/2` returns a list of frames, one per output, in the order of `outputs`.
+  All of the outputs are produced in a single NIF call. Each output is scaled from the
+  smallest frame that is at least as big as the output - either the input frame,
+  or one of the outputs listed before it. List bigger outputs first, so that
+  e.g. a thumbnail is scaled down from the preview instead of from the full frame.
+  Only outputs in either the input or the same pixel format are scaled from.
+  Cropped outputs are always converted from the input frame, so outputs with different
+  regions of the same frame are converted in a single call too.
+  """
+  @spec new_multi([Keyword.t()], Keyword.t()) :: t()
+  def new_multi([_ | _] = outputs, opts \\ []) do
+    opts = NimbleOptions.validate!(opts, @shared_schema)
+
+    outputs =
+      Enum.map(outputs, fn output ->
+        output
+        |> NimbleOptions.validate!(@output_schema)
+        |> validate_output!()
+      end)
+
+    %__MODULE__{converter: do_new(outputs, opts), outputs: length(outputs)}
+  end
+
+  defp validate_output!(opts) do
+    if Enum.all?([:out_format, :out_width, :out_height, :crop], &is_nil(opts[&1])) do
+      raise "At least one of `out_format`, `out_width`, `out_height` or `crop` must be provided"
+    end
+
+    {opts[:out_format], opts[:out_width] || -1, opts[:out_height] || -1, opts[:crop]}
+  end
+
+  defp do_new(outputs, opts) do
+    NIF.new(
+      outputs,
+      opts[:zero_copy],
+      opts[:threads],
+      opts[:fast_path],
+      opts[:frame_layout],
+      TensorOptions.to_nif(opts[:tensor])
+    )
+  end
+
   @doc """
   Converts a video frame.
+
+  The frame can be either tightly packed or made of planes (see `t:Xav.Frame.data/0`).
+
+  For converters created with `new_multi/2`, returns a list of frames, one per output.
   """
-  @spec convert(t(), Frame.t()) :: Frame.t()
+  @spec convert(t(), Frame.t()) :: Frame.t() | [Frame.t()]
   def convert(
-        %__MODULE__{out_format: format, out_width: nil, out_height: nil},
+        %__MODULE__{
+          out_format: format,
+          out_width: nil,
+          out_height: nil,
+          outputs: nil,
+          tensor: nil,
+          crop: nil
+        },
         %Frame{format: format} = frame
       ),
       do: frame
 
-  def convert(%__MODULE__{converter: converter}, frame) do
-    {data, out_format, width, height, _pts} =
-      NIF.convert(converter, frame.data, frame.width, frame.height, frame.format)
+  def convert(%__MODULE__{converter: converter} = video_converter, frame) do
+    converter
+    |> NIF.convert(frame.data, frame.width, frame.height, frame.format, frame.linesizes)
+    |> to_frames(frame, video_converter)
+  end
+
+  @doc """
+  Converts multiple regions of a single video frame in a single call.
+
+  Every region is an `{x, y, width, height}` tuple and is converted just like
+  with the `crop` option (see `new/1`), which it replaces, so only the regions
+  are ever converted. Returns a list of frames, one per region.
+
+  Regions of different sizes require different scaling contexts. The converter
+  keeps the state for a few recently used input sizes (see `stats/1`),
+  so when the regions come e.g. from a tracker, consider rounding their sizes.
 
+  Converters created with `new_multi/2` are not supported.
+  """
+  @spec convert_rois(t(), Frame.t(), [Frame.crop()]) :: [Frame.t()]
+  def convert_rois(%__MODULE__{converter: converter, outputs: nil}, frame, rois)
+      when is_list(rois) do
+    converter
+    |> NIF.convert_rois(
+      frame.data,
+      frame.width,
+      frame.height,
+      frame.format,
+      frame.linesizes,
+      rois
+    )
+    |> Enum.map(&to_frame(&1, frame))
+  end
+
+  @doc """
+  Converts a list of video frames in a single call.
+
+  This is cheaper than calling `convert/2` for every frame,
+  especially for small output sizes, as the whole list is converted
+  in a single NIF call, reusing the scaling context and output buffers.
+  """
+  @spec convert_many(t(), [Frame.t()]) :: [Frame.t()] | [[Frame.t()]]
+  def convert_many(
+        %__MODULE__{
+          out_format: format,
+          out_width: nil,
+          out_height: nil,
+          outputs: nil,
+          tensor: nil,
+          crop: nil
+        } = converter,
+        frames
+      ) do
+    if Enum.all?(frames, &(&1.format == format)) do
+      frames
+    else
+      do_convert_many(converter, frames)
+    end
+  end
+
+  def convert_many(converter, frames), do: do_convert_many(converter, frames)
+
+  @doc """
+  Returns statistics of the converter.
+
+  The converter keeps the state for the 3 most recently used inputs
+  (resolution and pixel format) besides the current one, so that switching
+  back to them, e.g. between simulcast layers, doesn't require reinitialization.
+
+  * `cache_hits` - the number of input changes to a recently used input
+  * `cache_misses` - the number of input changes that required reinitialization
+
+  For converters created with `new_multi/2`, the statistics are summed over all outputs.
+  """
+  @spec stats(t()) :: %{cache_hits: non_neg_integer(), cache_misses: non_neg_integer()}
+  def stats(%__MODULE__{converter: converter}), do: NIF.stats(converter)
+
+  defp do_convert_many(%__MODULE__{converter: converter} = video_converter, frames) do
+    converter
+    |> NIF.convert_many(
+      Enum.map(frames, &{&1.data, &1.width, &1.height, &1.format, &1.linesizes})
+    )
+    |> Enum.zip_with(frames, &to_frames(&1, &2, video_converter))
+  end
+
+  defp to_frames([converted], frame, %__MODULE__{outputs: nil}), do: to_frame(converted, frame)
+  defp to_frames(converted, frame, _converter), do: Enum.map(converted, &to_frame(&1, frame))
+
+  defp to_frame({data, out_format, width, height, _pts}, frame) do
     %Frame{
       type: frame.type,
       data: data,
@@ -87,4 +301,12 @@ defmodule Xav.VideoConverter do
       pts: frame.pts
     }
   end
+
+  defp to_frame({planes, out_format, width, height, pts, linesizes}, frame) do
+    %Frame{to_frame({planes, out_format, width, height, pts}, frame) | linesizes: linesizes}
+  end
+
+  defp to_frame({data, out_format, width, height, pts, nil, tensor}, frame) do
+    %Frame{to_frame({data, out_format, width, height, pts}, frame) | tensor: tensor}
+  end
 end
@@ -6,10 +6,21 @@ defmodule Xav.VideoConverter.NIF do
 
   def __on_load__ do
     path = :filename.join(:code.priv_dir(:xav), ~c"libxavvideoconverter")
-    :ok = :erlang.load_nif(path, 0)
+    :ok = :erlang.load_nif(path, Xav.ThreadBudget.get())
   end
 
-  def new(_format, _width, _height), do: :erlang.nif_error(:undef)
+  def new(_outputs, _zero_copy, _threads, _fast_path, _frame_layout, _tensor),
+    do: :erlang.nif_error(:undef)
 
-  def convert(_converter, _frame, _width, _height, _pix_format), do: :erlang.nif_error(:undef)
+  def convert(_converter, _frame, _width, _height, _pix_format, _linesizes),
+    do: :erlang.nif_error(:undef)
+
+  def convert_many(_converter, _frames), do: :erlang.nif_error(:undef)
+
+  def convert_rois(_converter, _frame, _width, _height, _pix_format, _linesizes, _rois),
+    do: :erlang.nif_error(:undef)
+
+  def stats(_converter), do: :erlang.nif_error(:undef)
+
+  def check_yuv_kernels(_y, _u, _v), do: :erlang.nif_error(:undef)
 end
@@ -10,6 +10,7 @@ defmodule Xav.MixProject do
       version: @version,
       elixir: "~> 1.14",
       start_permanent: Mix.env() == :prod,
+      elixirc_paths: elixirc_paths(Mix.env()),
       description: "Elixir audio/video library built on top of FFmpeg",
       package: package(),
       compilers: [:elixir_make] ++ Mix.compilers(),
@@ -50,6 +51,9 @@ defmodule Xav.MixProject do
     ]
   end
 
+  defp elixirc_paths(:test), do: ["lib", "test/support"]
+  defp elixirc_paths(_env), do: ["lib"]
+
   defp package do
     [
       files: ~w(lib .formatter.exs mix.exs README* LICENSE* c_src Makefile),
@@ -0,0 +1,166 @@
+defmodule Xav.AudioMixerTest do
+  use ExUnit.Case, async: true
+
+  alias NimbleOptions.ValidationError
+
+  @opts [out_format: :flt, out_channels: 1, frame_size: 480, soft_clip: false]
+
+  defp flt_frame(value, samples, pts) do
+    data = for _ <- 1..samples, into: <<>>, do: <<value::float-32-native>>
+    Xav.Frame.new(data, :flt, samples, pts)
+  end
+
+  defp values(%Xav.Frame{data: data}), do: for(<<v::float-32-native <- data>>, do: v)
+
+  defp assert_all(frame, expected) do
+    assert Enum.all?(values(frame), &(abs(&1 - expected) < 1.0e-4))
+  end
+
+  test "new/1" do
+    assert %Xav.AudioMixer{out_format: :s16, out_sample_rate: 48_000, out_channels: 2} =
+             Xav.AudioMixer.new()
+
+    assert_raise ValidationError, fn -> Xav.AudioMixer.new(frame_size: 0) end
+
+    mixer = Xav.AudioMixer.new()
+    assert_raise ValidationError, fn -> Xav.AudioMixer.add_source(mixer, gain: -1) end
+  end
+
+  test "mixes sources with gain" do
+    mixer = Xav.AudioMixer.new(@opts)
+    a = Xav.AudioMixer.add_source(mixer)
+    b = Xav.AudioMixer.add_source(mixer, gain: 0.5)
+
+    :ok = Xav.AudioMixer.write(mixer, a, flt_frame(0.25, 960, 0))
+    # only a has written, b is awaited
+    assert [] = Xav.AudioMixer.mix(mixer)
+
+    :ok = Xav.AudioMixer.write(mixer, b, flt_frame(0.5, 960, 0))
+    assert [first, second] = Xav.AudioMixer.mix(mixer)
+
+    assert %Xav.Frame{format: :flt, samples: 480, pts: 0} = first
+    assert %Xav.Frame{samples: 480, pts: 480} = second
+    assert_all(first, 0.5)
+    assert_all(second, 0.5)
+
+    :ok = Xav.AudioMixer.set_gain(mixer, b, 0.0)
+    :ok = Xav.AudioMixer.write(mixer, a, flt_frame(0.25, 480, 960))
+    :ok = Xav.AudioMixer.write(mixer, b, flt_frame(0.5, 480, 960))
+    assert [third] = Xav.AudioMixer.mix(mixer)
+    assert_all(third, 0.25)
+  end
+
+  test "mixes missing sources as silence after max_delay" do
+    # 10 ms at 48 kHz
+    mixer = Xav.AudioMixer.new([max_delay: 10] ++ @opts)
+    a = Xav.AudioMixer.add_source(mixer)
+    _b = Xav.AudioMixer.add_source(mixer)
+
+    :ok = Xav.AudioMixer.write(mixer, a, flt_frame(0.25, 480, 0))
+    assert [] = Xav.AudioMixer.mix(mixer)
+
+    :ok = Xav.AudioMixer.write(mixer, a, flt_frame(0.25, 480, 480))
+    assert [frame] = Xav.AudioMixer.mix(mixer)
+    assert %Xav.Frame{pts: 0} = frame
+    assert_all(frame, 0.25)
+  end
+
+  test "fills gaps with silence and drops late samples" do
+    mixer = Xav.AudioMixer.new(@opts)
+    a = Xav.AudioMixer.add_source(mixer)
+
+    :ok = Xav.AudioMixer.write(mixer, a, flt_frame(0.25, 480, 0))
+    :ok = Xav.AudioMixer.write(mixer, a, flt_frame(0.25, 480, 960))
+    assert [first, gap, third] = Xav.AudioMixer.mix(mixer)
+    assert_all(first, 0.25)
+    assert_all(gap, 0.0)
+    assert_all(third, 0.25)
+
+    # the frame arrives after its part of the timeline has been mixed
+    :ok = Xav.AudioMixer.write(mixer, a, flt_frame(0.25, 480, 480))
+    assert [] = Xav.AudioMixer.flush(mixer)
+  end
+
+  test "keeps 64-bit pts" do
+    mixer = Xav.AudioMixer.new(@opts)
+    a = Xav.AudioMixer.add_source(mixer)
+    pts = 2 ** 33
+
+    :ok = Xav.AudioMixer.write(mixer, a, flt_frame(0.25, 960, pts))
+    assert [first, second] = Xav.AudioMixer.mix(mixer)
+    assert first.pts == pts
+    assert second.pts == pts + 480
+  end
+
+  test "flush/1 pads the last frame with silence" do
+    mixer = Xav.AudioMixer.new(@opts)
+    a = Xav.AudioMixer.add_source(mixer)
+
+    :ok = Xav.AudioMixer.write(mixer, a, flt_frame(0.25, 600, 0))
+    assert [_first] = Xav.AudioMixer.mix(mixer)
+    assert [last] = Xav.AudioMixer.flush(mixer)
+
+    assert %Xav.Frame{samples: 480, pts: 480} = last
+    {head, tail} = last |> values() |> Enum.split(120)
+    assert Enum.all?(head, &(&1 == 0.25))
+    assert Enum.all?(tail, &(&1 == 0.0))
+  end
+
+  test "clipping" do
+    for {soft_clip, check} <- [{false, &(&1 == 1.0)}, {true, &(&1 > 0.9 and &1 < 1.0)}] do
+      mixer = Xav.AudioMixer.new(Keyword.put(@opts, :soft_clip, soft_clip))
+      a = Xav.AudioMixer.add_source(mixer)
+      b = Xav.AudioMixer.add_source(mixer)
+
+      :ok = Xav.AudioMixer.write(mixer, a, flt_frame(0.7, 480, 0))
+      :ok = Xav.AudioMixer.write(mixer, b, flt_frame(0.7, 480, 0))
+      assert [frame] = Xav.AudioMixer.mix(mixer)
+      assert frame |> values() |> Enum.all?(check)
+    end
+  end
+
+  test "can be shared by many processes" do
+    mixer = Xav.AudioMixer.new([max_delay: 10] ++ @opts)
+
+    writers =
+      for _i <- 1..4 do
+        Task.async(fn ->
+          source = Xav.AudioMixer.add_source(mixer)
+
+          for i <- 0..49 do
+            :ok = Xav.AudioMixer.write(mixer, source, flt_frame(0.1, 480, i * 480))
+            :ok = Xav.AudioMixer.set_gain(mixer, source, 0.5)
+          end
+
+          Xav.AudioMixer.remove_source(mixer, source)
+        end)
+      end
+
+    mixing =
+      Task.async(fn ->
+        Enum.flat_map(1..200, fn _i -> Xav.AudioMixer.mix(mixer) end)
+      end)
+
+    assert Enum.all?(Task.await_many(writers), &(&1 == :ok))
+    assert Enum.all?(Task.await(mixing), &(&1.samples == 480))
+  end
+
+  test "converts sources to the output format" do
+    mixer = Xav.AudioMixer.new(out_format: :s16p, frame_size: 960)
+    source = Xav.AudioMixer.add_source(mixer, in_sample_rate: 16_000)
+
+    {frames, _samples} =
+      "./test/fixtures/stt/harvard.mp3"
+      |> Xav.Reader.stream!(read: :audio, out_format: :s16, out_sample_rate: 16_000)
+      |> Enum.flat_map_reduce(0, fn frame, samples ->
+        # pts in the mixer's time base, 1 / 48 kHz
+        :ok = Xav.AudioMixer.write(mixer, source, %{frame | pts: samples * 3})
+        {Xav.AudioMixer.mix(mixer), samples + frame.samples}
+      end)
+
+    frames = frames ++ Xav.AudioMixer.flush(mixer)
+
+    assert length(frames) > 10
+    assert Enum.all?(frames, &match?(%Xav.Frame{format: :s16p, samples: 960, data: [_, _]}, &1))
+  end
+end
@@ -303,6 +303,22 @@ defmodule Xav.DecoderTest do
     assert_raise(ErlangError, fn -> Xav.Decoder.new(:unknown) end)
   end
 
+  test "new/2 with threading options" do
+    decoder = Xav.Decoder.new(:h264, thread_count: 4, thread_type: :slice)
+
+    assert :ok = Xav.Decoder.decode(decoder, @h264_frame)
+    assert {:ok, [%Xav.Frame{width: 1280, height: 720}]} = Xav.Decoder.flush(decoder)
+
+    decoder = Xav.Decoder.new(:h264, thread_count: 0, thread_type: :frame)
+
+    assert :ok = Xav.Decoder.decode(decoder, @h264_frame)
+    assert {:ok, [%Xav.Frame{width: 1280, height: 720}]} = Xav.Decoder.flush(decoder)
+
+    assert_raise NimbleOptions.ValidationError, fn ->
+      Xav.Decoder.new(:h264, thread_type: :unknown)
+    end
+  end
+
   describe "decode/2" do
     test "audio" do
       decoder = Xav.Decoder.new(:opus)
@@ -324,6 +340,24 @@ defmodule Xav.DecoderTest do
       assert byte_size(data) == 304
     end
 
+    test "audio in a planar format" do
+      decoder = Xav.Decoder.new(:opus, out_format: :fltp)
+
+      assert {:ok, %Xav.Frame{data: [left, right], samples: 960, format: :fltp}} =
+               Xav.Decoder.decode(decoder, @opus_frame)
+
+      assert byte_size(left) == 3840
+      assert byte_size(right) == 3840
+
+      # the default packed output is the same samples, only interleaved
+      decoder = Xav.Decoder.new(:opus)
+      assert {:ok, %Xav.Frame{data: data}} = Xav.Decoder.decode(decoder, @opus_frame)
+
+      left = for <<s::binary-4 <- left>>, do: s
+      right = for <<s::binary-4 <- right>>, do: s
+      assert data == Enum.zip_with(left, right, &(&1 <> &2)) |> IO.iodata_to_binary()
+    end
+
     test "video keyframe" do
       decoder = Xav.Decoder.new(:vp8)
 
@@ -366,6 +400,30 @@ defmodule Xav.DecoderTest do
       assert byte_size(frame) == 640 * 480 * 3
     end
 
+    test "zero copy video frame" do
+      decoder = Xav.Decoder.new(:vp8, out_format: :rgb24)
+      zero_copy_decoder = Xav.Decoder.new(:vp8, out_format: :rgb24, zero_copy: true)
+
+      assert {:ok, frame} = Xav.Decoder.decode(decoder, @vp8_keyframe)
+      assert {:ok, ^frame} = Xav.Decoder.decode(zero_copy_decoder, @vp8_keyframe)
+    end
+
+    test "zero copy decoding" do
+      decoder = Xav.Decoder.new(:vp8)
+      zero_copy_decoder = Xav.Decoder.new(:vp8, zero_copy: true)
+
+      assert {:ok, frame} = Xav.Decoder.decode(decoder, @vp8_keyframe)
+      assert {:ok, ^frame} = Xav.Decoder.decode(zero_copy_decoder, @vp8_keyframe)
+      assert {:ok, %Xav.Frame{pts: 1}} = Xav.Decoder.decode(zero_copy_decoder, @vp8_frame, pts: 1)
+    end
+
+    test "skip non-key frames" do
+      decoder = Xav.Decoder.new(:vp8, skip_frame: :nonkey)
+
+      assert {:ok, %Xav.Frame{pts: 0}} = Xav.Decoder.decode(decoder, @vp8_keyframe)
+      assert :ok = Xav.Decoder.decode(decoder, @vp8_frame, pts: 1)
+    end
+
     test "scale video frame" do
       decoder = Xav.Decoder.new(:vp8, out_width: 240, out_height: 180)
 
@@ -374,5 +432,439 @@ defmodule Xav.DecoderTest do
 
       assert byte_size(frame) == 240 * 180 * 3 / 2
     end
+
+    test "scale video frame with converter threads" do
+      decoder = Xav.Decoder.new(:vp8, out_width: 240, out_format: :rgb24, converter_threads: 0)
+
+      assert {:ok, %Xav.Frame{width: 240, height: 180, data: frame, format: :rgb24}} =
+               Xav.Decoder.decode(decoder, @vp8_keyframe)
+
+      assert byte_size(frame) == 240 * 180 * 3
+    end
+  end
+
+  describe "outputs" do
+    test "video" do
+      decoder =
+        Xav.Decoder.new(:vp8,
+          outputs: [[out_format: :rgb24], [out_format: :rgb24, out_width: 320], [out_width: 160]]
+        )
+
+      assert {:ok, [preview, thumbnail, small]} = Xav.Decoder.decode(decoder, @vp8_keyframe)
+      assert %Xav.Frame{width: 640, height: 480, format: :rgb24, pts: 0} = preview
+      assert %Xav.Frame{width: 320, height: 240, format: :rgb24, pts: 0} = thumbnail
+      assert %Xav.Frame{width: 160, height: 120, format: :yuv420p, pts: 0} = small
+
+      assert {:ok, ^preview} =
+               Xav.Decoder.decode(Xav.Decoder.new(:vp8, out_format: :rgb24), @vp8_keyframe)
+    end
+
+    test "async decoding" do
+      decoder = Xav.Decoder.new(:vp8, outputs: [[out_format: :rgb24], [out_width: 320]])
+      assert :ok = Xav.Decoder.decode_async(decoder, @vp8_keyframe)
+
+      assert_receive {:xav_decoder, ^decoder,
+                      {:ok, [[%Xav.Frame{format: :rgb24}, %Xav.Frame{width: 320}]]}}
+    end
+
+    test "invalid outputs" do
+      assert_raise ArgumentError, fn ->
+        Xav.Decoder.new(:vp8, out_width: 320, outputs: [[out_format: :rgb24]])
+      end
+
+      assert_raise ArgumentError, fn -> Xav.Decoder.new(:vp8, outputs: [[]]) end
+    end
+  end
+
+  describe "frame_layout: :planes" do
+    test "h264 video" do
+      packed_decoder = Xav.Decoder.new(:h264)
+      assert :ok = Xav.Decoder.decode(packed_decoder, @h264_frame)
+      assert {:ok, [packed_frame]} = Xav.Decoder.flush(packed_decoder)
+
+      converter = Xav.VideoConverter.new(out_format: :rgb24)
+      expected = Xav.VideoConverter.convert(converter, packed_frame).data
+
+      for zero_copy <- [true, false] do
+        decoder = Xav.Decoder.new(:h264, frame_layout: :planes, zero_copy: zero_copy)
+        assert :ok = Xav.Decoder.decode(decoder, @h264_frame)
+
+        assert {:ok, [frame]} = Xav.Decoder.flush(decoder)
+        assert %Xav.Frame{data: [y, u, v], linesizes: [y_linesize, uv_linesize, _]} = frame
+
+        assert y_linesize >= 1280 and uv_linesize >= 640
+        assert byte_size(y) == y_linesize * 719 + 1280
+        assert byte_size(v) == byte_size(u)
+
+        assert Xav.VideoConverter.convert(converter, frame).data == expected
+      end
+    end
+
+    test "converted video" do
+      decoder = Xav.Decoder.new(:vp8, out_format: :rgb24, frame_layout: :planes)
+
+      assert {:ok, %Xav.Frame{format: :rgb24, data: [data], linesizes: [linesize]}} =
+               Xav.Decoder.decode(decoder, @vp8_keyframe)
+
+      assert byte_size(data) == linesize * 479 + 640 * 3
+    end
+
+    test "async decoding" do
+      decoder = Xav.Decoder.new(:vp8, frame_layout: :planes)
+      assert :ok = Xav.Decoder.decode_async(decoder, @vp8_keyframe)
+
+      assert_receive {:xav_decoder, ^decoder,
+                      {:ok, [%Xav.Frame{data: [_y, _u, _v], linesizes: [_, _, _]}]}}
+    end
+  end
+
+  describe "tensor" do
+    test "video" do
+      rgb_decoder = Xav.Decoder.new(:vp8, out_format: :rgb24)
+      assert {:ok, rgb_frame} = Xav.Decoder.decode(rgb_decoder, @vp8_keyframe)
+
+      decoder = Xav.Decoder.new(:vp8, tensor: [layout: :chw])
+
+      assert {:ok, %Xav.Frame{format: :rgb24, tensor: {:f32, :chw}} = frame} =
+               Xav.Decoder.decode(decoder, @vp8_keyframe)
+
+      expected =
+        rgb_frame
+        |> Xav.Frame.to_nx()
+        |> Nx.divide(255)
+        |> Nx.transpose(axes: [:channels, :height, :width])
+
+      assert Nx.all_close(Xav.Frame.to_nx(frame), expected) == Nx.tensor(1, type: :u8)
+    end
+
+    test "async decoding" do
+      decoder = Xav.Decoder.new(:vp8, tensor: [type: :f16])
+      assert :ok = Xav.Decoder.decode_async(decoder, @vp8_keyframe)
+
+      assert_receive {:xav_decoder, ^decoder, {:ok, [%Xav.Frame{tensor: {:f16, :hwc}} = frame]}}
+      assert byte_size(frame.data) == 640 * 480 * 3 * 2
+    end
+
+    test "invalid options" do
+      assert_raise ArgumentError, fn ->
+        Xav.Decoder.new(:vp8, out_format: :yuv420p, tensor: [])
+      end
+
+      assert_raise ArgumentError, fn ->
+        Xav.Decoder.new(:vp8, outputs: [[out_width: 320]], tensor: [])
+      end
+    end
+  end
+
+  describe "batch_size" do
+    test "video" do
+      decoder = Xav.Decoder.new(:vp8, out_format: :rgb24)
+      assert {:ok, keyframe} = Xav.Decoder.decode(decoder, @vp8_keyframe, pts: 0)
+      assert {:ok, frame} = Xav.Decoder.decode(decoder, @vp8_frame, pts: 1)
+
+      decoder = Xav.Decoder.new(:vp8, out_format: :rgb24, batch_size: 2)
+      assert :ok = Xav.Decoder.decode(decoder, @vp8_keyframe, pts: 0)
+
+      assert {:ok, %Xav.Batch{format: :rgb24, width: 640, height: 480, count: 2} = batch} =
+               Xav.Decoder.decode(decoder, @vp8_frame, pts: 1)
+
+      assert batch.pts == [0, 1]
+      assert byte_size(batch.data) == 2 * 640 * 480 * 3
+      assert Xav.Batch.to_frames(batch) == [keyframe, frame]
+      assert Nx.shape(Xav.Batch.to_nx(batch)) == {2, 480, 640, 3}
+
+      assert {:ok, []} = Xav.Decoder.flush(decoder)
+    end
+
+    test "flush returns the incomplete batch" do
+      decoder = Xav.Decoder.new(:vp8, batch_size: 4)
+      assert :ok = Xav.Decoder.decode(decoder, @vp8_keyframe)
+
+      assert {:ok, [%Xav.Batch{format: :yuv420p, count: 1} = batch]} = Xav.Decoder.flush(decoder)
+      assert byte_size(batch.data) == div(640 * 480 * 3, 2)
+    end
+
+    test "tensor" do
+      decoder = Xav.Decoder.new(:vp8, batch_size: 2, tensor: [layout: :chw])
+
+      assert {:ok, [%Xav.Batch{count: 2, tensor: {:f32, :chw}} = batch]} =
+               Xav.Decoder.decode_many(decoder, [{@vp8_keyframe, 0, 0}, {@vp8_frame, 1, 1}])
+
+      tensor = Xav.Batch.to_nx(batch)
+      assert Nx.shape(tensor) == {2, 3, 480, 640}
+      assert Nx.names(tensor) == [:batch, :channels, :height, :width]
+    end
+
+    test "invalid options" do
+      assert_raise ArgumentError, fn ->
+        Xav.Decoder.new(:vp8, batch_size: 2, frame_layout: :planes)
+      end
+
+      assert_raise ArgumentError, fn ->
+        Xav.Decoder.new(:vp8, batch_size: 2, outputs: [[out_width: 320]])
+      end
+    end
+  end
+
+  describe "frame_size" do
+    test "splits frames" do
+      decoder = Xav.Decoder.new(:opus)
+      assert {:ok, %Xav.Frame{data: data}} = Xav.Decoder.decode(decoder, @opus_frame)
+      <<first::binary-size(3840), second::binary>> = data
+
+      decoder = Xav.Decoder.new(:opus, frame_size: 480)
+
+      assert {:ok,
+              [
+                %Xav.Frame{samples: 480, pts: 0, data: ^first},
+                %Xav.Frame{samples: 480, pts: 480, data: ^second}
+              ]} = Xav.Decoder.decode(decoder, @opus_frame)
+
+      assert {:ok, []} = Xav.Decoder.flush(decoder)
+    end
+
+    test "joins frames and pads the last one with silence" do
+      decoder = Xav.Decoder.new(:opus, frame_size: 1200)
+
+      assert :ok = Xav.Decoder.decode(decoder, @opus_frame, pts: 0)
+
+      assert {:ok, [%Xav.Frame{samples: 1200, pts: 0}]} =
+               Xav.Decoder.decode(decoder, @opus_frame, pts: 960)
+
+      assert {:ok, [%Xav.Frame{samples: 1200, pts: 1200, data: data}]} =
+               Xav.Decoder.flush(decoder)
+
+      # 720 samples of 2 f32 channels, followed by silence
+      assert binary_part(data, 5760, 3840) == <<0::size(3840 * 8)>>
+    end
+
+    test "overlap" do
+      decoder = Xav.Decoder.new(:opus, frame_size: 480, frame_overlap: 240)
+
+      assert {:ok, [%Xav.Frame{pts: 0}, %Xav.Frame{pts: 240}, %Xav.Frame{pts: 480}]} =
+               Xav.Decoder.decode(decoder, @opus_frame)
+
+      # the remaining samples have already been returned
+      assert {:ok, []} = Xav.Decoder.flush(decoder)
+    end
+
+    test "time_base" do
+      decoder = Xav.Decoder.new(:opus, frame_size: 480, time_base: {1, 1000})
+
+      assert {:ok, [%Xav.Frame{pts: 100}, %Xav.Frame{pts: 110}]} =
+               Xav.Decoder.decode(decoder, @opus_frame, pts: 100)
+    end
+
+    test "pts past 32 bits" do
+      decoder = Xav.Decoder.new(:opus, frame_size: 480)
+      pts = 2 ** 31 - 200
+
+      assert {:ok, [%Xav.Frame{pts: ^pts}, %Xav.Frame{pts: second_pts}]} =
+               Xav.Decoder.decode(decoder, @opus_frame, pts: pts)
+
+      assert second_pts == pts + 480
+    end
+
+    test "resampling" do
+      decoder =
+        Xav.Decoder.new(:opus,
+          out_format: :s16,
+          out_sample_rate: 16_000,
+          out_channels: 1,
+          frame_size: 160
+        )
+
+      {:ok, frames} = Xav.Decoder.decode_many(decoder, List.duplicate({@opus_frame, 0, 0}, 3))
+      {:ok, flushed} = Xav.Decoder.flush(decoder)
+      frames = frames ++ flushed
+
+      # 3 x 20 ms at 16 kHz, including samples delayed by the resampler
+      assert length(frames) >= 6
+      assert Enum.all?(frames, &(&1.samples == 160 and byte_size(&1.data) == 320))
+
+      # pts is in the default time base of the decoded audio, 1/48000
+      for {frame, idx} <- Enum.with_index(frames), do: assert(frame.pts == idx * 480)
+    end
+
+    test "invalid options" do
+      assert_raise ArgumentError, fn -> Xav.Decoder.new(:opus, frame_overlap: 10) end
+
+      assert_raise ArgumentError, fn ->
+        Xav.Decoder.new(:opus, frame_size: 10, frame_overlap: 10)
+      end
+
+      assert_raise ErlangError, fn -> Xav.Decoder.new(:vp8, frame_size: 10) end
+    end
+  end
+
+  describe "levels" do
+    test "are returned with the samples" do
+      decoder = Xav.Decoder.new(:opus, levels: [])
+
+      assert {:ok, %Xav.Frame{data: data, samples: 960, levels: levels}} =
+               Xav.Decoder.decode(decoder, @opus_frame)
+
+      assert byte_size(data) == 960 * 2 * 4
+      assert %{rms: [_, _], peak: [_, _], level: level, voice: nil} = levels
+      assert level in 0..127
+      assert Enum.all?(levels.rms, &(&1 >= 0.0 and &1 <= 1.0))
+      assert Enum.zip_with(levels.rms, levels.peak, &(&1 <= &2)) |> Enum.all?()
+    end
+
+    test "without payload" do
+      decoder = Xav.Decoder.new(:opus, out_format: :s16, levels: [payload: false, vad: []])
+
+      assert {:ok, %Xav.Frame{data: nil, samples: 960, levels: levels}} =
+               Xav.Decoder.decode(decoder, @opus_frame)
+
+      assert is_boolean(levels.voice)
+
+      assert {:ok, [%Xav.Frame{data: nil, levels: %{}}]} =
+               Xav.Decoder.decode_many(decoder, [{@opus_frame, 0, 0}])
+    end
+
+    test "invalid options" do
+      assert_raise ArgumentError, fn -> Xav.Decoder.new(:opus, frame_size: 480, levels: []) end
+      assert_raise ErlangError, fn -> Xav.Decoder.new(:vp8, levels: []) end
+    end
+  end
+
+  describe "decode_many/2" do
+    test "video" do
+      decoder = Xav.Decoder.new(:vp8)
+
+      assert {:ok, [%Xav.Frame{pts: 0}, %Xav.Frame{pts: 1}]} =
+               Xav.Decoder.decode_many(decoder, [{@vp8_keyframe, 0, 0}, {@vp8_frame, 1, 1}])
+    end
+
+    test "audio" do
+      decoder = Xav.Decoder.new(:opus)
+
+      assert {:ok, [%Xav.Frame{samples: 960, pts: 0}, %Xav.Frame{samples: 960, pts: 960}]} =
+               Xav.Decoder.decode_many(decoder, [{@opus_frame, 0, 0}, {@opus_frame, 960, 960}])
+    end
+
+    test "empty list" do
+      decoder = Xav.Decoder.new(:vp8)
+      assert {:ok, []} = Xav.Decoder.decode_many(decoder, [])
+    end
+
+    test "video without prior keyframe" do
+      decoder = Xav.Decoder.new(:vp8)
+      assert {:error, :no_keyframe} = Xav.Decoder.decode_many(decoder, [{@vp8_frame, 0, 0}])
+    end
+  end
+
+  describe "decode_async/3" do
+    test "video" do
+      decoder = Xav.Decoder.new(:vp8)
+
+      assert :ok = Xav.Decoder.decode_async(decoder, @vp8_keyframe, pts: 0)
+      assert :ok = Xav.Decoder.decode_async(decoder, @vp8_frame, pts: 1)
+
+      assert_receive {:xav_decoder, ^decoder, {:ok, [%Xav.Frame{type: :video, pts: 0}]}}, 1000
+      assert_receive {:xav_decoder, ^decoder, {:ok, [%Xav.Frame{type: :video, pts: 1}]}}, 1000
+    end
+
+    test "audio" do
+      decoder = Xav.Decoder.new(:opus)
+
+      assert :ok = Xav.Decoder.decode_async(decoder, @opus_frame)
+
+      assert_receive {:xav_decoder, ^decoder, {:ok, [%Xav.Frame{type: :audio, samples: 960}]}},
+                     1000
+    end
+
+    test "every queued packet is replied to" do
+      decoder = Xav.Decoder.new(:vp8, async_queue_size: 1)
+
+      results =
+        for pts <- 0..9 do
+          {pts, Xav.Decoder.decode_async(decoder, @vp8_keyframe, pts: pts)}
+        end
+
+      assert Enum.all?(results, fn {_pts, res} -> res in [:ok, {:error, :queue_full}] end)
+
+      for {pts, :ok} <- results do
+        assert_receive {:xav_decoder, ^decoder, {:ok, [%Xav.Frame{pts: ^pts}]}}, 1000
+      end
+
+      refute_received {:xav_decoder, _decoder, _result}
+    end
+
+    test "video without prior keyframe" do
+      decoder = Xav.Decoder.new(:vp8)
+
+      assert :ok = Xav.Decoder.decode_async(decoder, @vp8_frame)
+      assert_receive {:xav_decoder, ^decoder, {:error, :no_keyframe}}, 1000
+    end
+  end
+
+  describe "flush_next/2" do
+    test "h264 video" do
+      decoder = Xav.Decoder.new(:h264)
+
+      assert :ok = Xav.Decoder.decode(decoder, @h264_frame)
+
+      assert {:ok, [%Xav.Frame{width: 1280, height: 720, pts: 0}]} =
+               Xav.Decoder.flush_next(decoder, 1)
+
+      assert {:eof, []} = Xav.Decoder.flush_next(decoder, 1)
+    end
+
+    test "decoder can be reused after eof" do
+      decoder = Xav.Decoder.new(:h264)
+
+      for _i <- 1..2 do
+        assert :ok = Xav.Decoder.decode(decoder, @h264_frame)
+        assert {:eof, [%Xav.Frame{width: 1280, height: 720}]} = Xav.Decoder.flush_next(decoder, 8)
+      end
+    end
+
+    test "empty decoder" do
+      decoder = Xav.Decoder.new(:vp8)
+      assert {:eof, []} = Xav.Decoder.flush_next(decoder)
+    end
+  end
+
+  describe "decoder pool" do
+    # a unique set of options, so that other tests don't share the pooled decoders
+    @pool_opts [skip_idct: :bidir, skip_loop_filter: :bidir]
+
+    test "pooled decoder decodes" do
+      decoder = Xav.Decoder.new(:vp8, [pooled: true] ++ @pool_opts)
+      assert {:ok, %Xav.Frame{type: :video}} = Xav.Decoder.decode(decoder, @vp8_keyframe)
+    end
+
+    test "prewarmed decoders are reused" do
+      assert Xav.Decoder.prewarm(:vp8, 1, @pool_opts) == 1
+
+      %{hits: hits} = Xav.Decoder.pool_stats()
+      decoder = Xav.Decoder.new(:vp8, [pooled: true] ++ @pool_opts)
+      assert %{hits: new_hits} = Xav.Decoder.pool_stats()
+      assert new_hits == hits + 1
+
+      assert {:ok, %Xav.Frame{type: :video}} = Xav.Decoder.decode(decoder, @vp8_keyframe)
+    end
+
+    test "pool_stats/0" do
+      assert %{
+               hits: _hits,
+               misses: _misses,
+               opens: opens,
+               open_time_us: open_time_us,
+               idle: idle,
+               max_idle: max_idle
+             } = Xav.Decoder.pool_stats()
+
+      assert opens >= 0 and open_time_us >= 0
+      assert idle <= max_idle
+    end
+
+    test "prewarm/3 with invalid options" do
+      assert_raise NimbleOptions.ValidationError, fn ->
+        Xav.Decoder.prewarm(:vp8, 1, out_width: 100)
+      end
+    end
   end
 end
@@ -1,6 +1,8 @@
 defmodule Xav.EncoderTest do
   use ExUnit.Case, async: true
 
+  import Xav.TestHelpers
+
   alias NimbleOptions.ValidationError
 
   describe "new/2" do
@@ -30,18 +32,7 @@ defmodule Xav.EncoderTest do
   end
 
   describe "encode/1" do
-    setup do
-      frame = %Xav.Frame{
-        type: :video,
-        data: File.read!("test/fixtures/video_converter/frame_360x240.yuv"),
-        format: :yuv420p,
-        width: 360,
-        height: 240,
-        pts: 0
-      }
-
-      %{frame: frame}
-    end
+    setup :frame_360p
 
     test "encode a frame", %{frame: frame} do
       encoder =
@@ -66,6 +57,27 @@ defmodule Xav.EncoderTest do
       assert byte_size(data) > 0
     end
 
+    test "encode a frame made of planes", %{frame: frame} do
+      <<y::binary-size(360 * 240), u::binary-size(180 * 120), v::binary-size(180 * 120)>> =
+        frame.data
+
+      planes_frame = %Xav.Frame{
+        frame
+        | data: [pad_rows(y, 360, 24), pad_rows(u, 180, 12), pad_rows(v, 180, 12)],
+          linesizes: [384, 192, 192]
+      }
+
+      [packets, planes_packets] =
+        for frame <- [frame, planes_frame] do
+          encoder =
+            Xav.Encoder.new(:h264, width: 360, height: 240, format: :yuv420p, time_base: {1, 25})
+
+          Xav.Encoder.encode(encoder, frame) ++ Xav.Encoder.flush(encoder)
+        end
+
+      assert Enum.map(planes_packets, & &1.data) == Enum.map(packets, & &1.data)
+    end
+
     test "encode multiple frames", %{frame: frame} do
       encoder =
         Xav.Encoder.new(:h264,
@@ -112,6 +124,43 @@ defmodule Xav.EncoderTest do
       assert Enum.all?(packets, &(&1.dts == &1.pts)), "dts should be equal to pts"
     end
 
+    test "realtime preset", %{frame: frame} do
+      encoder =
+        Xav.Encoder.new(:h264,
+          width: 360,
+          height: 240,
+          format: :yuv420p,
+          time_base: {1, 25},
+          realtime: true
+        )
+
+      # zerolatency disables lookahead, so every frame is returned right away
+      assert [%Xav.Packet{pts: 0, keyframe?: true}] = Xav.Encoder.encode(encoder, frame)
+      assert [%Xav.Packet{pts: 1}] = Xav.Encoder.encode(encoder, %{frame | pts: 1})
+    end
+
+    test "encoder options", %{frame: frame} do
+      opts = [width: 360, height: 240, format: :yuv420p, time_base: {1, 25}]
+
+      sizes =
+        for crf <- [10, 40] do
+          encoder = Xav.Encoder.new(:h264, [options: [crf: crf, preset: :ultrafast]] ++ opts)
+          packets = Xav.Encoder.encode(encoder, frame) ++ Xav.Encoder.flush(encoder)
+          packets |> Enum.map(&byte_size(&1.data)) |> Enum.sum()
+        end
+
+      assert [high_quality, low_quality] = sizes
+      assert high_quality > low_quality
+
+      assert_raise ErlangError, fn ->
+        Xav.Encoder.new(:h264, [options: [no_such_option: 1]] ++ opts)
+      end
+
+      assert_raise ValidationError, fn ->
+        Xav.Encoder.new(:h264, [options: [crf: [1]]] ++ opts)
+      end
+    end
+
     test "encode audio samples" do
       audio_file = "test/fixtures/encoder/audio/input-s16le.raw"
       ref_file = "test/fixtures/encoder/audio/reference.al"
@@ -143,4 +192,53 @@ defmodule Xav.EncoderTest do
       assert File.read!(ref_file) == encoded_data
     end
   end
+
+  describe "encode_async/2" do
+    setup :frame_360p
+
+    test "returns the same packets as encode/2", %{frame: frame} do
+      opts = [width: 360, height: 240, format: :yuv420p, time_base: {1, 25}, gop_size: 1]
+      frames = for pts <- 0..2, do: %{frame | pts: pts}
+
+      sync_encoder = Xav.Encoder.new(:h264, opts)
+      packets = Enum.flat_map(frames, &Xav.Encoder.encode(sync_encoder, &1))
+
+      encoder = Xav.Encoder.new(:h264, opts)
+      for frame <- frames, do: assert(:ok = Xav.Encoder.encode_async(encoder, frame))
+
+      async_packets =
+        for _frame <- frames, reduce: [] do
+          acc ->
+            assert_receive {:xav_encoder, ^encoder, {:ok, packets}}, 5000
+            acc ++ packets
+        end
+
+      assert Enum.all?(async_packets, &match?(%Xav.Packet{}, &1))
+
+      assert Enum.map(async_packets ++ Xav.Encoder.flush(encoder), & &1.data) ==
+               Enum.map(packets ++ Xav.Encoder.flush(sync_encoder), & &1.data)
+    end
+
+    test "bounded queue", %{frame: frame} do
+      encoder =
+        Xav.Encoder.new(:h264,
+          width: 360,
+          height: 240,
+          format: :yuv420p,
+          time_base: {1, 25},
+          async_queue_size: 1
+        )
+
+      results = for pts <- 0..9, do: Xav.Encoder.encode_async(encoder, %{frame | pts: pts})
+      queued = Enum.count(results, &(&1 == :ok))
+
+      assert queued >= 1
+      assert Enum.all?(results, &(&1 in [:ok, {:error, :queue_full}]))
+
+      for _ <- 1..queued, do: assert_receive({:xav_encoder, ^encoder, {:ok, _packets}}, 5000)
+      refute_received {:xav_encoder, ^encoder, _result}
+    end
+  end
+
+  defp frame_360p(_context), do: %{frame: yuv_frame(360, 240)}
 end
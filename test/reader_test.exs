@@ -17,6 +17,93 @@ defmodule Xav.ReaderTest do
     for _i <- 0..(30 * 5), do: assert({:ok, %Xav.Frame{}} = Xav.Reader.next_frame(r))
   end
 
+  test "next_frame/1 with frame threading" do
+    {:ok, r} =
+      Xav.Reader.new("./test/fixtures/sample_h264.mp4", thread_count: 0, thread_type: :frame)
+
+    for _i <- 0..30, do: assert({:ok, %Xav.Frame{}} = Xav.Reader.next_frame(r))
+  end
+
+  test "next_frame/1 with zero copy" do
+    {:ok, r} = Xav.Reader.new("./test/fixtures/sample_h264.mp4")
+    {:ok, zero_copy_r} = Xav.Reader.new("./test/fixtures/sample_h264.mp4", zero_copy: true)
+
+    for _i <- 0..30 do
+      assert {:ok, frame} = Xav.Reader.next_frame(r)
+      assert {:ok, ^frame} = Xav.Reader.next_frame(zero_copy_r)
+    end
+  end
+
+  test "next_frame/1 with converter threads" do
+    {:ok, r} =
+      Xav.Reader.new("./test/fixtures/sample_h264.mp4", converter_threads: 4, fast_path: false)
+
+    for _i <- 0..30 do
+      assert {:ok, %Xav.Frame{format: :rgb24, width: w, height: h, data: data}} =
+               Xav.Reader.next_frame(r)
+
+      assert byte_size(data) == w * h * 3
+    end
+  end
+
+  test "next_frame/1 with tensor" do
+    {:ok, r} = Xav.Reader.new("./test/fixtures/sample_h264.mp4")
+
+    {:ok, tensor_r} =
+      Xav.Reader.new("./test/fixtures/sample_h264.mp4",
+        tensor: [mean: [0.5, 0.5, 0.5], std: [0.5, 0.5, 0.5]]
+      )
+
+    for _i <- 0..5 do
+      assert {:ok, frame} = Xav.Reader.next_frame(r)
+      assert {:ok, %Xav.Frame{tensor: {:f32, :hwc}} = tensor_frame} =
+               Xav.Reader.next_frame(tensor_r)
+
+      expected =
+        frame |> Xav.Frame.to_nx() |> Nx.divide(255) |> Nx.subtract(0.5) |> Nx.divide(0.5)
+
+      assert Nx.all_close(Xav.Frame.to_nx(tensor_frame), expected) == Nx.tensor(1, type: :u8)
+    end
+  end
+
+  test "next_batch/2" do
+    frames = "./test/fixtures/sample_h264.mp4" |> Xav.Reader.stream!() |> Enum.take(8)
+    {:ok, r} = Xav.Reader.new("./test/fixtures/sample_h264.mp4")
+
+    assert {:ok, %Xav.Batch{format: :rgb24, count: 4} = batch1} = Xav.Reader.next_batch(r, 4)
+    assert {:ok, %Xav.Batch{count: 4} = batch2} = Xav.Reader.next_batch(r, 4)
+    assert Xav.Batch.to_frames(batch1) ++ Xav.Batch.to_frames(batch2) == frames
+
+    %Xav.Frame{width: width, height: height} = hd(frames)
+    assert Nx.shape(Xav.Batch.to_nx(batch1)) == {4, height, width, 3}
+  end
+
+  test "next_batch/2 at eof" do
+    frames = "./test/fixtures/sample_h264.mp4" |> Xav.Reader.stream!() |> Enum.count()
+    {:ok, r} = Xav.Reader.new("./test/fixtures/sample_h264.mp4", tensor: [type: :f16])
+
+    batches =
+      Stream.repeatedly(fn -> Xav.Reader.next_batch(r, 32) end)
+      |> Enum.take_while(&match?({:ok, _batch}, &1))
+      |> Enum.map(fn {:ok, batch} -> batch end)
+
+    assert Enum.all?(batches, &(&1.tensor == {:f16, :hwc}))
+    assert batches |> Enum.map(& &1.count) |> Enum.sum() == frames
+    assert {:error, :eof} = Xav.Reader.next_batch(r, 32)
+  end
+
+  test "next_frame/1 with keyframes only" do
+    all_frames = "./test/fixtures/sample_h264.mp4" |> Xav.Reader.stream!() |> Enum.count()
+
+    keyframes =
+      "./test/fixtures/sample_h264.mp4"
+      |> Xav.Reader.stream!(skip_frame: :nonkey)
+      |> Enum.count()
+
+    assert keyframes > 0
+    assert keyframes < all_frames
+  end
+
   describe "seek/2" do
     test "works with video" do
       {:ok, r} = Xav.Reader.new("./test/fixtures/sample_h264.mp4")
@@ -54,6 +141,142 @@ defmodule Xav.ReaderTest do
     end
   end
 
+  describe "audio output formats" do
+    test "planar formats return one binary per channel" do
+      {:ok, r} =
+        Xav.Reader.new("./test/fixtures/stt/harvard.mp3", read: :audio, out_format: :fltp)
+
+      assert {:ok, %Xav.Frame{data: [left, right], format: :fltp, samples: samples} = frame} =
+               Xav.Reader.next_frame(r)
+
+      assert byte_size(left) == samples * 4
+      assert byte_size(right) == samples * 4
+      assert Xav.Frame.to_nx(frame).shape == {2, samples}
+    end
+
+    test "planar formats with resampling" do
+      frames =
+        "./test/fixtures/stt/harvard.mp3"
+        |> Xav.Reader.stream!(read: :audio, out_format: :s16p, out_sample_rate: 16_000)
+        |> Enum.take(5)
+
+      assert Enum.all?(frames, fn %Xav.Frame{data: [left, right], samples: samples} ->
+               byte_size(left) == samples * 2 and byte_size(right) == samples * 2
+             end)
+    end
+
+    test "packed output interleaves samples of all channels" do
+      path = "./test/fixtures/stt/harvard.mp3"
+      planar = path |> Xav.Reader.stream!(read: :audio, out_format: :fltp) |> Enum.take(10)
+      packed = path |> Xav.Reader.stream!(read: :audio) |> Enum.take(10)
+
+      for {%Xav.Frame{data: [left, right]}, %Xav.Frame{format: :flt, data: data}} <-
+            Enum.zip(planar, packed) do
+        left = for <<s::binary-4 <- left>>, do: s
+        right = for <<s::binary-4 <- right>>, do: s
+        assert data == Enum.zip_with(left, right, &(&1 <> &2)) |> IO.iodata_to_binary()
+      end
+    end
+
+    test "frame_size" do
+      frames =
+        "./test/fixtures/stt/harvard.mp3"
+        |> Xav.Reader.stream!(
+          read: :audio,
+          out_format: :flt,
+          out_sample_rate: 16_000,
+          out_channels: 1,
+          frame_size: 16_000,
+          frame_overlap: 4_000
+        )
+        |> Enum.to_list()
+
+      assert length(frames) > 1
+      assert Enum.all?(frames, &(&1.samples == 16_000 and byte_size(&1.data) == 64_000))
+
+      # every frame starts 0.75 s after the previous one, up to rounding
+      {min, max} =
+        frames
+        |> Enum.map(& &1.pts)
+        |> Enum.chunk_every(2, 1, :discard)
+        |> Enum.map(fn [pts, next_pts] -> next_pts - pts end)
+        |> Enum.min_max()
+
+      assert max - min <= 1
+    end
+
+    test "resampler presets and options" do
+      opts = [read: :audio, out_format: :s16, out_sample_rate: 16_000, out_channels: 1]
+
+      counts =
+        for resampler <- [
+              [preset: :fast],
+              [preset: :high],
+              [options: [filter_size: 16, dither_method: :triangular]]
+            ] do
+          "./test/fixtures/stt/harvard.mp3"
+          |> Xav.Reader.stream!([resampler: resampler] ++ opts)
+          |> Enum.reduce(0, &(&1.samples + &2))
+        end
+
+      # the filter length only changes the number of samples delayed by the resampler
+      assert Enum.max(counts) - Enum.min(counts) < 100
+
+      assert_raise ErlangError, fn ->
+        Xav.Reader.new("./test/fixtures/stt/harvard.mp3",
+          read: :audio,
+          resampler: [options: [no_such_option: 1]]
+        )
+      end
+    end
+  end
+
+  describe "levels" do
+    test "match the levels of the samples" do
+      frames =
+        "./test/fixtures/stt/harvard.mp3"
+        |> Xav.Reader.stream!(read: :audio, out_format: :fltp, levels: [vad: []])
+        |> Enum.take(200)
+
+      for %Xav.Frame{data: channels, samples: samples, levels: levels} <- frames do
+        rms =
+          for channel <- channels do
+            sum = for(<<s::float-32-native <- channel>>, reduce: 0.0, do: (acc -> acc + s * s))
+            :math.sqrt(sum / samples)
+          end
+
+        assert Enum.zip_with(rms, levels.rms, &(abs(&1 - &2) < 1.0e-4)) |> Enum.all?()
+        assert is_boolean(levels.voice)
+      end
+
+      # a few seconds of speech
+      assert Enum.any?(frames, & &1.levels.voice)
+    end
+
+    test "without payload" do
+      {:ok, r} =
+        Xav.Reader.new("./test/fixtures/stt/harvard.mp3",
+          read: :audio,
+          levels: [payload: false]
+        )
+
+      assert {:ok, %Xav.Frame{data: nil, samples: samples, levels: %{level: level}}} =
+               Xav.Reader.next_frame(r)
+
+      assert samples > 0
+      assert level in 0..127
+
+      assert :ok = Xav.Reader.seek(r, 1.0)
+      assert {:ok, %Xav.Frame{data: nil}} = Xav.Reader.next_frame(r)
+    end
+
+    test "are rejected for video" do
+      assert_raise ArgumentError, fn ->
+        Xav.Reader.new("./test/fixtures/sample_h264.mp4", levels: [])
+      end
+    end
+  end
+
   test "stream!" do
     Xav.Reader.stream!("./test/fixtures/sample_h264.mp4")
     |> Enum.all?(fn frame -> is_struct(frame, Xav.Frame) end)
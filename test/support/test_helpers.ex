@@ -0,0 +1,29 @@
+defmodule Xav.TestHelpers do
+  @moduledoc false
+
+  # Fixtures and helpers shared by the tests.
+
+  @doc """
+  Returns a raw yuv420p frame from `test/fixtures/video_converter`.
+  """
+  @spec yuv_frame(pos_integer(), pos_integer()) :: Xav.Frame.t()
+  def yuv_frame(width, height) do
+    %Xav.Frame{
+      type: :video,
+      data: File.read!("test/fixtures/video_converter/frame_#{width}x#{height}.yuv"),
+      format: :yuv420p,
+      width: width,
+      height: height,
+      pts: 0
+    }
+  end
+
+  @doc """
+  Appends `pad` bytes of padding to every `width` bytes long row of a plane.
+  """
+  @spec pad_rows(binary(), pos_integer(), non_neg_integer()) :: binary()
+  def pad_rows(plane, width, pad) do
+    padding = :binary.copy(<<0>>, pad)
+    for <<row::binary-size(width) <- plane>>, into: <<>>, do: row <> padding
+  end
+end
@@ -1,6 +1,8 @@
 defmodule Xav.VideoConverterTest do
   use ExUnit.Case, async: true
 
+  import Xav.TestHelpers
+
   alias NimbleOptions.ValidationError
 
   describe "new/1" do
@@ -23,14 +25,7 @@ defmodule Xav.VideoConverterTest do
 
   describe "convert/2" do
     setup do
-      frame_480p = %Xav.Frame{
-        type: :video,
-        data: File.read!("test/fixtures/video_converter/frame_480x360.yuv"),
-        format: :yuv420p,
-        width: 480,
-        height: 360,
-        pts: 0
-      }
+      frame_480p = yuv_frame(480, 360)
 
       %{
         converter: Xav.VideoConverter.new(out_format: :rgb24),
@@ -94,5 +89,440 @@ defmodule Xav.VideoConverterTest do
                height: 240
              } = Xav.VideoConverter.convert(converter, frame_480p)
     end
+
+    test "switching between resolutions", %{converter: converter, frame_480p: frame_480p} do
+      frame_360p = %Xav.Frame{
+        type: :video,
+        data: File.read!("test/fixtures/video_converter/frame_360x240.yuv"),
+        format: :yuv420p,
+        width: 360,
+        height: 240
+      }
+
+      assert %{cache_hits: 0, cache_misses: 0} = Xav.VideoConverter.stats(converter)
+
+      expected_480p = Xav.VideoConverter.convert(converter, frame_480p)
+      expected_360p = Xav.VideoConverter.convert(converter, frame_360p)
+
+      for _i <- 1..3 do
+        assert Xav.VideoConverter.convert(converter, frame_480p) == expected_480p
+        assert Xav.VideoConverter.convert(converter, frame_360p) == expected_360p
+      end
+
+      assert %{cache_hits: 6, cache_misses: 1} = Xav.VideoConverter.stats(converter)
+    end
+
+    test "multiple threads", %{frame_480p: frame_480p} do
+      for threads <- [0, 2, 4] do
+        converter =
+          Xav.VideoConverter.new(
+            out_width: 240,
+            out_format: :rgb24,
+            threads: threads,
+            fast_path: false
+          )
+
+        assert %Xav.Frame{width: 240, height: 180, format: :rgb24, data: data} =
+                 Xav.VideoConverter.convert(converter, frame_480p)
+
+        assert byte_size(data) == 240 * 180 * 3
+      end
+    end
+
+    test "zero copy", %{converter: converter, frame_480p: frame_480p} do
+      zero_copy_converter = Xav.VideoConverter.new(out_format: :rgb24, zero_copy: true)
+
+      assert %Xav.Frame{data: expected} = Xav.VideoConverter.convert(converter, frame_480p)
+
+      # previously returned frames must not be overwritten by subsequent conversions
+      frames = for _i <- 1..3, do: Xav.VideoConverter.convert(zero_copy_converter, frame_480p)
+      assert Enum.all?(frames, &(&1.data == expected))
+    end
+  end
+
+  describe "convert_many/2" do
+    setup do
+      frame_480p = yuv_frame(480, 360)
+
+      frame_360p = %{yuv_frame(360, 240) | pts: 1}
+
+      %{frames: [frame_480p, frame_360p, %{frame_480p | pts: 2}]}
+    end
+
+    test "returns the same frames as convert/2", %{frames: frames} do
+      converter = Xav.VideoConverter.new(out_format: :rgb24, out_width: 240)
+
+      expected = Enum.map(frames, &Xav.VideoConverter.convert(converter, &1))
+      assert Xav.VideoConverter.convert_many(converter, frames) == expected
+
+      assert [
+               %Xav.Frame{width: 240, height: 180, pts: 0},
+               %Xav.Frame{width: 240, height: 160, pts: 1},
+               %Xav.Frame{width: 240, height: 180, pts: 2}
+             ] = expected
+    end
+
+    test "empty list" do
+      converter = Xav.VideoConverter.new(out_format: :rgb24)
+      assert Xav.VideoConverter.convert_many(converter, []) == []
+    end
+
+    test "invalid frame size", %{frames: [frame | _rest]} do
+      converter = Xav.VideoConverter.new(out_format: :rgb24)
+      frame = %{frame | data: binary_part(frame.data, 0, 100)}
+
+      assert_raise ErlangError, fn -> Xav.VideoConverter.convert_many(converter, [frame]) end
+    end
+  end
+
+  describe "fast path" do
+    setup :frame_480p
+
+    test "matches swscale", %{frame: frame} do
+      for opts <- [[out_format: :rgb24], [out_format: :rgb24, out_width: 240]] do
+        fast = Xav.VideoConverter.new(opts)
+        swscale = Xav.VideoConverter.new([fast_path: false] ++ opts)
+
+        %Xav.Frame{data: fast_data} = fast_frame = Xav.VideoConverter.convert(fast, frame)
+        %Xav.Frame{data: data} = swscale_frame = Xav.VideoConverter.convert(swscale, frame)
+
+        assert Map.delete(fast_frame, :data) == Map.delete(swscale_frame, :data)
+        assert mean_abs_diff(fast_data, data) < 3
+      end
+    end
+
+    test "bgr24", %{frame: frame} do
+      rgb = Xav.VideoConverter.new(out_format: :rgb24)
+      bgr = Xav.VideoConverter.new(out_format: :bgr24)
+
+      %Xav.Frame{data: rgb_data} = Xav.VideoConverter.convert(rgb, frame)
+      %Xav.Frame{data: bgr_data, format: :bgr24} = Xav.VideoConverter.convert(bgr, frame)
+
+      assert for(<<r, g, b <- rgb_data>>, into: <<>>, do: <<b, g, r>>) == bgr_data
+    end
+
+    test "every kernel matches the C version" do
+      # an odd width, so that kernels also convert their tail with a narrower kernel
+      width = 4099
+      # random samples with the extremes, which saturate in SIMD kernels
+      [y, u, v] = for _plane <- 1..3, do: <<0, 255, 16, 235>> <> :rand.bytes(width - 4)
+
+      kernels = Xav.VideoConverter.NIF.check_yuv_kernels(y, u, v)
+
+      assert Keyword.has_key?(kernels, :c)
+      assert Enum.all?(kernels, fn {_kernel, matches?} -> matches? end), inspect(kernels)
+    end
+
+    test "nv12 input", %{frame: frame} do
+      nv12_frame = Xav.VideoConverter.convert(Xav.VideoConverter.new(out_format: :nv12), frame)
+
+      for opts <- [[out_format: :rgb24], [out_format: :rgb24, out_width: 240]] do
+        converter = Xav.VideoConverter.new(opts)
+
+        assert Xav.VideoConverter.convert(converter, nv12_frame).data ==
+                 Xav.VideoConverter.convert(converter, frame).data
+      end
+    end
+  end
+
+  describe "new_multi/2" do
+    setup :frame_480p
+
+    test "converts a frame to every output", %{frame: frame} do
+      outputs = [
+        [out_format: :rgb24],
+        [out_format: :rgb24, out_width: 240],
+        [out_format: :rgb24, out_width: 224, out_height: 224]
+      ]
+
+      converter = Xav.VideoConverter.new_multi(outputs)
+
+      assert [preview, thumbnail, model_input] = Xav.VideoConverter.convert(converter, frame)
+      assert %Xav.Frame{width: 480, height: 360, format: :rgb24, pts: 0} = preview
+      assert %Xav.Frame{width: 240, height: 180, format: :rgb24, pts: 0} = thumbnail
+      assert %Xav.Frame{width: 224, height: 224, format: :rgb24, pts: 0} = model_input
+
+      for {output, converted} <- Enum.zip(outputs, [preview, thumbnail, model_input]) do
+        assert converted ==
+                 Xav.VideoConverter.convert(Xav.VideoConverter.new(output), frame)
+      end
+    end
+
+    test "scales outputs down from previous outputs", %{frame: frame} do
+      converter = Xav.VideoConverter.new_multi([[out_width: 240], [out_width: 120]])
+
+      assert [%Xav.Frame{width: 240, height: 180} = preview, thumbnail] =
+               Xav.VideoConverter.convert(converter, frame)
+
+      # the thumbnail is scaled from the preview, not from the input frame
+      assert thumbnail ==
+               Xav.VideoConverter.convert(Xav.VideoConverter.new(out_width: 120), preview)
+    end
+
+    test "convert_many/2", %{frame: frame} do
+      converter = Xav.VideoConverter.new_multi([[out_format: :rgb24], [out_width: 240]])
+
+      assert [
+               [%Xav.Frame{format: :rgb24, pts: 0}, %Xav.Frame{width: 240, pts: 0}],
+               [%Xav.Frame{format: :rgb24, pts: 1}, %Xav.Frame{width: 240, pts: 1}]
+             ] = Xav.VideoConverter.convert_many(converter, [frame, %{frame | pts: 1}])
+    end
+
+    test "fails on invalid outputs" do
+      assert_raise RuntimeError, fn -> Xav.VideoConverter.new_multi([[out_width: 240], []]) end
+
+      assert_raise ValidationError, fn ->
+        Xav.VideoConverter.new_multi([[out_width: 0]])
+      end
+    end
+  end
+
+  describe "frame layout" do
+    setup :frame_480p
+
+    test "converts frames made of planes", %{frame: frame} do
+      planes_frame = to_planes(frame, 32)
+
+      for opts <- [[fast_path: true], [fast_path: false], [out_width: 240, threads: 2]] do
+        converter = Xav.VideoConverter.new([out_format: :rgb24] ++ opts)
+
+        assert Xav.VideoConverter.convert(converter, planes_frame).data ==
+                 Xav.VideoConverter.convert(converter, frame).data
+      end
+
+      converter = Xav.VideoConverter.new(out_format: :rgb24)
+
+      assert [%{data: data}, %{data: data}] =
+               Xav.VideoConverter.convert_many(converter, [planes_frame, frame])
+    end
+
+    test "returns frames made of planes", %{frame: frame} do
+      rgb_converter = Xav.VideoConverter.new(out_format: :rgb24)
+      packed_frame = Xav.VideoConverter.convert(Xav.VideoConverter.new(out_width: 240), frame)
+      expected = Xav.VideoConverter.convert(rgb_converter, packed_frame).data
+
+      for zero_copy <- [true, false] do
+        converter =
+          Xav.VideoConverter.new(out_width: 240, frame_layout: :planes, zero_copy: zero_copy)
+
+        assert %Xav.Frame{
+                 width: 240,
+                 height: 180,
+                 data: [y, u, v],
+                 linesizes: [y_linesize, uv_linesize, uv_linesize]
+               } = planes_frame = Xav.VideoConverter.convert(converter, frame)
+
+        assert byte_size(y) == y_linesize * 179 + 240
+        assert byte_size(u) == uv_linesize * 89 + 120
+        assert byte_size(v) == byte_size(u)
+
+        # planes can be passed on without repacking
+        assert Xav.VideoConverter.convert(rgb_converter, planes_frame).data == expected
+      end
+    end
+
+    test "raises on invalid planes", %{frame: frame} do
+      converter = Xav.VideoConverter.new(out_format: :rgb24)
+      %Xav.Frame{data: [y, u, v], linesizes: linesizes} = planes_frame = to_planes(frame, 0)
+
+      assert_raise ErlangError, fn ->
+        Xav.VideoConverter.convert(converter, %{planes_frame | data: [y, u]})
+      end
+
+      assert_raise ErlangError, fn ->
+        frame = %{planes_frame | data: [y, u, binary_part(v, 0, 10)]}
+        Xav.VideoConverter.convert(converter, frame)
+      end
+
+      assert_raise ErlangError, fn ->
+        frame = %{planes_frame | linesizes: Enum.map(linesizes, &(&1 - 1))}
+        Xav.VideoConverter.convert(converter, frame)
+      end
+    end
+  end
+
+  describe "tensor" do
+    setup :frame_480p
+
+    test "normalizes channels", %{frame: frame} do
+      mean = [0.485, 0.456, 0.406]
+      std = [0.229, 0.224, 0.225]
+
+      expected =
+        Xav.VideoConverter.new(out_format: :rgb24, out_width: 240)
+        |> Xav.VideoConverter.convert(frame)
+        |> Xav.Frame.to_nx()
+        |> Nx.divide(255)
+        |> Nx.subtract(Nx.tensor(mean))
+        |> Nx.divide(Nx.tensor(std))
+
+      converter = Xav.VideoConverter.new(out_width: 240, tensor: [mean: mean, std: std])
+
+      assert %Xav.Frame{format: :rgb24, width: 240, height: 180, tensor: {:f32, :hwc}} =
+               tensor_frame = Xav.VideoConverter.convert(converter, frame)
+
+      assert byte_size(tensor_frame.data) == 240 * 180 * 3 * 4
+      assert Nx.all_close(Xav.Frame.to_nx(tensor_frame), expected) == Nx.tensor(1, type: :u8)
+    end
+
+    test "layout and type", %{frame: frame} do
+      hwc =
+        [tensor: []]
+        |> Xav.VideoConverter.new()
+        |> Xav.VideoConverter.convert(frame)
+        |> Xav.Frame.to_nx()
+
+      for type <- [:f32, :f16] do
+        converter = Xav.VideoConverter.new(out_format: :rgb24, tensor: [type: type, layout: :chw])
+
+        assert [%Xav.Frame{tensor: {^type, :chw}} = chw_frame] =
+                 Xav.VideoConverter.convert_many(converter, [frame])
+
+        chw = Xav.Frame.to_nx(chw_frame)
+        assert Nx.names(chw) == [:channels, :height, :width]
+
+        assert Nx.all_close(chw, Nx.transpose(hwc, axes: [:channels, :height, :width]),
+                 atol: 1.0e-3
+               ) == Nx.tensor(1, type: :u8)
+      end
+    end
+
+    test "keeps the channel order of bgr24", %{frame: frame} do
+      rgb_converter = Xav.VideoConverter.new(tensor: [])
+      bgr_converter = Xav.VideoConverter.new(out_format: :bgr24, tensor: [])
+
+      rgb = rgb_converter |> Xav.VideoConverter.convert(frame) |> Xav.Frame.to_nx()
+      bgr = bgr_converter |> Xav.VideoConverter.convert(frame) |> Xav.Frame.to_nx()
+
+      assert Nx.equal(bgr, Nx.reverse(rgb, axes: [:channels])) |> Nx.all() ==
+               Nx.tensor(1, type: :u8)
+    end
+
+    test "fails on invalid options" do
+      assert_raise ArgumentError, fn ->
+        Xav.VideoConverter.new(out_format: :yuv420p, tensor: [])
+      end
+
+      assert_raise ValidationError, fn -> Xav.VideoConverter.new(tensor: [std: [1, 0, 1]]) end
+      assert_raise ValidationError, fn -> Xav.VideoConverter.new(tensor: [mean: [0.5]]) end
+    end
+  end
+
+  describe "crop" do
+    setup :frame_480p
+
+    test "converts only the region", %{frame: frame} do
+      converter = Xav.VideoConverter.new(crop: {100, 50, 64, 32})
+
+      assert %Xav.Frame{format: :yuv420p, width: 64, height: 32, data: data} =
+               Xav.VideoConverter.convert(converter, frame)
+
+      assert data == crop_yuv420p(frame, {100, 50, 64, 32})
+    end
+
+    test "scales the region", %{frame: frame} do
+      converter =
+        Xav.VideoConverter.new(out_format: :rgb24, out_width: 112, crop: {10, 20, 224, 224})
+
+      assert %Xav.Frame{format: :rgb24, width: 112, height: 112, data: data} =
+               Xav.VideoConverter.convert(converter, frame)
+
+      assert byte_size(data) == 112 * 112 * 3
+    end
+
+    test "convert_rois/3", %{frame: frame} do
+      rois = [{0, 0, 32, 32}, {100, 50, 64, 32}, {416, 296, 64, 64}]
+      converter = Xav.VideoConverter.new(out_format: :yuv420p)
+
+      frames = Xav.VideoConverter.convert_rois(converter, frame, rois)
+      assert Enum.map(frames, & &1.data) == Enum.map(rois, &crop_yuv420p(frame, &1))
+
+      # the regions are the same as separately cropped frames, also when scaled
+      converter = Xav.VideoConverter.new(out_format: :rgb24, out_width: 32, out_height: 32)
+
+      for {roi, roi_frame} <-
+            Enum.zip(rois, Xav.VideoConverter.convert_rois(converter, frame, rois)) do
+        crop_converter =
+          Xav.VideoConverter.new(out_format: :rgb24, out_width: 32, out_height: 32, crop: roi)
+
+        assert roi_frame == Xav.VideoConverter.convert(crop_converter, frame)
+      end
+    end
+
+    test "new_multi/2", %{frame: frame} do
+      converter =
+        Xav.VideoConverter.new_multi([
+          [out_width: 240],
+          [crop: {100, 50, 64, 32}],
+          [out_width: 120]
+        ])
+
+      assert [%{width: 240}, %{width: 64, height: 32, data: data}, %{width: 120}] =
+               Xav.VideoConverter.convert(converter, frame)
+
+      assert data == crop_yuv420p(frame, {100, 50, 64, 32})
+    end
+
+    test "raises on a region out of the frame", %{frame: frame} do
+      converter = Xav.VideoConverter.new(crop: {450, 0, 64, 32})
+      assert_raise ErlangError, fn -> Xav.VideoConverter.convert(converter, frame) end
+
+      converter = Xav.VideoConverter.new(out_format: :rgb24)
+
+      assert_raise ErlangError, fn ->
+        Xav.VideoConverter.convert_rois(converter, frame, [{0, 0, 32, 32}, {0, 350, 32, 32}])
+      end
+    end
+  end
+
+  defp frame_480p(_context), do: %{frame: yuv_frame(480, 360)}
+
+  # splits a packed yuv420p frame into planes with `pad` bytes of padding after each row
+  defp to_planes(%Xav.Frame{format: :yuv420p, width: width, height: height} = frame, pad) do
+    luma_size = width * height
+    chroma_size = div(luma_size, 4)
+
+    <<y::binary-size(luma_size), u::binary-size(chroma_size), v::binary-size(chroma_size)>> =
+      frame.data
+
+    chroma_width = div(width, 2)
+
+    planes = [
+      pad_rows(y, width, pad),
+      pad_rows(u, chroma_width, pad),
+      pad_rows(v, chroma_width, pad)
+    ]
+
+    %Xav.Frame{
+      frame
+      | data: planes,
+        linesizes: [width + pad, chroma_width + pad, chroma_width + pad]
+    }
+  end
+
+  defp mean_abs_diff(a, b) do
+    a
+    |> :binary.bin_to_list()
+    |> Enum.zip_reduce(:binary.bin_to_list(b), 0, fn x, y, acc -> acc + abs(x - y) end)
+    |> Kernel./(byte_size(a))
+  end
+
+  defp crop_yuv420p(%Xav.Frame{width: width, height: height, data: data}, {x, y, w, h}) do
+    luma_size = width * height
+    chroma_size = div(luma_size, 4)
+
+    <<y_plane::binary-size(luma_size), u::binary-size(chroma_size),
+      v::binary-size(chroma_size)>> = data
+
+    crop_plane = fn plane, plane_width, x, y, w, h ->
+      for row <- y..(y + h - 1), into: <<>>, do: binary_part(plane, row * plane_width + x, w)
+    end
+
+    chroma_width = div(width, 2)
+    {cx, cy, cw, ch} = {div(x, 2), div(y, 2), div(w, 2), div(h, 2)}
+
+    crop_plane.(y_plane, width, x, y, w, h) <>
+      crop_plane.(u, chroma_width, cx, cy, cw, ch) <>
+      crop_plane.(v, chroma_width, cx, cy, cw, ch)
   end
 end
@@ -20,4 +20,113 @@ defmodule XavTest do
       end
     end
   end
+
+  describe "set_thread_budget/1" do
+    setup do
+      on_exit(fn -> Xav.set_thread_budget(0) end)
+
+      # threads held by instances that are still alive, e.g. in other tests
+      %{baseline: Xav.thread_budget().in_use}
+    end
+
+    test "clamps threads to what is left in the budget", %{baseline: baseline} do
+      assert :ok = Xav.set_thread_budget(baseline + 4)
+      assert %{budget: budget} = Xav.thread_budget()
+      assert budget == baseline + 4
+
+      in_use =
+        in_process(fn ->
+          decoder = Xav.Decoder.new(:h264, thread_count: 3)
+          first = Xav.thread_budget().in_use
+
+          # only one thread is left, which isn't accounted
+          decoder2 = Xav.Decoder.new(:h264, thread_count: 3)
+          second = Xav.thread_budget().in_use
+
+          # auto is resolved before it is accounted, so it can't exceed the budget either
+          decoder3 = Xav.Decoder.new(:h264, thread_count: 0)
+          third = Xav.thread_budget().in_use
+
+          assert Enum.all?([decoder, decoder2, decoder3], &is_reference/1)
+          [first, second, third]
+        end)
+
+      assert in_use == [baseline + 3, baseline + 3, baseline + 3]
+      assert Enum.all?(in_use, &(&1 <= budget))
+      assert_in_use(baseline)
+    end
+
+    test "leaves auto to FFmpeg without a budget", %{baseline: baseline} do
+      assert :ok = Xav.set_thread_budget(0)
+
+      in_use =
+        in_process(fn ->
+          _decoder = Xav.Decoder.new(:h264, thread_count: 0)
+          Xav.thread_budget().in_use
+        end)
+
+      assert in_use == baseline
+    end
+
+    test "accounts encoder threads", %{baseline: baseline} do
+      assert :ok = Xav.set_thread_budget(baseline + 3)
+
+      opts = [width: 360, height: 240, format: :yuv420p, time_base: {1, 30}]
+
+      in_use =
+        in_process(fn ->
+          _encoder = Xav.Encoder.new(:h264, Keyword.put(opts, :options, threads: 2))
+          first = Xav.thread_budget().in_use
+
+          # clamped to the single thread that is left
+          _encoder = Xav.Encoder.new(:h264, Keyword.put(opts, :options, threads: 2))
+          [first, Xav.thread_budget().in_use]
+        end)
+
+      assert in_use == [baseline + 2, baseline + 2]
+      assert_in_use(baseline)
+    end
+
+    test "returns threads when instances are garbage collected", %{baseline: baseline} do
+      assert :ok = Xav.set_thread_budget(baseline + 2)
+
+      in_use =
+        in_process(fn ->
+          # the decoder isn't referenced anywhere, so it's freed by the next GC
+          Xav.Decoder.new(:h264, thread_count: 2)
+          before_gc = Xav.thread_budget().in_use
+
+          :erlang.garbage_collect()
+          [before_gc, Xav.thread_budget().in_use]
+        end)
+
+      assert in_use == [baseline + 2, baseline]
+    end
+  end
+
+  # Runs `fun` in a separate process, so that everything it creates
+  # is freed once the process exits.
+  defp in_process(fun) do
+    {pid, ref} = spawn_monitor(fn -> exit({:result, fun.()}) end)
+
+    receive do
+      {:DOWN, ^ref, :process, ^pid, {:result, result}} -> result
+      {:DOWN, ^ref, :process, ^pid, reason} -> flunk("process failed: #{inspect(reason)}")
+    end
+  end
+
+  # resources of an exited process might be freed after it's reported as down
+  defp assert_in_use(expected, retries \\ 50) do
+    case Xav.thread_budget().in_use do
+      ^expected ->
+        :ok
+
+      in_use when retries == 0 ->
+        flunk("expected #{expected} threads in use, got #{in_use}")
+
+      _in_use ->
+        Process.sleep(10)
+        assert_in_use(expected, retries - 1)
+    end
+  end
 end